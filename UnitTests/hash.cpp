@@ -41,6 +41,49 @@ namespace UnitTests
 		h.hash(data, sizeof(data) - sizeof(*data));
 		h.finalize();
 		Assert::AreEqual<stdex::crc32_t>(0xc6c3c95d, h);
+
+		// Large blocks take a different path than small ones.
+		uint8_t buf[1000];
+		for (size_t i = 0; i < _countof(buf); ++i)
+			buf[i] = static_cast<uint8_t>(i * 7);
+		stdex::crc32_hash h1;
+		h1.hash(buf, sizeof(buf));
+		h1.finalize();
+		stdex::crc32_hash h2;
+		for (size_t i = 0; i < _countof(buf); ++i)
+			h2.hash(buf + i, 1);
+		h2.finalize();
+		Assert::AreEqual<stdex::crc32_t>(h1, h2);
+
+		stdex::crc32_hash h3;
+		h3.hash(buf, 333);
+		h3.finalize();
+		stdex::crc32_hash h4;
+		h4.hash(buf + 333, sizeof(buf) - 333);
+		h4.finalize();
+		Assert::AreEqual<stdex::crc32_t>(h1, stdex::crc32_combine(h3, h4, sizeof(buf) - 333));
+	}
+
+	void hash::crc32c()
+	{
+		stdex::crc32c_hash h;
+		static const char data[] = "123456789";
+		h.hash(data, sizeof(data) - sizeof(*data));
+		h.finalize();
+		Assert::AreEqual<stdex::crc32c_t>(0xe3069283, h);
+
+		// Large blocks take a different path than small ones.
+		static uint8_t buf[30000];
+		for (size_t i = 0; i < _countof(buf); ++i)
+			buf[i] = static_cast<uint8_t>(i * 7);
+		stdex::crc32c_hash h1;
+		h1.hash(buf, sizeof(buf));
+		h1.finalize();
+		stdex::crc32c_hash h2;
+		for (size_t i = 0; i < _countof(buf); ++i)
+			h2.hash(buf + i, 1);
+		h2.finalize();
+		Assert::AreEqual<stdex::crc32c_t>(h1, h2);
 	}
 
 	void hash::md5()
@@ -10,6 +10,7 @@ int main(int, const char *[])
 {
 	try {
 		UnitTests::hash::crc32();
+		UnitTests::hash::crc32c();
 		UnitTests::hash::md5();
 		UnitTests::hash::sha1();
 		UnitTests::langid::from_rfc1766();
@@ -19,13 +20,31 @@ int main(int, const char *[])
 		UnitTests::parser::sgml_test();
 		UnitTests::parser::wtest();
 		UnitTests::pool::test();
+		UnitTests::ring::spsc();
 		UnitTests::ring::test();
 		UnitTests::sgml::sgml2str();
 		UnitTests::sgml::str2sgml();
+		UnitTests::stream::adaptive();
 		UnitTests::stream::async();
+		UnitTests::stream::async_file();
+		UnitTests::stream::borrow();
+		UnitTests::stream::cache();
+		UnitTests::stream::containers();
+		UnitTests::stream::copy();
+		UnitTests::stream::direct();
+		UnitTests::stream::fanout();
+		UnitTests::stream::fifo();
+		UnitTests::stream::hint();
 		UnitTests::stream::file_stat();
+		UnitTests::stream::instrument();
+		UnitTests::stream::mapped();
 		UnitTests::stream::open_close();
+		UnitTests::stream::positional();
+		UnitTests::stream::readln();
 		UnitTests::stream::replicator();
+		UnitTests::stream::uring();
+		UnitTests::stream::varint();
+		UnitTests::stream::vectored();
 		UnitTests::string::strncpy();
 		UnitTests::string::sprintf();
 		UnitTests::unicode::charset_encoder();
@@ -33,6 +52,10 @@ int main(int, const char *[])
 		UnitTests::unicode::str2wstr();
 		UnitTests::unicode::wstr2str();
 		UnitTests::watchdog::test();
+		UnitTests::zlib::block();
+		UnitTests::zlib::flush();
+		UnitTests::zlib::oneshot();
+		UnitTests::zlib::parallel();
 		UnitTests::zlib::test();
 		std::cout << "PASS\n";
 		return 0;
@@ -51,6 +51,7 @@ namespace UnitTests
 	{
 	public:
 		TEST_METHOD(crc32);
+		TEST_METHOD(crc32c);
 		TEST_METHOD(md5);
 		TEST_METHOD(sha1);
 	};
@@ -85,6 +86,7 @@ namespace UnitTests
 	TEST_CLASS(ring)
 	{
 	public:
+		TEST_METHOD(spsc);
 		TEST_METHOD(test);
 	};
 
@@ -98,10 +100,27 @@ namespace UnitTests
 	TEST_CLASS(stream)
 	{
 	public:
+		TEST_METHOD(adaptive);
 		TEST_METHOD(async);
+		TEST_METHOD(async_file);
+		TEST_METHOD(borrow);
+		TEST_METHOD(cache);
+		TEST_METHOD(containers);
+		TEST_METHOD(copy);
+		TEST_METHOD(direct);
+		TEST_METHOD(fanout);
+		TEST_METHOD(fifo);
+		TEST_METHOD(hint);
+		TEST_METHOD(instrument);
+		TEST_METHOD(mapped);
+		TEST_METHOD(positional);
+		TEST_METHOD(readln);
 		TEST_METHOD(replicator);
 		TEST_METHOD(open_close);
 		TEST_METHOD(file_stat);
+		TEST_METHOD(uring);
+		TEST_METHOD(varint);
+		TEST_METHOD(vectored);
 	};
 
 	TEST_CLASS(string)
@@ -129,6 +148,10 @@ namespace UnitTests
 	TEST_CLASS(zlib)
 	{
 	public:
+		TEST_METHOD(block);
+		TEST_METHOD(flush);
+		TEST_METHOD(oneshot);
+		TEST_METHOD(parallel);
 		TEST_METHOD(test);
 	};
 }
@@ -32,5 +32,13 @@ namespace UnitTests
 
 		for (auto& w : workers)
 			w.join();
+
+		pool_t small(1);
+		Assert::IsTrue(small.push(worker_t(new int(1)), 0));
+		worker_t el(new int(2));
+		Assert::IsFalse(small.push(std::move(el), 0));
+		Assert::IsTrue(el != nullptr);
+		Assert::AreEqual(1, *small.pop(0));
+		Assert::IsTrue(small.pop(0) == nullptr);
 	}
 }
@@ -25,6 +25,53 @@ static stdex::sstring temp_path()
 
 namespace UnitTests
 {
+	void stream::adaptive()
+	{
+		constexpr uint32_t total = 0x40000;
+		memory_file source;
+		{
+			stdex::stream::instrument source_stats(source);
+			buffer f(source_stats, 0x100, 0x100, 0x10000);
+			for (uint32_t i = 0; i < total; ++i)
+				f << i;
+			f.flush();
+			Assert::IsTrue(f.ok());
+			stats_t s = source_stats.stats();
+			Assert::AreEqual<uint64_t>(total * sizeof(uint32_t), s.write.bytes);
+			Assert::IsTrue(s.write.count < 32);
+		}
+		source.seekbeg(0);
+		{
+			stdex::stream::instrument source_stats(source);
+			buffer f(source_stats, 0x100, 0, 0x10000);
+			uint32_t x;
+			for (uint32_t i = 0; i < total; ++i) {
+				f >> x;
+				Assert::IsTrue(f.ok());
+				Assert::AreEqual(i, x);
+			}
+			f >> x;
+			Assert::IsFalse(f.ok());
+			stats_t s = source_stats.stats();
+			Assert::AreEqual<uint64_t>(total * sizeof(uint32_t), s.read.bytes);
+			Assert::IsTrue(s.read.count < 32);
+		}
+		source.seekbeg(0);
+		{
+			// Large reads bypass the drained buffer.
+			stdex::stream::instrument source_stats(source);
+			buffer f(source_stats, 0x100, 0, 0x10000);
+			uint32_t x;
+			f >> x;
+			std::vector<uint8_t> data(0x20000);
+			Assert::AreEqual(data.size(), f.read(data.data(), data.size()));
+			Assert::IsTrue(f.ok());
+			stats_t s = source_stats.stats();
+			Assert::AreEqual<uint64_t>(2, s.read.count);
+			Assert::AreEqual<uint64_t>(0x100 + data.size() - (0x100 - sizeof(x)), s.read.bytes);
+		}
+	}
+
 	void stream::async()
 	{
 		constexpr uint32_t total = 1000;
@@ -112,6 +159,961 @@ namespace UnitTests
 		std::filesystem::remove(filename3);
 	}
 
+	void stream::containers()
+	{
+		std::vector<uint32_t> v1;
+		std::vector<std::string> v2 = { "a", "bc", "" };
+		std::set<uint64_t> s1;
+		std::multiset<int16_t> s2;
+		std::map<uint32_t, double> m1;
+		std::multimap<std::string, uint8_t> m2 = { { "x", 1 }, { "x", 2 }, { "y", 3 } };
+		for (uint32_t i = 0; i < 100000; ++i) {
+			v1.push_back(i * 3);
+			s1.insert(static_cast<uint64_t>(i) << 20);
+			s2.insert(static_cast<int16_t>(i % 1000 - 500));
+			m1[i * 7] = i / 2.0;
+		}
+
+		memory_file mf;
+		basic_file& f = mf;
+		f << v1 << v2 << s1 << s2 << m1 << m2;
+		Assert::IsTrue(f.ok());
+		Assert::AreEqual<fsize_t>(
+			4 + v1.size() * 4 + 4 + 3 * 4 + 3 + 4 + s1.size() * 8 + 4 + s2.size() * 2 + 4 + m1.size() * 12 + 4 + 3 * (4 + 1 + 1),
+			f.size());
+
+		f.seekbeg(0);
+		std::vector<uint32_t> v1_in;
+		std::vector<std::string> v2_in;
+		std::set<uint64_t> s1_in;
+		std::multiset<int16_t> s2_in;
+		std::map<uint32_t, double> m1_in;
+		std::multimap<std::string, uint8_t> m2_in;
+		f >> v1_in >> v2_in >> s1_in >> s2_in >> m1_in >> m2_in;
+		Assert::IsTrue(f.ok());
+		Assert::IsTrue(v1 == v1_in);
+		Assert::IsTrue(v2 == v2_in);
+		Assert::IsTrue(s1 == s1_in);
+		Assert::IsTrue(s2 == s2_in);
+		Assert::IsTrue(m1 == m1_in);
+		Assert::IsTrue(m2 == m2_in);
+
+		// Truncated data
+		f.seekbeg(0);
+		f.truncate();
+		f << static_cast<uint32_t>(3) << static_cast<uint32_t>(1) << static_cast<uint32_t>(2);
+		f.seekbeg(0);
+		f >> v1_in;
+		Assert::IsFalse(f.ok());
+		Assert::AreEqual<size_t>(2, v1_in.size());
+		Assert::AreEqual<uint32_t>(2, v1_in[1]);
+		f.seekbeg(0);
+		f >> s1_in;
+		Assert::IsFalse(f.ok());
+		Assert::AreEqual<size_t>(1, s1_in.size());
+	}
+
+	void stream::fanout()
+	{
+		constexpr uint32_t total = 100000;
+
+		memory_file f1;
+
+		stdex::sstring filename2(temp_path());
+		filename2 += _T("stdex-stream-fanout.tmp");
+		file f2(
+			filename2.c_str(),
+			mode_for_reading | mode_for_writing | mode_create | mode_binary);
+
+		memory_file f3;
+
+		{
+			stdex::stream::replicator writer(0x100);
+			buffer f2_buf(f2, 0, 32);
+			writer.push_back(&f1);
+			writer.push_back(&f2_buf);
+			for (uint32_t i = 0; i < total; ++i) {
+				if (i == total / 2) {
+					writer.flush();
+					Assert::IsTrue(writer.ok());
+					Assert::AreEqual<stdex::stream::fsize_t>(i * sizeof(uint32_t), f1.size());
+					Assert::AreEqual<stdex::stream::fsize_t>(i * sizeof(uint32_t), f2.size());
+					writer.push_back(&f3);
+				}
+				writer << i;
+				Assert::IsTrue(writer.ok());
+			}
+			writer.remove(&f3);
+			Assert::AreEqual<stdex::stream::fsize_t>((total - total / 2) * sizeof(uint32_t), f3.size());
+		}
+
+		f1.seekbeg(0);
+		f2.seekbeg(0);
+		f3.seekbeg(0);
+		{
+			buffer f2_buf(f2, 64, 0);
+			uint32_t x;
+			for (uint32_t i = 0; i < total; ++i) {
+				f1 >> x;
+				Assert::IsTrue(f1.ok());
+				Assert::AreEqual(i, x);
+				f2_buf >> x;
+				Assert::IsTrue(f2_buf.ok());
+				Assert::AreEqual(i, x);
+				if (i >= total / 2) {
+					f3 >> x;
+					Assert::IsTrue(f3.ok());
+					Assert::AreEqual(i, x);
+				}
+			}
+			f1 >> x;
+			Assert::IsFalse(f1.ok());
+			f2_buf >> x;
+			Assert::IsFalse(f2_buf.ok());
+		}
+
+		f2.close();
+		std::filesystem::remove(filename2);
+
+		{
+			// Failure is reported once and the failed stream can be removed.
+			basic broken;
+			memory_file f4;
+			stdex::stream::replicator writer(0x100);
+			writer.push_back(&f4);
+			writer.push_back(&broken);
+			writer << static_cast<uint32_t>(1);
+			writer.flush();
+			Assert::IsFalse(writer.ok());
+			auto failed = writer.failed();
+			Assert::AreEqual<size_t>(1, failed.size());
+			Assert::IsTrue(failed[0] == &broken);
+			writer.flush();
+			Assert::IsTrue(writer.ok());
+			writer.remove(&broken);
+			writer << static_cast<uint32_t>(2);
+			writer.flush();
+			Assert::IsTrue(writer.ok());
+			Assert::AreEqual<stdex::stream::fsize_t>(2 * sizeof(uint32_t), f4.size());
+		}
+	}
+
+	void stream::fifo()
+	{
+		constexpr uint32_t total = 10000;
+
+		stdex::stream::fifo f1(0x40), f2(0x40);
+		for (uint32_t i = 0; i < total; ++i) {
+			f1 << i;
+			Assert::IsTrue(f1.ok());
+			if (i % 3 == 0) {
+				uint32_t x;
+				f1 >> x;
+				Assert::IsTrue(f1.ok());
+				Assert::AreEqual(i / 3, x);
+			}
+		}
+		uint32_t remaining = total - (total + 2) / 3;
+		Assert::AreEqual(remaining * sizeof(uint32_t), f1.size());
+
+		for (uint32_t i = total; i < 2 * total; ++i)
+			f2 << i;
+		f1.splice(f2);
+		Assert::AreEqual<size_t>(0, f2.size());
+		Assert::AreEqual((remaining + total) * sizeof(uint32_t), f1.size());
+
+		// Read a few records using the borrow API.
+		for (uint32_t i = (total + 2) / 3; i < (total + 2) / 3 + 100; ++i) {
+			uint32_t x;
+			size_t num_read = 0;
+			while (num_read < sizeof(x)) {
+				auto [data, length] = f1.acquire_read(sizeof(x) - num_read);
+				Assert::IsTrue(f1.ok());
+				memcpy(reinterpret_cast<uint8_t*>(&x) + num_read, data, length);
+				f1.release_read(length);
+				num_read += length;
+			}
+			Assert::AreEqual(i, x);
+		}
+
+		memory_file f3;
+		Assert::AreEqual((remaining + total - 100) * sizeof(uint32_t), f1.write_to(f3));
+		Assert::IsTrue(f1.ok());
+		Assert::AreEqual<size_t>(0, f1.size());
+		f3.seekbeg(0);
+		for (uint32_t i = (total + 2) / 3 + 100; i < 2 * total; ++i) {
+			uint32_t x;
+			f3 >> x;
+			Assert::IsTrue(f3.ok());
+			Assert::AreEqual(i, x);
+		}
+
+		uint32_t x;
+		f1 >> x;
+		Assert::IsFalse(f1.ok());
+		x = 1234;
+		Assert::AreEqual(sizeof(x), f1.write(&x, sizeof(x)));
+		f1 >> x;
+		Assert::IsTrue(f1.ok());
+		Assert::AreEqual<uint32_t>(1234, x);
+	}
+
+	void stream::cache()
+	{
+		stdex::sstring filename(temp_path());
+		filename += _T("stdex-stream-cache.tmp");
+		memory_file f1;
+		{
+			cached_file f2(
+				filename.c_str(),
+				mode_for_reading | mode_for_writing | mode_create | mode_binary,
+				128, 4);
+			basic_file* files[] = { &f1, &f2 };
+			diag_file f(files, _countof(files));
+			uint8_t data[300];
+			uint32_t seed = 1;
+			auto rnd = [&](uint32_t n) { seed = seed * 1103515245 + 12345; return (seed >> 8) % n; };
+			for (uint32_t i = 0; i < 10000; ++i) {
+				// Alternate between the head and the tail of the file.
+				stdex::stream::fsize_t size = f.size();
+				if (i & 1)
+					f.seekbeg(rnd(static_cast<uint32_t>(std::min<stdex::stream::fsize_t>(size, 500)) + 1));
+				else
+					f.seekend(-static_cast<stdex::stream::foff_t>(rnd(static_cast<uint32_t>(std::min<stdex::stream::fsize_t>(size, 500)) + 1)));
+				size_t length = rnd(_countof(data)) + 1;
+				switch (rnd(10)) {
+				case 0: f.truncate(); break;
+				case 1: f.flush(); break;
+				case 2: case 3: case 4: f.read(data, length); break;
+				default:
+					for (size_t j = 0; j < length; ++j)
+						data[j] = static_cast<uint8_t>(rnd(0x100));
+					f.write(data, length);
+				}
+			}
+		}
+		{
+			memory_file f2(filename.c_str(), mode_for_reading | mode_open_existing | mode_binary);
+			Assert::AreEqual(f1.size(), f2.size());
+			Assert::AreEqual(0, memcmp(f1.data(), f2.data(), static_cast<size_t>(f1.size())));
+		}
+		std::filesystem::remove(filename);
+	}
+
+	void stream::hint()
+	{
+		constexpr uint32_t total = 0x10000;
+		access_t patterns[] = { access_t::sequential, access_t::will_need, access_t::dont_need, access_t::random, access_t::normal };
+		stdex::sstring filename(temp_path());
+		filename += _T("stdex-stream-hint.tmp");
+		{
+			memory_file f;
+			for (uint32_t i = 0; i < total; ++i)
+				f << i;
+			for (auto access : patterns)
+				f.hint(0x1000, fsize_max, access);
+			f.seekbeg(0);
+			uint32_t x;
+			for (uint32_t i = 0; i < total; ++i) {
+				f >> x;
+				Assert::AreEqual(i, x);
+			}
+		}
+		{
+			mapped_file f(filename.c_str(), mode_for_reading | mode_for_writing | mode_create | mode_binary);
+			for (uint32_t i = 0; i < total; ++i)
+				f << i;
+			for (auto access : patterns)
+				f.hint(0, fsize_max, access);
+			f.seekbeg(0);
+			uint32_t x;
+			for (uint32_t i = 0; i < total; ++i) {
+				f >> x;
+				Assert::AreEqual(i, x);
+			}
+		}
+		{
+			cached_file f(filename.c_str(), mode_for_reading | mode_for_writing | mode_open_existing | mode_binary, 0x1000, 4);
+			f.hint(0, fsize_max, access_t::sequential);
+			uint32_t x;
+			for (uint32_t i = 0; i < total; ++i) {
+				f >> x;
+				Assert::AreEqual(i, x);
+			}
+			f.seekbeg(0x2000);
+			f << static_cast<uint32_t>(0xdeadbeef);
+			for (auto access : patterns)
+				f.hint(0, fsize_max, access);
+			positional_window w(f, 0x1000);
+			for (auto access : patterns)
+				w.hint(0x100, 0x2000, access);
+			f.seekbeg(0x1ffc);
+			f >> x;
+			Assert::AreEqual<uint32_t>(0x7ff, x);
+			f >> x;
+			Assert::AreEqual<uint32_t>(0xdeadbeef, x);
+		}
+		{
+			file f(filename.c_str(), mode_for_reading | mode_open_existing | mode_binary);
+			for (auto access : patterns)
+				f.hint(0, fsize_max, access);
+			uint32_t x;
+			for (uint32_t i = 0; i < total; ++i) {
+				f >> x;
+				Assert::AreEqual(i == 0x800 ? 0xdeadbeef : i, x);
+			}
+		}
+		std::filesystem::remove(filename);
+	}
+
+	void stream::instrument()
+	{
+		memory_file source;
+		instrument_file f(source);
+		{
+			stdex::stream::instrument f_buf_stats(f);
+			buffer f_buf(f_buf_stats, 0, 0x100);
+			stdex::stream::instrument f_stats(f_buf);
+			for (uint32_t i = 0; i < 1000; ++i)
+				f_stats << i;
+			f_stats.flush();
+			Assert::IsTrue(f_stats.ok());
+			stats_t s = f_stats.stats();
+			Assert::AreEqual<uint64_t>(1000, s.write.count);
+			Assert::AreEqual<uint64_t>(4000, s.write.bytes);
+			Assert::AreEqual<uint64_t>(1, s.flush.count);
+			uint64_t total = 0;
+			for (auto n : s.write.latency)
+				total += n;
+			Assert::AreEqual<uint64_t>(s.write.count, total);
+			s = f_buf_stats.stats();
+			Assert::AreEqual<uint64_t>(4000 / 0x100 + 1, s.write.count);
+			Assert::AreEqual<uint64_t>(4000, s.write.bytes);
+		}
+		f.seekbeg(0);
+		uint8_t data[0x400];
+		Assert::AreEqual(sizeof(data), f.read(data, sizeof(data)));
+		stats_t s = f.stats();
+		Assert::AreEqual<uint64_t>(4000 / 0x100 + 1, s.write.count);
+		Assert::AreEqual<uint64_t>(4000, s.write.bytes);
+		Assert::AreEqual<uint64_t>(1, s.read.count);
+		Assert::AreEqual<uint64_t>(sizeof(data), s.read.bytes);
+		Assert::AreEqual<uint64_t>(1, s.seek.count);
+		f.reset_stats();
+		s = f.stats();
+		Assert::AreEqual<uint64_t>(0, s.write.count + s.read.count + s.seek.count + s.flush.count);
+
+		// Borrowing is passed through to the source.
+		Assert::IsTrue(f.can_borrow_ahead());
+		const uint8_t* ptr; size_t num_read;
+		std::tie(ptr, num_read) = f.acquire_read(0x100);
+		Assert::IsTrue(ptr == reinterpret_cast<const uint8_t*>(source.data()) + sizeof(data));
+		Assert::AreEqual<size_t>(0x100, num_read);
+		f.release_read(0x80);
+		Assert::AreEqual<stdex::stream::fpos_t>(sizeof(data) + 0x80, f.tell());
+		s = f.stats();
+		Assert::AreEqual<uint64_t>(1, s.read.count);
+		Assert::AreEqual<uint64_t>(0x80, s.read.bytes);
+
+		// Failed release on the source is reported by the wrapper.
+		stdex::stream::converter c(source);
+		stdex::stream::instrument c_stats(c);
+		std::tie(ptr, num_read) = c_stats.acquire_read(0x10);
+		Assert::AreEqual<size_t>(0x10, num_read);
+		c_stats.release_read(0x8);
+		Assert::IsTrue(c_stats.state() == state_t::fail);
+	}
+
+	void stream::mapped()
+	{
+		constexpr uint32_t total = 10000;
+		stdex::sstring filename(temp_path());
+		filename += _T("stdex-stream-mapped.tmp");
+		{
+			mapped_file f(filename.c_str(), mode_for_reading | mode_for_writing | mode_create | mode_binary);
+			Assert::IsTrue(f.ok());
+			for (uint32_t i = 0; i < total; ++i) {
+				f << i;
+				Assert::IsTrue(f.ok());
+			}
+			Assert::AreEqual<stdex::stream::fsize_t>(total * sizeof(uint32_t), f.size());
+			f.seekbeg(sizeof(uint32_t));
+			f << static_cast<uint32_t>(0x12345678);
+			f.seekend(-static_cast<stdex::stream::foff_t>(sizeof(uint32_t)));
+			f.truncate();
+			Assert::AreEqual<stdex::stream::fsize_t>((total - 1) * sizeof(uint32_t), f.size());
+		}
+		{
+			file f(filename.c_str(), mode_for_reading | mode_open_existing | mode_binary);
+			Assert::AreEqual<stdex::stream::fsize_t>((total - 1) * sizeof(uint32_t), f.size());
+		}
+		{
+			mapped_file f(filename.c_str(), mode_for_reading | mode_open_existing | mode_binary);
+			Assert::IsTrue(f.ok());
+			uint32_t x;
+			for (uint32_t i = 0; i < total - 1; ++i) {
+				f >> x;
+				Assert::IsTrue(f.ok());
+				Assert::AreEqual(i == 1 ? 0x12345678 : i, x);
+			}
+			f >> x;
+			Assert::IsFalse(f.ok());
+			f.seekbeg(0);
+			f.write(&x, sizeof(x));
+			Assert::IsFalse(f.ok());
+		}
+		{
+			mapped_file f(filename.c_str(), mode_for_reading | mode_for_writing | mode_open_existing | mode_append | mode_binary);
+			Assert::IsTrue(f.ok());
+			f.seekbeg(0);
+			f << total - 1;
+			Assert::IsTrue(f.ok());
+			Assert::AreEqual<stdex::stream::fsize_t>(total * sizeof(uint32_t), f.size());
+			uint32_t x;
+			f.seekbeg(0);
+			f >> x;
+			Assert::AreEqual<uint32_t>(0, x);
+			f.seekend(-static_cast<stdex::stream::foff_t>(sizeof(uint32_t)));
+			f >> x;
+			Assert::AreEqual(total - 1, x);
+		}
+		std::filesystem::remove(filename);
+	}
+
+	static void borrow_copy(_Inout_ basic& source, _Inout_ basic& dest, _In_ size_t block_size)
+	{
+		for (;;) {
+			const uint8_t* src; size_t num_read;
+			std::tie(src, num_read) = source.acquire_read(block_size);
+			if (!num_read) {
+				Assert::IsTrue(source.state() == state_t::eof);
+				break;
+			}
+			// Consume at most half of the data borrowed to test partial release.
+			num_read = num_read / 2 + 1;
+			uint8_t* dst; size_t num_write;
+			std::tie(dst, num_write) = dest.acquire_write(num_read);
+			Assert::IsTrue(dest.ok());
+			Assert::IsTrue(num_write > 0 && num_write <= num_read);
+			memcpy(dst, src, num_write);
+			dest.release_write(num_write);
+			source.release_read(num_write);
+		}
+	}
+
+	void stream::async_file()
+	{
+		constexpr uint32_t total = 0x10000;
+		stdex::sstring filename(temp_path());
+		filename += _T("stdex-stream-async_file.tmp");
+		{
+			file f(filename.c_str(), mode_for_reading | mode_for_writing | mode_create | mode_binary);
+			for (uint32_t i = 0; i < total; ++i)
+				f << i;
+			f.seekbeg(0);
+			Assert::IsTrue(f.ok());
+
+			{
+				async_file_reader<0x1000> r(f);
+				uint32_t x;
+				for (uint32_t i = 0; i < total; i += 3) {
+					// Read a record and skip over the following ones, both within and past the data read ahead.
+					Assert::AreEqual<stdex::stream::fpos_t>(i * sizeof(uint32_t), r.tell());
+					r >> x;
+					Assert::IsTrue(r.ok());
+					Assert::AreEqual(i, x);
+					r.skip(i % 0x100 ? 2 * sizeof(uint32_t) : 0x2000 + 2 * sizeof(uint32_t));
+					if (i % 0x100 == 0)
+						i += 0x2000 / sizeof(uint32_t);
+				}
+				r >> x;
+				Assert::IsFalse(r.ok());
+
+				r.seekbeg(100 * sizeof(uint32_t));
+				r >> x;
+				Assert::AreEqual<uint32_t>(100, x);
+				r.seekcur(-static_cast<foff_t>(50 * sizeof(uint32_t)));
+				r >> x;
+				Assert::AreEqual<uint32_t>(51, x);
+				r.seekend(-static_cast<foff_t>(sizeof(uint32_t)));
+				r >> x;
+				Assert::AreEqual(total - 1, x);
+				r >> x;
+				Assert::IsTrue(r.state() == state_t::eof);
+				r.seekbeg(10 * sizeof(uint32_t));
+			}
+			Assert::AreEqual<stdex::stream::fpos_t>(10 * sizeof(uint32_t), f.tell());
+
+			{
+				async_file_reader<> r(f);
+				std::vector<uint32_t> data;
+				data.resize(total - 10);
+				Assert::AreEqual(data.size() * sizeof(uint32_t), r.read(data.data(), data.size() * sizeof(uint32_t)));
+				for (uint32_t i = 10; i < total; ++i)
+					Assert::AreEqual(i, data[i - 10]);
+			}
+		}
+		std::filesystem::remove(filename);
+	}
+
+	void stream::borrow()
+	{
+		constexpr size_t total = 10000;
+		memory_file source;
+		for (size_t i = 0; i < total; ++i)
+			source << static_cast<uint8_t>(i * 7 + (i >> 8));
+		{
+			memory_file dest;
+			source.seekbeg(0);
+			borrow_copy(source, dest, 100);
+			Assert::AreEqual<stdex::stream::fsize_t>(total, dest.size());
+			Assert::AreEqual(0, memcmp(source.data(), dest.data(), total));
+		}
+		{
+			memory_file dest;
+			{
+				stdex::stream::buffer dest_buf(dest, 0, 64);
+				source.seekbeg(0);
+				stdex::stream::buffer source_buf(source, 50, 0);
+				borrow_copy(source_buf, dest_buf, 100);
+			}
+			Assert::AreEqual<stdex::stream::fsize_t>(total, dest.size());
+			Assert::AreEqual(0, memcmp(source.data(), dest.data(), total));
+		}
+		{
+			memory_file dest;
+			{
+				stdex::stream::cache dest_cache(dest, 64, 2);
+				source.seekbeg(0);
+				stdex::stream::cache source_cache(source, 128, 3);
+				borrow_copy(source_cache, dest_cache, 300);
+			}
+			Assert::AreEqual<stdex::stream::fsize_t>(total, dest.size());
+			Assert::AreEqual(0, memcmp(source.data(), dest.data(), total));
+		}
+		{
+			// Default implementation on a seekable stream returns unconsumed data on release.
+			stdex::sstring filename(temp_path());
+			filename += _T("stdex-stream-borrow.tmp");
+			{
+				file dest(filename.c_str(), mode_for_reading | mode_for_writing | mode_create | mode_binary);
+				source.seekbeg(0);
+				borrow_copy(source, dest, 100);
+				dest.seekbeg(0);
+				memory_file dest2;
+				borrow_copy(dest, dest2, 100);
+				Assert::AreEqual<stdex::stream::fsize_t>(total, dest2.size());
+				Assert::AreEqual(0, memcmp(source.data(), dest2.data(), total));
+			}
+			std::filesystem::remove(filename);
+		}
+		{
+			// Default implementation on a non-seekable stream cannot put unconsumed data back.
+			source.seekbeg(0);
+			stdex::stream::converter c(source);
+			Assert::IsFalse(c.can_borrow_ahead());
+			const uint8_t* data; size_t length;
+			std::tie(data, length) = c.acquire_read(10);
+			Assert::AreEqual<size_t>(10, length);
+			c.release_read(10);
+			Assert::IsTrue(c.ok());
+			uint8_t x;
+			c >> x;
+			Assert::AreEqual(reinterpret_cast<const uint8_t*>(source.data())[10], x);
+			std::tie(data, length) = c.acquire_read(10);
+			c.release_read(5);
+			Assert::IsTrue(c.state() == state_t::fail);
+		}
+	}
+
+	void stream::uring()
+	{
+		constexpr uint32_t total = 100000;
+		stdex::sstring filename(temp_path());
+		filename += _T("stdex-stream-uring.tmp");
+		for (bool allow_uring : { true, false }) {
+			{
+				file f(filename.c_str(), mode_for_writing | mode_create | mode_binary);
+				f << static_cast<uint32_t>(0xffffffff);
+				{
+					uring_file w(f, 0x1000, 4, allow_uring);
+					if (!allow_uring)
+						Assert::IsFalse(w.uring());
+					for (uint32_t i = 0; i < total; ++i) {
+						w << i;
+						Assert::IsTrue(w.ok());
+					}
+				}
+				Assert::AreEqual<stdex::stream::fpos_t>((total + 1) * sizeof(uint32_t), f.tell());
+			}
+			{
+				file f(filename.c_str(), mode_for_reading | mode_open_existing | mode_binary);
+				Assert::AreEqual<stdex::stream::fsize_t>((total + 1) * sizeof(uint32_t), f.size());
+				f.skip(sizeof(uint32_t));
+				uring_file r(f, 0x1000, 4, allow_uring);
+				if (!allow_uring)
+					Assert::IsFalse(r.uring());
+				uint32_t x;
+				for (uint32_t i = 0; i < total; ++i) {
+					r >> x;
+					Assert::IsTrue(r.ok());
+					Assert::AreEqual(i, x);
+				}
+				r >> x;
+				Assert::IsFalse(r.ok());
+			}
+			std::filesystem::remove(filename);
+		}
+	}
+
+	void stream::vectored()
+	{
+		uint8_t data[0x1000];
+		for (size_t i = 0; i < _countof(data); ++i)
+			data[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+		segment_t out[] = {
+			{ data, 10 },
+			{ data + 10, 0 },
+			{ data + 10, 0xf00 },
+			{ data + 0xf0a, 0xf6 },
+		};
+		stdex::sstring filename(temp_path());
+		filename += _T("stdex-stream-vectored.tmp");
+		{
+			file f(filename.c_str(), mode_for_reading | mode_for_writing | mode_create | mode_binary);
+			Assert::AreEqual(sizeof(data), f.writev(out, _countof(out)));
+			Assert::IsTrue(f.ok());
+			{
+				// Write larger than buffer must flush the buffer and the data in order.
+				stdex::stream::buffer b(f, 0, 0x100);
+				b.write(data, 0x80);
+				b.write(data + 0x80, 0xf80);
+				Assert::IsTrue(b.ok());
+			}
+			Assert::AreEqual<stdex::stream::fsize_t>(2 * sizeof(data), f.size());
+			f.seekbeg(0);
+			uint8_t a[0x800], b[0x1000], c[0x900];
+			segment_t in[] = {
+				{ a, sizeof(a) },
+				{ b, sizeof(b) },
+				{ c, sizeof(c) },
+			};
+			Assert::AreEqual(2 * sizeof(data), f.readv(in, _countof(in)));
+			Assert::IsTrue(f.ok());
+			Assert::AreEqual(0, memcmp(a, data, sizeof(a)));
+			Assert::AreEqual(0, memcmp(b, data + sizeof(a), sizeof(data) - sizeof(a)));
+			Assert::AreEqual(0, memcmp(b + sizeof(data) - sizeof(a), data, sizeof(a)));
+			Assert::AreEqual(0, memcmp(c, data + sizeof(a), sizeof(data) - sizeof(a)));
+			Assert::AreEqual<size_t>(0, f.readv(in, _countof(in)));
+			Assert::IsTrue(f.state() == state_t::eof);
+		}
+		{
+			memory_file f;
+			Assert::AreEqual(sizeof(data), f.writev(out, _countof(out)));
+			Assert::AreEqual(0, memcmp(f.data(), data, sizeof(data)));
+		}
+		std::filesystem::remove(filename);
+	}
+
+	void stream::positional()
+	{
+		constexpr size_t thread_count = 8;
+		constexpr uint32_t total = 10000;
+		stdex::sstring filename(temp_path());
+		filename += _T("stdex-stream-positional.tmp");
+		{
+			file f(filename.c_str(), mode_for_reading | mode_for_writing | mode_create | mode_binary);
+			memory_file m;
+			basic_file* files[] = { &f, &m };
+			for (auto source : files) {
+				source->write_byte(0xff, thread_count * total * sizeof(uint32_t));
+				source->seekbeg(0);
+				std::list<std::thread> workers;
+				for (size_t i = 0; i < thread_count; ++i) {
+					workers.push_back(std::thread([](_Inout_ basic_file& source, _In_ size_t i) {
+						positional_window w(source, i * total * sizeof(uint32_t), total * sizeof(uint32_t));
+						for (uint32_t j = 0; j < total; ++j)
+							w << static_cast<uint32_t>(i * total + j);
+						Assert::IsTrue(w.ok());
+						w << static_cast<uint32_t>(0);
+						Assert::IsFalse(w.ok());
+					}, std::ref(*source), i));
+				}
+				for (auto& w : workers)
+					w.join();
+				workers.clear();
+				Assert::AreEqual<stdex::stream::fpos_t>(0, source->tell());
+				for (size_t i = 0; i < thread_count; ++i) {
+					workers.push_back(std::thread([](_Inout_ basic_file& source, _In_ size_t i) {
+						positional_window w(source, (thread_count - i - 1) * total * sizeof(uint32_t));
+						Assert::AreEqual<stdex::stream::fsize_t>((i + 1) * total * sizeof(uint32_t), w.size());
+						uint32_t x;
+						for (uint32_t j = 0; j < total; ++j) {
+							w >> x;
+							Assert::IsTrue(w.ok());
+							Assert::AreEqual(static_cast<uint32_t>((thread_count - i - 1) * total + j), x);
+						}
+					}, std::ref(*source), i));
+				}
+				for (auto& w : workers)
+					w.join();
+				uint32_t x;
+				Assert::AreEqual(sizeof(x), source->read_at(sizeof(x), &x, sizeof(x)));
+				Assert::AreEqual<uint32_t>(1, x);
+				Assert::AreEqual<size_t>(0, source->read_at(thread_count * total * sizeof(uint32_t), &x, sizeof(x)));
+			}
+		}
+		std::filesystem::remove(filename);
+	}
+
+	void stream::copy()
+	{
+		constexpr uint32_t total = 100000;
+		stdex::sstring filename1(temp_path()), filename2(temp_path());
+		filename1 += _T("stdex-stream-copy1.tmp");
+		filename2 += _T("stdex-stream-copy2.tmp");
+		{
+			file f1(filename1.c_str(), mode_for_reading | mode_for_writing | mode_create | mode_binary);
+			for (uint32_t i = 0; i < total; ++i)
+				f1 << i;
+			Assert::IsTrue(f1.ok());
+
+			file f2(filename2.c_str(), mode_for_reading | mode_for_writing | mode_create | mode_binary);
+			memory_file f3;
+			basic_file* targets[] = { &f2, &f3 };
+			for (auto target : targets) {
+				f1.seekbeg(10 * sizeof(uint32_t));
+				Assert::AreEqual<fsize_t>(100 * sizeof(uint32_t), target->write_stream(f1, 100 * sizeof(uint32_t)));
+				Assert::IsTrue(target->ok());
+				Assert::IsTrue(f1.ok());
+				Assert::AreEqual<stdex::stream::fpos_t>(110 * sizeof(uint32_t), f1.tell());
+				Assert::AreEqual<fsize_t>((total - 110) * sizeof(uint32_t), target->write_stream(f1));
+				Assert::IsTrue(target->ok());
+				Assert::IsFalse(f1.ok());
+				Assert::AreEqual<fsize_t>((total - 10) * sizeof(uint32_t), target->size());
+
+				target->seekbeg(0);
+				uint32_t x;
+				for (uint32_t i = 10; i < total; ++i) {
+					*target >> x;
+					Assert::IsTrue(target->ok());
+					Assert::AreEqual(i, x);
+				}
+				*target >> x;
+				Assert::IsFalse(target->ok());
+			}
+		}
+		std::filesystem::remove(filename1);
+		std::filesystem::remove(filename2);
+	}
+
+	void stream::direct()
+	{
+		constexpr uint32_t total = 10000;
+		constexpr size_t block_size = 0x2000, alignment = 0x1000;
+		alignas(alignment) static uint32_t block[2 * block_size / sizeof(uint32_t)];
+		stdex::sstring filename(temp_path());
+		filename += _T("stdex-stream-direct.tmp");
+		{
+			direct_file f(filename.c_str(), mode_for_writing | mode_create | mode_binary, block_size, alignment);
+			Assert::IsTrue(f.ok());
+			for (uint32_t i = 0; i < total; ++i)
+				f << i;
+			Assert::IsTrue(f.ok());
+			Assert::AreEqual<fsize_t>(total * sizeof(uint32_t), f.size());
+
+			// Overwrite unaligned, then aligned whole blocks bypassing the buffer.
+			f.seekbeg(1001 * sizeof(uint32_t));
+			f << static_cast<uint32_t>(0xdeadbeef);
+			f.seekbeg(2 * block_size);
+			for (size_t i = 0; i < _countof(block); ++i)
+				block[i] = static_cast<uint32_t>(2 * block_size / sizeof(uint32_t) + i);
+			Assert::AreEqual(sizeof(block), f.write(block, sizeof(block)));
+			f.seekbeg(2 * block_size + 3 * sizeof(uint32_t));
+			f << static_cast<uint32_t>(0xcafebabe);
+			Assert::IsTrue(f.ok());
+		}
+		{
+			file f(filename.c_str(), mode_for_reading | mode_open_existing | mode_binary);
+			Assert::AreEqual<fsize_t>(total * sizeof(uint32_t), f.size());
+			uint32_t x;
+			for (uint32_t i = 0; i < total; ++i) {
+				f >> x;
+				Assert::IsTrue(f.ok());
+				Assert::AreEqual(i == 1001 ? 0xdeadbeef : i == 2 * block_size / sizeof(uint32_t) + 3 ? 0xcafebabe : i, x);
+			}
+		}
+		{
+			direct_file f(filename.c_str(), mode_for_reading | mode_for_writing | mode_open_existing | mode_binary, block_size, alignment);
+			Assert::AreEqual<fsize_t>(total * sizeof(uint32_t), f.size());
+			uint32_t x[3];
+			f.seekbeg(block_size - sizeof(uint32_t));
+			Assert::AreEqual(sizeof(x), f.read(x, sizeof(x)));
+			Assert::AreEqual<uint32_t>(block_size / sizeof(uint32_t) - 1, x[0]);
+			Assert::AreEqual<uint32_t>(block_size / sizeof(uint32_t) + 1, x[2]);
+			f.seekbeg(0);
+			Assert::AreEqual(sizeof(block), f.read(block, sizeof(block)));
+			Assert::AreEqual<uint32_t>(1000, block[1000]);
+			Assert::AreEqual<uint32_t>(0xdeadbeef, block[1001]);
+			f.seekend(-static_cast<foff_t>(sizeof(uint32_t)));
+			Assert::AreEqual(sizeof(uint32_t), f.read(x, sizeof(x)));
+			Assert::AreEqual<uint32_t>(total - 1, x[0]);
+			Assert::AreEqual<size_t>(0, f.read(x, sizeof(x)));
+			Assert::IsFalse(f.ok());
+
+			f.seekbeg(5000 * sizeof(uint32_t) + 1);
+			f.truncate();
+			Assert::IsTrue(f.ok());
+			f.write("\x01\x02\x03", 3);
+			Assert::AreEqual<fsize_t>(5000 * sizeof(uint32_t) + 4, f.size());
+		}
+		{
+			file f(filename.c_str(), mode_for_reading | mode_open_existing | mode_binary);
+			Assert::AreEqual<fsize_t>(5000 * sizeof(uint32_t) + 4, f.size());
+			uint32_t x;
+			f.seekbeg(4999 * sizeof(uint32_t));
+			f >> x;
+			Assert::AreEqual<uint32_t>(4999, x);
+			f >> x;
+			Assert::AreEqual(static_cast<uint32_t>(5000 & 0xff) | 0x03020100u, x);
+		}
+		Assert::ExpectException<std::invalid_argument>([&] { direct_file f(filename.c_str(), mode_for_reading | mode_open_existing | mode_binary, 0x1800, alignment); });
+		std::filesystem::remove(filename);
+	}
+
+	void stream::readln()
+	{
+		std::vector<std::string> lines = { "first", "", "carriage\rreturn", "crlf", "", std::string(0x3000, 'x'), "last\r" };
+		std::string text;
+		for (size_t i = 0; i < lines.size(); ++i) {
+			text += lines[i];
+			if (i + 1 < lines.size())
+				text += i % 2 ? "\r\n" : "\n";
+		}
+
+		memory_file source;
+		source.write(text.data(), text.size());
+		stdex::sstring filename(temp_path());
+		filename += _T("stdex-stream-readln.tmp");
+		file f(filename.c_str(), mode_for_reading | mode_for_writing | mode_create | mode_binary);
+		f.write(text.data(), text.size());
+		{
+			buffer source_buf(source, 0x100, 0);
+			basic* sources[] = { &source, &source_buf, &f };
+			for (auto s : sources) {
+				source.seekbeg(0);
+				f.seekbeg(0);
+				std::string line;
+				for (auto& l : lines) {
+					s->readln(line);
+					Assert::AreEqual(l, line);
+				}
+				Assert::IsFalse(s->ok());
+				s->readln(line);
+				Assert::IsTrue(line.empty());
+				Assert::IsFalse(s->ok());
+
+				source.seekbeg(0);
+				f.seekbeg(0);
+				size_t i = 0;
+				for (auto l : line_reader(*s)) {
+					Assert::IsTrue(i < lines.size());
+					Assert::AreEqual(lines[i++], std::string(l));
+				}
+				Assert::AreEqual(lines.size(), i);
+			}
+		}
+		f.close();
+		std::filesystem::remove(filename);
+	}
+
+	void stream::varint()
+	{
+		memory_file mf;
+		basic_file& f = mf;
+		f.write_varint<uint32_t>(0).write_varint<uint32_t>(127).write_varint<uint32_t>(128);
+		Assert::AreEqual<fsize_t>(4, f.size());
+		f.write_varint<int8_t>(-1).write_varint<int16_t>(-64).write_varint<int16_t>(64);
+		Assert::AreEqual<fsize_t>(8, f.size());
+		f.write_varint(UINT64_MAX).write_varint(INT64_MIN).write_varint(INT64_MAX);
+		Assert::AreEqual<fsize_t>(38, f.size());
+		f.write_vstr("Hello").write_vstr(std::wstring(L"World"));
+		std::vector<uint16_t> v = { 1, 2, 300, 65535 };
+		std::set<int64_t> s = { -1000000, -1, 0, 1, 1000000 };
+		std::list<std::string> l = { "a", "bc" };
+		f.write_vcollection(v).write_vcollection(s).write_vcollection(l);
+		Assert::IsTrue(f.ok());
+
+		stdex::sstring filename(temp_path());
+		filename += _T("stdex-stream-varint.tmp");
+		{
+			file ff(filename.c_str(), mode_for_reading | mode_for_writing | mode_create | mode_binary);
+			f.seekbeg(0);
+			ff.write_stream(f);
+			basic_file* sources[] = { &f, &ff };
+			for (auto source : sources) {
+				source->seekbeg(0);
+				uint32_t a, b, c; int8_t d; int16_t e, g; uint64_t h; int64_t i, j;
+				source->read_varint(a).read_varint(b).read_varint(c).read_varint(d).read_varint(e).read_varint(g);
+				source->read_varint(h).read_varint(i).read_varint(j);
+				Assert::IsTrue(source->ok());
+				Assert::AreEqual<uint32_t>(0, a);
+				Assert::AreEqual<uint32_t>(127, b);
+				Assert::AreEqual<uint32_t>(128, c);
+				Assert::AreEqual<int8_t>(-1, d);
+				Assert::AreEqual<int16_t>(-64, e);
+				Assert::AreEqual<int16_t>(64, g);
+				Assert::AreEqual<uint64_t>(UINT64_MAX, h);
+				Assert::AreEqual<int64_t>(INT64_MIN, i);
+				Assert::AreEqual<int64_t>(INT64_MAX, j);
+				std::string str; std::wstring wstr;
+				source->read_vstr(str).read_vstr(wstr);
+				Assert::AreEqual<std::string>("Hello", str);
+				Assert::AreEqual<std::wstring>(L"World", wstr);
+				std::vector<uint16_t> v_in; std::set<int64_t> s_in; std::list<std::string> l_in;
+				source->read_vcollection(v_in).read_vcollection(s_in).read_vcollection(l_in);
+				Assert::IsTrue(source->ok());
+				Assert::IsTrue(v == v_in);
+				Assert::IsTrue(s == s_in);
+				Assert::IsTrue(l == l_in);
+				source->read_varint(a);
+				Assert::IsFalse(source->ok());
+			}
+		}
+		std::filesystem::remove(filename);
+
+		// Arrays spanning buffer boundaries
+		std::vector<int32_t> data(100000);
+		for (size_t i = 0; i < data.size(); ++i)
+			data[i] = static_cast<int32_t>((i * 0x9e3779b9) >> (i % 32)) * (i % 2 ? 1 : -1);
+		f.seekbeg(0);
+		f.truncate();
+		Assert::AreEqual(data.size(), f.write_varint_array(data.data(), data.size()));
+		f.seekbeg(0);
+		{
+			buffer f_buf(f, 0x100, 0);
+			std::vector<int32_t> data_in(data.size());
+			Assert::AreEqual(data.size(), f_buf.read_varint_array(data_in.data(), data_in.size()));
+			Assert::IsTrue(data == data_in);
+		}
+
+		// Malformed data
+		uint8_t overlong[11];
+		memset(overlong, 0xff, sizeof(overlong));
+		f.seekbeg(0);
+		f.truncate();
+		f.write(overlong, sizeof(overlong));
+		f.write_varint<uint16_t>(300);
+		f.seekbeg(0);
+		uint64_t x;
+		f.read_varint(x);
+		Assert::IsTrue(f.state() == state_t::fail);
+		f.seekbeg(sizeof(overlong));
+		uint8_t y;
+		f.read_varint(y);
+		Assert::IsTrue(f.state() == state_t::fail);
+	}
+
 	void stream::open_close()
 	{
 		cached_file dat(stdex::invalid_handle, state_t::fail, 4096);
@@ -12,6 +12,143 @@ using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace UnitTests
 {
+	void zlib::block()
+	{
+		constexpr uint32_t total = 100000;
+		stdex::stream::memory_file dat_deflated;
+		dat_deflated << "header";
+		{
+			stdex::zlib_block_writer zlib(dat_deflated, Z_BEST_SPEED, 0x1000);
+			for (uint32_t i = 0; i < total; ++i)
+				zlib << i;
+		}
+		Assert::IsTrue(dat_deflated.size() < total * sizeof(uint32_t));
+
+		stdex::zlib_block_reader zlib(dat_deflated, 2);
+		Assert::AreEqual<stdex::stream::fsize_t>(total * sizeof(uint32_t), zlib.size());
+		uint32_t x;
+		for (uint32_t i : { 0u, 12345u, 1023u, 1024u, total - 1, 5u, 77777u }) {
+			zlib.seekbeg(i * sizeof(uint32_t));
+			zlib >> x;
+			Assert::IsTrue(zlib.ok());
+			Assert::AreEqual(i, x);
+		}
+		zlib >> x;
+		Assert::AreEqual<uint32_t>(77778, x);
+		zlib.seekend(-static_cast<stdex::stream::foff_t>(sizeof(uint32_t) / 2));
+		zlib >> x;
+		Assert::IsFalse(zlib.ok());
+
+		zlib.seekbeg(0);
+		std::vector<uint32_t> data(total);
+		Assert::AreEqual(total * sizeof(uint32_t), zlib.read(data.data(), total * sizeof(uint32_t)));
+		for (uint32_t i = 0; i < total; ++i)
+			Assert::AreEqual(i, data[i]);
+
+		stdex::stream::memory_file dat_invalid;
+		dat_invalid << "not compressed at all";
+		Assert::ExpectException<std::runtime_error>([&] { stdex::zlib_block_reader zlib(dat_invalid); });
+	}
+
+	void zlib::flush()
+	{
+		static const char* messages[] = { "Hello", "", "world!", "This is a test." };
+		stdex::stream::fifo channel;
+		stdex::zlib_writer writer(channel, Z_BEST_COMPRESSION, 0x100);
+		stdex::zlib_reader reader(channel, 0x100);
+		char data[0x100];
+		for (size_t i = 0; i < _countof(messages); ++i) {
+			// Each message must be available in full as soon as it is flushed.
+			size_t length = strlen(messages[i]);
+			writer.write(messages[i], length);
+			writer.flush(i % 2 ? Z_FULL_FLUSH : Z_SYNC_FLUSH);
+			Assert::IsTrue(writer.ok());
+			Assert::AreEqual(length, reader.read(data, sizeof(data)));
+			Assert::AreEqual(0, memcmp(messages[i], data, length));
+		}
+	}
+
+	void zlib::oneshot()
+	{
+		std::vector<uint8_t> deflated, inflated;
+		for (size_t i = 0; i < 1000; ++i) {
+			std::string message = "Message #" + std::to_string(i) + std::string(i % 100, 'x');
+			int level = static_cast<int>(i % 10);
+			deflated = stdex::zlib_compress(message.data(), message.size(), level);
+
+			// Pooled contexts must produce the same output as fresh ones.
+			std::vector<uint8_t> expected(compressBound(static_cast<uLong>(message.size())));
+			uLongf expected_size = static_cast<uLongf>(expected.size());
+			Assert::AreEqual(Z_OK, compress2(expected.data(), &expected_size, reinterpret_cast<const Bytef*>(message.data()), static_cast<uLong>(message.size()), level));
+			expected.resize(expected_size);
+			Assert::IsTrue(expected == deflated);
+
+			inflated.clear();
+			stdex::zlib_decompress(inflated, deflated.data(), deflated.size());
+			Assert::AreEqual(message, std::string(inflated.begin(), inflated.end()));
+		}
+
+		inflated.assign({ 'a', 'b' });
+		stdex::zlib_decompress(inflated, deflated.data(), deflated.size());
+		Assert::AreEqual<size_t>(2 + 9 + 3 + 99, inflated.size());
+		Assert::AreEqual<uint8_t>('a', inflated[0]);
+		Assert::ExpectException<std::runtime_error>([&] { stdex::zlib_decompress(deflated.data(), deflated.size() / 2); });
+		Assert::ExpectException<std::runtime_error>([&] { stdex::zlib_decompress("garbage", 7); });
+
+		// A burst of streams returns more contexts than pools keep.
+		{
+			stdex::stream::memory_file dat[2 * stdex::zlib_pool_capacity];
+			std::vector<std::unique_ptr<stdex::zlib_writer>> writers;
+			for (auto& d : dat)
+				writers.emplace_back(new stdex::zlib_writer(d));
+		}
+		stdex::zlib_clear_pools();
+		deflated = stdex::zlib_compress("test", 4);
+		inflated = stdex::zlib_decompress(deflated.data(), deflated.size());
+		Assert::AreEqual<std::string>("test", std::string(inflated.begin(), inflated.end()));
+	}
+
+	void zlib::parallel()
+	{
+		std::vector<uint32_t> inflated(0x40000);
+		for (size_t i = 0; i < inflated.size(); ++i)
+			inflated[i] = static_cast<uint32_t>(i / 7 * 0x9e3779b1u) >> 20;
+
+		stdex::stream::memory_file dat_deflated;
+		{
+			stdex::zlib_parallel_writer zlib(dat_deflated, Z_DEFAULT_COMPRESSION, false, 4, 0x4000);
+			zlib.write(inflated.data(), 0x1234);
+			zlib.flush();
+			Assert::IsTrue(zlib.ok());
+			zlib.write(reinterpret_cast<const uint8_t*>(inflated.data()) + 0x1234, inflated.size() * sizeof(uint32_t) - 0x1234);
+		}
+		Assert::IsTrue(dat_deflated.size() < inflated.size() * sizeof(uint32_t) / 2);
+		dat_deflated.seekbeg(0);
+		std::vector<uint32_t> data(inflated.size());
+		{
+			stdex::zlib_reader zlib(dat_deflated);
+			Assert::AreEqual(data.size(), zlib.read_array(data.data(), sizeof(uint32_t), data.size()));
+		}
+		Assert::IsTrue(inflated == data);
+
+		stdex::stream::memory_file dat_gzip;
+		{
+			stdex::zlib_parallel_writer zlib(dat_gzip, Z_BEST_SPEED, true, 0, 0x8000);
+			zlib.write(inflated.data(), inflated.size() * sizeof(uint32_t));
+		}
+		z_stream strm = {};
+		Assert::AreEqual(Z_OK, inflateInit2(&strm, 16 + MAX_WBITS));
+		std::fill(data.begin(), data.end(), 0);
+		strm.next_in = reinterpret_cast<Bytef*>(const_cast<void*>(dat_gzip.data()));
+		strm.avail_in = static_cast<uInt>(dat_gzip.size());
+		strm.next_out = reinterpret_cast<Bytef*>(data.data());
+		strm.avail_out = static_cast<uInt>(data.size() * sizeof(uint32_t));
+		Assert::AreEqual(Z_STREAM_END, inflate(&strm, Z_FINISH));
+		Assert::AreEqual<uInt>(0, strm.avail_in);
+		inflateEnd(&strm);
+		Assert::IsTrue(inflated == data);
+	}
+
 	void zlib::test()
 	{
 		static const char inflated[] = "This is a test.";
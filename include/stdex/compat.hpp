@@ -218,4 +218,6 @@ size_t _countof(const T (&arr)[N])
 #define lseek64 lseek
 #define lockf64 lockf
 #define ftruncate64 ftruncate
+#define pread64 pread
+#define pwrite64 pwrite
 #endif
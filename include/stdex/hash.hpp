@@ -10,6 +10,22 @@
 #include "math.h"
 #include "stream.hpp"
 #include <stdint.h>
+#if _M_IX86 || _M_X64
+#include <intrin.h>
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#elif __i386__ || __x86_64__
+#include <cpuid.h>
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#elif __aarch64__
+#if __ARM_FEATURE_CRC32
+#include <arm_acle.h>
+#endif
+#if __ARM_FEATURE_CRYPTO || __ARM_FEATURE_AES
+#include <arm_neon.h>
+#endif
+#endif
 
 #if defined(__GNUC__)
 #pragma GCC diagnostic push
@@ -162,6 +178,351 @@ namespace stdex
 		basic_hash<T>& m_hash;
 	};
 
+	/// \cond internal
+	///
+	/// CPU support for accelerated CRC computation
+	///
+	struct crc32_cpu_t
+	{
+		bool pclmul; ///< Does CPU support carry-less multiplication?
+		bool crc32c; ///< Does CPU support CRC-32C instruction?
+
+		crc32_cpu_t()
+		{
+#if _M_IX86 || _M_X64
+			int info[4];
+			__cpuid(info, 1);
+			pclmul = (info[2] & (1 << 1)) != 0;
+			crc32c = (info[2] & (1 << 20)) != 0;
+#elif __i386__ || __x86_64__
+			unsigned int eax, ebx, ecx = 0, edx;
+			if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+				ecx = 0;
+			pclmul = (ecx & (1 << 1)) != 0;
+			crc32c = (ecx & (1 << 20)) != 0;
+#else
+#if __aarch64__ && (__ARM_FEATURE_CRYPTO || __ARM_FEATURE_AES)
+			pclmul = true;
+#else
+			pclmul = false;
+#endif
+#if __aarch64__ && __ARM_FEATURE_CRC32
+			crc32c = true;
+#else
+			crc32c = false;
+#endif
+#endif
+		}
+
+		///
+		/// Returns CPU support
+		///
+		static const crc32_cpu_t& get()
+		{
+			static const crc32_cpu_t cpu;
+			return cpu;
+		}
+	};
+
+	///
+	/// Lookup tables for computing reflected CRC-32 with given polynomial
+	///
+	template <uint32_t P>
+	struct crc32_tables_t
+	{
+		uint32_t slice[16][256]; ///< Slicing-by-16 tables; slice[0] is the classic byte-wise table
+		uint32_t x2n[32]; ///< x^(2^n) mod P
+
+		crc32_tables_t()
+		{
+			for (uint32_t i = 0; i < 256; ++i) {
+				uint32_t crc = i;
+				for (int j = 0; j < 8; ++j)
+					crc = crc & 1 ? (crc >> 1) ^ P : crc >> 1;
+				slice[0][i] = crc;
+			}
+			for (size_t k = 1; k < _countof(slice); ++k)
+				for (size_t i = 0; i < 256; ++i)
+					slice[k][i] = (slice[k - 1][i] >> 8) ^ slice[0][slice[k - 1][i] & 0xff];
+
+			x2n[0] = 0x40000000; // x^1
+			for (size_t n = 1; n < _countof(x2n); ++n)
+				x2n[n] = multmodp(x2n[n - 1], x2n[n - 1]);
+		}
+
+		///
+		/// Returns tables for polynomial P
+		///
+		static const crc32_tables_t& get()
+		{
+			static const crc32_tables_t tables;
+			return tables;
+		}
+
+		///
+		/// Updates CRC state with data using slicing-by-16 and slicing-by-8
+		///
+		uint32_t update(_In_ uint32_t crc, _In_reads_bytes_opt_(length) const uint8_t* data, _In_ size_t length) const
+		{
+			stdex_assert(data || !length);
+			for (; length >= 16; data += 16, length -= 16) {
+				crc ^= static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 | static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+				crc =
+					slice[15][crc & 0xff] ^ slice[14][(crc >> 8) & 0xff] ^ slice[13][(crc >> 16) & 0xff] ^ slice[12][crc >> 24] ^
+					slice[11][data[4]] ^ slice[10][data[5]] ^ slice[9][data[6]] ^ slice[8][data[7]] ^
+					slice[7][data[8]] ^ slice[6][data[9]] ^ slice[5][data[10]] ^ slice[4][data[11]] ^
+					slice[3][data[12]] ^ slice[2][data[13]] ^ slice[1][data[14]] ^ slice[0][data[15]];
+			}
+			if (length >= 8) {
+				crc ^= static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 | static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+				crc =
+					slice[7][crc & 0xff] ^ slice[6][(crc >> 8) & 0xff] ^ slice[5][(crc >> 16) & 0xff] ^ slice[4][crc >> 24] ^
+					slice[3][data[4]] ^ slice[2][data[5]] ^ slice[1][data[6]] ^ slice[0][data[7]];
+				data += 8;
+				length -= 8;
+			}
+			for (; length; ++data, --length)
+				crc = slice[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+			return crc;
+		}
+
+		///
+		/// Returns a * b mod P
+		///
+		static uint32_t multmodp(_In_ uint32_t a, _In_ uint32_t b)
+		{
+			uint32_t m = 0x80000000, p = 0;
+			for (;;) {
+				if (a & m) {
+					p ^= b;
+					if (!(a & (m - 1)))
+						break;
+				}
+				m >>= 1;
+				b = b & 1 ? (b >> 1) ^ P : b >> 1;
+			}
+			return p;
+		}
+
+		///
+		/// Returns x^(n * 2^k) mod P
+		///
+		uint32_t x2nmodp(_In_ uint64_t n, _In_ size_t k) const
+		{
+			uint32_t p = 0x80000000; // x^0
+			for (; n; n >>= 1, ++k)
+				if (n & 1)
+					p = multmodp(x2n[k & 31], p);
+			return p;
+		}
+
+		///
+		/// Combines CRCs of two consecutive blocks of data
+		///
+		uint32_t combine(_In_ uint32_t crc1, _In_ uint32_t crc2, _In_ uint64_t length2) const
+		{
+			return multmodp(x2nmodp(length2, 3), crc1) ^ crc2;
+		}
+	};
+
+#if _M_IX86 || _M_X64 || __i386__ || __x86_64__
+	///
+	/// Updates CRC-32 state using PCLMULQDQ folding
+	///
+	/// Based on Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+	///
+	/// \param[in] crc     CRC state
+	/// \param[in] data    Pointer to data
+	/// \param[in] length  Amount of data in bytes. Must be a multiple of 16 and at least 64.
+	///
+#if defined(__GNUC__)
+	__attribute__((target("sse2,pclmul")))
+#endif
+	inline uint32_t crc32_pclmul(_In_ uint32_t crc, _In_reads_bytes_(length) const uint8_t* data, _In_ size_t length)
+	{
+		stdex_assert(length >= 64 && !(length % 16));
+		const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+		const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+		const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+		const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+		const __m128i mask32 = _mm_set_epi32(0, ~0, 0, ~0);
+
+		__m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+		__m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+		__m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+		__m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+		data += 64;
+		length -= 64;
+
+		// Fold 4 x 128 bits in parallel.
+		for (; length >= 64; data += 64, length -= 64) {
+			x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x00), _mm_clmulepi64_si128(x1, k1k2, 0x11)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00)));
+			x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x00), _mm_clmulepi64_si128(x2, k1k2, 0x11)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10)));
+			x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x00), _mm_clmulepi64_si128(x3, k1k2, 0x11)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20)));
+			x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x00), _mm_clmulepi64_si128(x4, k1k2, 0x11)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30)));
+		}
+
+		// Fold into 128 bits.
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x2);
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x3);
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x4);
+		for (; length >= 16; data += 16, length -= 16)
+			x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+
+		// Fold 128 bits into 64 bits.
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k3k4, 0x10));
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 4), _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5k0, 0x00));
+
+		// Barrett reduce to 32 bits.
+		x2 = _mm_and_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10), mask32);
+		x1 = _mm_xor_si128(x1, _mm_clmulepi64_si128(x2, poly, 0x00));
+		return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+	}
+#elif __aarch64__ && (__ARM_FEATURE_CRYPTO || __ARM_FEATURE_AES)
+	inline uint64x2_t crc32_pmull_lo(_In_ uint64x2_t a, _In_ uint64x2_t b)
+	{
+		return vreinterpretq_u64_p128(vmull_p64(vgetq_lane_p64(vreinterpretq_p64_u64(a), 0), vgetq_lane_p64(vreinterpretq_p64_u64(b), 0)));
+	}
+
+	inline uint64x2_t crc32_pmull_hi(_In_ uint64x2_t a, _In_ uint64x2_t b)
+	{
+		return vreinterpretq_u64_p128(vmull_high_p64(vreinterpretq_p64_u64(a), vreinterpretq_p64_u64(b)));
+	}
+
+	inline uint64x2_t crc32_pmull_fold(_In_ uint64x2_t x, _In_ uint64x2_t k, _In_ const uint8_t* data)
+	{
+		return veorq_u64(veorq_u64(crc32_pmull_lo(x, k), crc32_pmull_hi(x, k)), vreinterpretq_u64_u8(vld1q_u8(data)));
+	}
+
+	///
+	/// Updates CRC-32 state using PMULL folding
+	///
+	/// Same algorithm as PCLMULQDQ variant on x86, using ARMv8 Crypto Extension.
+	///
+	/// \param[in] crc     CRC state
+	/// \param[in] data    Pointer to data
+	/// \param[in] length  Amount of data in bytes. Must be a multiple of 16 and at least 64.
+	///
+	inline uint32_t crc32_pclmul(_In_ uint32_t crc, _In_reads_bytes_(length) const uint8_t* data, _In_ size_t length)
+	{
+		stdex_assert(length >= 64 && !(length % 16));
+		const uint64x2_t k1k2 = vcombine_u64(vcreate_u64(0x0154442bd4), vcreate_u64(0x01c6e41596));
+		const uint64x2_t k3k4 = vcombine_u64(vcreate_u64(0x01751997d0), vcreate_u64(0x00ccaa009e));
+		const uint64x2_t k5k0 = vcombine_u64(vcreate_u64(0x0163cd6124), vcreate_u64(0x0000000000));
+		const uint64x2_t poly = vcombine_u64(vcreate_u64(0x01db710641), vcreate_u64(0x01f7011641));
+		const uint64x2_t mask32 = vdupq_n_u64(0xffffffff);
+		const uint8x16_t zero = vdupq_n_u8(0);
+
+		uint64x2_t x1 = veorq_u64(vreinterpretq_u64_u8(vld1q_u8(data + 0x00)), vcombine_u64(vcreate_u64(crc), vcreate_u64(0)));
+		uint64x2_t x2 = vreinterpretq_u64_u8(vld1q_u8(data + 0x10));
+		uint64x2_t x3 = vreinterpretq_u64_u8(vld1q_u8(data + 0x20));
+		uint64x2_t x4 = vreinterpretq_u64_u8(vld1q_u8(data + 0x30));
+		data += 64;
+		length -= 64;
+
+		// Fold 4 x 128 bits in parallel.
+		for (; length >= 64; data += 64, length -= 64) {
+			x1 = crc32_pmull_fold(x1, k1k2, data + 0x00);
+			x2 = crc32_pmull_fold(x2, k1k2, data + 0x10);
+			x3 = crc32_pmull_fold(x3, k1k2, data + 0x20);
+			x4 = crc32_pmull_fold(x4, k1k2, data + 0x30);
+		}
+
+		// Fold into 128 bits.
+		x1 = veorq_u64(veorq_u64(crc32_pmull_lo(x1, k3k4), crc32_pmull_hi(x1, k3k4)), x2);
+		x1 = veorq_u64(veorq_u64(crc32_pmull_lo(x1, k3k4), crc32_pmull_hi(x1, k3k4)), x3);
+		x1 = veorq_u64(veorq_u64(crc32_pmull_lo(x1, k3k4), crc32_pmull_hi(x1, k3k4)), x4);
+		for (; length >= 16; data += 16, length -= 16)
+			x1 = crc32_pmull_fold(x1, k3k4, data);
+
+		// Fold 128 bits into 64 bits.
+		x1 = veorq_u64(
+			vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(x1), zero, 8)),
+			crc32_pmull_lo(x1, vdupq_laneq_u64(k3k4, 1)));
+		x1 = veorq_u64(
+			vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(x1), zero, 4)),
+			crc32_pmull_lo(vandq_u64(x1, mask32), k5k0));
+
+		// Barrett reduce to 32 bits.
+		x2 = vandq_u64(crc32_pmull_lo(vandq_u64(x1, mask32), vdupq_laneq_u64(poly, 1)), mask32);
+		x1 = veorq_u64(x1, crc32_pmull_lo(x2, poly));
+		return vgetq_lane_u32(vreinterpretq_u32_u64(x1), 1);
+	}
+#endif
+
+#if _M_IX86 || _M_X64 || __i386__ || __x86_64__ || (__aarch64__ && __ARM_FEATURE_CRC32)
+	///
+	/// Updates CRC-32C state with 8 bytes of data using CRC-32C instruction
+	///
+#if defined(__GNUC__) && (__i386__ || __x86_64__)
+	__attribute__((target("sse4.2")))
+#endif
+	inline uint32_t crc32c_hw(_In_ uint32_t crc, _In_reads_bytes_(8) const uint8_t* data)
+	{
+#if _M_X64 || __x86_64__
+		uint64_t value;
+		memcpy(&value, data, sizeof(value));
+		return static_cast<uint32_t>(_mm_crc32_u64(crc, value));
+#elif _M_IX86 || __i386__
+		uint32_t value[2];
+		memcpy(value, data, sizeof(value));
+		return _mm_crc32_u32(_mm_crc32_u32(crc, value[0]), value[1]);
+#else
+		uint64_t value;
+		memcpy(&value, data, sizeof(value));
+		return __crc32cd(crc, value);
+#endif
+	}
+
+	///
+	/// Updates CRC-32C state with data using CRC-32C instruction
+	///
+	/// Large buffers are split into three lanes hashed in an interleaved manner to hide the latency of the instruction.
+	/// Lane CRCs are combined in the end.
+	///
+	/// \param[in] crc     CRC state
+	/// \param[in] data    Pointer to data
+	/// \param[in] length  Amount of data in bytes
+	///
+#if defined(__GNUC__) && (__i386__ || __x86_64__)
+	__attribute__((target("sse4.2")))
+#endif
+	inline uint32_t crc32c_hw(_In_ uint32_t crc, _In_reads_bytes_opt_(length) const uint8_t* data, _In_ size_t length)
+	{
+		stdex_assert(data || !length);
+		static const size_t lanes[] = { 0x2000, 0x100 };
+		static const uint32_t shifts[] = {
+			crc32_tables_t<0x82f63b78>::get().x2nmodp(lanes[0], 3),
+			crc32_tables_t<0x82f63b78>::get().x2nmodp(lanes[1], 3),
+		};
+		for (size_t i = 0; i < _countof(lanes); ++i) {
+			const size_t lane = lanes[i];
+			for (; length >= 3 * lane; data += 3 * lane, length -= 3 * lane) {
+				uint32_t crc1 = 0, crc2 = 0;
+				for (size_t j = 0; j < lane; j += 8) {
+					crc = crc32c_hw(crc, data + j);
+					crc1 = crc32c_hw(crc1, data + lane + j);
+					crc2 = crc32c_hw(crc2, data + 2 * lane + j);
+				}
+				crc = crc32_tables_t<0x82f63b78>::multmodp(shifts[i], crc) ^ crc1;
+				crc = crc32_tables_t<0x82f63b78>::multmodp(shifts[i], crc) ^ crc2;
+			}
+		}
+		for (; length >= 8; data += 8, length -= 8)
+			crc = crc32c_hw(crc, data);
+		for (; length; ++data, --length) {
+#if _M_IX86 || _M_X64 || __i386__ || __x86_64__
+			crc = _mm_crc32_u8(crc, *data);
+#else
+			crc = __crc32cb(crc, *data);
+#endif
+		}
+		return crc;
+	}
+#endif
+	/// \endcond
+
 	///
 	/// CRC32 hash value
 	///
@@ -170,6 +531,9 @@ namespace stdex
 	///
 	/// Hashes as CRC32
 	///
+	/// Uses carry-less multiplication (PCLMULQDQ on x86, PMULL on ARMv8) when CPU supports it, and slicing-by-16 lookup
+	/// tables otherwise.
+	///
 	class crc32_hash : public basic_hash<crc32_t>
 	{
 	public:
@@ -185,64 +549,74 @@ namespace stdex
 
 		virtual void hash(_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
 		{
-			static const uint32_t crc32_table[256] = {
-				0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419,
-				0x706af48f, 0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4,
-				0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07,
-				0x90bf1d91, 0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de,
-				0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7, 0x136c9856,
-				0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
-				0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4,
-				0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b,
-				0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3,
-				0x45df5c75, 0xdcd60dcf, 0xabd13d59, 0x26d930ac, 0x51de003a,
-				0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599,
-				0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
-				0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190,
-				0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f,
-				0x9fbfe4a5, 0xe8b8d433, 0x7807c9a2, 0x0f00f934, 0x9609a88e,
-				0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
-				0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed,
-				0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
-				0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3,
-				0xfbd44c65, 0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2,
-				0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a,
-				0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5,
-				0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa, 0xbe0b1010,
-				0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
-				0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17,
-				0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6,
-				0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615,
-				0x73dc1683, 0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8,
-				0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1, 0xf00f9344,
-				0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
-				0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a,
-				0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
-				0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1,
-				0xa6bc5767, 0x3fb506dd, 0x48b2364b, 0xd80d2bda, 0xaf0a1b4c,
-				0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef,
-				0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
-				0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe,
-				0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31,
-				0x2cd99e8b, 0x5bdeae1d, 0x9b64c2b0, 0xec63f226, 0x756aa39c,
-				0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713,
-				0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b,
-				0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
-				0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1,
-				0x18b74777, 0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c,
-				0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45, 0xa00ae278,
-				0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7,
-				0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc, 0x40df0b66,
-				0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
-				0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605,
-				0xcdd70693, 0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8,
-				0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b,
-				0x2d02ef8d
-			};
+			stdex_assert(data || !length);
+			const auto& tables = crc32_tables_t<0xedb88320>::get();
+			auto p = reinterpret_cast<const uint8_t*>(data);
+#if _M_IX86 || _M_X64 || __i386__ || __x86_64__ || (__aarch64__ && (__ARM_FEATURE_CRYPTO || __ARM_FEATURE_AES))
+			if (length >= 64 && crc32_cpu_t::get().pclmul) {
+				size_t n = length & ~static_cast<size_t>(15);
+				m_value = crc32_pclmul(m_value, p, n);
+				p += n;
+				length -= n;
+			}
+#endif
+			m_value = tables.update(m_value, p, length);
+		}
+
+		virtual void finalize()
+		{
+			m_value = ~m_value;
+		}
+	};
+
+	///
+	/// Combines CRC32 hashes of two consecutive blocks of data
+	///
+	/// \param[in] crc1     CRC32 of the first block
+	/// \param[in] crc2     CRC32 of the second block
+	/// \param[in] length2  Size of the second block in bytes
+	///
+	/// \returns CRC32 of both blocks concatenated
+	///
+	inline crc32_t crc32_combine(_In_ crc32_t crc1, _In_ crc32_t crc2, _In_ uint64_t length2)
+	{
+		return crc32_tables_t<0xedb88320>::get().combine(crc1, crc2, length2);
+	}
+
+	///
+	/// CRC32C hash value
+	///
+	using crc32c_t = uint32_t;
 
+	///
+	/// Hashes as CRC32C (Castagnoli)
+	///
+	/// Uses CRC-32C instruction (SSE4.2 on x86, ARMv8 CRC32) when CPU supports it, and slicing-by-16 lookup tables
+	/// otherwise.
+	///
+	class crc32c_hash : public basic_hash<crc32c_t>
+	{
+	public:
+		crc32c_hash(crc32c_t crc = 0)
+		{
+			m_value = ~crc;
+		}
+
+		virtual void clear()
+		{
+			m_value = 0xffffffff;
+		}
+
+		virtual void hash(_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+		{
 			stdex_assert(data || !length);
-			for (size_t i = 0; i < length; i++)
-				m_value = crc32_table[(m_value ^ reinterpret_cast<const uint8_t*>(data)[i]) & 0xff] ^ (m_value >> 8);
+#if _M_IX86 || _M_X64 || __i386__ || __x86_64__ || (__aarch64__ && __ARM_FEATURE_CRC32)
+			if (crc32_cpu_t::get().crc32c) {
+				m_value = crc32c_hw(m_value, reinterpret_cast<const uint8_t*>(data), length);
+				return;
+			}
+#endif
+			m_value = crc32_tables_t<0x82f63b78>::get().update(m_value, reinterpret_cast<const uint8_t*>(data), length);
 		}
 
 		virtual void finalize()
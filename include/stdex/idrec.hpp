@@ -460,12 +460,23 @@ namespace stdex {
 				// Parameter r does not need to be passed by reference. It has only one field (data), which is a reference itself already.
 
 				stdex::stream::memory_file temp;
-				auto start = r.open(temp);
-				if (!temp.ok()) _Unlikely_ return stream;
 				temp << r.data;
-				r.close(temp, start);
-				temp.seekbeg(0);
-				stream.write_stream(temp);
+				if (!temp.ok()) _Unlikely_ return stream;
+
+				// Write header, data and padding in a single call.
+				T_id id = HE2LE(ID);
+				T_size
+					size      = static_cast<T_size>(temp.size()),
+					size_le   = HE2LE(size),
+					remainder = padding<T_size, N_align>(size);
+				static const char padding_data[N_align] = {};
+				stdex::stream::segment_t segments[] = {
+					{ &id, sizeof(id) },
+					{ &size_le, sizeof(size_le) },
+					{ const_cast<void*>(temp.data()), static_cast<size_t>(temp.size()) },
+					{ const_cast<char*>(padding_data), static_cast<size_t>(remainder) },
+				};
+				stream.writev(segments, _countof(segments));
 
 				return stream;
 			}
@@ -9,6 +9,9 @@
 #include "spinlock.hpp"
 #ifdef _WIN32
 #include "windows.h"
+#elif defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 #include <list>
 #include <map>
@@ -37,6 +40,7 @@ namespace stdex
 
 		mutable std::mutex m_mutex;
 		std::map<numaid_t, numaentry_t> m_available;
+		size_t m_capacity;
 
 	private:
 		static numaid_t numa_node()
@@ -46,10 +50,11 @@ namespace stdex
 			GetCurrentProcessorNumberEx(&Processor);
 			USHORT NodeNumber = 0;
 			return GetNumaProcessorNodeEx(&Processor, &NodeNumber) ? NodeNumber : 0;
-#elif defined(__APPLE__)
-			return 0;
+#elif defined(__linux__)
+			unsigned int cpu, node;
+			return syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 ? static_cast<numaid_t>(node) : 0;
 #else
-			return numa_node_of_cpu(sched_getcpu());
+			return 0;
 #endif
 		}
 
@@ -60,6 +65,14 @@ namespace stdex
 		}
 
 	public:
+		///
+		/// Constructs a pool
+		///
+		/// \param[in] capacity  Maximum number of items kept per NUMA node
+		///
+		pool(_In_ size_t capacity = SIZE_MAX) : m_capacity(capacity)
+		{}
+
 		///
 		/// Removes an item from the pool
 		///
@@ -85,11 +98,16 @@ namespace stdex
 		/// \param[in] r     Item to add
 		/// \param[in] numa  NUMA node to identify subpool to add item to
 		///
-		void push(_Inout_ T&& r, _In_ numaid_t numa = numa_node())
+		/// \returns true if item was added; false if subpool is full and \p r was left intact
+		///
+		bool push(_Inout_ T&& r, _In_ numaid_t numa = numa_node())
 		{
 			auto& ne = numa_entry(numa);
 			const std::lock_guard<spinlock> guard(ne.lock);
+			if (ne.list.size() >= m_capacity)
+				return false;
 			ne.list.push_front(std::move(r));
+			return true;
 		}
 
 		///
@@ -7,8 +7,12 @@
 
 #include "assert.hpp"
 #include "compat.hpp"
+#include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <stdexcept>
+#include <thread>
 #include <tuple>
 
 #if defined(__GNUC__)
@@ -152,6 +156,157 @@ namespace stdex
 		bool m_quit;
 		T m_data[N_cap];
 	};
+
+	constexpr size_t cache_line_size = 64; ///< Assumed CPU cache line size (in bytes)
+
+	///
+	/// Lock-free single-producer/single-consumer ring buffer
+	///
+	/// Unlike ring, the sender and receiver publish their progress using atomic counters and take no lock unless the
+	/// ring is full or empty. Then, they spin for a while before they block.
+	///
+	/// \tparam T  Ring element type
+	///
+	template <class T>
+	class spsc_ring
+	{
+	public:
+		///
+		/// Constructs a ring
+		///
+		/// \param[in] capacity  Ring capacity (in number of elements)
+		///
+		spsc_ring(_In_ size_t capacity) :
+			m_data(new T[capacity]),
+			m_capacity(capacity),
+			m_quit(false),
+			m_waiting(0),
+			m_head(0),
+			m_tail(0)
+		{
+			if (!capacity) _Unlikely_
+				throw std::invalid_argument("zero capacity");
+		}
+
+		///
+		/// Allocates the data after the ring tail. Use push() after the allocated data is populated.
+		///
+		/// \return Pointer to data available for writing and maximum data size to write. Or, `{nullptr, 0}` if quit() has been called.
+		///
+		std::tuple<T*, size_t> back()
+		{
+			uint64_t tail = m_tail.load(std::memory_order_relaxed), head = m_head.load(std::memory_order_acquire);
+			if (tail - head >= m_capacity) {
+				wait([&] { return m_quit || tail - (head = m_head.load()) < m_capacity; });
+				if (m_quit) _Unlikely_
+					return { nullptr, 0 };
+			}
+			size_t idx = static_cast<size_t>(tail % m_capacity);
+			return { &m_data[idx], std::min(m_capacity - static_cast<size_t>(tail - head), m_capacity - idx) };
+		}
+
+		///
+		/// Notifies the receiver the data was populated.
+		///
+		/// \param[in] size  Amount of data that was really populated
+		///
+		void push(_In_ size_t size)
+		{
+			uint64_t tail = m_tail.load(std::memory_order_relaxed);
+			stdex_assert(tail + size - m_head.load(std::memory_order_relaxed) <= m_capacity);
+			m_tail.store(tail + size);
+			notify();
+		}
+
+		///
+		/// Peeks the data at the ring head. Use pop() after the data was consumed.
+		///
+		/// \return Pointer to data available for reading and maximum data size to read. Or, `{nullptr, 0}` if quit() has been called.
+		///
+		std::tuple<T*, size_t> front()
+		{
+			uint64_t head = m_head.load(std::memory_order_relaxed), tail = m_tail.load(std::memory_order_acquire);
+			if (head == tail) {
+				wait([&] { return (tail = m_tail.load()) != head || m_quit; });
+				tail = m_tail.load();
+				if (head == tail) _Unlikely_
+					return { nullptr, 0 };
+			}
+			size_t idx = static_cast<size_t>(head % m_capacity);
+			return { &m_data[idx], std::min(static_cast<size_t>(tail - head), m_capacity - idx) };
+		}
+
+		///
+		/// Notifies the sender the data was consumed.
+		///
+		/// \param[in] size  Amount of data that was really consumed
+		///
+		void pop(_In_ size_t size)
+		{
+			uint64_t head = m_head.load(std::memory_order_relaxed);
+			stdex_assert(size <= m_tail.load(std::memory_order_relaxed) - head);
+			m_head.store(head + size);
+			notify();
+		}
+
+		///
+		/// Cancells waiting sender and receiver
+		///
+		void quit()
+		{
+			m_quit = true;
+			{ const std::lock_guard<std::mutex> lg(m_mutex); }
+			m_cv.notify_all();
+		}
+
+		///
+		/// Waits until the ring is flush
+		///
+		void sync()
+		{
+			wait([&] { return m_quit || m_head.load() == m_tail.load(); });
+		}
+
+	protected:
+		///
+		/// Spins for a while and then blocks until the condition is met
+		///
+		template <class P>
+		void wait(_In_ P ready)
+		{
+			for (size_t i = 0; i < spin_count; ++i) {
+				if (ready())
+					return;
+				std::this_thread::yield();
+			}
+			std::unique_lock<std::mutex> lk(m_mutex);
+			++m_waiting;
+			m_cv.wait(lk, ready);
+			--m_waiting;
+		}
+
+		///
+		/// Wakes blocked sender or receiver
+		///
+		void notify()
+		{
+			if (m_waiting) {
+				{ const std::lock_guard<std::mutex> lg(m_mutex); }
+				m_cv.notify_all();
+			}
+		}
+
+	protected:
+		static constexpr size_t spin_count = 0x100; ///< Number of attempts before blocking
+		std::unique_ptr<T[]> m_data;
+		size_t m_capacity;
+		std::atomic<bool> m_quit;
+		std::atomic<size_t> m_waiting; ///< Number of threads blocked
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		alignas(cache_line_size) std::atomic<uint64_t> m_head; ///< Number of elements consumed
+		alignas(cache_line_size) std::atomic<uint64_t> m_tail; ///< Number of elements populated
+	};
 }
 
 #if defined(__GNUC__)
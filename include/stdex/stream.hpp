@@ -24,15 +24,33 @@
 #else
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#if defined(__linux__)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
 #endif
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <iterator>
+#include <limits>
 #include <list>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <set>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 #if defined(__GNUC__)
@@ -52,6 +70,14 @@
 #else
 #define CHECK_STREAM_STATE 1
 #endif
+#if !defined(USE_IO_URING)
+// IORING_OP_READ and IORING_OP_WRITE require Linux 5.6 headers.
+#if defined(__linux__) && defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define USE_IO_URING 1
+#else
+#define USE_IO_URING 0
+#endif
+#endif
 
 namespace stdex
 {
@@ -78,6 +104,16 @@ namespace stdex
 		constexpr utf32_t utf32_bom = U'\ufeff'; ///< Byte-order-mark written at each UTF-32 file start
 		constexpr const char utf8_bom[3] = { '\xef', '\xbb', '\xbf' }; ///> UTF-8 byte-order-mark
 
+		///
+		/// Data segment for scatter/gather I/O
+		///
+		struct segment_t {
+			void* data;    ///< Segment data. Data is not modified when writing.
+			size_t length; ///< Segment size in bytes
+		};
+
+		constexpr size_t max_segments = 0x10; ///< Maximum number of segments passed to OS in a single call
+
 		///
 		/// Basic stream operations
 		///
@@ -86,6 +122,24 @@ namespace stdex
 		public:
 			basic(_In_ state_t state = state_t::ok) : m_state(state) {}
 
+			///
+			/// Copies stream state. Data borrowed from the other stream is not copied.
+			///
+			/// \param[in] other  Other stream
+			///
+			basic(_In_ const basic& other) : m_state(other.m_state) {}
+
+			///
+			/// Copies stream state. Data borrowed from the other stream is not copied.
+			///
+			/// \param[in] other  Other stream
+			///
+			basic& operator=(_In_ const basic& other)
+			{
+				m_state = other.m_state;
+				return *this;
+			}
+
 			virtual ~basic() noexcept(false) {}
 
 			///
@@ -126,6 +180,164 @@ namespace stdex
 				return 0;
 			}
 
+			///
+			/// Reads data from the stream into multiple buffers
+			///
+			/// Buffers are filled in order. The default implementation reads each buffer separately.
+			///
+			/// \param[in] segments  Buffers to store read data
+			/// \param[in] count     Number of buffers
+			///
+			/// \return Number of bytes successfully read.
+			/// On EOF, 0 is returned and stream state is set to state_t::eof.
+			/// On error, 0 is returned and stream state is set to state_t::fail.
+			///
+			virtual size_t readv(_In_reads_(count) const segment_t* segments, _In_ size_t count)
+			{
+				stdex_assert(segments || !count);
+				size_t num_read_total = 0;
+				for (size_t i = 0; i < count; ++i) {
+					size_t num_read = read(segments[i].data, segments[i].length);
+					num_read_total += num_read;
+					if (num_read < segments[i].length) {
+						if (num_read_total)
+							m_state = state_t::ok;
+						return num_read_total;
+					}
+				}
+				m_state = state_t::ok;
+				return num_read_total;
+			}
+
+			///
+			/// Writes data from multiple buffers to the stream
+			///
+			/// Buffers are written in order. The default implementation writes each buffer separately.
+			///
+			/// \param[in] segments  Buffers to write data from
+			/// \param[in] count     Number of buffers
+			///
+			/// \return Number of bytes successfully written.
+			/// On error, stream state is set to state_t::fail.
+			///
+			virtual size_t writev(_In_reads_(count) const segment_t* segments, _In_ size_t count)
+			{
+				stdex_assert(segments || !count);
+				size_t num_written_total = 0;
+				for (size_t i = 0; i < count; ++i) {
+					size_t num_written = write(segments[i].data, segments[i].length);
+					num_written_total += num_written;
+					if (num_written < segments[i].length)
+						return num_written_total;
+				}
+				m_state = state_t::ok;
+				return num_written_total;
+			}
+
+			///
+			/// Borrows data from the stream for reading without copying
+			///
+			/// Use release_read() to consume the data.
+			/// The default implementation reads data to an internal buffer allocated on first use. Streams that keep
+			/// data in memory return it directly.
+			///
+			/// \param[in] length  Byte limit of data to borrow
+			///
+			/// \return Pointer to data and number of bytes available there. The data is valid until release_read() or
+			/// any other stream operation.
+			/// On EOF, `{nullptr, 0}` is returned and stream state is set to state_t::eof.
+			/// On error, `{nullptr, 0}` is returned and stream state is set to state_t::fail.
+			///
+			virtual std::tuple<const uint8_t*, size_t> acquire_read(_In_ size_t length)
+			{
+				if (!m_borrow || m_borrow->empty()) {
+					try {
+						if (!m_borrow)
+							m_borrow.reset(new std::vector<uint8_t>);
+						m_borrow->resize(length);
+					}
+					catch (const std::bad_alloc&) {
+						m_state = state_t::fail;
+						return { nullptr, 0 };
+					}
+					m_borrow->resize(read(m_borrow->data(), length));
+					if (m_borrow->empty())
+						return { nullptr, 0 };
+				}
+				else
+					m_state = state_t::ok;
+				return { m_borrow->data(), std::min(length, m_borrow->size()) };
+			}
+
+			///
+			/// Consumes data borrowed by acquire_read()
+			///
+			/// Data borrowed, but not consumed remains in the stream. Non-seekable streams using the default
+			/// acquire_read() implementation cannot put such data back: they must consume all data borrowed, or the
+			/// stream state is set to state_t::fail. Use can_borrow_ahead() to tell.
+			///
+			/// \param[in] length  Number of bytes consumed
+			///
+			virtual void release_read(_In_ size_t length)
+			{
+				size_t num_borrowed = m_borrow ? m_borrow->size() : 0;
+				stdex_assert(length <= num_borrowed);
+				if (length < num_borrowed) _Unlikely_
+					m_state = state_t::fail;
+				if (m_borrow)
+					m_borrow->clear();
+			}
+
+			///
+			/// Returns true if data borrowed by acquire_read() and not consumed remains available to all subsequent reads
+			///
+			/// Such streams may be asked to borrow more data than eventually consumed, e.g. when scanning for a delimiter.
+			///
+			virtual bool can_borrow_ahead() const
+			{
+				return false;
+			}
+
+			///
+			/// Reserves space in the stream for writing without copying
+			///
+			/// Use release_write() to commit the data written.
+			/// The default implementation provides an internal buffer that is written to the stream on release. Streams
+			/// that keep data in memory return a pointer to their storage.
+			///
+			/// \param[in] length  Byte limit of space to reserve
+			///
+			/// \return Pointer to space and number of bytes available there. The space is valid until release_write()
+			/// or any other stream operation.
+			/// On error, `{nullptr, 0}` is returned and stream state is set to state_t::fail.
+			///
+			virtual std::tuple<uint8_t*, size_t> acquire_write(_In_ size_t length)
+			{
+				try {
+					if (!m_borrow)
+						m_borrow.reset(new std::vector<uint8_t>);
+					m_borrow->resize(length);
+				}
+				catch (const std::bad_alloc&) {
+					m_state = state_t::fail;
+					return { nullptr, 0 };
+				}
+				m_state = state_t::ok;
+				return { m_borrow->data(), length };
+			}
+
+			///
+			/// Commits data written to space reserved by acquire_write()
+			///
+			/// \param[in] length  Number of bytes written
+			///
+			virtual void release_write(_In_ size_t length)
+			{
+				stdex_assert(m_borrow && length <= m_borrow->size());
+				write(m_borrow->data(), length);
+				m_borrow->clear();
+			}
+
 			///
 			/// Persists volatile element data
 			///
@@ -142,6 +354,18 @@ namespace stdex
 				m_state = state_t::ok;
 			}
 
+			///
+			/// Returns OS handle the stream reads from and writes to directly
+			///
+			/// Streams transforming or buffering data must not expose their underlying handle.
+			///
+			/// \return OS handle or invalid_handle if stream is not backed by one
+			///
+			virtual sys_handle os_handle() const
+			{
+				return invalid_handle;
+			}
+
 			///
 			/// Skips given amount of bytes of data on the stream
 			///
@@ -339,16 +563,51 @@ namespace stdex
 			template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
 			size_t readln_and_attach(_Inout_ std::basic_string<T, TR, AX>& str)
 			{
-				bool initial = true;
-				T chr = static_cast<T>(0), previous = static_cast<T>(0);
-				do {
-					read_array(&chr, sizeof(T), 1);
-					if (!initial && !(previous == static_cast<T>('\r') && chr == static_cast<T>('\n')))
-						str += previous;
-					else
-						initial = false;
-					previous = chr;
-				} while (ok() && chr != static_cast<T>('\n'));
+				if (!can_borrow_ahead()) {
+					bool initial = true;
+					T chr = static_cast<T>(0), previous = static_cast<T>(0);
+					do {
+						read_array(&chr, sizeof(T), 1);
+						if (!initial && !(previous == static_cast<T>('\r') && chr == static_cast<T>('\n')))
+							str += previous;
+						else
+							initial = false;
+						previous = chr;
+					} while (ok() && chr != static_cast<T>('\n'));
+					return str.size();
+				}
+
+				// Scan borrowed blocks for EOL.
+				size_t start = str.size();
+				for (;;) {
+					const uint8_t* data; size_t length;
+					std::tie(data, length) = acquire_read(default_block_size);
+					if (!length) _Unlikely_
+						return str.size();
+					size_t count = length / sizeof(T);
+					if (!count) _Unlikely_ {
+						// Character spans borrowed blocks.
+						release_read(0);
+						T chr;
+						if (read_array(&chr, sizeof(T), 1) != 1) _Unlikely_
+							return str.size();
+						if (chr == static_cast<T>('\n'))
+							break;
+						str += chr;
+						continue;
+					}
+					size_t n = find_lf<T>(data, count), offset = str.size();
+					str.resize(offset + n);
+					memcpy(&str[offset], data, n * sizeof(T));
+					if (n < count) {
+						release_read((n + 1) * sizeof(T));
+						break;
+					}
+					release_read(count * sizeof(T));
+				}
+				if (str.size() > start && str.back() == static_cast<T>('\r'))
+					str.pop_back();
+				m_state = state_t::ok;
 				return str.size();
 			}
 
@@ -477,16 +736,8 @@ namespace stdex
 				read_data(num_chars);
 				if (!ok()) _Unlikely_
 					return *this;
-				data.reserve(num_chars);
-				for (;;) {
-					constexpr uint32_t buf_chars = 0x400;
-					T buf[buf_chars];
-					uint32_t num_read = static_cast<uint32_t>(read_array(buf, sizeof(T), std::min<uint32_t>(num_chars, buf_chars)));
-					data.append(buf, num_read);
-					num_chars -= num_read;
-					if (!num_chars || !ok())
-						return *this;
-				}
+				read_chars(data, num_chars);
+				return *this;
 			}
 
 			///
@@ -539,109 +790,400 @@ namespace stdex
 				return *this;
 			}
 
-#ifdef _WIN32
 			///
-			/// Writes SAFEARRAY data
+			/// Reads variable-length integer
 			///
-			/// \return Number of bytes written
+			/// Unsigned integers are LEB128 encoded. Signed integers are zigzag encoded first, so small negative values
+			/// remain short.
+			/// This method is intended for chaining: e.g. stream.read_varint(a).read_varint(b).read_varint(c)...
+			/// Since it would make it impossible to detect if any of the read_varint(a) or read_varint(b) failed should
+			/// read_varint(c) succeed, the method skips reading if stream state is not ok.
 			///
-			size_t write_sa(_In_ LPSAFEARRAY sa)
+			/// \param[out] data  Where to store read data
+			///
+			/// \return This stream
+			///
+			template <class T>
+			basic& read_varint(_Out_ T& data)
 			{
-				safearray_accessor_with_size<uint8_t> a(sa);
-				return write(a.data(), a.size());
+				if (!ok() || read_varint_array(&data, 1) != 1) _Unlikely_
+					data = 0;
+				return *this;
 			}
-#endif
 
 			///
-			/// Writes content of another stream
+			/// Writes variable-length integer
 			///
-			/// \return Number of bytes written
+			/// This method is intended for chaining: e.g. stream.write_varint(a).write_varint(b).write_varint(c)...
+			/// Since it would make it impossible to detect if any of the write_varint(a) or write_varint(b) failed
+			/// should write_varint(c) succeed, the method skips writing if stream state is not ok.
 			///
-			fsize_t write_stream(_Inout_ basic& stream, _In_ fsize_t amount = fsize_max)
+			/// \param[in] data  Data to write
+			///
+			/// \return This stream
+			///
+			template <class T>
+			basic& write_varint(_In_ const T data)
 			{
-				std::unique_ptr<uint8_t[]> data(new uint8_t[static_cast<size_t>(std::min<fsize_t>(amount, default_block_size))]);
-				fsize_t num_copied = 0, to_write = amount;
-				m_state = state_t::ok;
-				while (to_write) {
-					size_t num_read = stream.read(data.get(), static_cast<size_t>(std::min<fsize_t>(default_block_size, to_write)));
-					size_t num_written = write(data.get(), num_read);
-					num_copied += num_written;
-					to_write -= num_written;
-					if (stream.m_state == state_t::eof) {
-						// EOF is not an error.
-						m_state = state_t::ok;
-						break;
+				static_assert(std::is_integral_v<T>, "integral type required");
+				if (!ok()) _Unlikely_
+					return *this;
+				uint8_t buf[max_varint_size];
+				write(buf, encode_varint(buf, zigzag_encode(data)));
+				return *this;
+			}
+
+			///
+			/// Reads an array of variable-length integers
+			///
+			/// Streams supporting can_borrow_ahead() are decoded directly from borrowed data.
+			///
+			/// \param[out] data   Array to read to
+			/// \param[in]  count  Number of elements to read
+			///
+			/// \return Number of read elements. On malformed data, stream state is set to state_t::fail.
+			///
+			template <class T>
+			size_t read_varint_array(_Out_writes_to_(count, return) T* data, _In_ size_t count)
+			{
+				static_assert(std::is_integral_v<T>, "integral type required");
+				stdex_assert(data || !count);
+				size_t i = 0;
+				if (can_borrow_ahead()) {
+					while (i < count) {
+						const uint8_t* buf; size_t length;
+						std::tie(buf, length) = acquire_read(default_block_size);
+						if (!length) _Unlikely_
+							return i;
+						size_t offset = 0;
+						for (; i < count; ++i) {
+							uint64_t value;
+							size_t n = decode_varint(buf + offset, length - offset, value);
+							if (!n)
+								break;
+							if (n == SIZE_MAX || !zigzag_decode(value, data[i])) _Unlikely_ {
+								release_read(offset);
+								m_state = state_t::fail;
+								return i;
+							}
+							offset += n;
+						}
+						release_read(offset);
+						if (!offset && i < count) {
+							// Integer spans borrowed blocks.
+							uint64_t value;
+							if (!read_varint_bytes(value)) _Unlikely_
+								return i;
+							if (!zigzag_decode(value, data[i])) _Unlikely_ {
+								m_state = state_t::fail;
+								return i;
+							}
+							++i;
+						}
 					}
-					m_state = stream.m_state;
-					if (!ok())
-						break;
 				}
-				return num_copied;
+				else {
+					for (; i < count; ++i) {
+						uint64_t value;
+						if (!read_varint_bytes(value)) _Unlikely_
+							return i;
+						if (!zigzag_decode(value, data[i])) _Unlikely_ {
+							m_state = state_t::fail;
+							return i;
+						}
+					}
+				}
+				m_state = state_t::ok;
+				return count;
 			}
 
 			///
-			/// Writes UTF8, UTF-16 or UTF-32 byte-order-mark
+			/// Writes an array of variable-length integers
 			///
-			void write_charset(_In_ charset_id charset)
-			{
-				if (charset == charset_id::utf32)
-					write_data(utf32_bom);
-				else if (charset == charset_id::utf16)
-					write_data(utf16_bom);
-				else if (charset == charset_id::utf8)
-					write_array(utf8_bom, sizeof(utf8_bom), 1);
+			/// \param[in] data   Array to write
+			/// \param[in] count  Number of elements to write
+			///
+			/// \return Number of elements written
+			///
+			template <class T>
+			size_t write_varint_array(_In_reads_(count) const T* data, _In_ size_t count)
+			{
+				static_assert(std::is_integral_v<T>, "integral type required");
+				stdex_assert(data || !count);
+				uint8_t buf[0x400];
+				size_t num_written = 0;
+				while (num_written < count) {
+					size_t length = 0, n = num_written;
+					for (; n < count && length <= sizeof(buf) - max_varint_size; ++n)
+						length += encode_varint(buf + length, zigzag_encode(data[n]));
+					if (write(buf, length) != length) _Unlikely_
+						return num_written;
+					num_written = n;
+				}
+				m_state = state_t::ok;
+				return count;
 			}
 
 			///
-			/// Writes formatted string to the stream
+			/// Reads string prefixed by variable-length integer length
 			///
-			/// \return Number of characters written
+			/// This method is intended for chaining: e.g. stream.read_vstr(a).read_vstr(b).read_vstr(c)...
+			/// Since it would make it impossible to detect if any of the read_vstr(a) or read_vstr(b) failed should
+			/// read_vstr(c) succeed, the method skips reading if stream state is not ok.
 			///
-			size_t write_sprintf(_In_z_ _Printf_format_string_params_(2) const char* format, _In_opt_ locale_t locale, ...)
+			/// \param[in] data  String to read to
+			///
+			/// \return This stream
+			///
+			template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
+			basic& read_vstr(_Out_ std::basic_string<T, TR, AX>& data)
 			{
-				va_list params;
-				va_start(params, locale);
-				size_t num_chars = write_vsprintf(format, locale, params);
-				va_end(params);
-				return num_chars;
+				data.clear();
+				if (!ok()) _Unlikely_
+					return *this;
+				size_t num_chars;
+				read_varint(num_chars);
+				if (!ok()) _Unlikely_
+					return *this;
+				read_chars(data, num_chars);
+				return *this;
 			}
 
 			///
-			/// Writes formatted string to the stream
+			/// Writes string prefixed by variable-length integer length
 			///
-			/// \return Number of characters written
+			/// This method is intended for chaining: e.g. stream.write_vstr(a).write_vstr(b).write_vstr(c)...
+			/// Since it would make it impossible to detect if any of the write_vstr(a) or write_vstr(b) failed should
+			/// write_vstr(c) succeed, the method skips writing if stream state is not ok.
 			///
-			size_t write_sprintf(_In_z_ _Printf_format_string_params_(2) const wchar_t* format, _In_opt_ locale_t locale, ...)
+			/// \param[in] data  String to write
+			///
+			/// \return This stream
+			///
+			template <class T>
+			basic& write_vstr(_In_z_ const T* data)
 			{
-				va_list params;
-				va_start(params, locale);
-				size_t num_chars = write_vsprintf(format, locale, params);
-				va_end(params);
-				return num_chars;
+				size_t num_chars = stdex::strlen(data);
+				write_varint(num_chars);
+				if (!ok()) _Unlikely_
+					return *this;
+				write_array(data, sizeof(T), num_chars);
+				return *this;
 			}
 
 			///
-			/// Writes formatted string to the stream
+			/// Writes string prefixed by variable-length integer length
 			///
-			/// \return Number of characters written
+			/// This method is intended for chaining: e.g. stream.write_vstr(a).write_vstr(b).write_vstr(c)...
+			/// Since it would make it impossible to detect if any of the write_vstr(a) or write_vstr(b) failed should
+			/// write_vstr(c) succeed, the method skips writing if stream state is not ok.
 			///
-			size_t write_vsprintf(_In_z_ _Printf_format_string_params_(2) const char* format, _In_opt_ locale_t locale, _In_ va_list params)
+			/// \param[in] data  String to write
+			///
+			/// \return This stream
+			///
+			template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
+			basic& write_vstr(_In_ const std::basic_string<T, TR, AX>& data)
 			{
-				std::string tmp;
-				tmp.reserve(default_block_size);
-				vappendf(tmp, format, locale, params);
-				return write_array(tmp.data(), sizeof(char), tmp.size());
+				write_varint(data.size());
+				if (!ok()) _Unlikely_
+					return *this;
+				write_array(data.data(), sizeof(T), data.size());
+				return *this;
 			}
 
 			///
-			/// Writes formatted string to the stream
+			/// Reads collection prefixed by variable-length integer element count
 			///
-			/// \return Number of characters written
+			/// Integer elements are read as variable-length integers. Other elements are read using operator >>.
+			/// Elements are inserted at the end of the collection. Suitable for sequence containers and sets.
 			///
-			size_t write_vsprintf(_In_z_ _Printf_format_string_params_(2) const wchar_t* format, _In_opt_ locale_t locale, _In_ va_list params)
+			/// \param[out] data  Collection to read to
+			///
+			/// \return This stream
+			///
+			template <class C>
+			basic& read_vcollection(_Out_ C& data)
 			{
-				std::wstring tmp;
-				tmp.reserve(default_block_size);
+				using T = typename C::value_type;
+				data.clear();
+				if (!ok()) _Unlikely_
+					return *this;
+				size_t num;
+				read_varint(num);
+				if (!ok()) _Unlikely_
+					return *this;
+				if constexpr (std::is_integral_v<T>) {
+					constexpr size_t block = 0x400;
+					T buf[block];
+					while (num) {
+						size_t n = std::min(num, block);
+						size_t num_read = read_varint_array(buf, n);
+						for (size_t i = 0; i < num_read; ++i)
+							data.insert(data.end(), buf[i]);
+						if (num_read < n) _Unlikely_
+							return *this;
+						num -= n;
+					}
+				}
+				else {
+					for (size_t i = 0; i < num; ++i) {
+						T el;
+						*this >> el;
+						if (!ok()) _Unlikely_
+							return *this;
+						data.insert(data.end(), std::move(el));
+					}
+				}
+				return *this;
+			}
+
+			///
+			/// Writes collection prefixed by variable-length integer element count
+			///
+			/// Integer elements are written as variable-length integers. Other elements are written using operator <<.
+			///
+			/// \param[in] data  Collection to write
+			///
+			/// \return This stream
+			///
+			template <class C>
+			basic& write_vcollection(_In_ const C& data)
+			{
+				using T = typename C::value_type;
+				size_t num = data.size();
+				write_varint(num);
+				if constexpr (std::is_integral_v<T>) {
+					// Gather elements in blocks.
+					constexpr size_t block = 0x400;
+					T buf[block];
+					auto el = data.cbegin();
+					while (num && ok()) {
+						size_t n = std::min(num, block);
+						for (size_t i = 0; i < n; ++i, ++el)
+							buf[i] = *el;
+						write_varint_array(buf, n);
+						num -= n;
+					}
+				}
+				else {
+					for (auto& el : data)
+						*this << el;
+				}
+				return *this;
+			}
+
+#ifdef _WIN32
+			///
+			/// Writes SAFEARRAY data
+			///
+			/// \return Number of bytes written
+			///
+			size_t write_sa(_In_ LPSAFEARRAY sa)
+			{
+				safearray_accessor_with_size<uint8_t> a(sa);
+				return write(a.data(), a.size());
+			}
+#endif
+
+			///
+			/// Writes content of another stream
+			///
+			/// When both streams are backed by OS handles, data is copied inside the kernel where supported.
+			///
+			/// \return Number of bytes written
+			///
+			fsize_t write_stream(_Inout_ basic& stream, _In_ fsize_t amount = fsize_max)
+			{
+				fsize_t num_copied = 0, to_write = amount;
+				m_state = state_t::ok;
+#ifdef __linux__
+				if (to_write && copy_sys(stream, num_copied, to_write))
+					return num_copied;
+#endif
+				if (!to_write)
+					return num_copied;
+				std::unique_ptr<uint8_t[]> data(new uint8_t[static_cast<size_t>(std::min<fsize_t>(to_write, default_block_size))]);
+				while (to_write) {
+					size_t num_read = stream.read(data.get(), static_cast<size_t>(std::min<fsize_t>(default_block_size, to_write)));
+					size_t num_written = write(data.get(), num_read);
+					num_copied += num_written;
+					to_write -= num_written;
+					if (stream.m_state == state_t::eof) {
+						// EOF is not an error.
+						m_state = state_t::ok;
+						break;
+					}
+					m_state = stream.m_state;
+					if (!ok())
+						break;
+				}
+				return num_copied;
+			}
+
+			///
+			/// Writes UTF8, UTF-16 or UTF-32 byte-order-mark
+			///
+			void write_charset(_In_ charset_id charset)
+			{
+				if (charset == charset_id::utf32)
+					write_data(utf32_bom);
+				else if (charset == charset_id::utf16)
+					write_data(utf16_bom);
+				else if (charset == charset_id::utf8)
+					write_array(utf8_bom, sizeof(utf8_bom), 1);
+			}
+
+			///
+			/// Writes formatted string to the stream
+			///
+			/// \return Number of characters written
+			///
+			size_t write_sprintf(_In_z_ _Printf_format_string_params_(2) const char* format, _In_opt_ locale_t locale, ...)
+			{
+				va_list params;
+				va_start(params, locale);
+				size_t num_chars = write_vsprintf(format, locale, params);
+				va_end(params);
+				return num_chars;
+			}
+
+			///
+			/// Writes formatted string to the stream
+			///
+			/// \return Number of characters written
+			///
+			size_t write_sprintf(_In_z_ _Printf_format_string_params_(2) const wchar_t* format, _In_opt_ locale_t locale, ...)
+			{
+				va_list params;
+				va_start(params, locale);
+				size_t num_chars = write_vsprintf(format, locale, params);
+				va_end(params);
+				return num_chars;
+			}
+
+			///
+			/// Writes formatted string to the stream
+			///
+			/// \return Number of characters written
+			///
+			size_t write_vsprintf(_In_z_ _Printf_format_string_params_(2) const char* format, _In_opt_ locale_t locale, _In_ va_list params)
+			{
+				std::string tmp;
+				tmp.reserve(default_block_size);
+				vappendf(tmp, format, locale, params);
+				return write_array(tmp.data(), sizeof(char), tmp.size());
+			}
+
+			///
+			/// Writes formatted string to the stream
+			///
+			/// \return Number of characters written
+			///
+			size_t write_vsprintf(_In_z_ _Printf_format_string_params_(2) const wchar_t* format, _In_opt_ locale_t locale, _In_ va_list params)
+			{
+				std::wstring tmp;
+				tmp.reserve(default_block_size);
 				vappendf(tmp, format, locale, params);
 				return write_array(tmp.data(), sizeof(wchar_t), tmp.size());
 			}
@@ -686,8 +1228,14 @@ namespace stdex
 				if (num > UINT32_MAX) _Unlikely_
 					throw std::invalid_argument("collection too big");
 				*this << static_cast<uint32_t>(num);
-				for (auto& el : data)
-					*this << el;
+				if constexpr (is_flat<T>) {
+					if (ok()) _Likely_
+						write_array(data.data(), sizeof(T), num);
+				}
+				else {
+					for (auto& el : data)
+						*this << el;
+				}
 				return *this;
 			}
 
@@ -699,132 +1247,530 @@ namespace stdex
 				*this >> num;
 				if (!ok()) _Unlikely_
 					return *this;
-				data.reserve(num);
-				for (uint32_t i = 0; i < num; ++i) {
-					T el;
-					*this >> el;
-					if (!ok()) _Unlikely_
-						return *this;
-					data.push_back(std::move(el));
+				if constexpr (is_flat<T>) {
+					data.resize(num);
+					data.resize(read_array(data.data(), sizeof(T), num));
+				}
+				else {
+					data.reserve(num);
+					for (uint32_t i = 0; i < num; ++i) {
+						T el;
+						*this >> el;
+						if (!ok()) _Unlikely_
+							return *this;
+						data.push_back(std::move(el));
+					}
 				}
+				return *this;
 			}
 
 			template <class KEY, class PR = std::less<KEY>, class AX = std::allocator<KEY>>
-			basic& operator <<(_In_ const std::set<KEY, PR, AX>& data)
+			basic& operator <<(_In_ const std::set<KEY, PR, AX>& data) { return write_set(data); }
+
+			template <class KEY, class PR = std::less<KEY>, class AX = std::allocator<KEY>>
+			basic& operator >>(_Out_ std::set<KEY, PR, AX>& data) { return read_set(data); }
+
+			template <class KEY, class PR = std::less<KEY>, class AX = std::allocator<KEY>>
+			basic& operator <<(_In_ const std::multiset<KEY, PR, AX>& data) { return write_set(data); }
+
+			template <class KEY, class PR = std::less<KEY>, class AX = std::allocator<KEY>>
+			basic& operator >>(_Out_ std::multiset<KEY, PR, AX>& data) { return read_set(data); }
+
+			template <class KEY, class T, class PR = std::less<KEY>, class AX = std::allocator<std::pair<const KEY, T>>>
+			basic& operator <<(_In_ const std::map<KEY, T, PR, AX>& data) { return write_map(data); }
+
+			template <class KEY, class T, class PR = std::less<KEY>, class AX = std::allocator<std::pair<const KEY, T>>>
+			basic& operator >>(_Out_ std::map<KEY, T, PR, AX>& data) { return read_map(data); }
+
+			template <class KEY, class T, class PR = std::less<KEY>, class AX = std::allocator<std::pair<const KEY, T>>>
+			basic& operator <<(_In_ const std::multimap<KEY, T, PR, AX>& data) { return write_map(data); }
+
+			template <class KEY, class T, class PR = std::less<KEY>, class AX = std::allocator<std::pair<const KEY, T>>>
+			basic& operator >>(_Out_ std::multimap<KEY, T, PR, AX>& data) { return read_map(data); }
+
+		protected:
+			/// \cond internal
+			///
+			/// Is T serialized as a plain little-endian copy of its memory representation?
+			///
+			template <class T>
+			static constexpr bool is_flat = std::is_arithmetic_v<T> && !std::is_same_v<T, bool> && BYTE_ORDER == LITTLE_ENDIAN;
+
+			template <class C>
+			basic& write_set(_In_ const C& data)
 			{
+				using KEY = typename C::key_type;
 				size_t num = data.size();
 				if (num > UINT32_MAX) _Unlikely_
 					throw std::invalid_argument("collection too big");
 				*this << static_cast<uint32_t>(num);
-				for (auto& el : data)
-					*this << el;
+				if constexpr (is_flat<KEY>) {
+					// Gather elements in blocks.
+					constexpr size_t block = default_block_size / sizeof(KEY);
+					std::unique_ptr<KEY[]> buf(new KEY[std::min(num, block)]);
+					auto el = data.cbegin();
+					while (num && ok()) {
+						size_t n = std::min(num, block);
+						for (size_t i = 0; i < n; ++i, ++el)
+							buf[i] = *el;
+						write_array(buf.get(), sizeof(KEY), n);
+						num -= n;
+					}
+				}
+				else {
+					for (auto& el : data)
+						*this << el;
+				}
 				return *this;
 			}
 
-			template <class KEY, class PR = std::less<KEY>, class AX = std::allocator<KEY>>
-			basic& operator >>(_Out_ std::set<KEY, PR, AX>& data)
+			template <class C>
+			basic& read_set(_Out_ C& data)
 			{
+				using KEY = typename C::key_type;
 				data.clear();
 				uint32_t num;
 				*this >> num;
 				if (!ok()) _Unlikely_
 					return *this;
-				for (uint32_t i = 0; i < num; ++i) {
-					KEY el;
-					*this >> el;
-					if (!ok()) _Unlikely_
-						return *this;
-					data.insert(std::move(el));
+				// Data is written sorted. Hinting insertion at the end makes it amortized constant time.
+				if constexpr (is_flat<KEY>) {
+					constexpr size_t block = default_block_size / sizeof(KEY);
+					std::unique_ptr<KEY[]> buf(new KEY[std::min<size_t>(num, block)]);
+					while (num) {
+						size_t n = std::min<size_t>(num, block);
+						size_t num_read = read_array(buf.get(), sizeof(KEY), n);
+						for (size_t i = 0; i < num_read; ++i)
+							data.insert(data.end(), buf[i]);
+						if (num_read < n) _Unlikely_
+							return *this;
+						num -= static_cast<uint32_t>(n);
+					}
 				}
+				else {
+					for (uint32_t i = 0; i < num; ++i) {
+						KEY el;
+						*this >> el;
+						if (!ok()) _Unlikely_
+							return *this;
+						data.insert(data.end(), std::move(el));
+					}
+				}
+				return *this;
 			}
 
-			template <class KEY, class PR = std::less<KEY>, class AX = std::allocator<KEY>>
-			basic& operator <<(_In_ const std::multiset<KEY, PR, AX>& data)
+			template <class C>
+			basic& write_map(_In_ const C& data)
 			{
+				using KEY = typename C::key_type;
+				using T = typename C::mapped_type;
 				size_t num = data.size();
 				if (num > UINT32_MAX) _Unlikely_
 					throw std::invalid_argument("collection too big");
 				*this << static_cast<uint32_t>(num);
-				for (auto& el : data)
-					*this << el;
+				if constexpr (is_flat<KEY> && is_flat<T>) {
+					// Gather key-value pairs in blocks. Pairs might be padded in memory, but not in the stream.
+					constexpr size_t el_size = sizeof(KEY) + sizeof(T), block = default_block_size / el_size;
+					std::unique_ptr<uint8_t[]> buf(new uint8_t[std::min(num, block) * el_size]);
+					auto el = data.cbegin();
+					while (num && ok()) {
+						size_t n = std::min(num, block);
+						for (uint8_t* ptr = buf.get(), *ptr_end = ptr + n * el_size; ptr < ptr_end; ptr += el_size, ++el) {
+							memcpy(ptr, &el->first, sizeof(KEY));
+							memcpy(ptr + sizeof(KEY), &el->second, sizeof(T));
+						}
+						write_array(buf.get(), el_size, n);
+						num -= n;
+					}
+				}
+				else {
+					for (auto& el : data)
+						*this << el.first << el.second;
+				}
 				return *this;
 			}
 
-			template <class KEY, class PR = std::less<KEY>, class AX = std::allocator<KEY>>
-			basic& operator >>(_Out_ std::multiset<KEY, PR, AX>& data)
+			template <class C>
+			basic& read_map(_Out_ C& data)
 			{
+				using KEY = typename C::key_type;
+				using T = typename C::mapped_type;
 				data.clear();
 				uint32_t num;
 				*this >> num;
 				if (!ok()) _Unlikely_
 					return *this;
-				for (uint32_t i = 0; i < num; ++i) {
-					KEY el;
-					*this >> el;
-					if (!ok()) _Unlikely_
-						return *this;
-					data.insert(std::move(el));
+				if constexpr (is_flat<KEY> && is_flat<T>) {
+					constexpr size_t el_size = sizeof(KEY) + sizeof(T), block = default_block_size / el_size;
+					std::unique_ptr<uint8_t[]> buf(new uint8_t[std::min<size_t>(num, block) * el_size]);
+					while (num) {
+						size_t n = std::min<size_t>(num, block);
+						size_t num_read = read_array(buf.get(), el_size, n);
+						for (const uint8_t* ptr = buf.get(), *ptr_end = ptr + num_read * el_size; ptr < ptr_end; ptr += el_size) {
+							KEY key; T value;
+							memcpy(&key, ptr, sizeof(KEY));
+							memcpy(&value, ptr + sizeof(KEY), sizeof(T));
+							data.emplace_hint(data.end(), key, value);
+						}
+						if (num_read < n) _Unlikely_
+							return *this;
+						num -= static_cast<uint32_t>(n);
+					}
+				}
+				else {
+					for (uint32_t i = 0; i < num; ++i) {
+						KEY key; T value;
+						*this >> key >> value;
+						if (!ok()) _Unlikely_
+							return *this;
+						data.emplace_hint(data.end(), std::move(key), std::move(value));
+					}
 				}
 				return *this;
 			}
 
-		protected:
-			state_t m_state;
-		};
-
-		///
-		/// Absolute file position
-		///
-		using fpos_t = uint64_t;
-		constexpr fpos_t fpos_max = UINT64_MAX;
-		constexpr fpos_t fpos_min = 0;
-
-		///
-		/// Relative file position
-		///
-		using foff_t = int64_t;
-		constexpr foff_t foff_max = INT64_MAX;
-		constexpr foff_t foff_min = INT64_MIN;
+			template<class T, class TR, class AX>
+			void read_chars(_Inout_ std::basic_string<T, TR, AX>& data, _In_ size_t num_chars)
+			{
+				data.reserve(std::min<size_t>(num_chars, default_block_size));
+				for (;;) {
+					constexpr size_t buf_chars = 0x400;
+					T buf[buf_chars];
+					size_t num_read = read_array(buf, sizeof(T), std::min(num_chars, buf_chars));
+					data.append(buf, num_read);
+					num_chars -= num_read;
+					if (!num_chars || !ok())
+						return;
+				}
+			}
 
-		///
-		/// Seek anchor
-		///
-		enum class seek_t {
-#ifdef _WIN32
-			beg = FILE_BEGIN,
-			cur = FILE_CURRENT,
-			end = FILE_END
-#else
-			beg = SEEK_SET,
-			cur = SEEK_CUR,
-			end = SEEK_END
-#endif
-		};
+			static constexpr size_t max_varint_size = 10; ///< Maximum size of LEB128 encoded 64-bit integer
 
-#if _HAS_CXX20
-		using clock = std::chrono::file_clock;
-#else
-		using clock = std::chrono::system_clock;
-#endif
-		using time_point = std::chrono::time_point<clock>;
+			template <class T>
+			static uint64_t zigzag_encode(_In_ T value)
+			{
+				if constexpr (std::is_signed_v<T>)
+					return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(value) >> 63);
+				else
+					return static_cast<uint64_t>(value);
+			}
 
-		///
-		/// Basic seekable stream operations
-		///
-		class basic_file : virtual public basic
-		{
-		public:
-			virtual std::vector<uint8_t> read_remainder(_In_ size_t max_length = SIZE_MAX)
+			template <class T>
+			static bool zigzag_decode(_In_ uint64_t value, _Out_ T& data)
 			{
-				size_t length = std::min<size_t>(max_length, static_cast<size_t>(size() - tell()));
-				std::vector<uint8_t> result;
-				try { result.resize(length); }
-				catch (const std::bad_alloc&) {
-					m_state = state_t::fail;
-					return result;
+				if constexpr (std::is_signed_v<T>) {
+					int64_t x = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+					if (x < static_cast<int64_t>(std::numeric_limits<T>::min()) || x > static_cast<int64_t>(std::numeric_limits<T>::max())) _Unlikely_
+						return false;
+					data = static_cast<T>(x);
 				}
-				result.resize(read_array(result.data(), sizeof(uint8_t), length));
-				return result;
+				else {
+					if (value > static_cast<uint64_t>(std::numeric_limits<T>::max())) _Unlikely_
+						return false;
+					data = static_cast<T>(value);
+				}
+				return true;
+			}
+
+			static size_t encode_varint(_Out_writes_to_(max_varint_size, return) uint8_t* data, _In_ uint64_t value)
+			{
+				size_t n = 0;
+				for (; value >= 0x80; value >>= 7)
+					data[n++] = static_cast<uint8_t>(value | 0x80);
+				data[n++] = static_cast<uint8_t>(value);
+				return n;
+			}
+
+			///
+			/// Decodes LEB128 encoded integer
+			///
+			/// \return Number of bytes decoded; 0 if data is incomplete; SIZE_MAX if data is malformed
+			///
+			static size_t decode_varint(_In_reads_bytes_(length) const uint8_t* data, _In_ size_t length, _Out_ uint64_t& value)
+			{
+				value = 0;
+				for (size_t i = 0; i < length && i < max_varint_size; ++i) {
+					uint8_t b = data[i];
+					if (i == max_varint_size - 1 && b > 1) _Unlikely_
+						return SIZE_MAX;
+					value |= static_cast<uint64_t>(b & 0x7f) << (7 * i);
+					if (!(b & 0x80))
+						return i + 1;
+				}
+				return length < max_varint_size ? 0 : SIZE_MAX;
+			}
+
+			bool read_varint_bytes(_Out_ uint64_t& value)
+			{
+				value = 0;
+				for (size_t i = 0;; ++i) {
+					uint8_t b;
+					if (read(&b, sizeof(b)) != sizeof(b)) _Unlikely_
+						return false;
+					if (i == max_varint_size - 1 && b > 1) _Unlikely_ {
+						m_state = state_t::fail;
+						return false;
+					}
+					value |= static_cast<uint64_t>(b & 0x7f) << (7 * i);
+					if (!(b & 0x80))
+						return true;
+				}
+			}
+
+			template <class T>
+			static size_t find_lf(_In_reads_bytes_(count * sizeof(T)) const uint8_t* data, _In_ size_t count)
+			{
+				if constexpr (sizeof(T) == 1) {
+					auto lf = reinterpret_cast<const uint8_t*>(memchr(data, '\n', count));
+					return lf ? static_cast<size_t>(lf - data) : count;
+				}
+				else {
+					// Data is not necessarily aligned to T.
+					for (size_t i = 0; i < count; ++i, data += sizeof(T)) {
+						T chr;
+						memcpy(&chr, data, sizeof(T));
+						if (chr == static_cast<T>('\n'))
+							return i;
+					}
+					return count;
+				}
+			}
+			/// \endcond
+
+#ifdef __linux__
+			/// \cond internal
+			bool copy_sys(_Inout_ basic& stream, _Inout_ fsize_t& num_copied, _Inout_ fsize_t& to_write)
+			{
+				sys_handle dst = os_handle(), src = stream.os_handle();
+				if (dst == invalid_handle || src == invalid_handle)
+					return false;
+				struct stat st;
+				bool pipe =
+					(fstat(src, &st) >= 0 && S_ISFIFO(st.st_mode)) ||
+					(fstat(dst, &st) >= 0 && S_ISFIFO(st.st_mode));
+
+				// Try copy_file_range(), sendfile() and splice() in turn. A method failing or copying nothing on
+				// the first call is considered unsupported for this pair of handles. Note that some pseudo-files
+				// report zero size, so a genuine EOF is left to the buffered copy to detect.
+				for (int method = 0; method < 3; ++method) {
+					if (method == 2 && !pipe)
+						break;
+					for (bool first = true; to_write; first = false) {
+						size_t length = static_cast<size_t>(std::min<fsize_t>(to_write, 0x40000000));
+						ssize_t num_written;
+						switch (method) {
+#ifdef __NR_copy_file_range
+						case 0: num_written = static_cast<ssize_t>(syscall(__NR_copy_file_range, src, nullptr, dst, nullptr, length, 0)); break;
+#else
+						case 0: num_written = -1; errno = ENOSYS; break;
+#endif
+						case 1: num_written = sendfile(dst, src, nullptr, length); break;
+						default: num_written = ::splice(src, nullptr, dst, nullptr, length, SPLICE_F_MOVE); break;
+						}
+						if (num_written > 0) {
+							num_copied += static_cast<fsize_t>(num_written);
+							to_write -= static_cast<fsize_t>(num_written);
+							continue;
+						}
+						if (num_written < 0 && errno == EINTR)
+							continue;
+						if (first)
+							break;
+						if (num_written < 0) _Unlikely_
+							m_state = state_t::fail;
+						else
+							stream.m_state = state_t::eof;
+						return true;
+					}
+					if (!to_write) {
+						stream.m_state = state_t::ok;
+						return true;
+					}
+				}
+				return false;
+			}
+			/// \endcond
+#endif
+
+			state_t m_state;
+			std::unique_ptr<std::vector<uint8_t>> m_borrow; ///< data of default acquire_read() and acquire_write() implementation
+		};
+
+		///
+		/// Reads lines of text from a stream
+		///
+		/// Lines contained in data borrowed from the stream are returned without copying. Other lines are
+		/// assembled in an internal string. The source stream should not be used directly while reading lines.
+		///
+		template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
+		class basic_line_reader
+		{
+		public:
+			///
+			/// Line iterator
+			///
+			class iterator
+			{
+			public:
+				using iterator_category = std::input_iterator_tag;
+				using value_type = std::basic_string_view<T, TR>;
+				using difference_type = ptrdiff_t;
+				using pointer = const value_type*;
+				using reference = const value_type&;
+
+				iterator(_In_opt_ basic_line_reader* reader = nullptr) : m_reader(reader)
+				{
+					if (m_reader && !m_reader->next(m_line))
+						m_reader = nullptr;
+				}
+
+				reference operator*() const { return m_line; }
+				pointer operator->() const { return &m_line; }
+
+				iterator& operator++()
+				{
+					if (!m_reader->next(m_line))
+						m_reader = nullptr;
+					return *this;
+				}
+
+				bool operator==(_In_ const iterator& other) const { return m_reader == other.m_reader; }
+				bool operator!=(_In_ const iterator& other) const { return m_reader != other.m_reader; }
+
+			protected:
+				basic_line_reader* m_reader;
+				value_type m_line;
+			};
+
+			///
+			/// Constructs a line reader
+			///
+			/// \param[in,out] source  Stream to read lines from
+			///
+			basic_line_reader(_Inout_ basic& source) :
+				m_source(source),
+				m_pending(0)
+			{}
+
+			~basic_line_reader()
+			{
+				if (m_pending)
+					m_source.release_read(m_pending);
+			}
+
+			///
+			/// Reads next line
+			///
+			/// \param[out] line  Line without EOL. The line is valid until next call or any other operation on the source stream.
+			///
+			/// \return true if a line was read; false on EOF or error
+			///
+			bool next(_Out_ std::basic_string_view<T, TR>& line)
+			{
+				if (m_pending) {
+					m_source.release_read(m_pending);
+					m_pending = 0;
+				}
+				if (m_source.can_borrow_ahead()) {
+					const uint8_t* data; size_t length;
+					std::tie(data, length) = m_source.acquire_read(default_block_size);
+					size_t count = length / sizeof(T);
+					if (count && !(reinterpret_cast<uintptr_t>(data) % alignof(T))) {
+						auto str = reinterpret_cast<const T*>(data);
+						auto lf = TR::find(str, count, static_cast<T>('\n'));
+						if (lf) {
+							size_t n = static_cast<size_t>(lf - str);
+							m_pending = (n + 1) * sizeof(T);
+							line = std::basic_string_view<T, TR>(str, n && str[n - 1] == static_cast<T>('\r') ? n - 1 : n);
+							return true;
+						}
+					}
+					if (length)
+						m_source.release_read(0);
+				}
+				m_source.readln(m_line);
+				if (!m_source.ok() && m_line.empty())
+					return false;
+				line = m_line;
+				return true;
+			}
+
+			iterator begin() { return iterator(this); }
+			iterator end() { return iterator(); }
+
+		protected:
+			basic& m_source;
+			size_t m_pending; ///< Number of bytes to consume from the stream on next call
+			std::basic_string<T, TR, AX> m_line;
+		};
+
+		using line_reader = basic_line_reader<char>;
+		using wline_reader = basic_line_reader<wchar_t>;
+
+		///
+		/// Absolute file position
+		///
+		using fpos_t = uint64_t;
+		constexpr fpos_t fpos_max = UINT64_MAX;
+		constexpr fpos_t fpos_min = 0;
+
+		///
+		/// Relative file position
+		///
+		using foff_t = int64_t;
+		constexpr foff_t foff_max = INT64_MAX;
+		constexpr foff_t foff_min = INT64_MIN;
+
+		///
+		/// Seek anchor
+		///
+		enum class seek_t {
+#ifdef _WIN32
+			beg = FILE_BEGIN,
+			cur = FILE_CURRENT,
+			end = FILE_END
+#else
+			beg = SEEK_SET,
+			cur = SEEK_CUR,
+			end = SEEK_END
+#endif
+		};
+
+		///
+		/// File access pattern
+		///
+		enum class access_t {
+			normal = 0, ///< No particular access pattern
+			sequential, ///< Data will be accessed sequentially from lower to higher offsets
+			random,     ///< Data will be accessed in random order
+			will_need,  ///< Data will be accessed in the near future
+			dont_need,  ///< Data will not be accessed in the near future
+		};
+
+#if _HAS_CXX20
+		using clock = std::chrono::file_clock;
+#else
+		using clock = std::chrono::system_clock;
+#endif
+		using time_point = std::chrono::time_point<clock>;
+
+		///
+		/// Basic seekable stream operations
+		///
+		class basic_file : virtual public basic
+		{
+		public:
+			virtual std::vector<uint8_t> read_remainder(_In_ size_t max_length = SIZE_MAX)
+			{
+				size_t length = std::min<size_t>(max_length, static_cast<size_t>(size() - tell()));
+				std::vector<uint8_t> result;
+				try { result.resize(length); }
+				catch (const std::bad_alloc&) {
+					m_state = state_t::fail;
+					return result;
+				}
+				result.resize(read_array(result.data(), sizeof(uint8_t), length));
+				return result;
 			}
 
 			///
@@ -865,6 +1811,72 @@ namespace stdex
 				seek(static_cast<foff_t>(amount), seek_t::cur);
 			}
 
+			virtual void release_read(_In_ size_t length)
+			{
+				size_t num_borrowed = m_borrow ? m_borrow->size() : 0;
+				stdex_assert(length <= num_borrowed);
+				if (m_borrow)
+					m_borrow->clear();
+				if (length < num_borrowed)
+					seek(-static_cast<foff_t>(num_borrowed - length), seek_t::cur);
+			}
+
+			///
+			/// Reads block of data at given file position
+			///
+			/// Stream state is not updated. Files with native support allow concurrent calls from multiple threads. The
+			/// default implementation seeks to the position, reads and seeks back. Do not rely on the file position after
+			/// the call: file on Windows moves it.
+			///
+			/// \param[in]  offset  Absolute file position to read from
+			/// \param[out] data    Buffer to store read data
+			/// \param[in]  length  Byte limit of data to read
+			///
+			/// \return Number of bytes successfully read. On EOF or error, fewer bytes than \p length are returned.
+			///
+			virtual _Success_(return != 0 || length == 0) size_t read_at(
+				_In_ fpos_t offset, _Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				state_t state = m_state;
+				fpos_t orig = tell();
+				size_t num_read = 0;
+				if (orig != fpos_max && seekbeg(offset) != fpos_max) {
+					num_read = read(data, length);
+					seekbeg(orig);
+				}
+				m_state = state;
+				return num_read;
+			}
+
+			///
+			/// Writes block of data at given file position
+			///
+			/// Stream state is not updated. Files with native support allow concurrent calls from multiple threads. The
+			/// default implementation seeks to the position, writes and seeks back. Do not rely on the file position after
+			/// the call: file on Windows moves it.
+			///
+			/// \param[in] offset  Absolute file position to write to
+			/// \param[in] data    Buffer to write data from
+			/// \param[in] length  Number of bytes to write
+			///
+			/// \return Number of bytes successfully written. On error, fewer bytes than \p length are returned.
+			///
+			virtual _Success_(return != 0) size_t write_at(
+				_In_ fpos_t offset, _In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				state_t state = m_state;
+				fpos_t orig = tell();
+				size_t num_written = 0;
+				if (orig != fpos_max && seekbeg(offset) != fpos_max) {
+					num_written = write(data, length);
+					seekbeg(orig);
+				}
+				m_state = state;
+				return num_written;
+			}
+
 			///
 			/// Returns absolute file position in file or fpos_max if fails.
 			/// This method does not update stream state.
@@ -893,6 +1905,22 @@ namespace stdex
 				throw std::domain_error("not implemented");
 			}
 
+			///
+			/// Declares intended access pattern of file section
+			///
+			/// Hints are advisory and do not change stream state. Files that cannot make use of them ignore them.
+			///
+			/// \param[in] offset  Section start
+			/// \param[in] length  Section length. Use fsize_max for the remainder of file.
+			/// \param[in] access  Access pattern
+			///
+			virtual void hint(_In_ fpos_t offset, _In_ fsize_t length, _In_ access_t access)
+			{
+				_Unreferenced_(offset);
+				_Unreferenced_(length);
+				_Unreferenced_(access);
+			}
+
 			///
 			/// Returns file size
 			/// Should the file size cannot be determined, the method returns fsize_max and it does not reset the state to failed.
@@ -977,6 +2005,53 @@ namespace stdex
 			}
 #endif
 
+		protected:
+			/// \cond internal
+			static void hint_memory(_In_opt_ const uint8_t* data, _In_ size_t size, _In_ fpos_t offset, _In_ fsize_t length, _In_ access_t access, _In_ bool file_backed)
+			{
+				if (!data || offset >= size)
+					return;
+				size_t end = length < size - offset ? static_cast<size_t>(offset + length) : size;
+#ifdef _WIN32
+#if _WIN32_WINNT >= _WIN32_WINNT_WIN8
+				if (access == access_t::will_need) {
+					WIN32_MEMORY_RANGE_ENTRY range = { const_cast<uint8_t*>(data) + static_cast<size_t>(offset), end - static_cast<size_t>(offset) };
+					PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+				}
+#else
+				_Unreferenced_(end);
+				_Unreferenced_(access);
+#endif
+				_Unreferenced_(file_backed);
+#else
+				int advice;
+				switch (access) {
+				case access_t::normal: advice = MADV_NORMAL; break;
+				case access_t::sequential: advice = MADV_SEQUENTIAL; break;
+				case access_t::random: advice = MADV_RANDOM; break;
+				case access_t::will_need: advice = MADV_WILLNEED; break;
+				case access_t::dont_need:
+					// Dropping anonymous pages would discard their content.
+					if (file_backed) {
+						advice = MADV_DONTNEED;
+						break;
+					}
+#ifdef MADV_COLD
+					advice = MADV_COLD;
+					break;
+#else
+					return;
+#endif
+				default: return;
+				}
+				uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+				uintptr_t start = reinterpret_cast<uintptr_t>(data + static_cast<size_t>(offset)) & ~(page_size - 1);
+				madvise(reinterpret_cast<void*>(start), reinterpret_cast<uintptr_t>(data + end) - start, advice);
+#endif
+			}
+			/// \endcond
+
+		public:
 			///
 			/// Attempts to detect text-file charset based on UTF-32, UTF-16 or UTF-8 BOM.
 			///
@@ -1084,8 +2159,27 @@ namespace stdex
 		class replicator : public basic
 		{
 		public:
+			///
+			/// Constructs a replicator
+			///
+			/// \param[in] queue_size  Size of the data queue shared by all streams (in bytes). When 0, write() waits for
+			///                        all streams to complete writing. Otherwise, write() returns as soon as data is queued
+			///                        and each stream writes queued data at its own pace. When the slowest stream falls
+			///                        behind by the size of the queue, write() waits for it. Use flush() to wait for all
+			///                        streams to catch up.
+			///
+			replicator(_In_ size_t queue_size = 0) :
+				m_queue(queue_size ? new uint8_t[queue_size] : nullptr),
+				m_queue_size(queue_size),
+				m_head(0),
+				m_waiting(false),
+				m_failed(false)
+			{}
+
 			virtual ~replicator()
 			{
+				if (m_queue_size)
+					wait_queue(m_queue_size);
 				for (auto w = m_workers.begin(), w_end = m_workers.end(); w != w_end; ++w) {
 					auto _w = w->get();
 					{
@@ -1101,19 +2195,25 @@ namespace stdex
 			///
 			/// Adds stream on the list.
 			///
+			/// When using a data queue, the stream receives data written after it was added only.
+			///
 			void push_back(_In_ basic* source)
 			{
-				m_workers.push_back(std::unique_ptr<worker>(new worker(source)));
+				m_workers.push_back(std::unique_ptr<worker>(new worker(source, m_queue_size ? this : nullptr)));
 			}
 
 			///
 			/// Removes stream from the list.
 			///
+			/// When using a data queue, waits for the stream to write all data queued.
+			///
 			void remove(basic* source)
 			{
 				for (auto w = m_workers.begin(), w_end = m_workers.end(); w != w_end; ++w) {
 					auto _w = w->get();
 					if (_w->source == source) {
+						if (m_queue_size)
+							wait_queue(m_queue_size);
 						{
 							const std::lock_guard<std::mutex> lk(_w->mutex);
 							_w->op = worker::op_t::quit;
@@ -1129,6 +2229,28 @@ namespace stdex
 			virtual _Success_(return != 0) size_t write(
 				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
 			{
+				if (m_queue_size) {
+					for (size_t to_write = length; to_write;) {
+						size_t available = wait_queue(1);
+						uint64_t head = m_head.load(std::memory_order_relaxed);
+						size_t offset = static_cast<size_t>(head % m_queue_size);
+						size_t num_queued = std::min(std::min(to_write, available), m_queue_size - offset);
+						memcpy(m_queue.get() + offset, data, num_queued);
+						m_head.store(head + num_queued);
+						for (auto w = m_workers.begin(), w_end = m_workers.end(); w != w_end; ++w) {
+							auto _w = w->get();
+							if (_w->waiting) {
+								{ const std::lock_guard<std::mutex> lk(_w->mutex); }
+								_w->cv.notify_one();
+							}
+						}
+						reinterpret_cast<const uint8_t*&>(data) += num_queued;
+						to_write -= num_queued;
+					}
+					m_state = m_failed.exchange(false) ? state_t::fail : state_t::ok;
+					return length;
+				}
+
 				for (auto w = m_workers.begin(), w_end = m_workers.end(); w != w_end; ++w) {
 					auto _w = w->get();
 					{
@@ -1155,24 +2277,49 @@ namespace stdex
 
 			virtual void close()
 			{
+				if (m_queue_size)
+					wait_queue(m_queue_size);
 				foreach_worker(worker::op_t::close);
 			}
 
 			virtual void flush()
 			{
+				if (m_queue_size)
+					wait_queue(m_queue_size);
 				foreach_worker(worker::op_t::flush);
+				if (m_failed.exchange(false))
+					m_state = state_t::fail;
+			}
+
+			///
+			/// Returns streams that failed writing queued data
+			///
+			/// write() or flush() reports each failure once. Streams that failed no longer receive data. Use remove()
+			/// to remove them.
+			///
+			std::vector<basic*> failed() const
+			{
+				std::vector<basic*> streams;
+				for (auto w = m_workers.cbegin(), w_end = m_workers.cend(); w != w_end; ++w)
+					if (w->get()->failed)
+						streams.push_back(w->get()->source);
+				return streams;
 			}
 
 		protected:
 			class worker : public std::thread
 			{
 			public:
-				worker(_In_ basic* _source) :
+				worker(_In_ basic* _source, _In_opt_ replicator* _owner = nullptr) :
 					source(_source),
+					owner(_owner),
 					op(op_t::noop),
 					data(nullptr),
 					length(0),
-					num_written(0)
+					num_written(0),
+					tail(_owner ? _owner->m_head.load() : 0),
+					waiting(false),
+					failed(false)
 				{
 					*static_cast<std::thread*>(this) = std::thread([](_Inout_ worker& w) { w.process_op(); }, std::ref(*this));
 				}
@@ -1181,8 +2328,18 @@ namespace stdex
 				void process_op()
 				{
 					for (;;) {
+						if (owner)
+							process_queue();
 						std::unique_lock<std::mutex> lk(mutex);
-						cv.wait(lk, [&] {return op != op_t::noop; });
+						if (owner) {
+							waiting = true;
+							cv.wait(lk, [&] {return op != op_t::noop || tail.load(std::memory_order_relaxed) != owner->m_head; });
+							waiting = false;
+							if (op == op_t::noop)
+								continue;
+						}
+						else
+							cv.wait(lk, [&] {return op != op_t::noop; });
 						switch (op) {
 						case op_t::quit:
 							return;
@@ -1203,8 +2360,30 @@ namespace stdex
 					}
 				}
 
+				void process_queue()
+				{
+					for (;;) {
+						uint64_t t = tail.load(std::memory_order_relaxed), h = owner->m_head.load(std::memory_order_acquire);
+						if (t == h)
+							return;
+						size_t offset = static_cast<size_t>(t % owner->m_queue_size);
+						size_t num_write = static_cast<size_t>(std::min<uint64_t>(h - t, owner->m_queue_size - offset));
+						if (!failed && source->write(owner->m_queue.get() + offset, num_write) < num_write) _Unlikely_ {
+							// Keep consuming the queue not to block other streams.
+							failed = true;
+							owner->m_failed = true;
+						}
+						tail.store(t + num_write);
+						if (owner->m_waiting) {
+							{ const std::lock_guard<std::mutex> lk(owner->m_mutex); }
+							owner->m_cv.notify_one();
+						}
+					}
+				}
+
 			public:
 				basic* source;
+				replicator* owner; ///< Replicator with data queue or nullptr when writing synchronously
 				enum class op_t {
 					noop = 0,
 					quit,
@@ -1215,6 +2394,9 @@ namespace stdex
 				const void* data; ///< Data to write
 				size_t length; ///< Byte limit of data to write
 				size_t num_written; ///< Number of bytes written
+				std::atomic<uint64_t> tail; ///< Number of bytes consumed from the data queue
+				std::atomic<bool> waiting; ///< Is worker waiting for data?
+				std::atomic<bool> failed; ///< Did writing queued data fail?
 				std::mutex mutex;
 				std::condition_variable cv;
 			};
@@ -1239,7 +2421,45 @@ namespace stdex
 				}
 			}
 
+			///
+			/// Returns free space in the data queue
+			///
+			size_t queue_available() const
+			{
+				uint64_t head = m_head.load(std::memory_order_relaxed), used = 0;
+				for (auto w = m_workers.cbegin(), w_end = m_workers.cend(); w != w_end; ++w)
+					used = std::max(used, head - w->get()->tail.load());
+				return m_queue_size - static_cast<size_t>(used);
+			}
+
+			///
+			/// Waits for the slowest stream to free space in the data queue
+			///
+			/// \param[in] length  Amount of free space required. Pass the size of the queue to wait for all streams to
+			///                    write all data queued.
+			///
+			/// \return Free space in the data queue
+			///
+			size_t wait_queue(_In_ size_t length)
+			{
+				size_t available = queue_available();
+				if (available >= length)
+					return available;
+				std::unique_lock<std::mutex> lk(m_mutex);
+				m_waiting = true;
+				m_cv.wait(lk, [&] { return (available = queue_available()) >= length; });
+				m_waiting = false;
+				return available;
+			}
+
 			std::list<std::unique_ptr<worker>> m_workers;
+			std::unique_ptr<uint8_t[]> m_queue; ///< Data queue
+			size_t m_queue_size; ///< Size of data queue
+			std::atomic<uint64_t> m_head; ///< Number of bytes written to the data queue
+			std::mutex m_mutex;
+			std::condition_variable m_cv;
+			std::atomic<bool> m_waiting; ///< Is writer waiting for free space in the data queue?
+			std::atomic<bool> m_failed; ///< Did any stream fail writing queued data since last reported?
 		};
 
 		constexpr size_t default_async_limit = 0x100000; ///< Default queue limit for readahead/writeback (in bytes)
@@ -1247,14 +2467,21 @@ namespace stdex
 		///
 		/// Provides read-ahead stream capability
 		///
-		/// \tparam N_cap  Read-ahead buffer size
+		/// \tparam N_cap  Default read-ahead buffer size
 		///
 		template <size_t N_cap = default_async_limit>
 		class async_reader : public converter
 		{
 		public:
-			async_reader(_Inout_ basic& source) :
+			///
+			/// Starts reading ahead
+			///
+			/// \param[in] source    Source stream
+			/// \param[in] capacity  Read-ahead buffer size
+			///
+			async_reader(_Inout_ basic& source, _In_ size_t capacity = N_cap) :
 				converter(source),
+				m_ring(capacity),
 				m_worker([](_Inout_ async_reader& w) { w.process(); }, std::ref(*this))
 			{}
 
@@ -1289,10 +2516,32 @@ namespace stdex
 				}
 			}
 
-		protected:
-			void process()
+			virtual std::tuple<const uint8_t*, size_t> acquire_read(_In_ size_t length)
 			{
-				for (;;) {
+				uint8_t* ptr; size_t num_read;
+				std::tie(ptr, num_read) = m_ring.front();
+				if (!ptr) _Unlikely_ {
+					m_state = length ? m_source->state() : state_t::ok;
+					return { nullptr, 0 };
+				}
+				m_state = state_t::ok;
+				return { ptr, std::min(num_read, length) };
+			}
+
+			virtual void release_read(_In_ size_t length)
+			{
+				m_ring.pop(length);
+			}
+
+			virtual bool can_borrow_ahead() const
+			{
+				return true;
+			}
+
+		protected:
+			void process()
+			{
+				for (;;) {
 					uint8_t* ptr; size_t num_write;
 					std::tie(ptr, num_write) = m_ring.back();
 					if (!ptr) _Unlikely_
@@ -1307,21 +2556,306 @@ namespace stdex
 			}
 
 		protected:
-			ring<uint8_t, N_cap> m_ring;
+			spsc_ring<uint8_t> m_ring;
+			std::thread m_worker;
+		};
+
+		///
+		/// Provides read-ahead capability to seekable file streams
+		///
+		/// A worker thread reads ahead using read_at() on the source. Seeking within the data read ahead keeps it. Seeking
+		/// elsewhere discards it along with the read in flight and restarts reading ahead at the new position. Other
+		/// operations are passed to the source while the worker might be reading from it: use sources with native
+		/// read_at() support, like file.
+		///
+		/// \tparam N_cap  Default read-ahead buffer size
+		///
+		template <size_t N_cap = default_async_limit>
+		class async_file_reader : public basic_file
+		{
+		public:
+			///
+			/// Starts reading ahead
+			///
+			/// \param[in] source    Source file
+			/// \param[in] capacity  Read-ahead buffer size
+			///
+			async_file_reader(_Inout_ basic_file& source, _In_ size_t capacity = N_cap) :
+				basic(source.state()),
+				m_source(source),
+				m_data(new uint8_t[capacity]),
+				m_capacity(capacity),
+				m_head(0),
+				m_count(0),
+				m_offset(source.tell()),
+				m_next(m_offset),
+				m_epoch(0),
+				m_done(m_offset == fpos_max),
+				m_failed(m_offset == fpos_max),
+				m_reading(false),
+				m_quit(false),
+				m_worker([](_Inout_ async_file_reader& w) { w.process(); }, std::ref(*this))
+			{
+				if (!capacity) _Unlikely_ {
+					stop();
+					throw std::invalid_argument("zero capacity");
+				}
+			}
+
+			virtual ~async_file_reader()
+			{
+				stop();
+				if (m_offset != fpos_max)
+					m_source.seekbeg(m_offset);
+			}
+
+#pragma warning(suppress: 6101) // See [1] below
+			virtual _Success_(return != 0 || length == 0) size_t read(
+				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				for (size_t to_read = length;;) {
+					if (!to_read) {
+						m_state = state_t::ok;
+						return length;
+					}
+					const uint8_t* ptr; size_t num_read;
+					std::tie(ptr, num_read) = front();
+					if (!ptr) _Unlikely_ {
+						m_state = to_read < length ? state_t::ok : m_failed ? state_t::fail : state_t::eof;
+						return length - to_read; // [1] Code analysis misses `length - to_read` bytes were written to data in previous loop iterations.
+					}
+					if (to_read < num_read)
+						num_read = to_read;
+					memcpy(data, ptr, num_read);
+					pop(num_read);
+					to_read -= num_read;
+					reinterpret_cast<uint8_t*&>(data) += num_read;
+				}
+			}
+
+			virtual std::tuple<const uint8_t*, size_t> acquire_read(_In_ size_t length)
+			{
+				const uint8_t* ptr; size_t num_read;
+				std::tie(ptr, num_read) = front();
+				if (!ptr) _Unlikely_ {
+					m_state = !length ? state_t::ok : m_failed ? state_t::fail : state_t::eof;
+					return { nullptr, 0 };
+				}
+				m_state = state_t::ok;
+				return { ptr, std::min(num_read, length) };
+			}
+
+			virtual void release_read(_In_ size_t length)
+			{
+				pop(length);
+			}
+
+			virtual bool can_borrow_ahead() const
+			{
+				return true;
+			}
+
+			virtual void close()
+			{
+				{
+					std::unique_lock<std::mutex> lk(m_mutex);
+					++m_epoch;
+					m_head = m_count = 0;
+					m_done = true;
+					m_cv.wait(lk, [&] { return !m_reading; });
+				}
+				m_source.close();
+				m_offset = fpos_max;
+				m_state = m_source.state();
+			}
+
+			virtual fpos_t seek(_In_ foff_t offset, _In_ seek_t how = seek_t::beg)
+			{
+				fpos_t base;
+				switch (how) {
+				case seek_t::beg: base = 0; break;
+				case seek_t::cur: base = m_offset; break;
+				case seek_t::end: base = m_source.size(); break;
+				default: throw std::invalid_argument("unknown seek origin");
+				}
+				if (base == fpos_max || (offset < 0 && static_cast<fpos_t>(-offset) > base)) _Unlikely_ {
+					m_state = state_t::fail;
+					return fpos_max;
+				}
+				fpos_t pos = base + offset;
+				{
+					const std::lock_guard<std::mutex> lk(m_mutex);
+					if (m_offset <= pos && pos <= m_offset + m_count) {
+						size_t n = static_cast<size_t>(pos - m_offset);
+						m_head = (m_head + n) % m_capacity;
+						m_count -= n;
+					}
+					else {
+						// Missed the data read ahead. Discard it and restart at the new position.
+						++m_epoch;
+						m_head = m_count = 0;
+						m_next = pos;
+						m_done = m_failed = false;
+					}
+					m_offset = pos;
+				}
+				m_cv.notify_all();
+				m_state = state_t::ok;
+				return pos;
+			}
+
+			virtual fpos_t tell() const
+			{
+				return m_offset;
+			}
+
+			virtual void lock(_In_ fpos_t offset, _In_ fsize_t length)
+			{
+				m_source.lock(offset, length);
+				m_state = m_source.state();
+			}
+
+			virtual void unlock(_In_ fpos_t offset, _In_ fsize_t length)
+			{
+				m_source.unlock(offset, length);
+				m_state = m_source.state();
+			}
+
+			virtual void hint(_In_ fpos_t offset, _In_ fsize_t length, _In_ access_t access)
+			{
+				m_source.hint(offset, length, access);
+			}
+
+			virtual fsize_t size() const
+			{
+				return m_source.size();
+			}
+
+			virtual void truncate()
+			{
+				m_state = state_t::fail;
+			}
+
+			virtual time_point ctime() const
+			{
+				return m_source.ctime();
+			}
+
+			virtual time_point atime() const
+			{
+				return m_source.atime();
+			}
+
+			virtual time_point mtime() const
+			{
+				return m_source.mtime();
+			}
+
+		protected:
+			/// \cond internal
+			std::tuple<const uint8_t*, size_t> front()
+			{
+				std::unique_lock<std::mutex> lk(m_mutex);
+				m_cv.wait(lk, [&] { return m_count || m_done; });
+				if (!m_count)
+					return { nullptr, 0 };
+				return { m_data.get() + m_head, std::min(m_count, m_capacity - m_head) };
+			}
+
+			void pop(_In_ size_t length)
+			{
+				{
+					const std::lock_guard<std::mutex> lk(m_mutex);
+					stdex_assert(length <= m_count);
+					m_head = (m_head + length) % m_capacity;
+					m_count -= length;
+					m_offset += length;
+				}
+				m_cv.notify_all();
+			}
+
+			void process()
+			{
+				std::unique_lock<std::mutex> lk(m_mutex);
+				for (;;) {
+					m_cv.wait(lk, [&] { return m_quit || (!m_done && m_count < m_capacity); });
+					if (m_quit)
+						break;
+					size_t tail = (m_head + m_count) % m_capacity;
+					size_t length = std::min(m_capacity - m_count, m_capacity - tail);
+					fpos_t offset = m_next;
+					uint64_t epoch = m_epoch;
+					m_reading = true;
+					lk.unlock();
+					size_t num_read = m_source.read_at(offset, m_data.get() + tail, length);
+					// read_at() does not report errors. Short read before the end of file is one.
+					bool failed = false;
+					if (num_read < length) {
+						fsize_t size = m_source.size();
+						failed = size == fsize_max || offset + num_read < size;
+					}
+					lk.lock();
+					m_reading = false;
+					if (epoch == m_epoch) {
+						m_count += num_read;
+						m_next += num_read;
+						if (num_read < length) {
+							m_done = true;
+							m_failed = failed;
+						}
+					}
+					m_cv.notify_all();
+				}
+			}
+
+			void stop()
+			{
+				{
+					const std::lock_guard<std::mutex> lk(m_mutex);
+					m_quit = true;
+				}
+				m_cv.notify_all();
+				m_worker.join();
+			}
+			/// \endcond
+
+		protected:
+			basic_file& m_source;
+			std::unique_ptr<uint8_t[]> m_data; ///< Read-ahead ring buffer
+			size_t m_capacity; ///< Size of ring buffer
+			size_t m_head; ///< Ring position of data at m_offset
+			size_t m_count; ///< Amount of data read ahead
+			fpos_t m_offset; ///< Logical file position
+			fpos_t m_next; ///< File position of the next read ahead
+			uint64_t m_epoch; ///< Incremented on every seek discarding the data read ahead
+			bool m_done; ///< Did the worker reach the end of file?
+			bool m_failed; ///< Did the worker stop on a read error?
+			bool m_reading; ///< Is the worker reading outside the lock?
+			bool m_quit;
+			std::mutex m_mutex;
+			std::condition_variable m_cv;
 			std::thread m_worker;
 		};
 
 		///
 		/// Provides write-back stream capability
 		///
-		/// \tparam N_cap  Write-back buffer size
+		/// \tparam N_cap  Default write-back buffer size
 		///
 		template <size_t N_cap = default_async_limit>
 		class async_writer : public converter
 		{
 		public:
-			async_writer(_Inout_ basic& source) :
+			///
+			/// Starts writing back
+			///
+			/// \param[in] source    Destination stream
+			/// \param[in] capacity  Write-back buffer size
+			///
+			async_writer(_Inout_ basic& source, _In_ size_t capacity = N_cap) :
 				converter(source),
+				m_ring(capacity),
 				m_worker([](_Inout_ async_writer& w) { w.process(); }, std::ref(*this))
 			{}
 
@@ -1355,6 +2889,23 @@ namespace stdex
 				}
 			}
 
+			virtual std::tuple<uint8_t*, size_t> acquire_write(_In_ size_t length)
+			{
+				uint8_t* ptr; size_t num_write;
+				std::tie(ptr, num_write) = m_ring.back();
+				if (!ptr) _Unlikely_ {
+					m_state = state_t::fail;
+					return { nullptr, 0 };
+				}
+				m_state = state_t::ok;
+				return { ptr, std::min(num_write, length) };
+			}
+
+			virtual void release_write(_In_ size_t length)
+			{
+				m_ring.push(length);
+			}
+
 			virtual void flush()
 			{
 				m_ring.sync();
@@ -1379,7 +2930,7 @@ namespace stdex
 			}
 
 		protected:
-			ring<uint8_t, N_cap> m_ring;
+			spsc_ring<uint8_t> m_ring;
 			std::thread m_worker;
 		};
 
@@ -1388,14 +2939,19 @@ namespace stdex
 		///
 		/// Buffered read/write stream
 		///
+		/// Reads and writes larger than the buffer bypass it once it is drained.
+		/// When the maximum buffer size exceeds the initial one, buffers adapt to the access pattern: a buffer is
+		/// doubled after each fill (read) or flush (write) using it completely, and halved after four consecutive
+		/// ones using less than a quarter of it. The size stays between the initial and maximum buffer size.
+		///
 		class buffer : public converter
 		{
 		protected:
 			/// \cond internal
-			explicit buffer(_In_ size_t read_buffer_size = default_buffer_size, _In_ size_t write_buffer_size = default_buffer_size) :
+			explicit buffer(_In_ size_t read_buffer_size = default_buffer_size, _In_ size_t write_buffer_size = default_buffer_size, _In_ size_t max_buffer_size = 0) :
 				converter(),
-				m_read_buffer(read_buffer_size),
-				m_write_buffer(write_buffer_size)
+				m_read_buffer(read_buffer_size, max_buffer_size),
+				m_write_buffer(write_buffer_size, max_buffer_size)
 			{}
 
 			void done()
@@ -1407,10 +2963,19 @@ namespace stdex
 			/// \endcond
 
 		public:
-			buffer(_Inout_ basic& source, _In_ size_t read_buffer_size = default_buffer_size, _In_ size_t write_buffer_size = default_buffer_size) :
+			///
+			/// Constructs a buffer
+			///
+			/// \param[in] source             Source stream
+			/// \param[in] read_buffer_size   Initial read buffer size. 0 disables read buffering.
+			/// \param[in] write_buffer_size  Initial write buffer size. 0 disables write buffering.
+			/// \param[in] max_buffer_size    Maximum size buffers may grow to. Buffers have fixed size when not greater
+			///                               than the initial size.
+			///
+			buffer(_Inout_ basic& source, _In_ size_t read_buffer_size = default_buffer_size, _In_ size_t write_buffer_size = default_buffer_size, _In_ size_t max_buffer_size = 0) :
 				converter(source),
-				m_read_buffer(read_buffer_size),
-				m_write_buffer(write_buffer_size)
+				m_read_buffer(read_buffer_size, max_buffer_size),
+				m_write_buffer(write_buffer_size, max_buffer_size)
 			{}
 
 			virtual ~buffer()
@@ -1436,10 +3001,11 @@ namespace stdex
 						reinterpret_cast<uint8_t*&>(data) += buffer_size;
 						to_read -= buffer_size;
 					}
-					m_read_buffer.head = 0;
+					size_t used = m_read_buffer.tail;
+					m_read_buffer.head = m_read_buffer.tail = 0;
+					m_read_buffer.adapt(used);
 					if (to_read > m_read_buffer.capacity) {
 						// When needing to read more data than buffer capacity, bypass the buffer.
-						m_read_buffer.tail = 0;
 						to_read -= m_source->read(data, to_read);
 						m_state = to_read < length ? state_t::ok : m_source->state();
 						return length - to_read;
@@ -1476,6 +3042,24 @@ namespace stdex
 						m_state = state_t::ok;
 						return length;
 					}
+					if (to_write > m_write_buffer.capacity) {
+						// When needing to write more data than buffer capacity, flush the buffer and write the data in a
+						// single call bypassing the buffer.
+						size_t buffer_size = m_write_buffer.tail - m_write_buffer.head;
+						segment_t segments[] = {
+							{ m_write_buffer.data + m_write_buffer.head, buffer_size },
+							{ const_cast<void*>(data), to_write },
+						};
+						size_t num_written = m_source->writev(segments, _countof(segments));
+						m_state = m_source->state();
+						if (num_written < buffer_size) _Unlikely_ {
+							m_write_buffer.head += num_written;
+							return length - to_write;
+						}
+						m_write_buffer.head = m_write_buffer.tail = 0;
+						to_write -= num_written - buffer_size;
+						return length - to_write;
+					}
 					if (available_buffer) {
 						memcpy(m_write_buffer.data + m_write_buffer.tail, data, available_buffer);
 						reinterpret_cast<const uint8_t*&>(data) += available_buffer;
@@ -1485,24 +3069,81 @@ namespace stdex
 					size_t buffer_size = m_write_buffer.tail - m_write_buffer.head;
 					if (buffer_size) {
 						m_write_buffer.head += converter::write(m_write_buffer.data + m_write_buffer.head, buffer_size);
-						if (m_write_buffer.head == m_write_buffer.tail)
+						if (m_write_buffer.head == m_write_buffer.tail) {
 							m_write_buffer.head = m_write_buffer.tail = 0;
+							m_write_buffer.adapt(m_write_buffer.capacity);
+						}
 						else
 							return length - to_write;
 					}
-					if (to_write > m_write_buffer.capacity) {
-						// When needing to write more data than buffer capacity, bypass the buffer.
-						to_write -= converter::write(data, to_write);
-						return length - to_write;
+				}
+			}
+
+			virtual std::tuple<const uint8_t*, size_t> acquire_read(_In_ size_t length)
+			{
+				if (!m_read_buffer.capacity) _Unlikely_
+					return converter::acquire_read(length);
+				if (m_read_buffer.head == m_read_buffer.tail) {
+					size_t used = m_read_buffer.tail;
+					m_read_buffer.head = m_read_buffer.tail = 0;
+					m_read_buffer.adapt(used);
+					m_read_buffer.tail = m_source->read(m_read_buffer.data, m_read_buffer.capacity);
+					if (!m_read_buffer.tail) {
+						m_state = length ? m_source->state() : state_t::ok;
+						return { nullptr, 0 };
 					}
 				}
+				m_state = state_t::ok;
+				return { m_read_buffer.data + m_read_buffer.head, std::min(length, m_read_buffer.tail - m_read_buffer.head) };
+			}
+
+			virtual void release_read(_In_ size_t length)
+			{
+				if (!m_read_buffer.capacity) _Unlikely_ {
+					converter::release_read(length);
+					return;
+				}
+				stdex_assert(length <= m_read_buffer.tail - m_read_buffer.head);
+				m_read_buffer.head += length;
+			}
+
+			virtual bool can_borrow_ahead() const
+			{
+				return m_read_buffer.capacity ? true : converter::can_borrow_ahead();
+			}
+
+			virtual std::tuple<uint8_t*, size_t> acquire_write(_In_ size_t length)
+			{
+				if (!m_write_buffer.capacity) _Unlikely_
+					return converter::acquire_write(length);
+				if (m_write_buffer.tail == m_write_buffer.capacity) {
+					flush_write();
+					if (!ok()) _Unlikely_
+						return { nullptr, 0 };
+					m_write_buffer.adapt(m_write_buffer.capacity);
+				}
+				m_state = state_t::ok;
+				return { m_write_buffer.data + m_write_buffer.tail, std::min(length, m_write_buffer.capacity - m_write_buffer.tail) };
+			}
+
+			virtual void release_write(_In_ size_t length)
+			{
+				if (!m_write_buffer.capacity) _Unlikely_ {
+					converter::release_write(length);
+					return;
+				}
+				stdex_assert(length <= m_write_buffer.capacity - m_write_buffer.tail);
+				m_write_buffer.tail += length;
 			}
 
 			virtual void flush()
 			{
+				size_t used = m_write_buffer.tail;
 				flush_write();
-				if (ok())
+				if (ok()) {
+					m_write_buffer.adapt(used);
 					converter::flush();
+				}
 			}
 
 		protected:
@@ -1526,11 +3167,16 @@ namespace stdex
 			struct buffer_t {
 				uint8_t* data;
 				size_t head, tail, capacity;
+				size_t min_capacity, max_capacity; ///< Adaptive size limits
+				size_t underused; ///< Number of consecutive fills/flushes using less than a quarter of the buffer
 
-				buffer_t(_In_ size_t buffer_size) :
+				buffer_t(_In_ size_t buffer_size, _In_ size_t max_buffer_size) :
 					head(0),
 					tail(0),
 					capacity(buffer_size),
+					min_capacity(buffer_size),
+					max_capacity(buffer_size ? std::max(buffer_size, max_buffer_size) : 0),
+					underused(0),
 					data(buffer_size ? new uint8_t[buffer_size] : nullptr)
 				{}
 
@@ -1539,6 +3185,41 @@ namespace stdex
 					if (data)
 						delete[] data;
 				}
+
+				///
+				/// Resizes empty buffer according to its usage
+				///
+				/// \param[in] used  Number of bytes used by the last fill or flush
+				///
+				void adapt(_In_ size_t used)
+				{
+					stdex_assert(head == tail);
+					if (min_capacity == max_capacity)
+						return;
+					size_t new_capacity;
+					if (used >= capacity) {
+						underused = 0;
+						new_capacity = std::min(capacity * 2, max_capacity);
+					}
+					else if (used < capacity / 4 && ++underused >= 4) {
+						underused = 0;
+						new_capacity = std::max(capacity / 2, min_capacity);
+					}
+					else {
+						if (used >= capacity / 4)
+							underused = 0;
+						return;
+					}
+					if (new_capacity == capacity)
+						return;
+					uint8_t* new_data = new (std::nothrow) uint8_t[new_capacity];
+					if (!new_data) _Unlikely_
+						return;
+					delete[] data;
+					data = new_data;
+					capacity = new_capacity;
+					head = tail = 0;
+				}
 			} m_read_buffer, m_write_buffer;
 		};
 
@@ -1777,6 +3458,12 @@ namespace stdex
 					m_state = state_t::fail;
 			}
 
+			virtual void hint(_In_ fpos_t offset, _In_ fsize_t length, _In_ access_t access)
+			{
+				if (offset < m_region.size())
+					m_source.hint(m_region.start + offset, std::min<fsize_t>(length, m_region.size() - offset), access);
+			}
+
 			virtual fsize_t size() const
 			{
 				return m_region.size();
@@ -1793,241 +3480,92 @@ namespace stdex
 			interval<fpos_t> m_region;
 		};
 
-		constexpr size_t default_cache_size = 0x1000; ///< Default cache size
-
 		///
-		/// Cached file
+		/// Limits file reading/writing to a predefined window using positional I/O
 		///
-		class cache : public basic_file
+		/// Unlike file_window, the source file position is neither used nor changed. Windows of a file with native
+		/// read_at()/write_at() support may access the file from multiple threads concurrently.
+		///
+		class positional_window : public basic_file
 		{
-		protected:
-			/// \cond internal
-#pragma warning(suppress: 26495) // The delayed init call will finish initializing the class.
-			explicit cache(_In_ size_t cache_size = default_cache_size) :
-				basic(state_t::fail),
-				m_cache(cache_size)
+		public:
+			///
+			/// Creates a window
+			///
+			/// \param[in] source  Source file
+			/// \param[in] offset  Window start in source file
+			/// \param[in] length  Window size
+			///
+			positional_window(_Inout_ basic_file& source, _In_ fpos_t offset = 0, _In_ fsize_t length = fsize_max) :
+				basic(state_t::ok),
+				m_source(source),
+				m_offset(0),
+				m_region(offset, length < fpos_max - offset ? offset + length : fpos_max)
 			{}
 
-			void init(_Inout_ basic_file& source)
+			virtual _Success_(return != 0 || length == 0) size_t read(
+				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
 			{
-				m_source = &source;
-				init();
+				stdex_assert(data || !length);
+				size_t num_read = read_at(m_offset, data, length);
+				m_offset += num_read;
+				m_state = num_read || !length ? state_t::ok : state_t::eof;
+				return num_read;
 			}
 
-			void init()
+			virtual _Success_(return != 0) size_t write(
+				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
 			{
-				m_state = m_source->state();
-				m_offset = m_source->tell();
-#if SET_FILE_OP_TIMES
-				m_atime = m_source->atime();
-				m_mtime = m_source->mtime();
-#endif
-			}
-
-			void done()
-			{
-				if (m_source) {
-					flush_cache();
-					if (!ok()) _Unlikely_
-						throw std::system_error(sys_error(), std::system_category(), "failed to flush cache"); // Data loss occurred
-					m_source->seekbeg(m_offset);
-#if SET_FILE_OP_TIMES
-					m_source->set_atime(m_atime);
-					m_source->set_mtime(m_mtime);
-#endif
-					m_source = nullptr;
-				}
-			}
-			/// \endcond
-
-		public:
-			cache(_Inout_ basic_file& source, _In_ size_t cache_size = default_cache_size) :
-				basic(source.state()),
-				m_source(&source),
-				m_cache(cache_size),
-				m_offset(source.tell())
-#if SET_FILE_OP_TIMES
-				, m_atime(source.atime())
-				, m_mtime(source.mtime())
-#endif
-			{}
-
-			virtual ~cache() noexcept(false)
-			{
-				if (m_source) {
-					flush_cache();
-					if (!ok()) _Unlikely_
-						throw std::system_error(sys_error(), std::system_category(), "failed to flush cache"); // Data loss occurred
-					m_source->seekbeg(m_offset);
-#if SET_FILE_OP_TIMES
-					m_source->set_atime(m_atime);
-					m_source->set_mtime(m_mtime);
-#endif
-				}
+				stdex_assert(data || !length);
+				size_t num_written = write_at(m_offset, data, length);
+				m_offset += num_written;
+				m_state = num_written == length ? state_t::ok : state_t::fail;
+				return num_written;
 			}
 
-			virtual _Success_(return != 0 || length == 0) size_t read(
-				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			virtual _Success_(return != 0 || length == 0) size_t read_at(
+				_In_ fpos_t offset, _Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
 			{
 				stdex_assert(data || !length);
-#if SET_FILE_OP_TIMES
-				m_atime = time_point::now();
-#endif
-				for (size_t to_read = length;;) {
-					if (m_cache.status != cache_t::cache_t::status_t::empty) {
-						if (m_cache.region.contains(m_offset)) {
-							size_t remaining_cache = static_cast<size_t>(m_cache.region.end - m_offset);
-							if (to_read <= remaining_cache) {
-								memcpy(data, m_cache.data + static_cast<size_t>(m_offset - m_cache.region.start), to_read);
-								m_offset += to_read;
-								m_state = state_t::ok;
-								return length;
-							}
-							memcpy(data, m_cache.data + static_cast<size_t>(m_offset - m_cache.region.start), remaining_cache);
-							reinterpret_cast<uint8_t*&>(data) += remaining_cache;
-							to_read -= remaining_cache;
-							m_offset += remaining_cache;
-						}
-						flush_cache();
-						if (!ok()) _Unlikely_ {
-							if (to_read < length)
-								m_state = state_t::ok;
-							return length - to_read;
-						}
-					}
-					{
-						fpos_t end_max = m_offset + to_read;
-						if (m_offset / m_cache.capacity < end_max / m_cache.capacity) {
-							// Read spans multiple cache blocks. Bypass cache to the last block.
-							m_source->seekbeg(m_offset);
-							if (!m_source->ok()) _Unlikely_ {
-								m_state = to_read < length ? state_t::ok : state_t::fail;
-								return length - to_read;
-							}
-							size_t num_read = m_source->read(data, to_read - static_cast<size_t>(end_max % m_cache.capacity));
-							m_offset += num_read;
-							to_read -= num_read;
-							if (!to_read) {
-								m_state = state_t::ok;
-								return length;
-							}
-							reinterpret_cast<uint8_t*&>(data) += num_read;
-							m_state = m_source->state();
-							if (!ok()) {
-								if (to_read < length)
-									m_state = state_t::ok;
-								return length - to_read;
-							}
-						}
-					}
-					load_cache(m_offset);
-					if (!ok()) _Unlikely_ {
-						m_state = to_read < length ? state_t::ok : state_t::fail;
-						return length - to_read;
-					}
-					if (m_cache.region.end <= m_offset) _Unlikely_ {
-						m_state = to_read < length ? state_t::ok : state_t::eof;
-						return length - to_read;
-					}
-				}
+				if (offset >= m_region.size())
+					return 0;
+				return m_source.read_at(m_region.start + offset, data, static_cast<size_t>(std::min<fsize_t>(length, m_region.size() - offset)));
 			}
 
-			virtual _Success_(return != 0) size_t write(
-				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			virtual _Success_(return != 0) size_t write_at(
+				_In_ fpos_t offset, _In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
 			{
 				stdex_assert(data || !length);
-#if SET_FILE_OP_TIMES
-				m_atime = m_mtime = time_point::now();
-#endif
-				for (size_t to_write = length;;) {
-					if (m_cache.status != cache_t::cache_t::status_t::empty) {
-						fpos_t end_max = m_cache.region.start + m_cache.capacity;
-						if (m_cache.region.start <= m_offset && m_offset < end_max) {
-							size_t remaining_cache = static_cast<size_t>(end_max - m_offset);
-							if (to_write <= remaining_cache) {
-								memcpy(m_cache.data + static_cast<size_t>(m_offset - m_cache.region.start), data, to_write);
-								m_offset += to_write;
-								m_cache.status = cache_t::cache_t::status_t::dirty;
-								m_cache.region.end = std::max(m_cache.region.end, m_offset);
-								m_state = state_t::ok;
-								return length;
-							}
-							memcpy(m_cache.data + static_cast<size_t>(m_offset - m_cache.region.start), data, remaining_cache);
-							reinterpret_cast<const uint8_t*&>(data) += remaining_cache;
-							to_write -= remaining_cache;
-							m_offset += remaining_cache;
-							m_cache.status = cache_t::cache_t::status_t::dirty;
-							m_cache.region.end = end_max;
-						}
-						flush_cache();
-						if (!ok()) _Unlikely_
-							return length - to_write;
-					}
-					{
-						fpos_t end_max = m_offset + to_write;
-						if (m_offset / m_cache.capacity < end_max / m_cache.capacity) {
-							// Write spans multiple cache blocks. Bypass cache to the last block.
-							m_source->seekbeg(m_offset);
-							if (!ok()) _Unlikely_
-								return length - to_write;
-							size_t num_written = m_source->write(data, to_write - static_cast<size_t>(end_max % m_cache.capacity));
-							m_offset += num_written;
-							m_state = m_source->state();
-							to_write -= num_written;
-							if (!to_write || !ok())
-								return length - to_write;
-							reinterpret_cast<const uint8_t*&>(data) += num_written;
-						}
-					}
-					load_cache(m_offset);
-					if (!ok()) _Unlikely_
-						return length - to_write;
-				}
+				if (offset >= m_region.size())
+					return 0;
+				return m_source.write_at(m_region.start + offset, data, static_cast<size_t>(std::min<fsize_t>(length, m_region.size() - offset)));
 			}
 
 			virtual void close()
 			{
-				invalidate_cache();
-				if (!ok()) _Unlikely_
-					throw std::system_error(sys_error(), std::system_category(), "failed to flush cache"); // Data loss occurred
-				m_source->close();
-				m_state = m_source->state();
+				// Source file is shared with other windows.
+				m_state = state_t::ok;
 			}
 
 			virtual void flush()
 			{
-#if SET_FILE_OP_TIMES
-				m_atime = m_mtime = time_point::min();
-#endif
-				flush_cache();
-				if (!ok()) _Unlikely_
-					return;
-				m_source->flush();
+				m_source.flush();
+				m_state = m_source.state();
 			}
 
 			virtual fpos_t seek(_In_ foff_t offset, _In_ seek_t how = seek_t::beg)
 			{
-				m_state = state_t::ok;
 				switch (how) {
-				case seek_t::beg:
-					break;
-				case seek_t::cur:
-					offset = static_cast<foff_t>(m_offset) + offset;
-					break;
-				case seek_t::end: {
-					auto n = size();
-					if (n == fsize_max) _Unlikely_{
-						m_state = state_t::fail;
-						return fpos_max;
-					}
-					offset = static_cast<foff_t>(n) + offset;
-					break;
+				case seek_t::beg: break;
+				case seek_t::cur: offset = static_cast<foff_t>(m_offset) + offset; break;
+				case seek_t::end: offset = static_cast<foff_t>(size()) + offset; break;
+				default: throw std::invalid_argument("unknown seek origin");
 				}
-				default:
-					throw std::invalid_argument("unknown seek origin");
+				if (offset < 0) _Unlikely_ {
+					m_state = state_t::fail;
+					return fpos_max;
 				}
-				if (offset < 0) _Unlikely_
-					throw std::invalid_argument("negative file offset");
+				m_state = state_t::ok;
 				return m_offset = static_cast<fpos_t>(offset);
 			}
 
@@ -2038,1511 +3576,4384 @@ namespace stdex
 
 			virtual void lock(_In_ fpos_t offset, _In_ fsize_t length)
 			{
-				m_source->lock(offset, length);
-				m_state = m_source->state();
+				if (offset < m_region.size()) {
+					m_source.lock(m_region.start + offset, std::min<fsize_t>(length, m_region.size() - offset));
+					m_state = m_source.state();
+				}
+				else
+					m_state = state_t::fail;
 			}
 
 			virtual void unlock(_In_ fpos_t offset, _In_ fsize_t length)
 			{
-				m_source->unlock(offset, length);
-				m_state = m_source->state();
+				if (offset < m_region.size()) {
+					m_source.unlock(m_region.start + offset, std::min<fsize_t>(length, m_region.size() - offset));
+					m_state = m_source.state();
+				}
+				else
+					m_state = state_t::fail;
 			}
 
-			virtual fsize_t size() const
+			virtual void hint(_In_ fpos_t offset, _In_ fsize_t length, _In_ access_t access)
 			{
-				return m_cache.status != cache_t::cache_t::status_t::empty ?
-					std::max(m_source->size(), m_cache.region.end) :
-					m_source->size();
+				if (offset < m_region.size())
+					m_source.hint(m_region.start + offset, std::min<fsize_t>(length, m_region.size() - offset), access);
 			}
 
-			virtual void truncate()
+			virtual fsize_t size() const
 			{
-#if SET_FILE_OP_TIMES
-				m_atime = m_mtime = time_point::now();
-#endif
-				m_source->seekbeg(m_offset);
-				if (m_cache.region.end <= m_offset) {
-					// Truncation does not affect cache.
-				}
-				else if (m_cache.region.start <= m_offset) {
-					// Truncation truncates cache.
-					m_cache.region.end = m_offset;
-				}
-				else {
-					// Truncation invalidates cache.
-					m_cache.status = cache_t::cache_t::status_t::empty;
-				}
-				m_source->truncate();
-				m_state = m_source->state();
+				fsize_t size = m_source.size();
+				return size > m_region.start ? std::min(size, m_region.end) - m_region.start : 0;
 			}
 
-			virtual time_point ctime() const
+			virtual void truncate()
 			{
-				return m_source->ctime();
+				m_state = state_t::fail;
 			}
 
-			virtual time_point atime() const
-			{
-#if SET_FILE_OP_TIMES
-				return std::max(m_atime, m_source->atime());
-#else
-				return m_source->atime();
-#endif
-			}
+		protected:
+			basic_file& m_source;
+			fpos_t m_offset;
+			interval<fpos_t> m_region;
+		};
 
-			virtual time_point mtime() const
+		constexpr size_t latency_buckets = 40; ///< Number of latency histogram buckets
+
+		///
+		/// Statistics of one stream operation type
+		///
+		struct op_stats_t {
+			uint64_t count;    ///< Number of operations
+			uint64_t bytes;    ///< Number of bytes transferred
+			uint64_t duration; ///< Total duration in nanoseconds
+
+			///
+			/// Latency histogram
+			///
+			/// Bucket i counts operations taking [2^i, 2^(i+1)) ns. The first bucket also counts operations under 1 ns
+			/// and the last bucket all operations taking longer.
+			///
+			uint64_t latency[latency_buckets];
+		};
+
+		///
+		/// Stream statistics
+		///
+		struct stats_t {
+			op_stats_t read;  ///< Reads
+			op_stats_t write; ///< Writes
+			op_stats_t seek;  ///< Seeks
+			op_stats_t flush; ///< Flushes
+		};
+
+		/// \cond internal
+		class op_counter
+		{
+		public:
+			op_counter() noexcept { reset(); }
+
+			void record(_In_ uint64_t bytes, _In_ std::chrono::steady_clock::duration duration) noexcept
 			{
-#if SET_FILE_OP_TIMES
-				return std::max(m_mtime, m_source->mtime());
-#else
-				return m_source->mtime();
-#endif
+				auto ns = static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0));
+				m_count.fetch_add(1, std::memory_order_relaxed);
+				m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+				m_duration.fetch_add(ns, std::memory_order_relaxed);
+				m_latency[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
 			}
 
-			virtual void set_ctime(time_point date)
+			void snapshot(_Out_ op_stats_t& stats) const noexcept
 			{
-				m_source->set_ctime(date);
+				stats.count = m_count.load(std::memory_order_relaxed);
+				stats.bytes = m_bytes.load(std::memory_order_relaxed);
+				stats.duration = m_duration.load(std::memory_order_relaxed);
+				for (size_t i = 0; i < latency_buckets; ++i)
+					stats.latency[i] = m_latency[i].load(std::memory_order_relaxed);
 			}
 
-			virtual void set_atime(time_point date)
+			void reset() noexcept
 			{
-#if SET_FILE_OP_TIMES
-				m_atime = date;
-#endif
-				m_source->set_atime(date);
+				m_count.store(0, std::memory_order_relaxed);
+				m_bytes.store(0, std::memory_order_relaxed);
+				m_duration.store(0, std::memory_order_relaxed);
+				for (size_t i = 0; i < latency_buckets; ++i)
+					m_latency[i].store(0, std::memory_order_relaxed);
 			}
 
-			virtual void set_mtime(time_point date)
+		protected:
+			static size_t bucket(_In_ uint64_t ns) noexcept
 			{
-#if SET_FILE_OP_TIMES
-				m_mtime = date;
+				if (!ns)
+					return 0;
+#if defined(__GNUC__)
+				return std::min<size_t>(63 - __builtin_clzll(ns), latency_buckets - 1);
+#else
+				size_t i = 0;
+				for (; ns >>= 1; ++i)
+					if (i == latency_buckets - 1)
+						break;
+				return i;
 #endif
-				m_source->set_mtime(date);
 			}
 
 		protected:
-			/// \cond internal
-			void flush_cache()
+			std::atomic<uint64_t> m_count, m_bytes, m_duration;
+			std::atomic<uint64_t> m_latency[latency_buckets];
+		};
+
+		class stats_collector
+		{
+		public:
+			stats_collector() :
+				m_acquire_read(0),
+				m_acquire_write(0)
+			{}
+
+			///
+			/// Returns snapshot of operation statistics
+			///
+			/// Safe to call while the stream is used from another thread. Individual counters are consistent, but
+			/// may be off by operations in progress relative to each other.
+			///
+			stats_t stats() const
 			{
-				if (m_cache.status != cache_t::cache_t::status_t::dirty)
-					m_state = state_t::ok;
-				else if (!m_cache.region.empty()) {
-					write_cache();
-					if (ok())
-						m_cache.status = cache_t::cache_t::status_t::loaded;
-				}
-				else {
-					m_state = state_t::ok;
-					m_cache.status = cache_t::cache_t::status_t::loaded;
-				}
+				stats_t stats;
+				m_read.snapshot(stats.read);
+				m_write.snapshot(stats.write);
+				m_seek.snapshot(stats.seek);
+				m_flush.snapshot(stats.flush);
+				return stats;
 			}
 
-			void invalidate_cache()
-			{
-				if (m_cache.status == cache_t::cache_t::status_t::dirty && !m_cache.region.empty()) {
-					write_cache();
-					if (!ok()) _Unlikely_
-						return;
-				} else
-					m_state = state_t::ok;
-				m_cache.status = cache_t::cache_t::status_t::empty;
-			}
-
-			void load_cache(_In_ fpos_t start)
-			{
-				stdex_assert(m_cache.status != cache_t::cache_t::status_t::dirty);
-				start -= start % m_cache.capacity; // Align to cache block size.
-				m_source->seekbeg(m_cache.region.start = start);
-				if (m_source->ok()) {
-					m_cache.region.end = start + m_source->read(m_cache.data, m_cache.capacity);
-					m_cache.status = cache_t::cache_t::status_t::loaded;
-					m_state = state_t::ok; // Regardless the read failure, we still might have cached some data.
-				}
-				else
-					m_state = state_t::fail;
-			}
-
-			void write_cache()
+			///
+			/// Resets operation statistics
+			///
+			void reset_stats()
 			{
-				stdex_assert(m_cache.status == cache_t::cache_t::status_t::dirty);
-				m_source->seekbeg(m_cache.region.start);
-				m_source->write(m_cache.data, static_cast<size_t>(m_cache.region.size()));
-				m_state = m_source->state();
+				m_read.reset();
+				m_write.reset();
+				m_seek.reset();
+				m_flush.reset();
 			}
 
-			basic_file* m_source;
-			struct cache_t {
-				uint8_t* data;
-				size_t capacity;
-				enum class status_t {
-					empty = 0,
-					loaded,
-					dirty,
-				} status;
-				interval<fpos_t> region; ///< valid data region
-
-				cache_t(_In_ size_t _capacity) :
-					data(new uint8_t[_capacity]),
-					capacity(_capacity),
-					status(status_t::empty),
-					region(0)
-				{}
-
-				~cache_t()
-				{
-					delete[] data;
-				}
-			} m_cache;
-			fpos_t m_offset; ///< Logical absolute file position
-#if SET_FILE_OP_TIMES
-			time_point
-				m_atime,
-				m_mtime;
-#endif
-			/// \endcond
+		protected:
+			op_counter m_read, m_write, m_seek, m_flush;
+			std::chrono::steady_clock::duration m_acquire_read, m_acquire_write; ///< Durations of acquire_read() and acquire_write() pending release
 		};
+		/// \endcond
 
 		///
-		/// OS data stream (file, pipe, socket...)
+		/// Records operation counts, bytes transferred and latency histograms of a stream
 		///
-		class basic_sys : virtual public basic, public sys_object
+		/// Insert it between layers of a stream stack to see which layer costs the time. Borrowing and OS handle are
+		/// passed through, so the stack takes the same code paths as without it. Borrowed data is recorded on release.
+		/// Data the OS copies between handles directly is not recorded.
+		///
+		class instrument : public converter, public stats_collector
 		{
 		public:
-			basic_sys(_In_opt_ sys_handle h = invalid_handle, _In_ state_t state = state_t::ok) :
-				basic(state),
-				sys_object(h)
-			{}
+			instrument(_Inout_ basic& source) : converter(source) {}
 
 			virtual _Success_(return != 0 || length == 0) size_t read(
 				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
 			{
-				stdex_assert(data || !length);
-				// Windows Server 2003 and Windows XP:  Pipe write operations across a network are limited in size per write.
-				// The amount varies per platform. For x86 platforms it's 63.97 MB. For x64 platforms it's 31.97 MB. For Itanium
-				// it's 63.95 MB. For more information regarding pipes, see the Remarks section.
-				size_t
-#if defined(_WIN64)
-					block_size = 0x1F80000;
-#elif defined(_WIN32)
-					block_size = 0x3f00000;
-#else
-					block_size = SSIZE_MAX;
-#endif
-				for (size_t to_read = length;;) {
-#ifdef _WIN32
-					// ReadFile() might raise exception (e.g. STATUS_FILE_BAD_FORMAT/0xE0000002).
-					BOOL succeeded;
-					DWORD num_read;
-					__try { succeeded = ReadFile(m_h, data, static_cast<DWORD>(std::min<size_t>(to_read, block_size)), &num_read, nullptr); }
-					__except (EXCEPTION_EXECUTE_HANDLER) { succeeded = FALSE; SetLastError(ERROR_UNHANDLED_EXCEPTION); num_read = 0; }
-					if (!succeeded && GetLastError() == ERROR_NO_SYSTEM_RESOURCES && block_size > default_block_size) _Unlikely_ {
-						// Error "Insufficient system resources exist to complete the requested service." occurs
-						// occasionally, when attempting to read too much data at once (e.g. over \\TSClient).
-						block_size = default_block_size;
-						continue;
-					}
-					if (!succeeded) _Unlikely_
-#else
-					auto num_read = ::read(m_h, data, std::min<size_t>(to_read, block_size));
-					if (num_read < 0) _Unlikely_
-#endif
-					{
-						m_state = to_read < length ? state_t::ok : state_t::fail;
-						return length - to_read;
-					}
-					if (!num_read) _Unlikely_ {
-						m_state = to_read < length || !length ? state_t::ok : state_t::eof;
-						return length - to_read;
-					}
-					to_read -= static_cast<size_t>(num_read);
-					if (!to_read) {
-						m_state = state_t::ok;
-						return length;
-					}
-					reinterpret_cast<uint8_t*&>(data) += num_read;
-				}
+				auto start = std::chrono::steady_clock::now();
+				size_t num_read = m_source->read(data, length);
+				m_read.record(num_read, std::chrono::steady_clock::now() - start);
+				m_state = m_source->state();
+				return num_read;
 			}
 
 			virtual _Success_(return != 0) size_t write(
 				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
 			{
-				// Windows Server 2003 and Windows XP:  Pipe write operations across a network are limited in size per write.
-				// The amount varies per platform. For x86 platforms it's 63.97 MB. For x64 platforms it's 31.97 MB. For Itanium
-				// it's 63.95 MB. For more information regarding pipes, see the Remarks section.
-				constexpr size_t
-#if defined(_WIN64)
-					block_size = 0x1F80000;
-#elif defined(_WIN32)
-					block_size = 0x3f00000;
-#else
-					block_size = SSIZE_MAX;
-#endif
-				for (size_t to_write = length;;) {
-#ifdef _WIN32
-					// ReadFile() might raise an exception. Be cautious with WriteFile() too.
-					BOOL succeeded;
-					DWORD num_written;
-					__try { succeeded = WriteFile(m_h, data, static_cast<DWORD>(std::min<size_t>(to_write, block_size)), &num_written, nullptr); }
-					__except (EXCEPTION_EXECUTE_HANDLER) { succeeded = FALSE; SetLastError(ERROR_UNHANDLED_EXCEPTION); num_written = 0; }
-					to_write -= num_written;
-					if (!to_write) {
-						m_state = state_t::ok;
-						return length;
-					}
-					reinterpret_cast<const uint8_t*&>(data) += num_written;
-					if (!succeeded) _Unlikely_ {
-						m_state = state_t::fail;
-						return length - to_write;
-					}
-#else
-					auto num_written = ::write(m_h, data, std::min<size_t>(to_write, block_size));
-					if (num_written < 0) _Unlikely_ {
-						m_state = state_t::fail;
-						return length - to_write;
-					}
-					to_write -= static_cast<size_t>(num_written);
-					if (!to_write) {
-						m_state = state_t::ok;
-						return length;
-					}
-					reinterpret_cast<const uint8_t*&>(data) += num_written;
-#endif
-				}
+				auto start = std::chrono::steady_clock::now();
+				size_t num_written = m_source->write(data, length);
+				m_write.record(num_written, std::chrono::steady_clock::now() - start);
+				m_state = m_source->state();
+				return num_written;
 			}
 
-			virtual void close()
+			virtual size_t readv(_In_reads_(count) const segment_t* segments, _In_ size_t count)
 			{
-				try {
-					sys_object::close();
-					m_state = state_t::ok;
-				}
-				catch (...) {
-					m_state = state_t::fail;
-				}
+				auto start = std::chrono::steady_clock::now();
+				size_t num_read = m_source->readv(segments, count);
+				m_read.record(num_read, std::chrono::steady_clock::now() - start);
+				m_state = m_source->state();
+				return num_read;
 			}
 
-			virtual void flush()
+			virtual size_t writev(_In_reads_(count) const segment_t* segments, _In_ size_t count)
 			{
-#ifdef _WIN32
-				m_state = FlushFileBuffers(m_h) ? state_t::ok : state_t::fail;
-#else
-				m_state = fsync(m_h) >= 0 ? state_t::ok : state_t::fail;
-#endif
+				auto start = std::chrono::steady_clock::now();
+				size_t num_written = m_source->writev(segments, count);
+				m_write.record(num_written, std::chrono::steady_clock::now() - start);
+				m_state = m_source->state();
+				return num_written;
 			}
-		};
 
-		///
-		/// Buffered OS data stream (file, pipe, socket...)
-		///
-		class buffered_sys : public buffer
-		{
-		public:
-			buffered_sys(_In_opt_ sys_handle h = invalid_handle, size_t read_buffer_size = default_buffer_size, size_t write_buffer_size = default_buffer_size) :
-				buffer(read_buffer_size, write_buffer_size),
-				m_source(h)
+			virtual std::tuple<const uint8_t*, size_t> acquire_read(_In_ size_t length)
 			{
-				init(m_source);
+				auto start = std::chrono::steady_clock::now();
+				auto result = m_source->acquire_read(length);
+				m_acquire_read = std::chrono::steady_clock::now() - start;
+				m_state = m_source->state();
+				return result;
 			}
 
-			virtual ~buffered_sys()
+			virtual void release_read(_In_ size_t length)
 			{
-				done();
+				auto start = std::chrono::steady_clock::now();
+				m_source->release_read(length);
+				m_read.record(length, m_acquire_read + (std::chrono::steady_clock::now() - start));
+				m_state = m_source->state();
 			}
 
-		protected:
-			basic_sys m_source;
+			virtual bool can_borrow_ahead() const
+			{
+				return m_source->can_borrow_ahead();
+			}
+
+			virtual std::tuple<uint8_t*, size_t> acquire_write(_In_ size_t length)
+			{
+				auto start = std::chrono::steady_clock::now();
+				auto result = m_source->acquire_write(length);
+				m_acquire_write = std::chrono::steady_clock::now() - start;
+				m_state = m_source->state();
+				return result;
+			}
+
+			virtual void release_write(_In_ size_t length)
+			{
+				auto start = std::chrono::steady_clock::now();
+				m_source->release_write(length);
+				m_write.record(length, m_acquire_write + (std::chrono::steady_clock::now() - start));
+				m_state = m_source->state();
+			}
+
+			virtual void flush()
+			{
+				auto start = std::chrono::steady_clock::now();
+				m_source->flush();
+				m_flush.record(0, std::chrono::steady_clock::now() - start);
+				m_state = m_source->state();
+			}
+
+			virtual sys_handle os_handle() const
+			{
+				return m_source->os_handle();
+			}
 		};
 
 		///
-		/// Socket stream
+		/// Records operation counts, bytes transferred and latency histograms of a file
 		///
-		class socket : public basic
+		/// See instrument for details.
+		///
+		class instrument_file : public basic_file, public stats_collector
 		{
 		public:
-			socket(_In_opt_ socket_t h = stdex::invalid_socket, _In_ state_t state = state_t::ok) :
-				basic(state),
-				m_h(h)
+			instrument_file(_Inout_ basic_file& source) :
+				basic(source.state()),
+				m_source(source)
 			{}
 
-		private:
-			socket(_In_ const socket& other);
-			socket& operator =(_In_ const socket& other);
+			virtual _Success_(return != 0 || length == 0) size_t read(
+				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				auto start = std::chrono::steady_clock::now();
+				size_t num_read = m_source.read(data, length);
+				m_read.record(num_read, std::chrono::steady_clock::now() - start);
+				m_state = m_source.state();
+				return num_read;
+			}
 
-		public:
-			socket(_Inout_ socket&& other) noexcept : m_h(other.m_h)
+			virtual _Success_(return != 0) size_t write(
+				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
 			{
-				other.m_h = stdex::invalid_socket;
+				auto start = std::chrono::steady_clock::now();
+				size_t num_written = m_source.write(data, length);
+				m_write.record(num_written, std::chrono::steady_clock::now() - start);
+				m_state = m_source.state();
+				return num_written;
 			}
 
-			socket& operator =(_Inout_ socket&& other) noexcept
+			virtual size_t readv(_In_reads_(count) const segment_t* segments, _In_ size_t count)
 			{
-				if (this != std::addressof(other)) {
-					if (m_h != stdex::invalid_socket)
-						closesocket(m_h);
-					m_h = other.m_h;
-					other.m_h = stdex::invalid_socket;
-				}
-				return *this;
+				auto start = std::chrono::steady_clock::now();
+				size_t num_read = m_source.readv(segments, count);
+				m_read.record(num_read, std::chrono::steady_clock::now() - start);
+				m_state = m_source.state();
+				return num_read;
 			}
 
-			///
-			/// Creates a socket
-			///
-			/// \param[in] af        Address family
-			/// \param[in] type      Socket type
-			/// \param[in] protocol  Socket protocol
-			///
-			socket(_In_ int af, _In_ int type, _In_ int protocol)
+			virtual size_t writev(_In_reads_(count) const segment_t* segments, _In_ size_t count)
 			{
-				m_h = ::socket(af, type, protocol);
-				if (m_h == stdex::invalid_socket) _Unlikely_
-					m_state = state_t::fail;
+				auto start = std::chrono::steady_clock::now();
+				size_t num_written = m_source.writev(segments, count);
+				m_write.record(num_written, std::chrono::steady_clock::now() - start);
+				m_state = m_source.state();
+				return num_written;
 			}
 
-			virtual ~socket()
+			virtual std::tuple<const uint8_t*, size_t> acquire_read(_In_ size_t length)
 			{
-				if (m_h != stdex::invalid_socket)
-					closesocket(m_h);
+				auto start = std::chrono::steady_clock::now();
+				auto result = m_source.acquire_read(length);
+				m_acquire_read = std::chrono::steady_clock::now() - start;
+				m_state = m_source.state();
+				return result;
 			}
 
-			///
-			/// Returns true if socket handle is valid
-			///
-			operator bool() const noexcept { return m_h != stdex::invalid_socket; }
+			virtual void release_read(_In_ size_t length)
+			{
+				auto start = std::chrono::steady_clock::now();
+				m_source.release_read(length);
+				m_read.record(length, m_acquire_read + (std::chrono::steady_clock::now() - start));
+				m_state = m_source.state();
+			}
 
-			///
-			/// Returns socket handle
-			///
-			socket_t get() const noexcept { return m_h; }
+			virtual bool can_borrow_ahead() const
+			{
+				return m_source.can_borrow_ahead();
+			}
 
-			virtual _Success_(return != 0 || length == 0) size_t read(
-				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			virtual std::tuple<uint8_t*, size_t> acquire_write(_In_ size_t length)
 			{
-				stdex_assert(data || !length);
-				constexpr int block_size = 0x10000000;
-				for (size_t to_read = length;;) {
-					auto num_read = recv(m_h, reinterpret_cast<char*>(data),
-#ifdef _WIN32
-						static_cast<int>(std::min<size_t>(to_read, block_size)),
-#else
-						std::min<size_t>(to_read, block_size),
-#endif
-						0);
-					if (num_read < 0) _Unlikely_ {
-						m_state = to_read < length ? state_t::ok : state_t::fail;
-						return length - to_read;
-					}
-					if (!num_read) {
-						m_state = to_read < length || !length ? state_t::ok : state_t::eof;
-						return length - to_read;
-					}
-					to_read -= static_cast<size_t>(num_read);
-					if (!to_read) {
-						m_state = state_t::ok;
-						return length;
-					}
-					reinterpret_cast<uint8_t*&>(data) += num_read;
-				}
+				auto start = std::chrono::steady_clock::now();
+				auto result = m_source.acquire_write(length);
+				m_acquire_write = std::chrono::steady_clock::now() - start;
+				m_state = m_source.state();
+				return result;
 			}
 
-			virtual _Success_(return != 0) size_t write(
-				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			virtual void release_write(_In_ size_t length)
 			{
-				stdex_assert(data || !length);
-				constexpr int block_size = 0x10000000;
-				for (size_t to_write = length;;) {
-					auto num_written = send(m_h, reinterpret_cast<const char*>(data),
-#ifdef _WIN32
-						static_cast<int>(std::min<size_t>(to_write, block_size)),
-#else
-						std::min<size_t>(to_write, block_size),
-#endif
-						0);
-					if (num_written < 0) _Unlikely_ {
-						m_state = state_t::fail;
-						return length - to_write;
-					}
-					to_write -= static_cast<size_t>(num_written);
-					if (!to_write) {
-						m_state = state_t::ok;
-						return length;
-					}
-					reinterpret_cast<const uint8_t*&>(data) += num_written;
-				}
+				auto start = std::chrono::steady_clock::now();
+				m_source.release_write(length);
+				m_write.record(length, m_acquire_write + (std::chrono::steady_clock::now() - start));
+				m_state = m_source.state();
+			}
+
+			virtual _Success_(return != 0 || length == 0) size_t read_at(
+				_In_ fpos_t offset, _Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				auto start = std::chrono::steady_clock::now();
+				size_t num_read = m_source.read_at(offset, data, length);
+				m_read.record(num_read, std::chrono::steady_clock::now() - start);
+				return num_read;
+			}
+
+			virtual _Success_(return != 0) size_t write_at(
+				_In_ fpos_t offset, _In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			{
+				auto start = std::chrono::steady_clock::now();
+				size_t num_written = m_source.write_at(offset, data, length);
+				m_write.record(num_written, std::chrono::steady_clock::now() - start);
+				return num_written;
 			}
 
 			virtual void close()
 			{
-				if (m_h != stdex::invalid_socket) {
-					closesocket(m_h);
-					m_h = stdex::invalid_socket;
-				}
-				m_state = state_t::ok;
+				m_source.close();
+				m_state = m_source.state();
 			}
 
-		protected:
-			socket_t m_h;
-		};
+			virtual void flush()
+			{
+				auto start = std::chrono::steady_clock::now();
+				m_source.flush();
+				m_flush.record(0, std::chrono::steady_clock::now() - start);
+				m_state = m_source.state();
+			}
 
-#ifdef _WIN32
-		///
-		/// Wrapper for ISequentialStream
-		///
-		class sequential_stream : public basic
-		{
-		public:
-			sequential_stream(_In_ ISequentialStream* source) : m_source(source)
+			virtual sys_handle os_handle() const
 			{
-				m_source->AddRef();
+				return m_source.os_handle();
 			}
 
-			virtual ~sequential_stream()
+			virtual fpos_t seek(_In_ foff_t offset, _In_ seek_t how = seek_t::beg)
 			{
-				m_source->Release();
+				auto start = std::chrono::steady_clock::now();
+				fpos_t result = m_source.seek(offset, how);
+				m_seek.record(0, std::chrono::steady_clock::now() - start);
+				m_state = m_source.state();
+				return result;
 			}
 
-			virtual _Success_(return != 0 || length == 0) size_t read(
-				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			virtual fpos_t tell() const
 			{
-				stdex_assert(data || !length);
-				for (size_t to_read = length;;) {
-					HRESULT hr;
-					ULONG num_read = 0;
-					__try { hr = m_source->Read(data, (ULONG)std::min<size_t>(to_read, ULONG_MAX), &num_read); }
-					__except (EXCEPTION_EXECUTE_HANDLER) { hr = E_FAIL; }
-					if (FAILED(hr)) _Unlikely_ {
-						m_state = to_read < length ? state_t::ok : state_t::fail;
-						return length - to_read;
-					}
-					to_read -= num_read;
-					if (hr == S_FALSE) _Unlikely_ {
-						m_state = to_read < length || !length ? state_t::ok : state_t::eof;
-						return length - to_read;
-					}
-					if (!to_read) {
-						m_state = state_t::ok;
-						return length;
-					}
-					reinterpret_cast<uint8_t*&>(data) += num_read;
-				}
+				return m_source.tell();
 			}
 
-			virtual _Success_(return != 0) size_t write(
-				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			virtual void lock(_In_ fpos_t offset, _In_ fsize_t length)
 			{
-				stdex_assert(data || !length);
-				for (size_t to_write = length;;) {
-					HRESULT hr;
-					ULONG num_written = 0;
-					__try { hr = m_source->Write(data, static_cast<ULONG>(std::min<size_t>(to_write, ULONG_MAX)), &num_written); }
-					__except (EXCEPTION_EXECUTE_HANDLER) { hr = E_FAIL; }
-					// In absence of documentation whether num_written gets set when FAILED(hr) (i.e. partially successful writes),
-					// assume write failed completely.
-					if (FAILED(hr)) _Unlikely_ {
-						m_state = state_t::fail;
-						return length - to_write;
-					}
-					to_write -= num_written;
-					if (!to_write) {
-						m_state = state_t::ok;
-						return length;
-					}
-					reinterpret_cast<const uint8_t*&>(data) += num_written;
-				}
+				m_source.lock(offset, length);
+				m_state = m_source.state();
 			}
 
-		protected:
-			ISequentialStream* m_source;
-		};
+			virtual void unlock(_In_ fpos_t offset, _In_ fsize_t length)
+			{
+				m_source.unlock(offset, length);
+				m_state = m_source.state();
+			}
 
-		///
-		/// Wrapper for IIS ASP IRequest and IResponse
-		///
-		class asp : public basic
-		{
-		public:
-			asp(_In_opt_ IRequest* request, _In_opt_ IResponse* response) :
-				m_request(request),
-				m_response(response)
+			virtual void hint(_In_ fpos_t offset, _In_ fsize_t length, _In_ access_t access)
 			{
-				if (m_request)
-					m_request->AddRef();
-				if (m_response)
-					m_response->AddRef();
+				m_source.hint(offset, length, access);
 			}
 
-			virtual ~asp()
+			virtual fsize_t size() const
 			{
-				if (m_request)
-					m_request->Release();
-				if (m_response)
-					m_response->Release();
+				return m_source.size();
 			}
 
-			virtual _Success_(return != 0 || length == 0) size_t read(
-				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			virtual void truncate()
 			{
-				stdex_assert(data || !length);
-				if (!m_request) _Unlikely_ {
-					m_state = state_t::fail;
-					return 0;
-				}
-				for (size_t to_read = length;;) {
-					VARIANT var_amount, var_data;
-					V_VT(&var_amount) = VT_I4;
-					V_I4(&var_amount) = (LONG)std::min<size_t>(to_read, LONG_MAX);
-					V_VT(&var_data) = VT_EMPTY;
-					HRESULT hr = [&]() {
-						__try { return m_request->BinaryRead(&var_amount, &var_data); }
-						__except (EXCEPTION_EXECUTE_HANDLER) { return E_FAIL; }
-					}();
-					if (FAILED(hr)) _Unlikely_ {
-						m_state = to_read < length ? state_t::ok : state_t::fail;
-						return length - to_read;
-					}
-					stdex_assert(V_VT(&var_amount) == VT_I4);
-					stdex_assert(V_VT(&var_data) == (VT_ARRAY | VT_UI1));
-					std::unique_ptr<SAFEARRAY, SafeArrayDestroy_delete> sa(V_ARRAY(&var_data));
-					if (!V_I4(&var_amount)) _Unlikely_ {
-						m_state = to_read < length || !length ? state_t::ok : state_t::eof;
-						return length - to_read;
-					}
-					safearray_accessor<uint8_t> a(sa.get());
-					memcpy(data, a.data(), V_I4(&var_amount));
-					to_read -= V_I4(&var_amount);
-					if (!to_read) {
-						m_state = state_t::ok;
-						return length;
-					}
-					reinterpret_cast<uint8_t*&>(data) += V_I4(&var_amount);
-				}
+				m_source.truncate();
+				m_state = m_source.state();
 			}
 
-			virtual _Success_(return != 0) size_t write(
-				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			virtual time_point ctime() const
 			{
-				if (!m_response) {
-					m_state = state_t::fail;
-					return 0;
-				}
-				for (size_t to_write = length;;) {
-					UINT num_written = static_cast<UINT>(std::min<size_t>(to_write, UINT_MAX));
-					std::unique_ptr<OLECHAR, SysFreeString_delete> bstr_data(SysAllocStringByteLen(reinterpret_cast<LPCSTR>(data), num_written));
-					VARIANT var_data;
-					V_VT(&var_data) = VT_BSTR;
-					V_BSTR(&var_data) = bstr_data.get();
-					HRESULT hr = [&]() {
-						__try { return m_response->BinaryWrite(var_data); }
-						__except (EXCEPTION_EXECUTE_HANDLER) { return E_FAIL; }
-					}();
-					if (FAILED(hr)) _Unlikely_ {
-						m_state = state_t::fail;
-						return length - to_write;
-					}
-					to_write -= num_written;
-					if (!to_write) {
-						m_state = state_t::ok;
-						return length;
-					}
-					reinterpret_cast<const uint8_t*&>(data) += num_written;
-				}
+				return m_source.ctime();
 			}
 
-			virtual void close()
+			virtual time_point atime() const
 			{
-				if (m_response) {
-					__try { m_response->End(); }
-					__except (EXCEPTION_EXECUTE_HANDLER) {}
-				}
-				m_state = state_t::ok;
+				return m_source.atime();
 			}
 
-			virtual void flush()
+			virtual time_point mtime() const
 			{
-				if (m_response) {
-					HRESULT hr;
-					__try { hr = m_response->Flush(); }
-					__except (EXCEPTION_EXECUTE_HANDLER) { hr = E_FAIL; }
-					m_state = SUCCEEDED(hr) ? state_t::ok : state_t::fail;
-				}
+				return m_source.mtime();
 			}
 
-		protected:
-			IRequest* m_request;
-			IResponse* m_response;
-		};
-#endif
+			virtual void set_ctime(time_point date)
+			{
+				m_source.set_ctime(date);
+			}
 
-		///
+			virtual void set_atime(time_point date)
+			{
+				m_source.set_atime(date);
+			}
+
+			virtual void set_mtime(time_point date)
+			{
+				m_source.set_mtime(date);
+			}
+
+		protected:
+			basic_file& m_source;
+		};
+
+		constexpr size_t default_cache_size = 0x1000; ///< Default cache block size
+		constexpr size_t default_cache_count = 1; ///< Default number of cache blocks
+
+		///
+		/// Cached file
+		///
+		/// Keeps up to a given number of file blocks in memory. When all blocks are in use, the least recently used block
+		/// is written back (when dirty) and reused. Use more than one block when accessing multiple file regions
+		/// alternately.
+		///
+		class cache : public basic_file
+		{
+		protected:
+			/// \cond internal
+#pragma warning(suppress: 26495) // The delayed init call will finish initializing the class.
+			explicit cache(_In_ size_t cache_size = default_cache_size, _In_ size_t cache_count = default_cache_count) :
+				basic(state_t::fail),
+				m_cache_capacity(cache_size),
+				m_cache_data(new uint8_t[mul(cache_size, cache_count)]),
+				m_cache(cache_count),
+				m_cache_mru(nullptr),
+				m_cache_tick(0),
+				m_access(access_t::normal)
+			{
+				init_cache();
+			}
+
+			void init(_Inout_ basic_file& source)
+			{
+				m_source = &source;
+				init();
+			}
+
+			void init()
+			{
+				m_state = m_source->state();
+				m_offset = m_source->tell();
+#if SET_FILE_OP_TIMES
+				m_atime = m_source->atime();
+				m_mtime = m_source->mtime();
+#endif
+			}
+
+			void done()
+			{
+				if (m_source) {
+					flush_cache();
+					if (!ok()) _Unlikely_
+						throw std::system_error(sys_error(), std::system_category(), "failed to flush cache"); // Data loss occurred
+					m_source->seekbeg(m_offset);
+#if SET_FILE_OP_TIMES
+					m_source->set_atime(m_atime);
+					m_source->set_mtime(m_mtime);
+#endif
+					m_source = nullptr;
+				}
+			}
+			/// \endcond
+
+		public:
+			///
+			/// Creates a cache on top of a file
+			///
+			/// \param[in] source       Source file
+			/// \param[in] cache_size   Size of the cache block
+			/// \param[in] cache_count  Number of cache blocks
+			///
+			cache(_Inout_ basic_file& source, _In_ size_t cache_size = default_cache_size, _In_ size_t cache_count = default_cache_count) :
+				basic(source.state()),
+				m_source(&source),
+				m_cache_capacity(cache_size),
+				m_cache_data(new uint8_t[mul(cache_size, cache_count)]),
+				m_cache(cache_count),
+				m_cache_mru(nullptr),
+				m_cache_tick(0),
+				m_access(access_t::normal),
+				m_offset(source.tell())
+#if SET_FILE_OP_TIMES
+				, m_atime(source.atime())
+				, m_mtime(source.mtime())
+#endif
+			{
+				init_cache();
+			}
+
+			virtual ~cache() noexcept(false)
+			{
+				if (m_source) {
+					flush_cache();
+					if (!ok()) _Unlikely_
+						throw std::system_error(sys_error(), std::system_category(), "failed to flush cache"); // Data loss occurred
+					m_source->seekbeg(m_offset);
+#if SET_FILE_OP_TIMES
+					m_source->set_atime(m_atime);
+					m_source->set_mtime(m_mtime);
+#endif
+				}
+			}
+
+			virtual _Success_(return != 0 || length == 0) size_t read(
+				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+#if SET_FILE_OP_TIMES
+				m_atime = time_point::now();
+#endif
+				for (size_t to_read = length;;) {
+					cache_t* c = find_cache(m_offset);
+					if (!c) {
+						fpos_t end_max = m_offset + to_read;
+						if (m_offset / m_cache_capacity < end_max / m_cache_capacity) {
+							// Read spans multiple cache blocks. Bypass cache to the last block.
+							size_t num_bypass = to_read - static_cast<size_t>(end_max % m_cache_capacity);
+							flush_cache(interval<fpos_t>(m_offset, m_offset + num_bypass));
+							if (ok())
+								m_source->seekbeg(m_offset);
+							if (!ok() || !m_source->ok()) _Unlikely_ {
+								m_state = to_read < length ? state_t::ok : state_t::fail;
+								return length - to_read;
+							}
+							size_t num_read = m_source->read(data, num_bypass);
+							m_offset += num_read;
+							to_read -= num_read;
+							if (!to_read) {
+								m_state = state_t::ok;
+								return length;
+							}
+							reinterpret_cast<uint8_t*&>(data) += num_read;
+							m_state = m_source->state();
+							if (!ok()) {
+								if (to_read < length)
+									m_state = state_t::ok;
+								return length - to_read;
+							}
+							continue;
+						}
+						c = load_cache(m_offset);
+						if (!c) _Unlikely_ {
+							m_state = to_read < length ? state_t::ok : state_t::fail;
+							return length - to_read;
+						}
+					}
+					if (!c->region.contains(m_offset) && !reload_cache(*c)) _Unlikely_ {
+						if (to_read < length)
+							m_state = state_t::ok;
+						return length - to_read;
+					}
+					size_t remaining_cache = static_cast<size_t>(c->region.end - m_offset);
+					if (to_read <= remaining_cache) {
+						memcpy(data, c->data + static_cast<size_t>(m_offset - c->region.start), to_read);
+						m_offset += to_read;
+						m_state = state_t::ok;
+						return length;
+					}
+					memcpy(data, c->data + static_cast<size_t>(m_offset - c->region.start), remaining_cache);
+					reinterpret_cast<uint8_t*&>(data) += remaining_cache;
+					to_read -= remaining_cache;
+					m_offset += remaining_cache;
+				}
+			}
+
+			virtual _Success_(return != 0) size_t write(
+				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+#if SET_FILE_OP_TIMES
+				m_atime = m_mtime = time_point::now();
+#endif
+				for (size_t to_write = length;;) {
+					cache_t* c = find_cache(m_offset);
+					if (!c) {
+						fpos_t end_max = m_offset + to_write;
+						if (m_offset / m_cache_capacity < end_max / m_cache_capacity) {
+							// Write spans multiple cache blocks. Bypass cache to the last block.
+							interval<fpos_t> bypass(m_offset, end_max - end_max % m_cache_capacity);
+							flush_cache(bypass);
+							if (ok())
+								m_source->seekbeg(m_offset);
+							if (!ok() || !m_source->ok()) _Unlikely_ {
+								m_state = state_t::fail;
+								return length - to_write;
+							}
+							size_t num_written = m_source->write(data, static_cast<size_t>(bypass.size()));
+							discard_cache(bypass);
+							m_offset += num_written;
+							m_state = m_source->state();
+							to_write -= num_written;
+							if (!to_write || !ok())
+								return length - to_write;
+							reinterpret_cast<const uint8_t*&>(data) += num_written;
+							continue;
+						}
+						c = load_cache(m_offset);
+						if (!c) _Unlikely_
+							return length - to_write;
+					}
+					fpos_t end_max = c->region.start + m_cache_capacity;
+					size_t num_written = static_cast<size_t>(std::min<fpos_t>(to_write, end_max - m_offset));
+					fill_cache(*c);
+					memcpy(c->data + static_cast<size_t>(m_offset - c->region.start), data, num_written);
+					mark_dirty(*c, interval<fpos_t>(m_offset, m_offset + num_written));
+					m_offset += num_written;
+					to_write -= num_written;
+					if (!to_write) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<const uint8_t*&>(data) += num_written;
+				}
+			}
+
+			virtual std::tuple<const uint8_t*, size_t> acquire_read(_In_ size_t length)
+			{
+#if SET_FILE_OP_TIMES
+				m_atime = time_point::now();
+#endif
+				cache_t* c = find_cache(m_offset);
+				if (!c) {
+					c = load_cache(m_offset);
+					if (!c) _Unlikely_ {
+						m_state = state_t::fail;
+						return { nullptr, 0 };
+					}
+				}
+				if (!c->region.contains(m_offset) && !reload_cache(*c)) _Unlikely_ {
+					if (!length)
+						m_state = state_t::ok;
+					return { nullptr, 0 };
+				}
+				m_state = state_t::ok;
+				return {
+					c->data + static_cast<size_t>(m_offset - c->region.start),
+					static_cast<size_t>(std::min<fpos_t>(length, c->region.end - m_offset)) };
+			}
+
+			virtual void release_read(_In_ size_t length)
+			{
+				m_offset += length;
+			}
+
+			virtual bool can_borrow_ahead() const
+			{
+				return true;
+			}
+
+			virtual std::tuple<uint8_t*, size_t> acquire_write(_In_ size_t length)
+			{
+				cache_t* c = find_cache(m_offset);
+				if (!c) {
+					c = load_cache(m_offset);
+					if (!c) _Unlikely_
+						return { nullptr, 0 };
+				}
+				fill_cache(*c);
+				m_state = state_t::ok;
+				return {
+					c->data + static_cast<size_t>(m_offset - c->region.start),
+					static_cast<size_t>(std::min<fpos_t>(length, c->region.start + m_cache_capacity - m_offset)) };
+			}
+
+			virtual void release_write(_In_ size_t length)
+			{
+#if SET_FILE_OP_TIMES
+				m_atime = m_mtime = time_point::now();
+#endif
+				if (!length)
+					return;
+				cache_t* c = find_cache(m_offset);
+				stdex_assert(c && m_offset + length <= c->region.start + m_cache_capacity);
+				mark_dirty(*c, interval<fpos_t>(m_offset, m_offset + length));
+				m_offset += length;
+			}
+
+			virtual void close()
+			{
+				invalidate_cache();
+				if (!ok()) _Unlikely_
+					throw std::system_error(sys_error(), std::system_category(), "failed to flush cache"); // Data loss occurred
+				m_source->close();
+				m_state = m_source->state();
+			}
+
+			virtual void flush()
+			{
+#if SET_FILE_OP_TIMES
+				m_atime = m_mtime = time_point::min();
+#endif
+				flush_cache();
+				if (!ok()) _Unlikely_
+					return;
+				m_source->flush();
+			}
+
+			virtual fpos_t seek(_In_ foff_t offset, _In_ seek_t how = seek_t::beg)
+			{
+				m_state = state_t::ok;
+				switch (how) {
+				case seek_t::beg:
+					break;
+				case seek_t::cur:
+					offset = static_cast<foff_t>(m_offset) + offset;
+					break;
+				case seek_t::end: {
+					auto n = size();
+					if (n == fsize_max) _Unlikely_{
+						m_state = state_t::fail;
+						return fpos_max;
+					}
+					offset = static_cast<foff_t>(n) + offset;
+					break;
+				}
+				default:
+					throw std::invalid_argument("unknown seek origin");
+				}
+				if (offset < 0) _Unlikely_
+					throw std::invalid_argument("negative file offset");
+				return m_offset = static_cast<fpos_t>(offset);
+			}
+
+			virtual fpos_t tell() const
+			{
+				return m_offset;
+			}
+
+			virtual void lock(_In_ fpos_t offset, _In_ fsize_t length)
+			{
+				m_source->lock(offset, length);
+				m_state = m_source->state();
+			}
+
+			virtual void unlock(_In_ fpos_t offset, _In_ fsize_t length)
+			{
+				m_source->unlock(offset, length);
+				m_state = m_source->state();
+			}
+
+			///
+			/// Declares intended access pattern of file section
+			///
+			/// The hint is passed on to the source. Sequential access makes the cache ask the source to read ahead on
+			/// every cache miss. Cache blocks of a section not needed are released unless they hold unwritten data.
+			///
+			/// \param[in] offset  Section start
+			/// \param[in] length  Section length. Use fsize_max for the remainder of file.
+			/// \param[in] access  Access pattern
+			///
+			virtual void hint(_In_ fpos_t offset, _In_ fsize_t length, _In_ access_t access)
+			{
+				switch (access) {
+				case access_t::normal:
+				case access_t::sequential:
+				case access_t::random:
+					m_access = access;
+					break;
+				case access_t::dont_need: {
+					fpos_t end = length < fpos_max - offset ? offset + length : fpos_max;
+					for (auto i = m_cache_index.lower_bound(offset); i != m_cache_index.end() && i->first < end;) {
+						if (i->second->status == cache_t::status_t::loaded && i->first + m_cache_capacity <= end) {
+							i->second->status = cache_t::status_t::empty;
+							if (m_cache_mru == i->second)
+								m_cache_mru = nullptr;
+							i = m_cache_index.erase(i);
+						}
+						else
+							++i;
+					}
+					break;
+				}
+				default:;
+				}
+				m_source->hint(offset, length, access);
+			}
+
+			virtual fsize_t size() const
+			{
+				fsize_t n = m_source->size();
+				for (auto& c : m_cache_index)
+					n = std::max(n, c.second->region.end);
+				return n;
+			}
+
+			virtual void truncate()
+			{
+#if SET_FILE_OP_TIMES
+				m_atime = m_mtime = time_point::now();
+#endif
+				m_source->seekbeg(m_offset);
+				for (auto i = m_cache_index.begin(); i != m_cache_index.end();) {
+					cache_t& c = *i->second;
+					if (c.region.end <= m_offset) {
+						// Truncation does not affect block.
+						++i;
+					}
+					else if (c.region.start <= m_offset) {
+						// Truncation truncates block.
+						c.region.end = m_offset;
+						if (c.status == cache_t::status_t::dirty && c.dirty.end > m_offset)
+							c.dirty.end = m_offset;
+						++i;
+					}
+					else {
+						// Truncation invalidates block.
+						c.status = cache_t::status_t::empty;
+						if (m_cache_mru == &c)
+							m_cache_mru = nullptr;
+						i = m_cache_index.erase(i);
+					}
+				}
+				m_source->truncate();
+				m_state = m_source->state();
+			}
+
+			virtual time_point ctime() const
+			{
+				return m_source->ctime();
+			}
+
+			virtual time_point atime() const
+			{
+#if SET_FILE_OP_TIMES
+				return std::max(m_atime, m_source->atime());
+#else
+				return m_source->atime();
+#endif
+			}
+
+			virtual time_point mtime() const
+			{
+#if SET_FILE_OP_TIMES
+				return std::max(m_mtime, m_source->mtime());
+#else
+				return m_source->mtime();
+#endif
+			}
+
+			virtual void set_ctime(time_point date)
+			{
+				m_source->set_ctime(date);
+			}
+
+			virtual void set_atime(time_point date)
+			{
+#if SET_FILE_OP_TIMES
+				m_atime = date;
+#endif
+				m_source->set_atime(date);
+			}
+
+			virtual void set_mtime(time_point date)
+			{
+#if SET_FILE_OP_TIMES
+				m_mtime = date;
+#endif
+				m_source->set_mtime(date);
+			}
+
+		protected:
+			/// \cond internal
+			struct cache_t {
+				uint8_t* data;
+				enum class status_t {
+					empty = 0,
+					loaded,
+					dirty,
+				} status;
+				interval<fpos_t> region; ///< valid data region
+				interval<fpos_t> dirty; ///< modified data region (when status is dirty)
+				uint64_t used; ///< time of last access for LRU replacement
+			};
+
+			void init_cache()
+			{
+				if (m_cache.empty()) _Unlikely_
+					throw std::invalid_argument("no cache blocks");
+				for (size_t i = 0, n = m_cache.size(); i < n; ++i) {
+					cache_t& c = m_cache[i];
+					c.data = m_cache_data.get() + i * m_cache_capacity;
+					c.status = cache_t::status_t::empty;
+					c.region = interval<fpos_t>(0);
+					c.used = 0;
+				}
+			}
+
+			cache_t* find_cache(_In_ fpos_t offset)
+			{
+				fpos_t start = offset - offset % m_cache_capacity;
+				cache_t* c;
+				if (m_cache_mru && m_cache_mru->region.start == start)
+					c = m_cache_mru;
+				else {
+					auto i = m_cache_index.find(start);
+					if (i == m_cache_index.end())
+						return nullptr;
+					m_cache_mru = c = i->second;
+				}
+				c->used = ++m_cache_tick;
+				return c;
+			}
+
+			void flush_cache()
+			{
+				flush_cache(interval<fpos_t>(0, fpos_max));
+			}
+
+			void flush_cache(_In_ const interval<fpos_t>& range)
+			{
+				// Blocks are indexed by their offset: write dirty blocks in file order and seek only when there is a gap.
+				fpos_t offset = fpos_max;
+				m_state = state_t::ok;
+				for (auto i = m_cache_index.lower_bound(range.start - range.start % m_cache_capacity), i_end = m_cache_index.end(); i != i_end && i->first < range.end; ++i) {
+					cache_t& c = *i->second;
+					if (c.status != cache_t::status_t::dirty)
+						continue;
+					if (!c.dirty.empty()) {
+						if (c.dirty.start != offset) {
+							m_source->seekbeg(c.dirty.start);
+							if (!m_source->ok()) _Unlikely_ {
+								m_state = state_t::fail;
+								return;
+							}
+						}
+						m_source->write(c.data + static_cast<size_t>(c.dirty.start - c.region.start), static_cast<size_t>(c.dirty.size()));
+						m_state = m_source->state();
+						if (!ok()) _Unlikely_
+							return;
+						offset = c.dirty.end;
+					}
+					c.status = cache_t::status_t::loaded;
+				}
+			}
+
+			void invalidate_cache()
+			{
+				flush_cache();
+				if (!ok()) _Unlikely_
+					return;
+				discard_cache(interval<fpos_t>(0, fpos_max));
+			}
+
+			void discard_cache(_In_ const interval<fpos_t>& range)
+			{
+				for (auto i = m_cache_index.lower_bound(range.start - range.start % m_cache_capacity); i != m_cache_index.end() && i->first < range.end;) {
+					i->second->status = cache_t::status_t::empty;
+					if (m_cache_mru == i->second)
+						m_cache_mru = nullptr;
+					i = m_cache_index.erase(i);
+				}
+			}
+
+			cache_t* load_cache(_In_ fpos_t start)
+			{
+				// Pick an empty or the least recently used block.
+				cache_t* c = nullptr;
+				for (auto& b : m_cache) {
+					if (b.status == cache_t::status_t::empty) {
+						c = &b;
+						break;
+					}
+					if (!c || b.used < c->used)
+						c = &b;
+				}
+				if (c->status == cache_t::status_t::dirty) {
+					write_cache(*c);
+					if (!ok()) _Unlikely_
+						return nullptr;
+				}
+				load_cache(*c, start - start % m_cache_capacity); // Align to cache block size.
+				if (!ok()) _Unlikely_
+					return nullptr;
+				if (m_access == access_t::sequential && c->region.size() == m_cache_capacity)
+					m_source->hint(c->region.end, mul(m_cache_capacity, m_cache.size()), access_t::will_need);
+				return c;
+			}
+
+			bool reload_cache(_Inout_ cache_t& c)
+			{
+				// The block ends before the offset. Unless we are at the end of file, other dirty blocks have
+				// extended the file meanwhile. Persist them and reload the block.
+				if (m_offset >= size()) {
+					m_state = state_t::eof;
+					return false;
+				}
+				flush_cache();
+				if (ok())
+					load_cache(c, c.region.start);
+				if (!ok()) _Unlikely_ {
+					m_state = state_t::fail;
+					return false;
+				}
+				if (!c.region.contains(m_offset)) _Unlikely_ {
+					m_state = state_t::eof;
+					return false;
+				}
+				return true;
+			}
+
+			void fill_cache(_Inout_ cache_t& c)
+			{
+				if (c.region.end < m_offset) {
+					// Writing past the valid data. Fill the gap with zeros as the file would.
+					memset(c.data + static_cast<size_t>(c.region.end - c.region.start), 0, static_cast<size_t>(m_offset - c.region.end));
+					mark_dirty(c, interval<fpos_t>(c.region.end, m_offset));
+				}
+			}
+
+			void mark_dirty(_Inout_ cache_t& c, _In_ const interval<fpos_t>& range)
+			{
+				if (c.status == cache_t::status_t::dirty) {
+					c.dirty.start = std::min(c.dirty.start, range.start);
+					c.dirty.end = std::max(c.dirty.end, range.end);
+				}
+				else {
+					c.status = cache_t::status_t::dirty;
+					c.dirty = range;
+				}
+				c.region.end = std::max(c.region.end, range.end);
+			}
+
+			void load_cache(_Inout_ cache_t& c, _In_ fpos_t start)
+			{
+				stdex_assert(c.status != cache_t::status_t::dirty);
+				stdex_assert(start % m_cache_capacity == 0);
+				if (c.status != cache_t::status_t::empty) {
+					m_cache_index.erase(c.region.start);
+					c.status = cache_t::status_t::empty;
+				}
+				m_source->seekbeg(c.region.start = start);
+				if (m_source->ok()) {
+					c.region.end = start + m_source->read(c.data, m_cache_capacity);
+					c.status = cache_t::status_t::loaded;
+					c.used = ++m_cache_tick;
+					m_cache_index[start] = &c;
+					m_cache_mru = &c;
+					m_state = state_t::ok; // Regardless the read failure, we still might have cached some data.
+				}
+				else {
+					if (m_cache_mru == &c)
+						m_cache_mru = nullptr;
+					m_state = state_t::fail;
+				}
+			}
+
+			void write_cache(_Inout_ cache_t& c)
+			{
+				stdex_assert(c.status == cache_t::status_t::dirty);
+				if (!c.dirty.empty()) {
+					m_source->seekbeg(c.dirty.start);
+					if (m_source->ok())
+						m_source->write(c.data + static_cast<size_t>(c.dirty.start - c.region.start), static_cast<size_t>(c.dirty.size()));
+					m_state = m_source->state();
+					if (!ok()) _Unlikely_
+						return;
+				}
+				else
+					m_state = state_t::ok;
+				c.status = cache_t::status_t::loaded;
+			}
+
+			basic_file* m_source;
+			size_t m_cache_capacity; ///< size of each cache block
+			std::unique_ptr<uint8_t[]> m_cache_data; ///< storage of all cache blocks
+			std::vector<cache_t> m_cache; ///< cache blocks
+			std::map<fpos_t, cache_t*> m_cache_index; ///< non-empty cache blocks by their file offset
+			cache_t* m_cache_mru; ///< most recently used cache block
+			uint64_t m_cache_tick; ///< access counter for LRU replacement
+			access_t m_access; ///< declared access pattern
+			fpos_t m_offset; ///< Logical absolute file position
+#if SET_FILE_OP_TIMES
+			time_point
+				m_atime,
+				m_mtime;
+#endif
+			/// \endcond
+		};
+
+		/// \cond internal
+#ifdef _WIN32
+		inline size_t make_wsabuf(_Out_writes_to_(max_segments, return) WSABUF* vec, _In_reads_(count) const segment_t* segments, _In_ size_t count, _In_ size_t offset)
+		{
+			// WSABUF length is 32-bit. A batch ends at the segment exceeding it, so the segments remain in sync.
+			constexpr size_t block_size = 0x10000000;
+			size_t n = 0;
+			for (; n < count && n < max_segments; ++n) {
+				size_t start = n ? 0 : offset;
+				size_t length = segments[n].length - start;
+				if (length > block_size) {
+					if (!n) {
+						vec[0].buf = reinterpret_cast<CHAR*>(segments[0].data) + start;
+						vec[0].len = static_cast<ULONG>(block_size);
+						n = 1;
+					}
+					break;
+				}
+				vec[n].buf = reinterpret_cast<CHAR*>(segments[n].data) + start;
+				vec[n].len = static_cast<ULONG>(length);
+			}
+			return n;
+		}
+#else
+		inline int make_iovec(_Out_writes_to_(max_segments, return) iovec* vec, _In_reads_(count) const segment_t* segments, _In_ size_t count, _In_ size_t offset)
+		{
+			int n = static_cast<int>(std::min(count, max_segments));
+			vec[0].iov_base = reinterpret_cast<uint8_t*>(segments[0].data) + offset;
+			vec[0].iov_len = segments[0].length - offset;
+			for (int i = 1; i < n; ++i) {
+				vec[i].iov_base = segments[i].data;
+				vec[i].iov_len = segments[i].length;
+			}
+			return n;
+		}
+#endif
+		/// \endcond
+
+		///
+		/// OS data stream (file, pipe, socket...)
+		///
+		class basic_sys : virtual public basic, public sys_object
+		{
+		public:
+			basic_sys(_In_opt_ sys_handle h = invalid_handle, _In_ state_t state = state_t::ok) :
+				basic(state),
+				sys_object(h)
+			{}
+
+			virtual _Success_(return != 0 || length == 0) size_t read(
+				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				// Windows Server 2003 and Windows XP:  Pipe write operations across a network are limited in size per write.
+				// The amount varies per platform. For x86 platforms it's 63.97 MB. For x64 platforms it's 31.97 MB. For Itanium
+				// it's 63.95 MB. For more information regarding pipes, see the Remarks section.
+				size_t
+#if defined(_WIN64)
+					block_size = 0x1F80000;
+#elif defined(_WIN32)
+					block_size = 0x3f00000;
+#else
+					block_size = SSIZE_MAX;
+#endif
+				for (size_t to_read = length;;) {
+#ifdef _WIN32
+					// ReadFile() might raise exception (e.g. STATUS_FILE_BAD_FORMAT/0xE0000002).
+					BOOL succeeded;
+					DWORD num_read;
+					__try { succeeded = ReadFile(m_h, data, static_cast<DWORD>(std::min<size_t>(to_read, block_size)), &num_read, nullptr); }
+					__except (EXCEPTION_EXECUTE_HANDLER) { succeeded = FALSE; SetLastError(ERROR_UNHANDLED_EXCEPTION); num_read = 0; }
+					if (!succeeded && GetLastError() == ERROR_NO_SYSTEM_RESOURCES && block_size > default_block_size) _Unlikely_ {
+						// Error "Insufficient system resources exist to complete the requested service." occurs
+						// occasionally, when attempting to read too much data at once (e.g. over \\TSClient).
+						block_size = default_block_size;
+						continue;
+					}
+					if (!succeeded) _Unlikely_
+#else
+					auto num_read = ::read(m_h, data, std::min<size_t>(to_read, block_size));
+					if (num_read < 0) _Unlikely_
+#endif
+					{
+						m_state = to_read < length ? state_t::ok : state_t::fail;
+						return length - to_read;
+					}
+					if (!num_read) _Unlikely_ {
+						m_state = to_read < length || !length ? state_t::ok : state_t::eof;
+						return length - to_read;
+					}
+					to_read -= static_cast<size_t>(num_read);
+					if (!to_read) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<uint8_t*&>(data) += num_read;
+				}
+			}
+
+			virtual _Success_(return != 0) size_t write(
+				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			{
+				// Windows Server 2003 and Windows XP:  Pipe write operations across a network are limited in size per write.
+				// The amount varies per platform. For x86 platforms it's 63.97 MB. For x64 platforms it's 31.97 MB. For Itanium
+				// it's 63.95 MB. For more information regarding pipes, see the Remarks section.
+				constexpr size_t
+#if defined(_WIN64)
+					block_size = 0x1F80000;
+#elif defined(_WIN32)
+					block_size = 0x3f00000;
+#else
+					block_size = SSIZE_MAX;
+#endif
+				for (size_t to_write = length;;) {
+#ifdef _WIN32
+					// ReadFile() might raise an exception. Be cautious with WriteFile() too.
+					BOOL succeeded;
+					DWORD num_written;
+					__try { succeeded = WriteFile(m_h, data, static_cast<DWORD>(std::min<size_t>(to_write, block_size)), &num_written, nullptr); }
+					__except (EXCEPTION_EXECUTE_HANDLER) { succeeded = FALSE; SetLastError(ERROR_UNHANDLED_EXCEPTION); num_written = 0; }
+					to_write -= num_written;
+					if (!to_write) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<const uint8_t*&>(data) += num_written;
+					if (!succeeded) _Unlikely_ {
+						m_state = state_t::fail;
+						return length - to_write;
+					}
+#else
+					auto num_written = ::write(m_h, data, std::min<size_t>(to_write, block_size));
+					if (num_written < 0) _Unlikely_ {
+						m_state = state_t::fail;
+						return length - to_write;
+					}
+					to_write -= static_cast<size_t>(num_written);
+					if (!to_write) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<const uint8_t*&>(data) += num_written;
+#endif
+				}
+			}
+
+#ifndef _WIN32
+			// ReadFileScatter() and WriteFileGather() require page-aligned buffers on handles opened with
+			// FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED. Windows falls back to basic::readv() and basic::writev().
+
+			virtual size_t readv(_In_reads_(count) const segment_t* segments, _In_ size_t count)
+			{
+				stdex_assert(segments || !count);
+				size_t num_read_total = 0;
+				for (size_t offset = 0;;) {
+					// Skip the segments filled.
+					for (; count && offset >= segments->length; ++segments, --count)
+						offset -= segments->length;
+					if (!count) {
+						m_state = state_t::ok;
+						return num_read_total;
+					}
+					iovec vec[max_segments];
+					int n = make_iovec(vec, segments, count, offset);
+					auto num_read = ::readv(m_h, vec, n);
+					if (num_read < 0) _Unlikely_ {
+						m_state = num_read_total ? state_t::ok : state_t::fail;
+						return num_read_total;
+					}
+					if (!num_read) _Unlikely_ {
+						m_state = num_read_total ? state_t::ok : state_t::eof;
+						return num_read_total;
+					}
+					num_read_total += static_cast<size_t>(num_read);
+					offset += static_cast<size_t>(num_read);
+				}
+			}
+
+			virtual size_t writev(_In_reads_(count) const segment_t* segments, _In_ size_t count)
+			{
+				stdex_assert(segments || !count);
+				size_t num_written_total = 0;
+				for (size_t offset = 0;;) {
+					// Skip the segments written.
+					for (; count && offset >= segments->length; ++segments, --count)
+						offset -= segments->length;
+					if (!count) {
+						m_state = state_t::ok;
+						return num_written_total;
+					}
+					iovec vec[max_segments];
+					int n = make_iovec(vec, segments, count, offset);
+					auto num_written = ::writev(m_h, vec, n);
+					if (num_written < 0) _Unlikely_ {
+						m_state = state_t::fail;
+						return num_written_total;
+					}
+					num_written_total += static_cast<size_t>(num_written);
+					offset += static_cast<size_t>(num_written);
+				}
+			}
+#endif
+
+			virtual void close()
+			{
+				try {
+					sys_object::close();
+					m_state = state_t::ok;
+				}
+				catch (...) {
+					m_state = state_t::fail;
+				}
+			}
+
+			virtual void flush()
+			{
+#ifdef _WIN32
+				m_state = FlushFileBuffers(m_h) ? state_t::ok : state_t::fail;
+#else
+				m_state = fsync(m_h) >= 0 ? state_t::ok : state_t::fail;
+#endif
+			}
+
+			virtual sys_handle os_handle() const
+			{
+				return m_h;
+			}
+		};
+
+		///
+		/// Buffered OS data stream (file, pipe, socket...)
+		///
+		class buffered_sys : public buffer
+		{
+		public:
+			buffered_sys(_In_opt_ sys_handle h = invalid_handle, size_t read_buffer_size = default_buffer_size, size_t write_buffer_size = default_buffer_size, size_t max_buffer_size = 0) :
+				buffer(read_buffer_size, write_buffer_size, max_buffer_size),
+				m_source(h)
+			{
+				init(m_source);
+			}
+
+			virtual ~buffered_sys()
+			{
+				done();
+			}
+
+		protected:
+			basic_sys m_source;
+		};
+
+		///
+		/// Socket stream
+		///
+		class socket : public basic
+		{
+		public:
+			socket(_In_opt_ socket_t h = stdex::invalid_socket, _In_ state_t state = state_t::ok) :
+				basic(state),
+				m_h(h)
+			{}
+
+		private:
+			socket(_In_ const socket& other);
+			socket& operator =(_In_ const socket& other);
+
+		public:
+			socket(_Inout_ socket&& other) noexcept : m_h(other.m_h)
+			{
+				other.m_h = stdex::invalid_socket;
+			}
+
+			socket& operator =(_Inout_ socket&& other) noexcept
+			{
+				if (this != std::addressof(other)) {
+					if (m_h != stdex::invalid_socket)
+						closesocket(m_h);
+					m_h = other.m_h;
+					other.m_h = stdex::invalid_socket;
+				}
+				return *this;
+			}
+
+			///
+			/// Creates a socket
+			///
+			/// \param[in] af        Address family
+			/// \param[in] type      Socket type
+			/// \param[in] protocol  Socket protocol
+			///
+			socket(_In_ int af, _In_ int type, _In_ int protocol)
+			{
+				m_h = ::socket(af, type, protocol);
+				if (m_h == stdex::invalid_socket) _Unlikely_
+					m_state = state_t::fail;
+			}
+
+			virtual ~socket()
+			{
+				if (m_h != stdex::invalid_socket)
+					closesocket(m_h);
+			}
+
+			///
+			/// Returns true if socket handle is valid
+			///
+			operator bool() const noexcept { return m_h != stdex::invalid_socket; }
+
+			///
+			/// Returns socket handle
+			///
+			socket_t get() const noexcept { return m_h; }
+
+			virtual _Success_(return != 0 || length == 0) size_t read(
+				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				constexpr int block_size = 0x10000000;
+				for (size_t to_read = length;;) {
+					auto num_read = recv(m_h, reinterpret_cast<char*>(data),
+#ifdef _WIN32
+						static_cast<int>(std::min<size_t>(to_read, block_size)),
+#else
+						std::min<size_t>(to_read, block_size),
+#endif
+						0);
+					if (num_read < 0) _Unlikely_ {
+						m_state = to_read < length ? state_t::ok : state_t::fail;
+						return length - to_read;
+					}
+					if (!num_read) {
+						m_state = to_read < length || !length ? state_t::ok : state_t::eof;
+						return length - to_read;
+					}
+					to_read -= static_cast<size_t>(num_read);
+					if (!to_read) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<uint8_t*&>(data) += num_read;
+				}
+			}
+
+			virtual _Success_(return != 0) size_t write(
+				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				constexpr int block_size = 0x10000000;
+				for (size_t to_write = length;;) {
+					auto num_written = send(m_h, reinterpret_cast<const char*>(data),
+#ifdef _WIN32
+						static_cast<int>(std::min<size_t>(to_write, block_size)),
+#else
+						std::min<size_t>(to_write, block_size),
+#endif
+						0);
+					if (num_written < 0) _Unlikely_ {
+						m_state = state_t::fail;
+						return length - to_write;
+					}
+					to_write -= static_cast<size_t>(num_written);
+					if (!to_write) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<const uint8_t*&>(data) += num_written;
+				}
+			}
+
+			virtual size_t readv(_In_reads_(count) const segment_t* segments, _In_ size_t count)
+			{
+				stdex_assert(segments || !count);
+				size_t num_read_total = 0;
+				for (size_t offset = 0;;) {
+					// Skip the segments filled.
+					for (; count && offset >= segments->length; ++segments, --count)
+						offset -= segments->length;
+					if (!count) {
+						m_state = state_t::ok;
+						return num_read_total;
+					}
+#ifdef _WIN32
+					WSABUF vec[max_segments];
+					DWORD n = static_cast<DWORD>(make_wsabuf(vec, segments, count, offset));
+					DWORD num_read, flags = 0;
+					if (WSARecv(m_h, vec, n, &num_read, &flags, nullptr, nullptr) == SOCKET_ERROR) _Unlikely_
+#else
+					iovec vec[max_segments];
+					int n = make_iovec(vec, segments, count, offset);
+					auto num_read = ::readv(m_h, vec, n);
+					if (num_read < 0) _Unlikely_
+#endif
+					{
+						m_state = num_read_total ? state_t::ok : state_t::fail;
+						return num_read_total;
+					}
+					if (!num_read) {
+						m_state = num_read_total ? state_t::ok : state_t::eof;
+						return num_read_total;
+					}
+					num_read_total += static_cast<size_t>(num_read);
+					offset += static_cast<size_t>(num_read);
+				}
+			}
+
+			virtual size_t writev(_In_reads_(count) const segment_t* segments, _In_ size_t count)
+			{
+				stdex_assert(segments || !count);
+				size_t num_written_total = 0;
+				for (size_t offset = 0;;) {
+					// Skip the segments written.
+					for (; count && offset >= segments->length; ++segments, --count)
+						offset -= segments->length;
+					if (!count) {
+						m_state = state_t::ok;
+						return num_written_total;
+					}
+#ifdef _WIN32
+					WSABUF vec[max_segments];
+					DWORD n = static_cast<DWORD>(make_wsabuf(vec, segments, count, offset));
+					DWORD num_written;
+					if (WSASend(m_h, vec, n, &num_written, 0, nullptr, nullptr) == SOCKET_ERROR) _Unlikely_
+#else
+					iovec vec[max_segments];
+					int n = make_iovec(vec, segments, count, offset);
+					auto num_written = ::writev(m_h, vec, n);
+					if (num_written < 0) _Unlikely_
+#endif
+					{
+						m_state = state_t::fail;
+						return num_written_total;
+					}
+					num_written_total += static_cast<size_t>(num_written);
+					offset += static_cast<size_t>(num_written);
+				}
+			}
+
+			virtual void close()
+			{
+				if (m_h != stdex::invalid_socket) {
+					closesocket(m_h);
+					m_h = stdex::invalid_socket;
+				}
+				m_state = state_t::ok;
+			}
+
+#ifndef _WIN32
+			virtual sys_handle os_handle() const
+			{
+				// POSIX sockets are file descriptors.
+				return m_h;
+			}
+#endif
+
+		protected:
+			socket_t m_h;
+		};
+
+#ifdef _WIN32
+		///
+		/// Wrapper for ISequentialStream
+		///
+		class sequential_stream : public basic
+		{
+		public:
+			sequential_stream(_In_ ISequentialStream* source) : m_source(source)
+			{
+				m_source->AddRef();
+			}
+
+			virtual ~sequential_stream()
+			{
+				m_source->Release();
+			}
+
+			virtual _Success_(return != 0 || length == 0) size_t read(
+				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				for (size_t to_read = length;;) {
+					HRESULT hr;
+					ULONG num_read = 0;
+					__try { hr = m_source->Read(data, (ULONG)std::min<size_t>(to_read, ULONG_MAX), &num_read); }
+					__except (EXCEPTION_EXECUTE_HANDLER) { hr = E_FAIL; }
+					if (FAILED(hr)) _Unlikely_ {
+						m_state = to_read < length ? state_t::ok : state_t::fail;
+						return length - to_read;
+					}
+					to_read -= num_read;
+					if (hr == S_FALSE) _Unlikely_ {
+						m_state = to_read < length || !length ? state_t::ok : state_t::eof;
+						return length - to_read;
+					}
+					if (!to_read) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<uint8_t*&>(data) += num_read;
+				}
+			}
+
+			virtual _Success_(return != 0) size_t write(
+				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				for (size_t to_write = length;;) {
+					HRESULT hr;
+					ULONG num_written = 0;
+					__try { hr = m_source->Write(data, static_cast<ULONG>(std::min<size_t>(to_write, ULONG_MAX)), &num_written); }
+					__except (EXCEPTION_EXECUTE_HANDLER) { hr = E_FAIL; }
+					// In absence of documentation whether num_written gets set when FAILED(hr) (i.e. partially successful writes),
+					// assume write failed completely.
+					if (FAILED(hr)) _Unlikely_ {
+						m_state = state_t::fail;
+						return length - to_write;
+					}
+					to_write -= num_written;
+					if (!to_write) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<const uint8_t*&>(data) += num_written;
+				}
+			}
+
+		protected:
+			ISequentialStream* m_source;
+		};
+
+		///
+		/// Wrapper for IIS ASP IRequest and IResponse
+		///
+		class asp : public basic
+		{
+		public:
+			asp(_In_opt_ IRequest* request, _In_opt_ IResponse* response) :
+				m_request(request),
+				m_response(response)
+			{
+				if (m_request)
+					m_request->AddRef();
+				if (m_response)
+					m_response->AddRef();
+			}
+
+			virtual ~asp()
+			{
+				if (m_request)
+					m_request->Release();
+				if (m_response)
+					m_response->Release();
+			}
+
+			virtual _Success_(return != 0 || length == 0) size_t read(
+				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				if (!m_request) _Unlikely_ {
+					m_state = state_t::fail;
+					return 0;
+				}
+				for (size_t to_read = length;;) {
+					VARIANT var_amount, var_data;
+					V_VT(&var_amount) = VT_I4;
+					V_I4(&var_amount) = (LONG)std::min<size_t>(to_read, LONG_MAX);
+					V_VT(&var_data) = VT_EMPTY;
+					HRESULT hr = [&]() {
+						__try { return m_request->BinaryRead(&var_amount, &var_data); }
+						__except (EXCEPTION_EXECUTE_HANDLER) { return E_FAIL; }
+					}();
+					if (FAILED(hr)) _Unlikely_ {
+						m_state = to_read < length ? state_t::ok : state_t::fail;
+						return length - to_read;
+					}
+					stdex_assert(V_VT(&var_amount) == VT_I4);
+					stdex_assert(V_VT(&var_data) == (VT_ARRAY | VT_UI1));
+					std::unique_ptr<SAFEARRAY, SafeArrayDestroy_delete> sa(V_ARRAY(&var_data));
+					if (!V_I4(&var_amount)) _Unlikely_ {
+						m_state = to_read < length || !length ? state_t::ok : state_t::eof;
+						return length - to_read;
+					}
+					safearray_accessor<uint8_t> a(sa.get());
+					memcpy(data, a.data(), V_I4(&var_amount));
+					to_read -= V_I4(&var_amount);
+					if (!to_read) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<uint8_t*&>(data) += V_I4(&var_amount);
+				}
+			}
+
+			virtual _Success_(return != 0) size_t write(
+				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			{
+				if (!m_response) {
+					m_state = state_t::fail;
+					return 0;
+				}
+				for (size_t to_write = length;;) {
+					UINT num_written = static_cast<UINT>(std::min<size_t>(to_write, UINT_MAX));
+					std::unique_ptr<OLECHAR, SysFreeString_delete> bstr_data(SysAllocStringByteLen(reinterpret_cast<LPCSTR>(data), num_written));
+					VARIANT var_data;
+					V_VT(&var_data) = VT_BSTR;
+					V_BSTR(&var_data) = bstr_data.get();
+					HRESULT hr = [&]() {
+						__try { return m_response->BinaryWrite(var_data); }
+						__except (EXCEPTION_EXECUTE_HANDLER) { return E_FAIL; }
+					}();
+					if (FAILED(hr)) _Unlikely_ {
+						m_state = state_t::fail;
+						return length - to_write;
+					}
+					to_write -= num_written;
+					if (!to_write) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<const uint8_t*&>(data) += num_written;
+				}
+			}
+
+			virtual void close()
+			{
+				if (m_response) {
+					__try { m_response->End(); }
+					__except (EXCEPTION_EXECUTE_HANDLER) {}
+				}
+				m_state = state_t::ok;
+			}
+
+			virtual void flush()
+			{
+				if (m_response) {
+					HRESULT hr;
+					__try { hr = m_response->Flush(); }
+					__except (EXCEPTION_EXECUTE_HANDLER) { hr = E_FAIL; }
+					m_state = SUCCEEDED(hr) ? state_t::ok : state_t::fail;
+				}
+			}
+
+		protected:
+			IRequest* m_request;
+			IResponse* m_response;
+		};
+#endif
+
+		///
 		/// File open mode
 		///
-		enum mode_t
+		enum mode_t
+		{
+			mode_for_reading = 1 << 0,        ///< Open for reading
+			mode_for_writing = 1 << 1,        ///< Open for writing
+			mode_for_chmod = 1 << 2,          ///< Open for changing file attributes
+
+			mode_open_existing = 0 << 3,      ///< Open file, fail if not exists
+			mode_truncate_existing = 1 << 3,  ///< Truncate file, fail if not exists
+			mode_preserve_existing = 2 << 3,  ///< Open file if exists; create file if not exists
+			mode_create_new = 3 << 3,         ///< Create file, fail if exists
+			mode_create = 4 << 3,             ///< Create file if not exists; open and truncate if exists
+			mode_disposition_mask = 7 << 3,   ///< Bitwise mask for creation disposition
+
+			mode_append = 1 << 6,             ///< Seek to the end of file after opening
+			mode_text = 0,                    ///< Open as text file
+			mode_binary = 1 << 7,             ///< Open as binary file
+
+			share_none = 0,                   ///< Open for exclusive access (default)
+			share_reading = 1 << 8,           ///< Allow others to read our file
+			share_writing = 1 << 9,           ///< Allow others to write to our file
+			share_deleting = 1 << 10,         ///< Allow others to mark our file for deletion
+			share_all = share_reading | share_writing | share_deleting, // Allow others all operations on our file
+
+			inherit_handle = 1 << 11,         ///< Inherit handle in child processes (Windows-specific)
+
+			hint_write_thru = 1 << 12,        ///< Write operations will not go through any intermediate cache, they will go directly to disk. (Windows-specific)
+			hint_no_buffering = 1 << 13,      ///< The file or device is being opened with no system caching for data reads and writes. (Windows-specific)
+			hint_random_access = 1 << 14,     ///< Access is intended to be random. (Windows-specific)
+			hint_sequential_access = 1 << 15, ///< Access is intended to be sequential from beginning to end. (Windows-specific)
+
+			mode_direct = 1 << 16,            ///< Bypass system cache. File offsets, transfer sizes and buffers must be aligned to the device sector size. Use direct_file for unaligned access.
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4250)
+		///
+		/// File-system file
+		///
+		class file : virtual public basic_file, virtual public basic_sys
+		{
+		public:
+			file(_In_opt_ sys_handle h = invalid_handle, _In_ state_t state = state_t::ok) : basic_sys(h, state) {}
+
+			///
+			/// Opens file
+			///
+			/// \param[in] filename  Filename
+			/// \param[in] mode      Bitwise combination of mode_t flags
+			///
+			file(_In_z_ const schar_t* filename, _In_ int mode)
+			{
+				open(filename, mode);
+			}
+
+			///
+			/// Opens file
+			///
+			/// \param[in] filename  Filename
+			/// \param[in] mode      Bitwise combination of mode_t flags
+			///
+			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
+			file(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode) : file(filename.c_str(), mode) {}
+
+			///
+			/// Opens file
+			///
+			/// \param[in] filename  Filename
+			/// \param[in] mode      Bitwise combination of mode_t flags
+			///
+			void open(_In_z_ const schar_t* filename, _In_ int mode)
+			{
+				if (m_h != invalid_handle)
+					close();
+
+#ifdef _WIN32
+				DWORD dwDesiredAccess = 0;
+				if (mode & mode_for_reading) dwDesiredAccess |= GENERIC_READ;
+				if (mode & mode_for_writing) dwDesiredAccess |= GENERIC_WRITE;
+				if (mode & mode_for_chmod)   dwDesiredAccess |= FILE_WRITE_ATTRIBUTES;
+
+				DWORD dwShareMode = 0;
+				if (mode & share_reading)  dwShareMode |= FILE_SHARE_READ;
+				if (mode & share_writing)  dwShareMode |= FILE_SHARE_WRITE;
+				if (mode & share_deleting) dwShareMode |= FILE_SHARE_DELETE;
+
+				SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES) };
+				sa.bInheritHandle = mode & inherit_handle ? true : false;
+
+				DWORD dwCreationDisposition;
+				switch (mode & mode_disposition_mask) {
+				case mode_open_existing: dwCreationDisposition = OPEN_EXISTING; break;
+				case mode_truncate_existing: dwCreationDisposition = TRUNCATE_EXISTING; break;
+				case mode_preserve_existing: dwCreationDisposition = OPEN_ALWAYS; break;
+				case mode_create_new: dwCreationDisposition = CREATE_NEW; break;
+				case mode_create: dwCreationDisposition = CREATE_ALWAYS; break;
+				default: throw std::invalid_argument("invalid mode");
+				}
+
+				DWORD dwFlagsAndAttributes = FILE_ATTRIBUTE_NORMAL;
+				if (mode & hint_write_thru)        dwFlagsAndAttributes |= FILE_FLAG_WRITE_THROUGH;
+				if (mode & hint_no_buffering)      dwFlagsAndAttributes |= FILE_FLAG_NO_BUFFERING;
+				if (mode & hint_random_access)     dwFlagsAndAttributes |= FILE_FLAG_RANDOM_ACCESS;
+				if (mode & hint_sequential_access) dwFlagsAndAttributes |= FILE_FLAG_SEQUENTIAL_SCAN;
+				if (mode & mode_direct)            dwFlagsAndAttributes |= FILE_FLAG_NO_BUFFERING;
+
+				m_h = CreateFile(filename, dwDesiredAccess, dwShareMode, &sa, dwCreationDisposition, dwFlagsAndAttributes, NULL);
+#else
+				int flags = 0;
+				switch (mode & (mode_for_reading | mode_for_writing)) {
+				case mode_for_reading: flags |= O_RDONLY; break;
+				case mode_for_writing: flags |= O_WRONLY; break;
+				case mode_for_reading | mode_for_writing: flags |= O_RDWR; break;
+				}
+				switch (mode & mode_disposition_mask) {
+				case mode_open_existing: break;
+				case mode_truncate_existing: flags |= O_TRUNC; break;
+				case mode_preserve_existing: flags |= O_CREAT; break;
+				case mode_create_new: flags |= O_CREAT | O_EXCL; break;
+				case mode_create: flags |= O_CREAT | O_TRUNC; break;
+				default: throw std::invalid_argument("invalid mode");
+				}
+				if (mode & hint_write_thru) flags |= O_DSYNC;
+#ifndef __APPLE__
+				if (mode & hint_no_buffering) flags |= O_RSYNC;
+#endif
+#ifdef O_DIRECT
+				if (mode & mode_direct) flags |= O_DIRECT;
+#endif
+
+				m_h = ::open(filename, flags, DEFFILEMODE);
+#ifdef __APPLE__
+				if (m_h != invalid_handle && (mode & mode_direct))
+					fcntl(m_h, F_NOCACHE, 1);
+#endif
+#endif
+				if (m_h != invalid_handle) {
+					m_state = state_t::ok;
+					if (mode & mode_append)
+						seek(0, seek_t::end);
+				}
+				else
+					m_state = state_t::fail;
+			}
+
+			///
+			/// Opens file
+			///
+			/// \param[in] filename  Filename
+			/// \param[in] mode      Bitwise combination of mode_t flags
+			///
+			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
+			void open(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode)
+			{
+				open(filename.c_str(), mode);
+			}
+
+			virtual _Success_(return != 0 || length == 0) size_t read_at(
+				_In_ fpos_t offset, _Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				constexpr size_t
+#if defined(_WIN32)
+					block_size = 0x1F80000;
+#else
+					block_size = SSIZE_MAX;
+#endif
+				for (size_t to_read = length;;) {
+					if (!to_read)
+						return length;
+#ifdef _WIN32
+					// On synchronous handles, this moves the file position too.
+					OVERLAPPED o = {};
+					o.Offset = static_cast<DWORD>(offset);
+					o.OffsetHigh = static_cast<DWORD>(offset >> 32);
+					DWORD num_read;
+					if (!ReadFile(m_h, data, static_cast<DWORD>(std::min<size_t>(to_read, block_size)), &num_read, &o) || !num_read) _Unlikely_
+						return length - to_read;
+#else
+					if (offset > static_cast<fpos_t>(std::numeric_limits<off64_t>::max())) _Unlikely_
+						return length - to_read;
+					auto num_read = pread64(m_h, data, std::min<size_t>(to_read, block_size), static_cast<off64_t>(offset));
+					if (num_read <= 0) _Unlikely_
+						return length - to_read;
+#endif
+					to_read -= static_cast<size_t>(num_read);
+					offset += static_cast<size_t>(num_read);
+					reinterpret_cast<uint8_t*&>(data) += num_read;
+				}
+			}
+
+			virtual _Success_(return != 0) size_t write_at(
+				_In_ fpos_t offset, _In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				constexpr size_t
+#if defined(_WIN32)
+					block_size = 0x1F80000;
+#else
+					block_size = SSIZE_MAX;
+#endif
+				for (size_t to_write = length;;) {
+					if (!to_write)
+						return length;
+#ifdef _WIN32
+					// On synchronous handles, this moves the file position too.
+					OVERLAPPED o = {};
+					o.Offset = static_cast<DWORD>(offset);
+					o.OffsetHigh = static_cast<DWORD>(offset >> 32);
+					DWORD num_written;
+					if (!WriteFile(m_h, data, static_cast<DWORD>(std::min<size_t>(to_write, block_size)), &num_written, &o) || !num_written) _Unlikely_
+						return length - to_write;
+#else
+					if (offset > static_cast<fpos_t>(std::numeric_limits<off64_t>::max())) _Unlikely_
+						return length - to_write;
+					auto num_written = pwrite64(m_h, data, std::min<size_t>(to_write, block_size), static_cast<off64_t>(offset));
+					if (num_written <= 0) _Unlikely_
+						return length - to_write;
+#endif
+					to_write -= static_cast<size_t>(num_written);
+					offset += static_cast<size_t>(num_written);
+					reinterpret_cast<const uint8_t*&>(data) += num_written;
+				}
+			}
+
+			virtual fpos_t seek(_In_ foff_t offset, _In_ seek_t how = seek_t::beg)
+			{
+#ifdef _WIN32
+				LARGE_INTEGER li;
+				li.QuadPart = offset;
+				li.LowPart = SetFilePointer(m_h, li.LowPart, &li.HighPart, static_cast<DWORD>(how));
+				if (li.LowPart != 0xFFFFFFFF || GetLastError() == NO_ERROR) {
+					m_state = state_t::ok;
+					return li.QuadPart;
+				}
+#else
+				off64_t result = lseek64(m_h, offset, static_cast<int>(how));
+				if (result >= 0) {
+					m_state = state_t::ok;
+					return static_cast<fpos_t>(result);
+				}
+#endif
+				m_state = state_t::fail;
+				return fpos_max;
+			}
+
+			virtual fpos_t tell() const
+			{
+				if (m_h != invalid_handle) {
+#ifdef _WIN32
+					LARGE_INTEGER li;
+					li.QuadPart = 0;
+					li.LowPart = SetFilePointer(m_h, 0, &li.HighPart, FILE_CURRENT);
+					if (li.LowPart != 0xFFFFFFFF || GetLastError() == NO_ERROR)
+						return li.QuadPart;
+#else
+					off64_t result = lseek64(m_h, 0, SEEK_CUR);
+					if (result >= 0)
+						return static_cast<fpos_t>(result);
+#endif
+				}
+				return fpos_max;
+			}
+
+			virtual void lock(_In_ fpos_t offset, _In_ fsize_t length)
+			{
+#ifdef _WIN32
+				LARGE_INTEGER liOffset;
+				LARGE_INTEGER liSize;
+				liOffset.QuadPart = offset;
+				liSize.QuadPart = length;
+				if (LockFile(m_h, liOffset.LowPart, liOffset.HighPart, liSize.LowPart, liSize.HighPart)) {
+					m_state = state_t::ok;
+					return;
+				}
+#else
+				off64_t orig = lseek64(m_h, 0, SEEK_CUR);
+				if (orig >= 0) {
+					if (offset > std::numeric_limits<off64_t>::max())
+						throw std::invalid_argument("file offset too big");
+					if (length > std::numeric_limits<off64_t>::max())
+						throw std::invalid_argument("file section length too big");
+					m_state = lseek64(m_h, static_cast<off64_t>(offset), SEEK_SET) >= 0 && lockf64(m_h, F_LOCK, static_cast<off64_t>(length)) >= 0 ? state_t::ok : state_t::fail;
+					lseek64(m_h, orig, SEEK_SET);
+					m_state = state_t::ok;
+					return;
+				}
+#endif
+				m_state = state_t::fail;
+			}
+
+			virtual void unlock(_In_ fpos_t offset, _In_ fsize_t length)
+			{
+#ifdef _WIN32
+				LARGE_INTEGER liOffset;
+				LARGE_INTEGER liSize;
+				liOffset.QuadPart = offset;
+				liSize.QuadPart = length;
+				if (UnlockFile(m_h, liOffset.LowPart, liOffset.HighPart, liSize.LowPart, liSize.HighPart)) {
+					m_state = state_t::ok;
+					return;
+				}
+#else
+				off64_t orig = lseek64(m_h, 0, SEEK_CUR);
+				if (orig >= 0) {
+					if (offset > std::numeric_limits<off64_t>::max())
+						throw std::invalid_argument("file offset too big");
+					if (length > std::numeric_limits<off64_t>::max())
+						throw std::invalid_argument("file section length too big");
+					if (lseek64(m_h, static_cast<off64_t>(offset), SEEK_SET) >= 0 && lockf64(m_h, F_ULOCK, static_cast<off64_t>(length)) >= 0) {
+						lseek64(m_h, orig, SEEK_SET);
+						m_state = state_t::ok;
+						return;
+					}
+					lseek64(m_h, orig, SEEK_SET);
+				}
+#endif
+				m_state = state_t::fail;
+			}
+
+			virtual void hint(_In_ fpos_t offset, _In_ fsize_t length, _In_ access_t access)
+			{
+#if defined(_WIN32)
+				// Windows takes access pattern hints on open only.
+				_Unreferenced_(offset);
+				_Unreferenced_(length);
+				_Unreferenced_(access);
+#elif defined(__APPLE__)
+				if (access == access_t::will_need && offset <= static_cast<fpos_t>(std::numeric_limits<off_t>::max())) {
+					radvisory ra;
+					ra.ra_offset = static_cast<off_t>(offset);
+					ra.ra_count = static_cast<int>(std::min<fsize_t>(length, INT_MAX));
+					fcntl(m_h, F_RDADVISE, &ra);
+				}
+#else
+				if (offset > static_cast<fpos_t>(std::numeric_limits<off64_t>::max())) _Unlikely_
+					return;
+				int advice;
+				switch (access) {
+				case access_t::normal: advice = POSIX_FADV_NORMAL; break;
+				case access_t::sequential: advice = POSIX_FADV_SEQUENTIAL; break;
+				case access_t::random: advice = POSIX_FADV_RANDOM; break;
+				case access_t::will_need: advice = POSIX_FADV_WILLNEED; break;
+				case access_t::dont_need: advice = POSIX_FADV_DONTNEED; break;
+				default: return;
+				}
+				// Zero length extends to the end of file.
+				posix_fadvise64(m_h, static_cast<off64_t>(offset), length <= static_cast<fsize_t>(std::numeric_limits<off64_t>::max()) ? static_cast<off64_t>(length) : 0, advice);
+#endif
+			}
+
+			virtual fsize_t size() const
+			{
+#ifdef _WIN32
+				LARGE_INTEGER li;
+				li.LowPart = GetFileSize(m_h, (LPDWORD)&li.HighPart);
+				if (li.LowPart == 0xFFFFFFFF && GetLastError() != NO_ERROR)
+					li.QuadPart = -1;
+				return li.QuadPart;
+#else
+				off64_t orig = lseek64(m_h, 0, SEEK_CUR);
+				if (orig >= 0) {
+					off64_t length = lseek64(m_h, 0, SEEK_END);
+					lseek64(m_h, orig, SEEK_SET);
+					if (length >= 0)
+						return static_cast<fsize_t>(length);
+				}
+				return fsize_max;
+#endif
+			}
+
+			virtual void truncate()
+			{
+#ifdef _WIN32
+				if (SetEndOfFile(m_h)) {
+					m_state = state_t::ok;
+					return;
+				}
+#else
+				off64_t length = lseek64(m_h, 0, SEEK_CUR);
+				if (length >= 0 && ftruncate64(m_h, length) >= 0) {
+					m_state = state_t::ok;
+					return;
+				}
+#endif
+				m_state = state_t::fail;
+			}
+
+#ifdef _WIN32
+			static time_point ft2tp(_In_ const FILETIME& ft)
+			{
+#if _HAS_CXX20
+				uint64_t t = (static_cast<int64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+#else
+				uint64_t t = ((static_cast<int64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) - 116444736000000000ll;
+#endif
+				return time_point(time_point::duration(t));
+			}
+
+			static void tp2ft(_In_ time_point tp, _Out_ FILETIME& ft)
+			{
+#if _HAS_CXX20
+				uint64_t t = tp.time_since_epoch().count();
+#else
+				uint64_t t = tp.time_since_epoch().count() + 116444736000000000ll;
+#endif
+				ft.dwHighDateTime = static_cast<DWORD>((t >> 32) & 0xffffffff);
+				ft.dwLowDateTime = static_cast<DWORD>(t & 0xffffffff);
+			}
+#endif
+
+			virtual time_point ctime() const
+			{
+#ifdef _WIN32
+				FILETIME ft;
+				if (GetFileTime(m_h, &ft, nullptr, nullptr))
+					return ft2tp(ft);
+#endif
+				return time_point::min();
+			}
+
+			virtual time_point atime() const
+			{
+#ifdef _WIN32
+				FILETIME ft;
+				if (GetFileTime(m_h, nullptr, &ft, nullptr))
+					return ft2tp(ft);
+#else
+				struct stat buf;
+				if (fstat(m_h, &buf) >= 0)
+					return clock::from_time_t(buf.st_atime);
+#endif
+				return time_point::min();
+			}
+
+			virtual time_point mtime() const
+			{
+#ifdef _WIN32
+				FILETIME ft;
+				if (GetFileTime(m_h, nullptr, nullptr, &ft))
+					return ft2tp(ft);
+#else
+				struct stat buf;
+				if (fstat(m_h, &buf) >= 0)
+					return clock::from_time_t(buf.st_mtime);
+#endif
+				return time_point::min();
+			}
+
+			virtual void set_ctime(time_point date)
+			{
+				stdex_assert(m_h != invalid_handle);
+#ifdef _WIN32
+				FILETIME ft;
+				tp2ft(date, ft);
+				if (SetFileTime(m_h, &ft, nullptr, nullptr))
+					return;
+				throw std::system_error(GetLastError(), std::system_category(), "SetFileTime failed");
+#else
+				_Unreferenced_(date);
+				throw std::runtime_error("not supported");
+#endif
+			}
+
+			virtual void set_atime(time_point date)
+			{
+				stdex_assert(m_h != invalid_handle);
+#ifdef _WIN32
+				FILETIME ft;
+				tp2ft(date, ft);
+				if (SetFileTime(m_h, nullptr, &ft, nullptr))
+					return;
+				throw std::system_error(GetLastError(), std::system_category(), "SetFileTime failed");
+#else
+				struct timespec ts[2] = {
+					{ date.time_since_epoch().count(), 0 },
+					{ 0, UTIME_OMIT },
+				};
+				if (futimens(m_h, ts) >= 0)
+					return;
+				throw std::system_error(errno, std::system_category(), "futimens failed");
+#endif
+			}
+
+			virtual void set_mtime(time_point date)
+			{
+#ifdef _WIN32
+				FILETIME ft;
+				tp2ft(date, ft);
+				if (SetFileTime(m_h, nullptr, nullptr, &ft))
+					return;
+				throw std::system_error(GetLastError(), std::system_category(), "SetFileTime failed");
+#else
+				struct timespec ts[2] = {
+					{ 0, UTIME_OMIT },
+					{ date.time_since_epoch().count(), 0 },
+				};
+				if (futimens(m_h, ts) >= 0)
+					return;
+				throw std::system_error(errno, std::system_category(), "futimens failed");
+#endif
+			}
+
+			///
+			/// Checks if file/folder/symlink likely exists
+			///
+			/// \param[in] filename  Filename
+			///
+			static bool exists(_In_z_ const stdex::schar_t* filename)
+			{
+#ifdef _WIN32
+				return GetFileAttributes(filename) != INVALID_FILE_ATTRIBUTES;
+#else
+				struct stat s;
+				return stat(filename, &s) == 0;
+#endif
+			}
+
+			///
+			/// Checks if file/folder/symlink likely exists
+			///
+			/// \param[in] filename  Filename
+			///
+			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
+			static bool exists(_In_ const std::basic_string<TR, AX>& filename)
+			{
+				return exists(filename.c_str());
+			}
+
+			///
+			/// Checks if file/folder/symlink is read-only
+			///
+			/// For inexistent or inaccessible paths, writability is assumed.
+			///
+			/// \param[in] filename  Filename
+			///
+			static bool readonly(_In_z_ const stdex::schar_t* filename)
+			{
+#ifdef _WIN32
+				DWORD dwAttr = GetFileAttributes(filename);
+				return dwAttr != INVALID_FILE_ATTRIBUTES && (dwAttr & FILE_ATTRIBUTE_READONLY) != 0;
+#else
+				struct stat s;
+				return stat(filename, &s) == 0 && (s.st_mode & (S_IWUSR|S_IWGRP|S_IWOTH)) == 0;
+#endif
+			}
+
+			///
+			/// Checks if file/folder/symlink is read-only
+			///
+			/// For inexistent or inaccessible paths, writability is assumed.
+			///
+			/// \param[in] filename  Filename
+			///
+			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
+			static bool readonly(_In_ const std::basic_string<TR, AX>& filename)
+			{
+				return readonly(filename.c_str());
+			}
+		};
+#pragma warning(pop)
+
+		///
+		/// Cached file-system file
+		///
+		class cached_file : public cache
+		{
+		public:
+			cached_file(_In_opt_ sys_handle h = invalid_handle, _In_ state_t state = state_t::ok, _In_ size_t cache_size = default_cache_size, _In_ size_t cache_count = default_cache_count) :
+				cache(cache_size, cache_count),
+				m_source(h, state)
+			{
+				init(m_source);
+			}
+
+			///
+			/// Opens file
+			///
+			/// \param[in] filename     Filename
+			/// \param[in] mode         Bitwise combination of mode_t flags
+			/// \param[in] cache_size   Size of the cache block
+			/// \param[in] cache_count  Number of cache blocks
+			///
+			cached_file(_In_z_ const schar_t* filename, _In_ int mode, _In_ size_t cache_size = default_cache_size, _In_ size_t cache_count = default_cache_count) :
+				cache(cache_size, cache_count),
+				m_source(filename, mode & mode_for_writing ? mode | mode_for_reading : mode)
+			{
+				init(m_source);
+			}
+
+			///
+			/// Opens file
+			///
+			/// \param[in] filename     Filename
+			/// \param[in] mode         Bitwise combination of mode_t flags
+			/// \param[in] cache_size   Size of the cache block
+			/// \param[in] cache_count  Number of cache blocks
+			///
+			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
+			cached_file(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode, _In_ size_t cache_size = default_cache_size, _In_ size_t cache_count = default_cache_count) : cached_file(filename.c_str(), mode, cache_size, cache_count) {}
+
+			virtual ~cached_file()
+			{
+				done();
+			}
+
+			///
+			/// Opens file
+			///
+			/// \param[in] filename    Filename
+			/// \param[in] mode        Bitwise combination of mode_t flags
+			///
+			void open(_In_z_ const schar_t* filename, _In_ int mode)
+			{
+				invalidate_cache();
+				if (!ok()) _Unlikely_{
+					m_state = state_t::fail;
+					return;
+				}
+				m_source.open(filename, mode & mode_for_writing ? mode | mode_for_reading : mode);
+				if (m_source.ok()) {
+					init();
+					return;
+				}
+				m_state = state_t::fail;
+			}
+
+			///
+			/// Opens file
+			///
+			/// \param[in] filename    Filename
+			/// \param[in] mode        Bitwise combination of mode_t flags
+			///
+			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
+			void open(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode)
+			{
+				open(filename.c_str(), mode);
+			}
+
+			///
+			/// Returns true if file has a valid handle
+			///
+			operator bool() const noexcept { return m_source; }
+
+		protected:
+			file m_source;
+		};
+
+		constexpr size_t default_direct_alignment = 0x1000; ///< Default file offset, size and memory alignment for direct I/O
+		constexpr size_t default_direct_block_size = 0x100000; ///< Default direct I/O buffer size
+
+		///
+		/// File-system file bypassing system cache
+		///
+		/// The file is opened with mode_direct. Reads and writes go through an aligned buffer, so they need not be
+		/// aligned. Transfers of whole blocks to or from aligned memory at aligned file offsets bypass the buffer. Writes
+		/// are padded to the alignment and the file is truncated back to its size on flush and close.
+		///
+		class direct_file : public basic_file
+		{
+		public:
+			///
+			/// Opens file
+			///
+			/// \param[in] filename    Filename
+			/// \param[in] mode        Bitwise combination of mode_t flags. mode_direct is implied.
+			/// \param[in] block_size  Size of the buffer. Must be a multiple of alignment.
+			/// \param[in] alignment   File offset, size and memory alignment required by the device. Must be a power of two.
+			///
+			direct_file(_In_z_ const schar_t* filename, _In_ int mode, _In_ size_t block_size = default_direct_block_size, _In_ size_t alignment = default_direct_alignment) :
+				basic(state_t::fail),
+				m_alignment(alignment),
+				m_block_size(block_size),
+				m_block(fpos_max),
+				m_offset(0),
+				m_size(0),
+				m_padded(false)
+			{
+				if (!alignment || (alignment & (alignment - 1)) || !block_size || block_size % alignment) _Unlikely_
+					throw std::invalid_argument("invalid block size or alignment");
+				m_buffer.reset(new uint8_t[block_size + alignment - 1]);
+				m_data = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(m_buffer.get()) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+				open(filename, mode);
+			}
+
+			///
+			/// Opens file
+			///
+			/// \param[in] filename    Filename
+			/// \param[in] mode        Bitwise combination of mode_t flags. mode_direct is implied.
+			/// \param[in] block_size  Size of the buffer. Must be a multiple of alignment.
+			/// \param[in] alignment   File offset, size and memory alignment required by the device. Must be a power of two.
+			///
+			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
+			direct_file(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode, _In_ size_t block_size = default_direct_block_size, _In_ size_t alignment = default_direct_alignment) : direct_file(filename.c_str(), mode, block_size, alignment) {}
+
+			virtual ~direct_file() noexcept(false)
+			{
+				if (m_source) {
+					if (!flush_buffer()) _Unlikely_
+						throw std::system_error(sys_error(), std::system_category(), "failed to flush buffer"); // Data loss occurred
+					trim();
+				}
+			}
+
+			///
+			/// Opens file
+			///
+			/// \param[in] filename    Filename
+			/// \param[in] mode        Bitwise combination of mode_t flags. mode_direct is implied.
+			///
+			void open(_In_z_ const schar_t* filename, _In_ int mode)
+			{
+				if (m_source)
+					close();
+				m_source.open(filename, (mode & mode_for_writing ? mode | mode_for_reading : mode) | mode_direct);
+				if (m_source.ok()) {
+					m_size = m_source.size();
+					m_offset = m_source.tell();
+					m_state = m_size != fsize_max && m_offset != fpos_max ? state_t::ok : state_t::fail;
+					return;
+				}
+				m_state = state_t::fail;
+			}
+
+			///
+			/// Opens file
+			///
+			/// \param[in] filename    Filename
+			/// \param[in] mode        Bitwise combination of mode_t flags. mode_direct is implied.
+			///
+			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
+			void open(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode)
+			{
+				open(filename.c_str(), mode);
+			}
+
+			///
+			/// Returns true if file has a valid handle
+			///
+			operator bool() const noexcept { return m_source; }
+
+			virtual _Success_(return != 0 || length == 0) size_t read(
+				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				size_t to_read = length;
+				for (;;) {
+					if (!to_read) {
+						m_state = state_t::ok;
+						return length;
+					}
+					if (m_offset >= m_size) {
+						m_state = to_read < length ? state_t::ok : state_t::eof;
+						return length - to_read;
+					}
+					size_t available = static_cast<size_t>(std::min<fsize_t>(to_read, m_size - m_offset));
+					if (available >= m_block_size && aligned(m_offset, data)) {
+						// Read whole blocks directly.
+						if (!flush_buffer()) _Unlikely_
+							break;
+						size_t num_read = m_source.read_at(m_offset, data, available - available % m_block_size);
+						m_offset += num_read;
+						to_read -= num_read;
+						reinterpret_cast<uint8_t*&>(data) += num_read;
+						if (!num_read) _Unlikely_
+							break;
+						continue;
+					}
+					if (!load(m_offset)) _Unlikely_
+						break;
+					size_t block_offset = static_cast<size_t>(m_offset - m_block);
+					size_t num_read = std::min(available, m_block_size - block_offset);
+					memcpy(data, m_data + block_offset, num_read);
+					m_offset += num_read;
+					to_read -= num_read;
+					reinterpret_cast<uint8_t*&>(data) += num_read;
+				}
+				m_state = to_read < length ? state_t::ok : state_t::fail;
+				return length - to_read;
+			}
+
+			virtual _Success_(return != 0) size_t write(
+				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				size_t to_write = length;
+				for (;;) {
+					if (!to_write) {
+						m_state = state_t::ok;
+						return length;
+					}
+					if (to_write >= m_block_size && aligned(m_offset, data)) {
+						// Write whole blocks directly.
+						if (!flush_buffer()) _Unlikely_
+							break;
+						size_t n = to_write - to_write % m_block_size;
+						if (m_block != fpos_max && m_block < m_offset + n && m_offset < m_block + m_block_size)
+							m_block = fpos_max;
+						size_t num_written = m_source.write_at(m_offset, data, n);
+						m_offset += num_written;
+						if (m_size < m_offset)
+							m_size = m_offset;
+						to_write -= num_written;
+						reinterpret_cast<const uint8_t*&>(data) += num_written;
+						if (num_written < n) _Unlikely_
+							break;
+						continue;
+					}
+					if (!load(m_offset)) _Unlikely_
+						break;
+					size_t block_offset = static_cast<size_t>(m_offset - m_block);
+					size_t num_written = std::min(to_write, m_block_size - block_offset);
+					memcpy(m_data + block_offset, data, num_written);
+					if (m_dirty.empty()) {
+						m_dirty.start = block_offset;
+						m_dirty.end = block_offset + num_written;
+					}
+					else {
+						m_dirty.start = std::min(m_dirty.start, block_offset);
+						m_dirty.end = std::max(m_dirty.end, block_offset + num_written);
+					}
+					m_offset += num_written;
+					if (m_size < m_offset)
+						m_size = m_offset;
+					to_write -= num_written;
+					reinterpret_cast<const uint8_t*&>(data) += num_written;
+				}
+				m_state = state_t::fail;
+				return length - to_write;
+			}
+
+			virtual void close()
+			{
+				bool ok = flush_buffer();
+				if (ok)
+					ok = trim();
+				m_source.close();
+				m_block = fpos_max;
+				m_dirty = interval<size_t>();
+				m_state = ok ? m_source.state() : state_t::fail;
+			}
+
+			virtual void flush()
+			{
+				if (flush_buffer() && trim()) {
+					m_source.flush();
+					m_state = m_source.state();
+				}
+				else
+					m_state = state_t::fail;
+			}
+
+			virtual fpos_t seek(_In_ foff_t offset, _In_ seek_t how = seek_t::beg)
+			{
+				fpos_t base;
+				switch (how) {
+				case seek_t::beg: base = 0; break;
+				case seek_t::cur: base = m_offset; break;
+				case seek_t::end: base = m_size; break;
+				default: throw std::invalid_argument("unknown seek origin");
+				}
+				if (offset < 0 && static_cast<fpos_t>(-offset) > base) _Unlikely_ {
+					m_state = state_t::fail;
+					return fpos_max;
+				}
+				m_state = state_t::ok;
+				return m_offset = base + offset;
+			}
+
+			virtual fpos_t tell() const
+			{
+				return m_source ? m_offset : fpos_max;
+			}
+
+			virtual void lock(_In_ fpos_t offset, _In_ fsize_t length)
+			{
+				m_source.lock(offset, length);
+				m_state = m_source.state();
+			}
+
+			virtual void unlock(_In_ fpos_t offset, _In_ fsize_t length)
+			{
+				m_source.unlock(offset, length);
+				m_state = m_source.state();
+			}
+
+			virtual fsize_t size() const
+			{
+				return m_size;
+			}
+
+			virtual void truncate()
+			{
+				if (!flush_buffer()) _Unlikely_ {
+					m_state = state_t::fail;
+					return;
+				}
+				m_block = fpos_max;
+				m_size = m_offset;
+				m_padded = true;
+				m_state = trim() ? state_t::ok : state_t::fail;
+			}
+
+			virtual time_point ctime() const
+			{
+				return m_source.ctime();
+			}
+
+			virtual time_point atime() const
+			{
+				return m_source.atime();
+			}
+
+			virtual time_point mtime() const
+			{
+				return m_source.mtime();
+			}
+
+			virtual void set_ctime(time_point date)
+			{
+				m_source.set_ctime(date);
+			}
+
+			virtual void set_atime(time_point date)
+			{
+				m_source.set_atime(date);
+			}
+
+			virtual void set_mtime(time_point date)
+			{
+				m_source.set_mtime(date);
+			}
+
+		protected:
+			/// \cond internal
+			bool aligned(_In_ fpos_t offset, _In_opt_ const void* data) const
+			{
+				return !(offset & (m_alignment - 1)) && !(reinterpret_cast<uintptr_t>(data) & (m_alignment - 1));
+			}
+
+			bool load(_In_ fpos_t offset)
+			{
+				fpos_t block = offset - offset % m_block_size;
+				if (block == m_block)
+					return true;
+				if (!flush_buffer()) _Unlikely_
+					return false;
+				m_block = fpos_max;
+				size_t num_read = 0;
+				if (block < m_size) {
+					size_t expected = static_cast<size_t>(std::min<fsize_t>(m_block_size, m_size - block));
+					num_read = m_source.read_at(block, m_data, m_block_size);
+					if (num_read < expected) _Unlikely_
+						return false;
+				}
+				memset(m_data + num_read, 0, m_block_size - num_read);
+				m_block = block;
+				return true;
+			}
+
+			bool flush_buffer()
+			{
+				if (m_dirty.empty())
+					return true;
+				// Extend dirty region to alignment. Padding is either data read from file or zeros.
+				size_t start = m_dirty.start & ~(m_alignment - 1);
+				size_t end = (m_dirty.end + m_alignment - 1) & ~(m_alignment - 1);
+				m_dirty = interval<size_t>();
+				if (m_source.write_at(m_block + start, m_data + start, end - start) != end - start) _Unlikely_
+					return false;
+				if (m_block + end > m_size)
+					m_padded = true;
+				return true;
+			}
+
+			bool trim()
+			{
+				if (!m_padded)
+					return true;
+				fpos_t offset = m_source.tell();
+				m_source.seekbeg(m_size);
+				m_source.truncate();
+				bool ok = m_source.ok();
+				m_source.seekbeg(offset);
+				m_padded = !ok;
+				return ok;
+			}
+			/// \endcond
+
+		protected:
+			file m_source;
+			size_t m_alignment;
+			size_t m_block_size;
+			std::unique_ptr<uint8_t[]> m_buffer;
+			uint8_t* m_data;            ///< Aligned buffer data
+			fpos_t m_block;             ///< File offset of buffered block or fpos_max if none
+			interval<size_t> m_dirty;   ///< Region of buffer needing to be written
+			fpos_t m_offset;            ///< Logical file pointer
+			fsize_t m_size;             ///< Logical file size
+			bool m_padded;              ///< Was file padded beyond m_size?
+		};
+
+		constexpr size_t default_uring_depth = 8; ///< Default number of requests in flight
+
+		///
+		/// Sequential file stream keeping multiple reads or writes in flight
+		///
+		/// Reads are issued ahead and writes are queued behind in blocks, up to given number of requests in flight. On
+		/// Linux, requests are submitted to io_uring. When io_uring is not available at build or run time, a worker thread
+		/// serves the requests one at a time.
+		///
+		class uring_file : public basic
 		{
-			mode_for_reading = 1 << 0,        ///< Open for reading
-			mode_for_writing = 1 << 1,        ///< Open for writing
-			mode_for_chmod = 1 << 2,          ///< Open for changing file attributes
+		public:
+			///
+			/// Attaches to a file
+			///
+			/// Reading or writing starts at the current file position. File position is updated on close or destruction.
+			///
+			/// \param[in] source       Source file
+			/// \param[in] block_size   Size of a single read or write request
+			/// \param[in] queue_depth  Maximum number of requests in flight
+			/// \param[in] allow_uring  Submit requests to io_uring when available. When false, a worker thread is used.
+			///
+			uring_file(_Inout_ file& source, _In_ size_t block_size = default_block_size, _In_ size_t queue_depth = default_uring_depth, _In_ bool allow_uring = true) :
+				basic(source.state()),
+				m_source(&source),
+				m_block_size(block_size),
+				m_data(new uint8_t[mul(block_size, queue_depth)]),
+				m_blocks(queue_depth),
+				m_head(0),
+				m_pos(0),
+				m_direction(direction_t::none),
+				m_offset(source.tell()),
+				m_next(m_offset),
+#if USE_IO_URING
+				m_uring(allow_uring ? static_cast<unsigned>(std::min<size_t>(queue_depth, UINT_MAX)) : 0),
+#endif
+				m_quit(false)
+			{
+				if (!block_size || !queue_depth || block_size > UINT_MAX) _Unlikely_
+					throw std::invalid_argument("invalid block size or queue depth");
+				for (size_t i = 0; i < queue_depth; ++i)
+					m_blocks[i].data = &m_data[i * block_size];
+#if USE_IO_URING
+				if (m_uring.fd >= 0)
+					return;
+#endif
+				m_worker = std::thread([](_Inout_ uring_file& w) { w.process(); }, std::ref(*this));
+			}
 
-			mode_open_existing = 0 << 3,      ///< Open file, fail if not exists
-			mode_truncate_existing = 1 << 3,  ///< Truncate file, fail if not exists
-			mode_preserve_existing = 2 << 3,  ///< Open file if exists; create file if not exists
-			mode_create_new = 3 << 3,         ///< Create file, fail if exists
-			mode_create = 4 << 3,             ///< Create file if not exists; open and truncate if exists
-			mode_disposition_mask = 7 << 3,   ///< Bitwise mask for creation disposition
+			virtual ~uring_file()
+			{
+				stop();
+				if (m_offset != fpos_max)
+					m_source->seekbeg(m_offset);
+				if (m_worker.joinable()) {
+					{
+						const std::lock_guard<std::mutex> lk(m_mutex);
+						m_quit = true;
+					}
+					m_queue_cv.notify_one();
+					m_worker.join();
+				}
+			}
 
-			mode_append = 1 << 6,             ///< Seek to the end of file after opening
-			mode_text = 0,                    ///< Open as text file
-			mode_binary = 1 << 7,             ///< Open as binary file
+			virtual _Success_(return != 0 || length == 0) size_t read(
+				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				if (!length) _Unlikely_ {
+					m_state = state_t::ok;
+					return 0;
+				}
+				if (m_direction != direction_t::reading) {
+					if (!stop()) _Unlikely_
+						return 0;
+					for (auto& b : m_blocks) {
+						b.offset = m_next;
+						b.length = m_block_size;
+						m_next += m_block_size;
+						submit(b, false);
+					}
+					m_head = m_pos = 0;
+					m_direction = direction_t::reading;
+				}
+				for (size_t to_read = length;;) {
+					block_t& b = m_blocks[m_head];
+					wait(b);
+					if (b.error) _Unlikely_ {
+						m_state = to_read < length ? state_t::ok : state_t::fail;
+						return length - to_read;
+					}
+					size_t num_read = b.num_done - m_pos;
+					if (!num_read) {
+						if (b.num_done < b.length) {
+							m_state = to_read < length ? state_t::ok : state_t::eof;
+							return length - to_read;
+						}
+						// Block consumed. Reuse it to read ahead.
+						b.offset = m_next;
+						m_next += m_block_size;
+						submit(b, false);
+						m_head = (m_head + 1) % m_blocks.size();
+						m_pos = 0;
+						continue;
+					}
+					if (to_read < num_read)
+						num_read = to_read;
+					memcpy(data, b.data + m_pos, num_read);
+					m_pos += num_read;
+					m_offset += num_read;
+					to_read -= num_read;
+					if (!to_read) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<uint8_t*&>(data) += num_read;
+				}
+			}
+
+			virtual _Success_(return != 0) size_t write(
+				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				if (!length) _Unlikely_ {
+					m_state = state_t::ok;
+					return 0;
+				}
+				if (m_direction != direction_t::writing) {
+					if (!stop()) _Unlikely_
+						return 0;
+					m_head = m_pos = 0;
+					m_blocks[m_head].offset = m_offset;
+					m_direction = direction_t::writing;
+				}
+				for (size_t to_write = length;;) {
+					block_t& b = m_blocks[m_head];
+					size_t num_written = std::min(to_write, m_block_size - m_pos);
+					memcpy(b.data + m_pos, data, num_written);
+					m_pos += num_written;
+					m_offset += num_written;
+					to_write -= num_written;
+					if (m_pos == m_block_size) {
+						b.length = m_pos;
+						submit(b, true);
+						m_head = (m_head + 1) % m_blocks.size();
+						m_pos = 0;
+						block_t& next = m_blocks[m_head];
+						wait(next);
+						next.offset = m_offset;
+						if (next.error) _Unlikely_ {
+							next.error = 0;
+							m_state = state_t::fail;
+							return length - to_write;
+						}
+					}
+					if (!to_write) {
+						m_state = state_t::ok;
+						return length;
+					}
+					reinterpret_cast<const uint8_t*&>(data) += num_written;
+				}
+			}
+
+			virtual void close()
+			{
+				stop();
+				m_source->close();
+				m_offset = m_next = fpos_max;
+				m_state = m_source->state();
+			}
+
+			virtual void flush()
+			{
+				if (m_direction == direction_t::writing && !stop()) _Unlikely_
+					return;
+				m_source->flush();
+				m_state = m_source->state();
+			}
+
+			///
+			/// Returns true if requests are submitted to io_uring
+			///
+			bool uring() const noexcept
+			{
+#if USE_IO_URING
+				return m_uring.fd >= 0;
+#else
+				return false;
+#endif
+			}
+
+		protected:
+			/// \cond internal
+			struct block_t {
+				uint8_t* data;
+				fpos_t offset;      ///< File offset of the request
+				size_t length;      ///< Number of bytes requested
+				size_t num_done;    ///< Number of bytes read or written
+				int error;          ///< Error code of the request
+				bool write;         ///< Is write request?
+				enum class status_t {
+					idle = 0,
+					pending,
+					complete,
+				} status;
+
+				block_t() :
+					data(nullptr),
+					offset(0),
+					length(0),
+					num_done(0),
+					error(0),
+					write(false),
+					status(status_t::idle)
+				{}
+			};
+
+			///
+			/// Waits for all requests to complete
+			///
+			/// \return true if all requests succeeded
+			///
+			bool stop()
+			{
+				if (m_direction == direction_t::writing && m_pos) {
+					block_t& b = m_blocks[m_head];
+					b.length = m_pos;
+					submit(b, true);
+				}
+				bool succeeded = true;
+				for (auto& b : m_blocks) {
+					wait(b);
+					if (b.error) {
+						// Failed read-ahead beyond current offset is not an error.
+						if (b.write)
+							succeeded = false;
+						b.error = 0;
+					}
+					b.status = block_t::status_t::idle;
+				}
+				m_direction = direction_t::none;
+				m_next = m_offset;
+				m_state = succeeded ? state_t::ok : state_t::fail;
+				return succeeded;
+			}
+
+			void submit(_Inout_ block_t& b, _In_ bool write)
+			{
+				b.num_done = 0;
+				b.error = 0;
+				b.write = write;
+#if USE_IO_URING
+				if (m_uring.fd >= 0) {
+					b.status = block_t::status_t::pending;
+					resubmit(b);
+					return;
+				}
+#endif
+				{
+					const std::lock_guard<std::mutex> lk(m_mutex);
+					b.status = block_t::status_t::pending;
+					m_queue.push_back(&b);
+				}
+				m_queue_cv.notify_one();
+			}
+
+			void wait(_Inout_ block_t& b)
+			{
+#if USE_IO_URING
+				if (m_uring.fd >= 0) {
+					while (b.status == block_t::status_t::pending) {
+						io_uring_cqe cqe;
+						if (!m_uring.reap(cqe)) _Unlikely_
+							throw std::system_error(errno, std::system_category(), "io_uring_enter failed");
+						block_t& c = *reinterpret_cast<block_t*>(static_cast<uintptr_t>(cqe.user_data));
+						if (cqe.res > 0) {
+							c.num_done += static_cast<size_t>(cqe.res);
+							if (c.num_done < c.length) {
+								// Short transfer. Continue with the rest of the block.
+								resubmit(c);
+								continue;
+							}
+						}
+						else if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+							resubmit(c);
+							continue;
+						}
+						else if (cqe.res < 0 || c.write)
+							c.error = cqe.res < 0 ? -cqe.res : EIO;
+						c.status = block_t::status_t::complete;
+					}
+					return;
+				}
+#endif
+				std::unique_lock<std::mutex> lk(m_mutex);
+				m_done_cv.wait(lk, [&b] { return b.status != block_t::status_t::pending; });
+			}
+
+#if USE_IO_URING
+			void resubmit(_Inout_ block_t& b)
+			{
+				if (!m_uring.submit(
+					b.write ? IORING_OP_WRITE : IORING_OP_READ,
+					m_source->get(),
+					b.data + b.num_done,
+					static_cast<unsigned>(b.length - b.num_done),
+					b.offset + b.num_done,
+					reinterpret_cast<uintptr_t>(&b))) _Unlikely_
+				{
+					b.error = errno;
+					b.status = block_t::status_t::complete;
+				}
+			}
+#endif
+
+			void process()
+			{
+				for (;;) {
+					block_t* b;
+					{
+						std::unique_lock<std::mutex> lk(m_mutex);
+						m_queue_cv.wait(lk, [this] { return m_quit || !m_queue.empty(); });
+						if (m_queue.empty())
+							break;
+						b = m_queue.front();
+						m_queue.pop_front();
+					}
+					m_source->seekbeg(b->offset);
+					while (m_source->ok() && b->num_done < b->length) {
+						size_t num_done = b->write ?
+							m_source->write(b->data + b->num_done, b->length - b->num_done) :
+							m_source->read(b->data + b->num_done, b->length - b->num_done);
+						if (!num_done)
+							break;
+						b->num_done += num_done;
+					}
+					{
+						const std::lock_guard<std::mutex> lk(m_mutex);
+						if (m_source->state() == state_t::fail || (b->write && b->num_done < b->length))
+							b->error = EIO;
+						b->status = block_t::status_t::complete;
+					}
+					m_done_cv.notify_all();
+				}
+			}
+
+#if USE_IO_URING
+			///
+			/// io_uring instance
+			///
+			struct uring_t {
+				int fd;
+				void* sq_ring;
+				size_t sq_ring_size;
+				void* cq_ring;
+				size_t cq_ring_size;
+				io_uring_sqe* sqes;
+				size_t sqes_size;
+				unsigned* sq_tail;
+				unsigned sq_mask;
+				unsigned* sq_array;
+				unsigned* cq_head;
+				unsigned* cq_tail;
+				unsigned cq_mask;
+				io_uring_cqe* cqes;
+
+				///
+				/// Sets up io_uring
+				///
+				/// \param[in] entries  Number of ring entries or 0 to leave io_uring unused
+				///
+				uring_t(_In_ unsigned entries) :
+					fd(-1),
+					sq_ring(MAP_FAILED),
+					cq_ring(MAP_FAILED),
+					sqes(reinterpret_cast<io_uring_sqe*>(MAP_FAILED))
+				{
+					if (!entries)
+						return;
+					io_uring_params p;
+					memset(&p, 0, sizeof(p));
+					fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+					if (fd < 0)
+						return;
+					// IORING_OP_READ and IORING_OP_WRITE were introduced together with IORING_FEAT_RW_CUR_POS in Linux 5.6.
+					if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+						done();
+						return;
+					}
+					sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+					cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+					if (p.features & IORING_FEAT_SINGLE_MMAP)
+						sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+					sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+					if (sq_ring == MAP_FAILED) {
+						done();
+						return;
+					}
+					cq_ring = p.features & IORING_FEAT_SINGLE_MMAP ?
+						sq_ring :
+						mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+					sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+					sqes = reinterpret_cast<io_uring_sqe*>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+					if (cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+						done();
+						return;
+					}
+					auto sq = reinterpret_cast<uint8_t*>(sq_ring);
+					sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+					sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+					sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+					auto cq = reinterpret_cast<uint8_t*>(cq_ring);
+					cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+					cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+					cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+					cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+				}
+
+				~uring_t()
+				{
+					if (fd >= 0)
+						done();
+				}
 
-			share_none = 0,                   ///< Open for exclusive access (default)
-			share_reading = 1 << 8,           ///< Allow others to read our file
-			share_writing = 1 << 9,           ///< Allow others to write to our file
-			share_deleting = 1 << 10,         ///< Allow others to mark our file for deletion
-			share_all = share_reading | share_writing | share_deleting, // Allow others all operations on our file
+				void done()
+				{
+					if (sqes != MAP_FAILED)
+						munmap(sqes, sqes_size);
+					if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+						munmap(cq_ring, cq_ring_size);
+					if (sq_ring != MAP_FAILED)
+						munmap(sq_ring, sq_ring_size);
+					::close(fd);
+					fd = -1;
+				}
+
+				///
+				/// Submits a read or write request
+				///
+				/// \return true if request was submitted; false otherwise and errno is set
+				///
+				bool submit(_In_ uint8_t opcode, _In_ int file, _In_ void* data, _In_ unsigned length, _In_ uint64_t offset, _In_ uint64_t user_data)
+				{
+					// One request per block and at most as many blocks as ring entries: the submission queue never overflows.
+					unsigned tail = *sq_tail;
+					unsigned index = tail & sq_mask;
+					io_uring_sqe& sqe = sqes[index];
+					memset(&sqe, 0, sizeof(sqe));
+					sqe.opcode = opcode;
+					sqe.fd = file;
+					sqe.addr = reinterpret_cast<uintptr_t>(data);
+					sqe.len = length;
+					sqe.off = offset;
+					sqe.user_data = user_data;
+					sq_array[index] = index;
+					__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+					for (;;) {
+						if (syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0) >= 0)
+							return true;
+						if (errno != EINTR) _Unlikely_
+							return false;
+					}
+				}
 
-			inherit_handle = 1 << 11,         ///< Inherit handle in child processes (Windows-specific)
+				///
+				/// Waits for and retrieves a completed request
+				///
+				/// \return true if request was retrieved; false otherwise and errno is set
+				///
+				bool reap(_Out_ io_uring_cqe& cqe)
+				{
+					for (;;) {
+						unsigned head = *cq_head;
+						if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+							cqe = cqes[head & cq_mask];
+							__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+							return true;
+						}
+						if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) _Unlikely_
+							return false;
+					}
+				}
+			};
+#endif
+			/// \endcond
 
-			hint_write_thru = 1 << 12,        ///< Write operations will not go through any intermediate cache, they will go directly to disk. (Windows-specific)
-			hint_no_buffering = 1 << 13,      ///< The file or device is being opened with no system caching for data reads and writes. (Windows-specific)
-			hint_random_access = 1 << 14,     ///< Access is intended to be random. (Windows-specific)
-			hint_sequential_access = 1 << 15, ///< Access is intended to be sequential from beginning to end. (Windows-specific)
+		protected:
+			file* m_source;
+			size_t m_block_size;
+			std::unique_ptr<uint8_t[]> m_data;
+			std::vector<block_t> m_blocks;
+			size_t m_head;                  ///< Index of the current block
+			size_t m_pos;                   ///< Position in the current block
+			enum class direction_t {
+				none = 0,
+				reading,
+				writing,
+			} m_direction;
+			fpos_t m_offset;                ///< Stream position
+			fpos_t m_next;                  ///< File offset of the next read-ahead block
+#if USE_IO_URING
+			uring_t m_uring;
+#endif
+			std::mutex m_mutex;
+			std::condition_variable m_queue_cv, m_done_cv;
+			std::list<block_t*> m_queue;
+			bool m_quit;
+			std::thread m_worker;
 		};
 
-#pragma warning(push)
-#pragma warning(disable: 4250)
 		///
-		/// File-system file
+		/// In-memory file
 		///
-		class file : virtual public basic_file, virtual public basic_sys
+		class memory_file : public basic_file
 		{
 		public:
-			file(_In_opt_ sys_handle h = invalid_handle, _In_ state_t state = state_t::ok) : basic_sys(h, state) {}
+			memory_file(_In_ state_t state = state_t::ok) :
+				basic(state),
+				m_data(nullptr),
+				m_offset(0),
+				m_size(0),
+				m_reserved(0),
+				m_manage(true)
+			{
+#if SET_FILE_OP_TIMES
+				m_ctime = m_atime = m_mtime = time_point::now();
+#endif
+			}
+
+			///
+			/// Creates an empty file of reserved size
+			///
+			/// \param[in] size   Reserved size
+			/// \param[in] state  Initial stream state
+			///
+			memory_file(_In_ size_t size, _In_ state_t state = state_t::ok) :
+				basic(state),
+				m_data(reinterpret_cast<uint8_t*>(malloc(size))),
+				m_offset(0),
+				m_size(0),
+				m_reserved(size),
+				m_manage(true)
+			{
+				if (!m_data) {
+					m_state = state_t::fail;
+					throw std::bad_alloc();
+				}
+#if SET_FILE_OP_TIMES
+				m_ctime = m_atime = m_mtime = time_point::now();
+#endif
+			}
+
+			///
+			/// Creates a file based on available data
+			///
+			/// \param[in] data      Pointer to data
+			/// \param[in] size      Valid data size
+			/// \param[in] reserved  Reserved data size
+			/// \param[in] manage    Is input data allocated using malloc() and this class may reallocate data?
+			/// \param[in] state     Initial stream state
+			///
+			memory_file(_Inout_ void* data, _In_ size_t size, _In_ size_t reserved, _In_ bool manage = false, _In_ state_t state = state_t::ok) :
+				basic(state),
+				m_data(reinterpret_cast<uint8_t*>(data)),
+				m_offset(0),
+				m_size(size),
+				m_reserved(reserved),
+				m_manage(manage)
+			{
+				stdex_assert(data || !size);
+				stdex_assert(reserved >= size);
+#if SET_FILE_OP_TIMES
+				m_ctime = m_atime = m_mtime = time_point::now();
+#endif
+			}
+
+			///
+			/// Creates a file based on available data
+			///
+			/// \param[in] data      Pointer to data
+			/// \param[in] size      Valid and reserved data size
+			/// \param[in] manage    Is input data allocated using malloc() and this class may reallocate data?
+			/// \param[in] state     Initial stream state
+			///
+			memory_file(_Inout_ void* data, _In_ size_t size, _In_ bool manage = false, _In_ state_t state = state_t::ok) :
+				memory_file(data, size, size, manage, state)
+			{}
+
+			///
+			/// Loads content from file-system file
+			///
+			/// \param[in] filename  Filename
+			/// \param[in] mode      Bitwise combination of mode_t flags
+			///
+			memory_file(_In_z_ const schar_t* filename, _In_ int mode) : memory_file()
+			{
+				load(filename, mode);
+			}
+
+			///
+			/// Loads content from file-system file
+			///
+			/// \param[in] filename  Filename
+			/// \param[in] mode      Bitwise combination of mode_t flags
+			///
+			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
+			memory_file(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode) : memory_file(filename.c_str(), mode) {}
+
+			///
+			/// Copies content from another file
+			///
+			/// \param[in] other  Other file
+			///
+			memory_file(_In_ const memory_file& other) :
+				basic_file(other),
+				m_data(reinterpret_cast<uint8_t*>(malloc(other.m_size))),
+				m_offset(other.m_offset),
+				m_size(other.m_size),
+				m_reserved(other.m_size),
+				m_manage(true)
+#if SET_FILE_OP_TIMES
+				, m_ctime(other.m_ctime)
+				, m_atime(other.m_atime)
+				, m_mtime(other.m_mtime)
+#endif
+			{
+				if (!m_data) {
+					m_state = state_t::fail;
+					throw std::bad_alloc();
+				}
+				memcpy(m_data, other.m_data, other.m_size);
+			}
+
+			///
+			/// Copies content from another file
+			///
+			/// \param[in] other  Other file
+			///
+			memory_file& operator=(_In_ const memory_file& other)
+			{
+				if (this != std::addressof(other)) {
+					*static_cast<basic_file*>(this) = other;
+					if (m_manage && m_data)
+						free(m_data);
+					m_data = reinterpret_cast<uint8_t*>(malloc(other.m_size));
+					if (!m_data) {
+						m_state = state_t::fail;
+						throw std::bad_alloc();
+					}
+					memcpy(m_data, other.m_data, other.m_size);
+					m_offset = other.m_offset;
+					m_size = other.m_size;
+					m_reserved = other.m_size;
+					m_manage = true;
+#if SET_FILE_OP_TIMES
+					m_ctime = other.m_ctime;
+					m_atime = other.m_atime;
+					m_mtime = other.m_mtime;
+#endif
+				}
+				return *this;
+			}
+
+			///
+			/// Moves content from another file
+			///
+			/// \param[in] other  Other file
+			///
+			memory_file(_Inout_ memory_file&& other) noexcept :
+				basic_file(std::move(other)),
+				m_data(other.m_data),
+				m_offset(other.m_offset),
+				m_size(other.m_size),
+				m_reserved(other.m_reserved),
+				m_manage(other.m_manage)
+#if SET_FILE_OP_TIMES
+				, m_ctime(other.m_ctime)
+				, m_atime(other.m_atime)
+				, m_mtime(other.m_mtime)
+#endif
+			{
+				other.m_state = state_t::ok;
+				other.m_data = nullptr;
+				other.m_offset = 0;
+				other.m_size = 0;
+				other.m_reserved = 0;
+				other.m_manage = true;
+#if SET_FILE_OP_TIMES
+				other.m_ctime = other.m_atime = other.m_mtime = time_point::now();
+#endif
+			}
+
+			///
+			/// Moves content from another file
+			///
+			/// \param[in] other  Other file
+			///
+			memory_file& operator=(_Inout_ memory_file&& other) noexcept
+			{
+				if (this != std::addressof(other)) {
+					*static_cast<basic_file*>(this) = std::move(other);
+					if (m_manage && m_data)
+						free(m_data);
+					m_data = other.m_data;
+					other.m_data = nullptr;
+					m_offset = other.m_offset;
+					other.m_offset = 0;
+					m_size = other.m_size;
+					other.m_size = 0;
+					m_reserved = other.m_reserved;
+					other.m_reserved = 0;
+					m_manage = other.m_manage;
+					other.m_manage = true;
+#if SET_FILE_OP_TIMES
+					m_ctime = other.m_ctime;
+					m_atime = other.m_atime;
+					m_mtime = other.m_mtime;
+					other.m_ctime = other.m_atime = other.m_mtime = time_point::now();
+#endif
+				}
+				return *this;
+			}
+
+			virtual ~memory_file()
+			{
+				if (m_manage && m_data)
+					free(m_data);
+			}
 
 			///
-			/// Opens file
+			/// Reallocates memory
+			///
+			/// \param[in] required  Demanded memory size
+			/// \param[in] tight     Don't over-allocate on grow, release excessive on decrease.
+			///
+			void reserve(_In_ size_t required, _In_ bool tight = false) noexcept
+			{
+				if (required <= m_reserved && (!tight || required >= m_reserved)) {
+					m_state = state_t::ok;
+					return;
+				}
+				if (!m_manage) {
+					m_state = state_t::fail;
+					return;
+				}
+				size_t reserved = tight ? required : ((required + required / 4 + (default_block_size - 1)) / default_block_size) * default_block_size;
+				auto data = reinterpret_cast<uint8_t*>(realloc(m_data, reserved));
+				if (!data && reserved) _Unlikely_ {
+					m_state = state_t::fail;
+					return;
+				}
+				m_data = data;
+				if (reserved < m_size)
+					m_size = reserved;
+				m_reserved = reserved;
+				m_state = state_t::ok;
+			}
+
+			///
+			/// Loads content from a file-system file
 			///
 			/// \param[in] filename  Filename
 			/// \param[in] mode      Bitwise combination of mode_t flags
 			///
-			file(_In_z_ const schar_t* filename, _In_ int mode)
+			void load(_In_z_ const schar_t* filename, _In_ int mode)
 			{
-				open(filename, mode);
+				file f(filename, (mode & ~hint_random_access) | mode_for_reading | hint_sequential_access);
+				if (!f.ok()) {
+					m_state = state_t::fail;
+					return;
+				}
+				fsize_t size = f.size();
+				if (size > SIZE_MAX) {
+					m_state = state_t::fail;
+					return;
+				}
+				reserve(static_cast<size_t>(size), true);
+				if (!ok()) _Unlikely_ {
+					return;
+				}
+				m_offset = m_size = 0;
+				write_stream(f);
+				if (ok())
+					m_offset = 0;
+#if SET_FILE_OP_TIMES
+				m_ctime = f.ctime();
+				m_atime = f.atime();
+				m_mtime = f.mtime();
+#endif
 			}
 
 			///
-			/// Opens file
+			/// Loads content from a file-system file
 			///
 			/// \param[in] filename  Filename
 			/// \param[in] mode      Bitwise combination of mode_t flags
 			///
 			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
-			file(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode) : file(filename.c_str(), mode) {}
+			void load(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode)
+			{
+				load(filename.c_str(), mode);
+			}
 
 			///
-			/// Opens file
+			/// Saves content to a file-system file
 			///
 			/// \param[in] filename  Filename
 			/// \param[in] mode      Bitwise combination of mode_t flags
 			///
-			void open(_In_z_ const schar_t* filename, _In_ int mode)
+			void save(_In_z_ const schar_t* filename, _In_ int mode)
 			{
-				if (m_h != invalid_handle)
-					close();
-
-#ifdef _WIN32
-				DWORD dwDesiredAccess = 0;
-				if (mode & mode_for_reading) dwDesiredAccess |= GENERIC_READ;
-				if (mode & mode_for_writing) dwDesiredAccess |= GENERIC_WRITE;
-				if (mode & mode_for_chmod)   dwDesiredAccess |= FILE_WRITE_ATTRIBUTES;
-
-				DWORD dwShareMode = 0;
-				if (mode & share_reading)  dwShareMode |= FILE_SHARE_READ;
-				if (mode & share_writing)  dwShareMode |= FILE_SHARE_WRITE;
-				if (mode & share_deleting) dwShareMode |= FILE_SHARE_DELETE;
-
-				SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES) };
-				sa.bInheritHandle = mode & inherit_handle ? true : false;
-
-				DWORD dwCreationDisposition;
-				switch (mode & mode_disposition_mask) {
-				case mode_open_existing: dwCreationDisposition = OPEN_EXISTING; break;
-				case mode_truncate_existing: dwCreationDisposition = TRUNCATE_EXISTING; break;
-				case mode_preserve_existing: dwCreationDisposition = OPEN_ALWAYS; break;
-				case mode_create_new: dwCreationDisposition = CREATE_NEW; break;
-				case mode_create: dwCreationDisposition = CREATE_ALWAYS; break;
-				default: throw std::invalid_argument("invalid mode");
-				}
-
-				DWORD dwFlagsAndAttributes = FILE_ATTRIBUTE_NORMAL;
-				if (mode & hint_write_thru)        dwFlagsAndAttributes |= FILE_FLAG_WRITE_THROUGH;
-				if (mode & hint_no_buffering)      dwFlagsAndAttributes |= FILE_FLAG_NO_BUFFERING;
-				if (mode & hint_random_access)     dwFlagsAndAttributes |= FILE_FLAG_RANDOM_ACCESS;
-				if (mode & hint_sequential_access) dwFlagsAndAttributes |= FILE_FLAG_SEQUENTIAL_SCAN;
-
-				m_h = CreateFile(filename, dwDesiredAccess, dwShareMode, &sa, dwCreationDisposition, dwFlagsAndAttributes, NULL);
-#else
-				int flags = 0;
-				switch (mode & (mode_for_reading | mode_for_writing)) {
-				case mode_for_reading: flags |= O_RDONLY; break;
-				case mode_for_writing: flags |= O_WRONLY; break;
-				case mode_for_reading | mode_for_writing: flags |= O_RDWR; break;
+				file f(filename, (mode & ~hint_random_access) | mode_for_writing | hint_sequential_access);
+				if (!f.ok()) {
+					m_state = state_t::fail;
+					return;
 				}
-				switch (mode & mode_disposition_mask) {
-				case mode_open_existing: break;
-				case mode_truncate_existing: flags |= O_TRUNC; break;
-				case mode_preserve_existing: flags |= O_CREAT; break;
-				case mode_create_new: flags |= O_CREAT | O_EXCL; break;
-				case mode_create: flags |= O_CREAT | O_TRUNC; break;
-				default: throw std::invalid_argument("invalid mode");
+				f.write(m_data, m_size);
+				if (!f.ok()) {
+					m_state = state_t::fail;
+					return;
 				}
-				if (mode & hint_write_thru) flags |= O_DSYNC;
-#ifndef __APPLE__
-				if (mode & hint_no_buffering) flags |= O_RSYNC;
-#endif
-
-				m_h = ::open(filename, flags, DEFFILEMODE);
+				f.truncate();
+#if SET_FILE_OP_TIMES
+				f.set_ctime(m_ctime);
+				f.set_atime(m_atime);
+				f.set_mtime(m_mtime);
 #endif
-				if (m_h != invalid_handle) {
-					m_state = state_t::ok;
-					if (mode & mode_append)
-						seek(0, seek_t::end);
-				}
-				else
-					m_state = state_t::fail;
 			}
 
 			///
-			/// Opens file
+			/// Saves content to a file-system file
 			///
 			/// \param[in] filename  Filename
 			/// \param[in] mode      Bitwise combination of mode_t flags
 			///
 			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
-			void open(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode)
+			void save(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode)
 			{
-				open(filename.c_str(), mode);
+				save(filename.c_str(), mode);
 			}
 
-			virtual fpos_t seek(_In_ foff_t offset, _In_ seek_t how = seek_t::beg)
+			///
+			/// Returns pointer to data
+			///
+			const void* data() const { return m_data; }
+
+			virtual _Success_(return != 0 || length == 0) size_t read(
+				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
 			{
-#ifdef _WIN32
-				LARGE_INTEGER li;
-				li.QuadPart = offset;
-				li.LowPart = SetFilePointer(m_h, li.LowPart, &li.HighPart, static_cast<DWORD>(how));
-				if (li.LowPart != 0xFFFFFFFF || GetLastError() == NO_ERROR) {
+				stdex_assert(data || !length);
+#if SET_FILE_OP_TIMES
+				m_atime = time_point::now();
+#endif
+				size_t available = m_offset < m_size ? m_size - m_offset : 0;
+				if (length <= available) {
+					memcpy(data, &m_data[m_offset], length);
+					m_offset += length;
 					m_state = state_t::ok;
-					return li.QuadPart;
+					return length;
 				}
-#else
-				off64_t result = lseek64(m_h, offset, static_cast<int>(how));
-				if (result >= 0) {
-					m_state = state_t::ok;
-					return static_cast<fpos_t>(result);
+				if (length && !available) {
+					m_state = state_t::eof;
+					return 0;
 				}
-#endif
-				m_state = state_t::fail;
-				return fpos_max;
+				memcpy(data, &m_data[m_offset], available);
+				m_offset += available;
+				m_state = state_t::ok;
+				return available;
 			}
 
-			virtual fpos_t tell() const
+			///
+			/// Reads one primitive data type
+			///
+			/// This method is intended for chaining: e.g. stream.read_str(a).read_str(b).read_str(c)...
+			/// Since it would make it impossible to detect if any of the read_str(a) or read_str(b) failed should
+			/// read_str(c) succeed, the method skips reading if stream state is not ok.
+			///
+			/// As memory read rarely fails, a #define CHECK_STREAM_STATE 0 turns this checking off when
+			/// performance is paramount.
+			///
+			/// \param[in] data  Where to store read data
+			///
+			/// \returns This stream
+			///
+			template <class T>
+			memory_file& read_data(_Out_ T& data)
 			{
-				if (m_h != invalid_handle) {
-#ifdef _WIN32
-					LARGE_INTEGER li;
-					li.QuadPart = 0;
-					li.LowPart = SetFilePointer(m_h, 0, &li.HighPart, FILE_CURRENT);
-					if (li.LowPart != 0xFFFFFFFF || GetLastError() == NO_ERROR)
-						return li.QuadPart;
-#else
-					off64_t result = lseek64(m_h, 0, SEEK_CUR);
-					if (result >= 0)
-						return static_cast<fpos_t>(result);
+#if SET_FILE_OP_TIMES
+				m_atime = time_point::now();
 #endif
+				if (CHECK_STREAM_STATE && !ok()) _Unlikely_ {
+					data = 0;
+					return *this;
 				}
-				return fpos_max;
-			}
-
-			virtual void lock(_In_ fpos_t offset, _In_ fsize_t length)
-			{
-#ifdef _WIN32
-				LARGE_INTEGER liOffset;
-				LARGE_INTEGER liSize;
-				liOffset.QuadPart = offset;
-				liSize.QuadPart = length;
-				if (LockFile(m_h, liOffset.LowPart, liOffset.HighPart, liSize.LowPart, liSize.HighPart)) {
+				size_t end_offset = m_offset + sizeof(T);
+				if (end_offset <= m_size) {
+					data = LE2HE(*reinterpret_cast<T*>(&m_data[m_offset]));
+					m_offset = end_offset;
+#if !CHECK_STREAM_STATE
 					m_state = state_t::ok;
-					return;
+#endif
 				}
-#else
-				off64_t orig = lseek64(m_h, 0, SEEK_CUR);
-				if (orig >= 0) {
-					if (offset > std::numeric_limits<off64_t>::max())
-						throw std::invalid_argument("file offset too big");
-					if (length > std::numeric_limits<off64_t>::max())
-						throw std::invalid_argument("file section length too big");
-					m_state = lseek64(m_h, static_cast<off64_t>(offset), SEEK_SET) >= 0 && lockf64(m_h, F_LOCK, static_cast<off64_t>(length)) >= 0 ? state_t::ok : state_t::fail;
-					lseek64(m_h, orig, SEEK_SET);
-					m_state = state_t::ok;
-					return;
+				else {
+					data = 0;
+					m_offset = m_size;
+					m_state = state_t::eof;
 				}
-#endif
-				m_state = state_t::fail;
+				return *this;
 			}
 
-			virtual void unlock(_In_ fpos_t offset, _In_ fsize_t length)
+			///
+			/// Reads length-prefixed string from the stream
+			///
+			/// This method is intended for chaining: e.g. stream.read_str(a).read_str(b).read_str(c)...
+			/// Since it would make it impossible to detect if any of the read_str(a) or read_str(b) failed should
+			/// read_str(c) succeed, the method skips reading if stream state is not ok.
+			///
+			/// As memory read rarely fails, a #define CHECK_STREAM_STATE 0 turns this checking off when
+			/// performance is paramount.
+			///
+			/// \param[in] data  String to read to
+			///
+			/// \return This stream
+			///
+			template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
+			memory_file& read_str(_Inout_ std::basic_string<T, TR, AX>&data)
 			{
-#ifdef _WIN32
-				LARGE_INTEGER liOffset;
-				LARGE_INTEGER liSize;
-				liOffset.QuadPart = offset;
-				liSize.QuadPart = length;
-				if (UnlockFile(m_h, liOffset.LowPart, liOffset.HighPart, liSize.LowPart, liSize.HighPart)) {
-					m_state = state_t::ok;
-					return;
+#if SET_FILE_OP_TIMES
+				m_atime = time_point::now();
+#endif
+				if (CHECK_STREAM_STATE && !ok()) _Unlikely_ {
+					data.clear();
+					return *this;
 				}
-#else
-				off64_t orig = lseek64(m_h, 0, SEEK_CUR);
-				if (orig >= 0) {
-					if (offset > std::numeric_limits<off64_t>::max())
-						throw std::invalid_argument("file offset too big");
-					if (length > std::numeric_limits<off64_t>::max())
-						throw std::invalid_argument("file section length too big");
-					if (lseek64(m_h, static_cast<off64_t>(offset), SEEK_SET) >= 0 && lockf64(m_h, F_ULOCK, static_cast<off64_t>(length)) >= 0) {
-						lseek64(m_h, orig, SEEK_SET);
+				size_t end_offset = m_offset + sizeof(uint32_t);
+				if (end_offset <= m_size) {
+					uint32_t num_chars = LE2HE(*reinterpret_cast<uint32_t*>(&m_data[m_offset]));
+					m_offset = end_offset;
+					end_offset = stdex::add(m_offset, stdex::mul(num_chars, sizeof(T)));
+					T* start = reinterpret_cast<T*>(&m_data[m_offset]);
+					if (end_offset <= m_size) {
+						data.assign(start, start + num_chars);
+						m_offset = end_offset;
+#if !CHECK_STREAM_STATE
 						m_state = state_t::ok;
-						return;
+#endif
+						return *this;
 					}
-					lseek64(m_h, orig, SEEK_SET);
+					if (end_offset <= m_size)
+						data.assign(start, reinterpret_cast<T*>(&m_data[m_size]));
 				}
-#endif
-				m_state = state_t::fail;
+				m_offset = m_size;
+				m_state = state_t::eof;
+				return *this;
 			}
 
-			virtual fsize_t size() const
+			virtual _Success_(return != 0) size_t write(
+				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
 			{
-#ifdef _WIN32
-				LARGE_INTEGER li;
-				li.LowPart = GetFileSize(m_h, (LPDWORD)&li.HighPart);
-				if (li.LowPart == 0xFFFFFFFF && GetLastError() != NO_ERROR)
-					li.QuadPart = -1;
-				return li.QuadPart;
-#else
-				off64_t orig = lseek64(m_h, 0, SEEK_CUR);
-				if (orig >= 0) {
-					off64_t length = lseek64(m_h, 0, SEEK_END);
-					lseek64(m_h, orig, SEEK_SET);
-					if (length >= 0)
-						return static_cast<fsize_t>(length);
-				}
-				return fsize_max;
+				stdex_assert(data || !length);
+#if SET_FILE_OP_TIMES
+				m_atime = m_mtime = time_point::now();
 #endif
-			}
-
-			virtual void truncate()
-			{
-#ifdef _WIN32
-				if (SetEndOfFile(m_h)) {
-					m_state = state_t::ok;
-					return;
-				}
-#else
-				off64_t length = lseek64(m_h, 0, SEEK_CUR);
-				if (length >= 0 && ftruncate64(m_h, length) >= 0) {
-					m_state = state_t::ok;
-					return;
+				size_t end_offset = m_offset + length;
+				if (end_offset > m_reserved) {
+					reserve(end_offset);
+					if (!ok()) _Unlikely_
+						return 0;
 				}
-#endif
-				m_state = state_t::fail;
+				memcpy(&m_data[m_offset], data, length);
+				m_offset = end_offset;
+				if (m_offset > m_size)
+					m_size = m_offset;
+				m_state = state_t::ok;
+				return length;
 			}
 
-#ifdef _WIN32
-			static time_point ft2tp(_In_ const FILETIME& ft)
+			virtual std::tuple<const uint8_t*, size_t> acquire_read(_In_ size_t length)
 			{
-#if _HAS_CXX20
-				uint64_t t = (static_cast<int64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
-#else
-				uint64_t t = ((static_cast<int64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) - 116444736000000000ll;
+#if SET_FILE_OP_TIMES
+				m_atime = time_point::now();
 #endif
-				return time_point(time_point::duration(t));
+				if (m_offset >= m_size) {
+					m_state = length ? state_t::eof : state_t::ok;
+					return { nullptr, 0 };
+				}
+				m_state = state_t::ok;
+				return { &m_data[m_offset], std::min(length, m_size - m_offset) };
 			}
 
-			static void tp2ft(_In_ time_point tp, _Out_ FILETIME& ft)
+			virtual void release_read(_In_ size_t length)
 			{
-#if _HAS_CXX20
-				uint64_t t = tp.time_since_epoch().count();
-#else
-				uint64_t t = tp.time_since_epoch().count() + 116444736000000000ll;
-#endif
-				ft.dwHighDateTime = static_cast<DWORD>((t >> 32) & 0xffffffff);
-				ft.dwLowDateTime = static_cast<DWORD>(t & 0xffffffff);
+				stdex_assert(length <= m_size - m_offset);
+				m_offset += length;
 			}
-#endif
 
-			virtual time_point ctime() const
+			virtual bool can_borrow_ahead() const
 			{
-#ifdef _WIN32
-				FILETIME ft;
-				if (GetFileTime(m_h, &ft, nullptr, nullptr))
-					return ft2tp(ft);
-#endif
-				return time_point::min();
+				return true;
 			}
 
-			virtual time_point atime() const
+			virtual std::tuple<uint8_t*, size_t> acquire_write(_In_ size_t length)
 			{
-#ifdef _WIN32
-				FILETIME ft;
-				if (GetFileTime(m_h, nullptr, &ft, nullptr))
-					return ft2tp(ft);
-#else
-				struct stat buf;
-				if (fstat(m_h, &buf) >= 0)
-					return clock::from_time_t(buf.st_atime);
-#endif
-				return time_point::min();
+				size_t end_offset = add(m_offset, length);
+				if (end_offset > m_reserved) {
+					reserve(end_offset);
+					if (!ok()) _Unlikely_
+						return { nullptr, 0 };
+				}
+				m_state = state_t::ok;
+				return { &m_data[m_offset], length };
 			}
 
-			virtual time_point mtime() const
+			virtual void release_write(_In_ size_t length)
 			{
-#ifdef _WIN32
-				FILETIME ft;
-				if (GetFileTime(m_h, nullptr, nullptr, &ft))
-					return ft2tp(ft);
-#else
-				struct stat buf;
-				if (fstat(m_h, &buf) >= 0)
-					return clock::from_time_t(buf.st_mtime);
+#if SET_FILE_OP_TIMES
+				m_atime = m_mtime = time_point::now();
 #endif
-				return time_point::min();
+				stdex_assert(length <= m_reserved - m_offset);
+				m_offset += length;
+				if (m_offset > m_size)
+					m_size = m_offset;
 			}
 
-			virtual void set_ctime(time_point date)
+			virtual _Success_(return != 0 || length == 0) size_t read_at(
+				_In_ fpos_t offset, _Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
 			{
-				stdex_assert(m_h != invalid_handle);
-#ifdef _WIN32
-				FILETIME ft;
-				tp2ft(date, ft);
-				if (SetFileTime(m_h, &ft, nullptr, nullptr))
-					return;
-				throw std::system_error(GetLastError(), std::system_category(), "SetFileTime failed");
-#else
-				_Unreferenced_(date);
-				throw std::runtime_error("not supported");
-#endif
+				stdex_assert(data || !length);
+				size_t size = m_size;
+				if (offset >= size)
+					return 0;
+				size_t num_read = std::min(length, size - static_cast<size_t>(offset));
+				memcpy(data, &m_data[static_cast<size_t>(offset)], num_read);
+				return num_read;
 			}
 
-			virtual void set_atime(time_point date)
+			///
+			/// Writes block of data at given file position
+			///
+			/// Stream state is not updated. Writes within file size allow concurrent calls from multiple threads. Writes
+			/// extending the file must not run concurrently with any other operation.
+			///
+			/// \param[in] offset  Absolute file position to write to
+			/// \param[in] data    Buffer to write data from
+			/// \param[in] length  Number of bytes to write
+			///
+			/// \return Number of bytes successfully written. On error, fewer bytes than \p length are returned.
+			///
+			virtual _Success_(return != 0) size_t write_at(
+				_In_ fpos_t offset, _In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
 			{
-				stdex_assert(m_h != invalid_handle);
-#ifdef _WIN32
-				FILETIME ft;
-				tp2ft(date, ft);
-				if (SetFileTime(m_h, nullptr, &ft, nullptr))
-					return;
-				throw std::system_error(GetLastError(), std::system_category(), "SetFileTime failed");
-#else
-				struct timespec ts[2] = {
-					{ date.time_since_epoch().count(), 0 },
-					{ 0, UTIME_OMIT },
-				};
-				if (futimens(m_h, ts) >= 0)
-					return;
-				throw std::system_error(errno, std::system_category(), "futimens failed");
-#endif
+				stdex_assert(data || !length);
+				if (offset > SIZE_MAX - length) _Unlikely_
+					return 0;
+				size_t end_offset = static_cast<size_t>(offset) + length;
+				if (end_offset > m_reserved) {
+					state_t state = m_state;
+					reserve(end_offset);
+					bool succeeded = ok();
+					m_state = state;
+					if (!succeeded) _Unlikely_
+						return 0;
+				}
+				if (static_cast<size_t>(offset) > m_size) {
+					// Writing past the end of file. Fill the gap with zeros as the file would.
+					memset(&m_data[m_size], 0, static_cast<size_t>(offset) - m_size);
+				}
+				memcpy(&m_data[static_cast<size_t>(offset)], data, length);
+				if (end_offset > m_size)
+					m_size = end_offset;
+				return length;
 			}
 
-			virtual void set_mtime(time_point date)
+			///
+			/// Writes a byte of data
+			///
+			void write_byte(_In_ uint8_t byte, _In_ size_t amount = 1)
 			{
-#ifdef _WIN32
-				FILETIME ft;
-				tp2ft(date, ft);
-				if (SetFileTime(m_h, nullptr, nullptr, &ft))
-					return;
-				throw std::system_error(GetLastError(), std::system_category(), "SetFileTime failed");
-#else
-				struct timespec ts[2] = {
-					{ 0, UTIME_OMIT },
-					{ date.time_since_epoch().count(), 0 },
-				};
-				if (futimens(m_h, ts) >= 0)
-					return;
-				throw std::system_error(errno, std::system_category(), "futimens failed");
+#if SET_FILE_OP_TIMES
+				m_atime = m_mtime = time_point::now();
 #endif
+				size_t end_offset = m_offset + amount;
+				if (end_offset > m_reserved) {
+					reserve(end_offset);
+					if (!ok()) _Unlikely_
+						return;
+				}
+				memset(&m_data[m_offset], byte, amount);
+				m_offset = end_offset;
+				if (m_offset > m_size)
+					m_size = m_offset;
+				m_state = state_t::ok;
 			}
 
 			///
-			/// Checks if file/folder/symlink likely exists
+			/// Writes one primitive data type
+			///
+			/// This method is intended for chaining: e.g. stream.write_data(a).write_data(b).write_data(c)...
+			/// Since it would make it impossible to detect if any of the write_data(a) or write_data(b) failed should
+			/// write_data(c) succeed, the method skips writing if stream state is not ok.
+			///
+			/// As memory write rarely fails, a #define CHECK_STREAM_STATE 0 turns this checking off when
+			/// performance is paramount.
+			///
+			/// \param[in] data  Data to write
 			///
-			/// \param[in] filename  Filename
+			/// \returns This stream
 			///
-			static bool exists(_In_z_ const stdex::schar_t* filename)
+			template <class T>
+			memory_file& write_data(const T data)
 			{
-#ifdef _WIN32
-				return GetFileAttributes(filename) != INVALID_FILE_ATTRIBUTES;
-#else
-				struct stat s;
-				return stat(filename, &s) == 0;
+#if SET_FILE_OP_TIMES
+				m_atime = m_mtime = time_point::now();
 #endif
+				if (CHECK_STREAM_STATE && !ok()) _Unlikely_
+					return *this;
+				size_t end_offset = m_offset + sizeof(T);
+				if (end_offset > m_reserved) {
+					reserve(end_offset);
+					if (!ok()) _Unlikely_
+						return *this;
+				}
+				(*reinterpret_cast<T*>(&m_data[m_offset])) = HE2LE(data);
+				m_offset = end_offset;
+				if (m_offset > m_size)
+					m_size = m_offset;
+#if !CHECK_STREAM_STATE
+				m_state = state_t::ok;
+#endif
+				return *this;
 			}
 
 			///
-			/// Checks if file/folder/symlink likely exists
-			///
-			/// \param[in] filename  Filename
+			/// Writes string to the stream length-prefixed
 			///
-			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
-			static bool exists(_In_ const std::basic_string<TR, AX>& filename)
-			{
-				return exists(filename.c_str());
-			}
-
+			/// This method is intended for chaining: e.g. stream.write_str(a).write_str(b).write_str(c)...
+			/// Since it would make it impossible to detect if any of the write_str(a) or write_str(b) failed should
+			/// write_str(c) succeed, the method skips writing if stream state is not ok.
 			///
-			/// Checks if file/folder/symlink is read-only
+			/// As memory write rarely fails, a #define CHECK_STREAM_STATE 0 turns this checking off when
+			/// performance is paramount.
 			///
-			/// For inexistent or inaccessible paths, writability is assumed.
+			/// \param[in] data  String to write
 			///
-			/// \param[in] filename  Filename
+			/// \return This stream
 			///
-			static bool readonly(_In_z_ const stdex::schar_t* filename)
+			template <class T>
+			memory_file& write_str(_In_z_ const T * data)
 			{
-#ifdef _WIN32
-				DWORD dwAttr = GetFileAttributes(filename);
-				return dwAttr != INVALID_FILE_ATTRIBUTES && (dwAttr & FILE_ATTRIBUTE_READONLY) != 0;
-#else
-				struct stat s;
-				return stat(filename, &s) == 0 && (s.st_mode & (S_IWUSR|S_IWGRP|S_IWOTH)) == 0;
+#if SET_FILE_OP_TIMES
+				m_atime = m_mtime = time_point::now();
+#endif
+				if (CHECK_STREAM_STATE && !ok()) _Unlikely_
+					return *this;
+				size_t num_chars = stdex::strlen(data);
+				if (num_chars > UINT32_MAX)
+					throw std::invalid_argument("string too long");
+				size_t size_chars = num_chars * sizeof(T);
+				size_t size = sizeof(uint32_t) + size_chars;
+				size_t end_offset = m_offset + size;
+				if (end_offset > m_reserved) {
+					reserve(end_offset);
+					if (!ok()) _Unlikely_
+						return *this;
+				}
+				auto p = &m_data[m_offset];
+				*reinterpret_cast<uint32_t*>(p) = HE2LE((uint32_t)num_chars);
+				memcpy(p + sizeof(uint32_t), data, size_chars);
+				m_offset = end_offset;
+				if (m_offset > m_size)
+					m_size = m_offset;
+#if !CHECK_STREAM_STATE
+				m_state = state_t::ok;
 #endif
+				return *this;
 			}
 
 			///
-			/// Checks if file/folder/symlink is read-only
-			///
-			/// For inexistent or inaccessible paths, writability is assumed.
+			/// Writes string to the stream length-prefixed
 			///
-			/// \param[in] filename  Filename
+			/// This method is intended for chaining: e.g. stream.write_str(a).write_str(b).write_str(c)...
+			/// Since it would make it impossible to detect if any of the write_str(a) or write_str(b) failed should
+			/// write_str(c) succeed, the method skips writing if stream state is not ok.
 			///
-			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
-			static bool readonly(_In_ const std::basic_string<TR, AX>& filename)
-			{
-				return readonly(filename.c_str());
-			}
-		};
-#pragma warning(pop)
-
-		///
-		/// Cached file-system file
-		///
-		class cached_file : public cache
-		{
-		public:
-			cached_file(_In_opt_ sys_handle h = invalid_handle, _In_ state_t state = state_t::ok, _In_ size_t cache_size = default_cache_size) :
-				cache(cache_size),
-				m_source(h, state)
-			{
-				init(m_source);
-			}
-
+			/// As memory write rarely fails, a #define CHECK_STREAM_STATE 0 turns this checking off when
+			/// performance is paramount.
 			///
-			/// Opens file
+			/// \param[in] data  String to write
 			///
-			/// \param[in] filename    Filename
-			/// \param[in] mode        Bitwise combination of mode_t flags
-			/// \param[in] cache_size  Size of the cache block
+			/// \return This stream
 			///
-			cached_file(_In_z_ const schar_t* filename, _In_ int mode, _In_ size_t cache_size = default_cache_size) :
-				cache(cache_size),
-				m_source(filename, mode & mode_for_writing ? mode | mode_for_reading : mode)
+			template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
+			memory_file& write_str(_In_ const std::basic_string<T, TR, AX>& data)
 			{
-				init(m_source);
+#if SET_FILE_OP_TIMES
+				m_atime = m_mtime = time_point::now();
+#endif
+				if (CHECK_STREAM_STATE && !ok()) _Unlikely_
+					return *this;
+				size_t num_chars = data.size();
+				if (num_chars > UINT32_MAX)
+					throw std::invalid_argument("string too long");
+				size_t size_chars = num_chars * sizeof(T);
+				size_t size = sizeof(uint32_t) + size_chars;
+				size_t end_offset = m_offset + size;
+				if (end_offset > m_reserved) {
+					reserve(end_offset);
+					if (!ok()) _Unlikely_
+						return *this;
+				}
+				auto p = &m_data[m_offset];
+				*reinterpret_cast<uint32_t*>(p) = HE2LE((uint32_t)num_chars);
+				memcpy(p + sizeof(uint32_t), data.data(), size_chars);
+				m_offset = end_offset;
+				if (m_offset > m_size)
+					m_size = m_offset;
+#if !CHECK_STREAM_STATE
+				m_state = state_t::ok;
+#endif
+				return *this;
 			}
 
 			///
-			/// Opens file
+			/// Writes content of another stream
 			///
-			/// \param[in] filename    Filename
-			/// \param[in] mode        Bitwise combination of mode_t flags
-			/// \param[in] cache_size  Size of the cache block
+			/// \return Number of bytes written
 			///
-			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
-			cached_file(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode, _In_ size_t cache_size = default_cache_size) : cached_file(filename.c_str(), mode, cache_size) {}
+			size_t write_stream(_Inout_ basic & stream, _In_ size_t amount = SIZE_MAX)
+			{
+#if SET_FILE_OP_TIMES
+				m_atime = m_mtime = time_point::now();
+#endif
+				size_t num_read, dst_offset = m_offset, dst_size = m_offset;
+				size_t num_copied = 0, to_write = amount;
+				m_state = state_t::ok;
+				if (amount != SIZE_MAX) {
+					dst_size = stdex::add(dst_size, amount);
+					reserve(dst_size);
+					if (!ok()) _Unlikely_
+						return 0;
+					while (to_write) {
+						num_read = stream.read(&m_data[dst_offset], to_write);
+						/*dst_size =*/ dst_offset += num_read;
+						num_copied += num_read;
+						to_write -= num_read;
+						if (!stream.ok()) {
+							if (stream.state() != state_t::eof)
+								m_state = state_t::fail;
+							break;
+						}
+					};
+				}
+				else {
+					size_t block_size;
+					while (to_write) {
+						block_size = std::min(to_write, default_block_size);
+						dst_size = stdex::add(dst_size, block_size);
+						reserve(dst_size);
+						if (!ok()) _Unlikely_
+							break;
+						num_read = stream.read(&m_data[dst_offset], block_size);
+						dst_size = dst_offset += num_read;
+						num_copied += num_read;
+						to_write -= num_read;
+						if (!stream.ok()) {
+							if (stream.state() != state_t::eof)
+								m_state = state_t::fail;
+							break;
+						}
+					};
+				}
+				m_offset = dst_offset;
+				if (m_offset > m_size)
+					m_size = m_offset;
+				return num_copied;
+			}
 
-			virtual ~cached_file()
+			virtual void close()
 			{
-				done();
+				if (m_manage && m_data)
+					free(m_data);
+				m_data = nullptr;
+				m_manage = true;
+				m_offset = 0;
+				m_size = m_reserved = 0;
+#if SET_FILE_OP_TIMES
+				m_ctime = m_atime = m_mtime = time_point::min();
+#endif
+				m_state = state_t::ok;
 			}
 
-			///
-			/// Opens file
-			///
-			/// \param[in] filename    Filename
-			/// \param[in] mode        Bitwise combination of mode_t flags
-			///
-			void open(_In_z_ const schar_t* filename, _In_ int mode)
+			virtual fpos_t seek(_In_ foff_t offset, _In_ seek_t how = seek_t::beg)
 			{
-				invalidate_cache();
-				if (!ok()) _Unlikely_{
-					m_state = state_t::fail;
-					return;
-				}
-				m_source.open(filename, mode & mode_for_writing ? mode | mode_for_reading : mode);
-				if (m_source.ok()) {
-					init();
-					return;
+				switch (how) {
+				case seek_t::beg: break;
+				case seek_t::cur: offset = static_cast<foff_t>(m_offset) + offset; break;
+				case seek_t::end: offset = static_cast<foff_t>(m_size) + offset; break;
+				default: throw std::invalid_argument("unknown seek origin");
 				}
-				m_state = state_t::fail;
+				if (offset < 0) _Unlikely_
+					throw std::invalid_argument("negative file offset");
+				if (static_cast<fpos_t>(offset) > SIZE_MAX) _Unlikely_
+					throw std::invalid_argument("file offset too big");
+				m_state = state_t::ok;
+				return m_offset = static_cast<size_t>(offset);
 			}
 
-			///
-			/// Opens file
-			///
-			/// \param[in] filename    Filename
-			/// \param[in] mode        Bitwise combination of mode_t flags
-			///
-			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
-			void open(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode)
+			virtual fpos_t tell() const
 			{
-				open(filename.c_str(), mode);
+				return m_offset;
 			}
 
-			///
-			/// Returns true if file has a valid handle
-			///
-			operator bool() const noexcept { return m_source; }
+			virtual fsize_t size() const
+			{
+				return m_size;
+			}
 
-		protected:
-			file m_source;
-		};
+			virtual void hint(_In_ fpos_t offset, _In_ fsize_t length, _In_ access_t access)
+			{
+				hint_memory(m_data, m_size, offset, length, access, false);
+			}
 
-		///
-		/// In-memory file
-		///
-		class memory_file : public basic_file
-		{
-		public:
-			memory_file(_In_ state_t state = state_t::ok) :
-				basic(state),
-				m_data(nullptr),
-				m_offset(0),
-				m_size(0),
-				m_reserved(0),
-				m_manage(true)
+			virtual void truncate()
 			{
 #if SET_FILE_OP_TIMES
-				m_ctime = m_atime = m_mtime = time_point::now();
+				m_atime = m_mtime = time_point::now();
 #endif
+				m_size = m_offset;
+				reserve(m_offset);
 			}
 
-			///
-			/// Creates an empty file of reserved size
-			///
-			/// \param[in] size   Reserved size
-			/// \param[in] state  Initial stream state
-			///
-			memory_file(_In_ size_t size, _In_ state_t state = state_t::ok) :
-				basic(state),
-				m_data(reinterpret_cast<uint8_t*>(malloc(size))),
-				m_offset(0),
-				m_size(0),
-				m_reserved(size),
-				m_manage(true)
-			{
-				if (!m_data) {
-					m_state = state_t::fail;
-					throw std::bad_alloc();
-				}
 #if SET_FILE_OP_TIMES
-				m_ctime = m_atime = m_mtime = time_point::now();
-#endif
+			virtual time_point ctime() const
+			{
+				return m_ctime;
 			}
 
-			///
-			/// Creates a file based on available data
-			///
-			/// \param[in] data      Pointer to data
-			/// \param[in] size      Valid data size
-			/// \param[in] reserved  Reserved data size
-			/// \param[in] manage    Is input data allocated using malloc() and this class may reallocate data?
-			/// \param[in] state     Initial stream state
-			///
-			memory_file(_Inout_ void* data, _In_ size_t size, _In_ size_t reserved, _In_ bool manage = false, _In_ state_t state = state_t::ok) :
-				basic(state),
-				m_data(reinterpret_cast<uint8_t*>(data)),
-				m_offset(0),
-				m_size(size),
-				m_reserved(reserved),
-				m_manage(manage)
+			virtual time_point atime() const
 			{
-				stdex_assert(data || !size);
-				stdex_assert(reserved >= size);
-#if SET_FILE_OP_TIMES
-				m_ctime = m_atime = m_mtime = time_point::now();
-#endif
+				return m_atime;
 			}
 
-			///
-			/// Creates a file based on available data
-			///
-			/// \param[in] data      Pointer to data
-			/// \param[in] size      Valid and reserved data size
-			/// \param[in] manage    Is input data allocated using malloc() and this class may reallocate data?
-			/// \param[in] state     Initial stream state
-			///
-			memory_file(_Inout_ void* data, _In_ size_t size, _In_ bool manage = false, _In_ state_t state = state_t::ok) :
-				memory_file(data, size, size, manage, state)
-			{}
+			virtual time_point mtime() const
+			{
+				return m_mtime;
+			}
 
-			///
-			/// Loads content from file-system file
-			///
-			/// \param[in] filename  Filename
-			/// \param[in] mode      Bitwise combination of mode_t flags
-			///
-			memory_file(_In_z_ const schar_t* filename, _In_ int mode) : memory_file()
+			virtual void set_ctime(time_point date)
 			{
-				load(filename, mode);
+				m_ctime = date;
 			}
 
-			///
-			/// Loads content from file-system file
-			///
-			/// \param[in] filename  Filename
-			/// \param[in] mode      Bitwise combination of mode_t flags
-			///
-			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
-			memory_file(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode) : memory_file(filename.c_str(), mode) {}
+			virtual void set_atime(time_point date)
+			{
+				m_atime = date;
+			}
 
-			///
-			/// Copies content from another file
-			///
-			/// \param[in] other  Other file
-			///
-			memory_file(_In_ const memory_file& other) :
-				basic_file(other),
-				m_data(reinterpret_cast<uint8_t*>(malloc(other.m_size))),
-				m_offset(other.m_offset),
-				m_size(other.m_size),
-				m_reserved(other.m_size),
-				m_manage(true)
-#if SET_FILE_OP_TIMES
-				, m_ctime(other.m_ctime)
-				, m_atime(other.m_atime)
-				, m_mtime(other.m_mtime)
-#endif
+			virtual void set_mtime(time_point date)
 			{
-				if (!m_data) {
-					m_state = state_t::fail;
-					throw std::bad_alloc();
-				}
-				memcpy(m_data, other.m_data, other.m_size);
+				m_mtime = date;
 			}
+#endif
 
+		protected:
 			///
-			/// Copies content from another file
+			/// Writes data to specified file location
+			/// This does not move file pointer nor update file size. It checks for reserved space stdex_assert-only (in Debug builds). Use with caution!
 			///
-			/// \param[in] other  Other file
+			/// \param[in] offset  Offset in file where to write data
+			/// \param[in] data    Data to write
 			///
-			memory_file& operator=(_In_ const memory_file& other)
+			template <class T>
+			void set(_In_ fpos_t offset, _In_ const T data)
 			{
-				if (this != std::addressof(other)) {
-					*static_cast<basic_file*>(this) = other;
-					if (m_manage && m_data)
-						free(m_data);
-					m_data = reinterpret_cast<uint8_t*>(malloc(other.m_size));
-					if (!m_data) {
-						m_state = state_t::fail;
-						throw std::bad_alloc();
-					}
-					memcpy(m_data, other.m_data, other.m_size);
-					m_offset = other.m_offset;
-					m_size = other.m_size;
-					m_reserved = other.m_size;
-					m_manage = true;
 #if SET_FILE_OP_TIMES
-					m_ctime = other.m_ctime;
-					m_atime = other.m_atime;
-					m_mtime = other.m_mtime;
+				m_atime = m_mtime = time_point::now();
 #endif
-				}
-				return *this;
+				stdex_assert(offset + sizeof(T) < m_size);
+				(*reinterpret_cast<T*>(&m_data[offset])) = HE2LE(data);
 			}
 
+		public:
+			void set(_In_ fpos_t offset, _In_ const int8_t data) { set<int8_t>(offset, data); }
+			void set(_In_ fpos_t offset, _In_ const int16_t data) { set<int16_t>(offset, data); }
+			void set(_In_ fpos_t offset, _In_ const int32_t data) { set<int32_t>(offset, data); }
+			void set(_In_ fpos_t offset, _In_ const int64_t data) { set<int64_t>(offset, data); }
+			void set(_In_ fpos_t offset, _In_ const uint8_t data) { set<uint8_t>(offset, data); }
+			void set(_In_ fpos_t offset, _In_ const uint16_t data) { set<uint16_t>(offset, data); }
+			void set(_In_ fpos_t offset, _In_ const uint32_t data) { set<uint32_t>(offset, data); }
+			void set(_In_ fpos_t offset, _In_ const uint64_t data) { set<uint64_t>(offset, data); }
+			void set(_In_ fpos_t offset, _In_ const float data) { set<float>(offset, data); }
+			void set(_In_ fpos_t offset, _In_ const double data) { set<double>(offset, data); }
+			void set(_In_ fpos_t offset, _In_ const char data) { set<char>(offset, data); }
+#ifdef _NATIVE_WCHAR_T_DEFINED
+			void set(_In_ fpos_t offset, _In_ const wchar_t data) { set<wchar_t>(offset, data); }
+#endif
+
 			///
-			/// Moves content from another file
+			/// Reads data from specified file location
+			/// This does not move file pointer. It checks for data size stdex_assert-only (in Debug builds). Use with caution!
 			///
-			/// \param[in] other  Other file
+			/// \param[in] offset  Offset in file where to write data
+			/// \param[in] data    Data to write
 			///
-			memory_file(_Inout_ memory_file&& other) noexcept :
-				basic_file(std::move(other)),
-				m_data(other.m_data),
-				m_offset(other.m_offset),
-				m_size(other.m_size),
-				m_reserved(other.m_reserved),
-				m_manage(other.m_manage)
-#if SET_FILE_OP_TIMES
-				, m_ctime(other.m_ctime)
-				, m_atime(other.m_atime)
-				, m_mtime(other.m_mtime)
-#endif
+		protected:
+			template <class T>
+			void get(_In_ fpos_t offset, _Out_ T & data)
 			{
-				other.m_state = state_t::ok;
-				other.m_data = nullptr;
-				other.m_offset = 0;
-				other.m_size = 0;
-				other.m_reserved = 0;
-				other.m_manage = true;
+				stdex_assert(offset + sizeof(T) < m_size);
+				data = LE2HE(*(T*)(&m_data[offset]));
 #if SET_FILE_OP_TIMES
-				other.m_ctime = other.m_atime = other.m_mtime = time_point::now();
+				m_atime = time_point::now();
+#endif
+			}
+
+		public:
+			void get(_In_ fpos_t offset, _Out_ int8_t & data) { get<int8_t>(offset, data); }
+			void get(_In_ fpos_t offset, _Out_ int16_t & data) { get<int16_t>(offset, data); }
+			void get(_In_ fpos_t offset, _Out_ int32_t & data) { get<int32_t>(offset, data); }
+			void get(_In_ fpos_t offset, _Out_ int64_t & data) { get<int64_t>(offset, data); }
+			void get(_In_ fpos_t offset, _Out_ uint8_t & data) { get<uint8_t>(offset, data); }
+			void get(_In_ fpos_t offset, _Out_ uint16_t & data) { get<uint16_t>(offset, data); }
+			void get(_In_ fpos_t offset, _Out_ uint32_t & data) { get<uint32_t>(offset, data); }
+			void get(_In_ fpos_t offset, _Out_ uint64_t & data) { get<uint64_t>(offset, data); }
+			void get(_In_ fpos_t offset, _Out_ float& data) { get<float>(offset, data); }
+			void get(_In_ fpos_t offset, _Out_ double& data) { get<double>(offset, data); }
+			void get(_In_ fpos_t offset, _Out_ char& data) { get<char>(offset, data); }
+#ifdef _NATIVE_WCHAR_T_DEFINED
+			void get(_In_ fpos_t offset, _Out_ wchar_t& data) { get<wchar_t>(offset, data); }
+#endif
+
+			memory_file& operator <<(_In_ const int8_t data) { return write_data(data); }
+			memory_file& operator >>(_Out_ int8_t & data) { return read_data(data); }
+			memory_file& operator <<(_In_ const int16_t data) { return write_data(data); }
+			memory_file& operator >>(_Out_ int16_t & data) { return read_data(data); }
+			memory_file& operator <<(_In_ const int32_t data) { return write_data(data); }
+			memory_file& operator >>(_Out_ int32_t & data) { return read_data(data); }
+			memory_file& operator <<(_In_ const int64_t data) { return write_data(data); }
+			memory_file& operator >>(_Out_ int64_t & data) { return read_data(data); }
+			memory_file& operator <<(_In_ const uint8_t data) { return write_data(data); }
+			memory_file& operator >>(_Out_ uint8_t & data) { return read_data(data); }
+			memory_file& operator <<(_In_ const uint16_t data) { return write_data(data); }
+			memory_file& operator >>(_Out_ uint16_t & data) { return read_data(data); }
+			memory_file& operator <<(_In_ const uint32_t data) { return write_data(data); }
+			memory_file& operator >>(_Out_ uint32_t & data) { return read_data(data); }
+			memory_file& operator <<(_In_ const uint64_t data) { return write_data(data); }
+			memory_file& operator >>(_Out_ uint64_t & data) { return read_data(data); }
+			memory_file& operator <<(_In_ const float data) { return write_data(data); }
+			memory_file& operator >>(_Out_ float& data) { return read_data(data); }
+			memory_file& operator <<(_In_ const double data) { return write_data(data); }
+			memory_file& operator >>(_Out_ double& data) { return read_data(data); }
+			memory_file& operator <<(_In_ const char data) { return write_data(data); }
+			memory_file& operator >>(_Out_ char& data) { return read_data(data); }
+#ifdef _NATIVE_WCHAR_T_DEFINED
+			memory_file& operator <<(_In_ const wchar_t data) { return write_data(data); }
+			memory_file& operator >>(_Out_ wchar_t& data) { return read_data(data); }
 #endif
-			}
+			template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
+			memory_file& operator >>(_Out_ std::basic_string<T, TR, AX>&data) { return read_str(data); }
+			template <class T>
+			memory_file& operator <<(_In_ const T * data) { return write_str(data); }
+			template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
+			memory_file& operator <<(_In_ const std::basic_string<T, TR, AX>& data) { return write_str(data); }
 
-			///
-			/// Moves content from another file
-			///
-			/// \param[in] other  Other file
-			///
-			memory_file& operator=(_Inout_ memory_file&& other) noexcept
-			{
-				if (this != std::addressof(other)) {
-					*static_cast<basic_file*>(this) = std::move(other);
-					if (m_manage && m_data)
-						free(m_data);
-					m_data = other.m_data;
-					other.m_data = nullptr;
-					m_offset = other.m_offset;
-					other.m_offset = 0;
-					m_size = other.m_size;
-					other.m_size = 0;
-					m_reserved = other.m_reserved;
-					other.m_reserved = 0;
-					m_manage = other.m_manage;
-					other.m_manage = true;
+		protected:
+			uint8_t* m_data; ///< file data
+			bool m_manage; ///< may reallocate m_data?
+			size_t m_offset; ///< file pointer
+			size_t m_size; ///< file size
+			size_t m_reserved; ///< reserved file size
 #if SET_FILE_OP_TIMES
-					m_ctime = other.m_ctime;
-					m_atime = other.m_atime;
-					m_mtime = other.m_mtime;
-					other.m_ctime = other.m_atime = other.m_mtime = time_point::now();
+			time_point
+				m_ctime,
+				m_atime,
+				m_mtime;
 #endif
-				}
-				return *this;
-			}
-
-			virtual ~memory_file()
-			{
-				if (m_manage && m_data)
-					free(m_data);
-			}
+		};
 
-			///
-			/// Reallocates memory
-			///
-			/// \param[in] required  Demanded memory size
-			/// \param[in] tight     Don't over-allocate on grow, release excessive on decrease.
-			///
-			void reserve(_In_ size_t required, _In_ bool tight = false) noexcept
-			{
-				if (required <= m_reserved && (!tight || required >= m_reserved)) {
-					m_state = state_t::ok;
-					return;
-				}
-				if (!m_manage) {
-					m_state = state_t::fail;
-					return;
-				}
-				size_t reserved = tight ? required : ((required + required / 4 + (default_block_size - 1)) / default_block_size) * default_block_size;
-				auto data = reinterpret_cast<uint8_t*>(realloc(m_data, reserved));
-				if (!data && reserved) _Unlikely_ {
-					m_state = state_t::fail;
-					return;
-				}
-				m_data = data;
-				if (reserved < m_size)
-					m_size = reserved;
-				m_reserved = reserved;
-				m_state = state_t::ok;
-			}
+		///
+		/// Memory-mapped file-system file
+		///
+		/// Reads and writes copy data directly from/to a view of the file. Writing past the end of the view grows the
+		/// file in larger increments and remaps it. The file is trimmed to its logical size on close. When opened with
+		/// mode_append, every write goes to the end of the file regardless of seek, as with file.
+		///
+		class mapped_file : public basic_file
+		{
+		public:
+			mapped_file() :
+				basic(state_t::fail),
+				m_data(nullptr),
+#ifdef _WIN32
+				m_mapping(NULL),
+#endif
+				m_offset(0),
+				m_size(0),
+				m_mapped(0),
+				m_writable(false),
+				m_append(false)
+			{}
 
 			///
-			/// Loads content from a file-system file
+			/// Opens and maps file
 			///
 			/// \param[in] filename  Filename
 			/// \param[in] mode      Bitwise combination of mode_t flags
 			///
-			void load(_In_z_ const schar_t* filename, _In_ int mode)
+			mapped_file(_In_z_ const schar_t* filename, _In_ int mode) : mapped_file()
 			{
-				file f(filename, (mode & ~hint_random_access) | mode_for_reading | hint_sequential_access);
-				if (!f.ok()) {
-					m_state = state_t::fail;
-					return;
-				}
-				fsize_t size = f.size();
-				if (size > SIZE_MAX) {
-					m_state = state_t::fail;
-					return;
-				}
-				reserve(static_cast<size_t>(size), true);
-				if (!ok()) _Unlikely_ {
-					return;
-				}
-				m_offset = m_size = 0;
-				write_stream(f);
-				if (ok())
-					m_offset = 0;
-#if SET_FILE_OP_TIMES
-				m_ctime = f.ctime();
-				m_atime = f.atime();
-				m_mtime = f.mtime();
-#endif
+				open(filename, mode);
 			}
 
 			///
-			/// Loads content from a file-system file
+			/// Opens and maps file
 			///
 			/// \param[in] filename  Filename
 			/// \param[in] mode      Bitwise combination of mode_t flags
 			///
 			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
-			void load(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode)
+			mapped_file(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode) : mapped_file(filename.c_str(), mode) {}
+
+		private:
+			mapped_file(_In_ const mapped_file& other);
+			mapped_file& operator =(_In_ const mapped_file& other);
+
+		public:
+			virtual ~mapped_file()
 			{
-				load(filename.c_str(), mode);
+				if (m_file)
+					close_file();
 			}
 
 			///
-			/// Saves content to a file-system file
+			/// Opens and maps file
 			///
 			/// \param[in] filename  Filename
 			/// \param[in] mode      Bitwise combination of mode_t flags
 			///
-			void save(_In_z_ const schar_t* filename, _In_ int mode)
+			void open(_In_z_ const schar_t* filename, _In_ int mode)
 			{
-				file f(filename, (mode & ~hint_random_access) | mode_for_writing | hint_sequential_access);
-				if (!f.ok()) {
+				if (m_file)
+					close_file();
+				m_writable = (mode & mode_for_writing) != 0;
+				m_append = m_writable && (mode & mode_append);
+				// Writable mappings require read access to the file.
+				m_file.open(filename, m_writable ? mode | mode_for_reading : mode);
+				if (!m_file.ok()) {
 					m_state = state_t::fail;
 					return;
 				}
-				f.write(m_data, m_size);
-				if (!f.ok()) {
+				fsize_t size = m_file.size();
+				if (size == fsize_max || size > SIZE_MAX) {
+					m_file.close();
 					m_state = state_t::fail;
 					return;
 				}
-				f.truncate();
-#if SET_FILE_OP_TIMES
-				f.set_ctime(m_ctime);
-				f.set_atime(m_atime);
-				f.set_mtime(m_mtime);
-#endif
+				m_size = static_cast<size_t>(size);
+				m_offset = m_append ? m_size : 0;
+				map(m_size);
+				if (!ok()) _Unlikely_
+					m_file.close();
 			}
 
 			///
-			/// Saves content to a file-system file
+			/// Opens and maps file
 			///
 			/// \param[in] filename  Filename
 			/// \param[in] mode      Bitwise combination of mode_t flags
 			///
 			template <class TR = std::char_traits<schar_t>, class AX = std::allocator<schar_t>>
-			void save(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode)
+			void open(_In_ const std::basic_string<TR, AX>& filename, _In_ int mode)
 			{
-				save(filename.c_str(), mode);
+				open(filename.c_str(), mode);
 			}
 
+			///
+			/// Returns true if file is open
+			///
+			operator bool() const noexcept { return m_file; }
+
 			///
 			/// Returns pointer to data
 			///
@@ -3552,126 +7963,38 @@ namespace stdex
 				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
 			{
 				stdex_assert(data || !length);
-#if SET_FILE_OP_TIMES
-				m_atime = time_point::now();
-#endif
-				size_t available = m_size - m_offset;
-				if (length <= available) {
-					memcpy(data, &m_data[m_offset], length);
-					m_offset += length;
-					m_state = state_t::ok;
-					return length;
-				}
-				if (length && !available) {
-					m_state = state_t::eof;
+				if (m_offset >= m_size) {
+					m_state = length ? state_t::eof : state_t::ok;
 					return 0;
 				}
-				memcpy(data, &m_data[m_offset], available);
-				m_offset += available;
-				m_state = state_t::ok;
-				return available;
-			}
-
-			///
-			/// Reads one primitive data type
-			///
-			/// This method is intended for chaining: e.g. stream.read_str(a).read_str(b).read_str(c)...
-			/// Since it would make it impossible to detect if any of the read_str(a) or read_str(b) failed should
-			/// read_str(c) succeed, the method skips reading if stream state is not ok.
-			///
-			/// As memory read rarely fails, a #define CHECK_STREAM_STATE 0 turns this checking off when
-			/// performance is paramount.
-			///
-			/// \param[in] data  Where to store read data
-			///
-			/// \returns This stream
-			///
-			template <class T>
-			memory_file& read_data(_Out_ T& data)
-			{
-#if SET_FILE_OP_TIMES
-				m_atime = time_point::now();
-#endif
-				if (CHECK_STREAM_STATE && !ok()) _Unlikely_ {
-					data = 0;
-					return *this;
-				}
-				size_t end_offset = m_offset + sizeof(T);
-				if (end_offset <= m_size) {
-					data = LE2HE(*reinterpret_cast<T*>(&m_data[m_offset]));
-					m_offset = end_offset;
-#if !CHECK_STREAM_STATE
-					m_state = state_t::ok;
-#endif
-				}
-				else {
-					data = 0;
-					m_offset = m_size;
-					m_state = state_t::eof;
-				}
-				return *this;
-			}
-
-			///
-			/// Reads length-prefixed string from the stream
-			///
-			/// This method is intended for chaining: e.g. stream.read_str(a).read_str(b).read_str(c)...
-			/// Since it would make it impossible to detect if any of the read_str(a) or read_str(b) failed should
-			/// read_str(c) succeed, the method skips reading if stream state is not ok.
-			///
-			/// As memory read rarely fails, a #define CHECK_STREAM_STATE 0 turns this checking off when
-			/// performance is paramount.
-			///
-			/// \param[in] data  String to read to
-			///
-			/// \return This stream
-			///
-			template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
-			memory_file& read_str(_Inout_ std::basic_string<T, TR, AX>&data)
-			{
-#if SET_FILE_OP_TIMES
-				m_atime = time_point::now();
-#endif
-				if (CHECK_STREAM_STATE && !ok()) _Unlikely_ {
-					data.clear();
-					return *this;
-				}
-				size_t end_offset = m_offset + sizeof(uint32_t);
-				if (end_offset <= m_size) {
-					uint32_t num_chars = LE2HE(*reinterpret_cast<uint32_t*>(&m_data[m_offset]));
-					m_offset = end_offset;
-					end_offset = stdex::add(m_offset, stdex::mul(num_chars, sizeof(T)));
-					T* start = reinterpret_cast<T*>(&m_data[m_offset]);
-					if (end_offset <= m_size) {
-						data.assign(start, start + num_chars);
-						m_offset = end_offset;
-#if !CHECK_STREAM_STATE
-						m_state = state_t::ok;
-#endif
-						return *this;
-					}
-					if (end_offset <= m_size)
-						data.assign(start, reinterpret_cast<T*>(&m_data[m_size]));
-				}
-				m_offset = m_size;
-				m_state = state_t::eof;
-				return *this;
+				size_t num_read = std::min(length, m_size - m_offset);
+				memcpy(data, m_data + m_offset, num_read);
+				m_offset += num_read;
+				m_state = state_t::ok;
+				return num_read;
 			}
 
 			virtual _Success_(return != 0) size_t write(
 				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
 			{
 				stdex_assert(data || !length);
-#if SET_FILE_OP_TIMES
-				m_atime = m_mtime = time_point::now();
-#endif
-				size_t end_offset = m_offset + length;
-				if (end_offset > m_reserved) {
+				if (!m_writable) _Unlikely_ {
+					m_state = state_t::fail;
+					return 0;
+				}
+				if (m_append)
+					m_offset = m_size;
+				size_t end_offset = add(m_offset, length);
+				if (end_offset > m_mapped) {
 					reserve(end_offset);
 					if (!ok()) _Unlikely_
 						return 0;
 				}
-				memcpy(&m_data[m_offset], data, length);
+				if (m_offset > m_size) {
+					// Writing past the end of file. Fill the gap with zeros as the file would.
+					memset(m_data + m_size, 0, m_offset - m_size);
+				}
+				memcpy(m_data + m_offset, data, length);
 				m_offset = end_offset;
 				if (m_offset > m_size)
 					m_size = m_offset;
@@ -3679,222 +8002,128 @@ namespace stdex
 				return length;
 			}
 
-			///
-			/// Writes a byte of data
-			///
-			void write_byte(_In_ uint8_t byte, _In_ size_t amount = 1)
+			virtual std::tuple<const uint8_t*, size_t> acquire_read(_In_ size_t length)
 			{
-#if SET_FILE_OP_TIMES
-				m_atime = m_mtime = time_point::now();
-#endif
-				size_t end_offset = m_offset + amount;
-				if (end_offset > m_reserved) {
-					reserve(end_offset);
-					if (!ok()) _Unlikely_
-						return;
+				if (m_offset >= m_size) {
+					m_state = length ? state_t::eof : state_t::ok;
+					return { nullptr, 0 };
 				}
-				memset(&m_data[m_offset], byte, amount);
-				m_offset = end_offset;
-				if (m_offset > m_size)
-					m_size = m_offset;
 				m_state = state_t::ok;
+				return { m_data + m_offset, std::min(length, m_size - m_offset) };
 			}
 
-			///
-			/// Writes one primitive data type
-			///
-			/// This method is intended for chaining: e.g. stream.write_data(a).write_data(b).write_data(c)...
-			/// Since it would make it impossible to detect if any of the write_data(a) or write_data(b) failed should
-			/// write_data(c) succeed, the method skips writing if stream state is not ok.
-			///
-			/// As memory write rarely fails, a #define CHECK_STREAM_STATE 0 turns this checking off when
-			/// performance is paramount.
-			///
-			/// \param[in] data  Data to write
-			///
-			/// \returns This stream
-			///
-			template <class T>
-			memory_file& write_data(const T data)
+			virtual void release_read(_In_ size_t length)
 			{
-#if SET_FILE_OP_TIMES
-				m_atime = m_mtime = time_point::now();
-#endif
-				if (CHECK_STREAM_STATE && !ok()) _Unlikely_
-					return *this;
-				size_t end_offset = m_offset + sizeof(T);
-				if (end_offset > m_reserved) {
-					reserve(end_offset);
-					if (!ok()) _Unlikely_
-						return *this;
-				}
-				(*reinterpret_cast<T*>(&m_data[m_offset])) = HE2LE(data);
-				m_offset = end_offset;
-				if (m_offset > m_size)
-					m_size = m_offset;
-#if !CHECK_STREAM_STATE
-				m_state = state_t::ok;
-#endif
-				return *this;
+				stdex_assert(length <= m_size - m_offset);
+				m_offset += length;
 			}
 
-			///
-			/// Writes string to the stream length-prefixed
-			///
-			/// This method is intended for chaining: e.g. stream.write_str(a).write_str(b).write_str(c)...
-			/// Since it would make it impossible to detect if any of the write_str(a) or write_str(b) failed should
-			/// write_str(c) succeed, the method skips writing if stream state is not ok.
-			///
-			/// As memory write rarely fails, a #define CHECK_STREAM_STATE 0 turns this checking off when
-			/// performance is paramount.
-			///
-			/// \param[in] data  String to write
-			///
-			/// \return This stream
-			///
-			template <class T>
-			memory_file& write_str(_In_z_ const T * data)
+			virtual bool can_borrow_ahead() const
 			{
-#if SET_FILE_OP_TIMES
-				m_atime = m_mtime = time_point::now();
-#endif
-				if (CHECK_STREAM_STATE && !ok()) _Unlikely_
-					return *this;
-				size_t num_chars = stdex::strlen(data);
-				if (num_chars > UINT32_MAX)
-					throw std::invalid_argument("string too long");
-				size_t size_chars = num_chars * sizeof(T);
-				size_t size = sizeof(uint32_t) + size_chars;
-				size_t end_offset = m_offset + size;
-				if (end_offset > m_reserved) {
+				return true;
+			}
+
+			virtual std::tuple<uint8_t*, size_t> acquire_write(_In_ size_t length)
+			{
+				if (!m_writable) _Unlikely_ {
+					m_state = state_t::fail;
+					return { nullptr, 0 };
+				}
+				if (m_append)
+					m_offset = m_size;
+				size_t end_offset = add(m_offset, length);
+				if (end_offset > m_mapped) {
 					reserve(end_offset);
 					if (!ok()) _Unlikely_
-						return *this;
+						return { nullptr, 0 };
 				}
-				auto p = &m_data[m_offset];
-				*reinterpret_cast<uint32_t*>(p) = HE2LE((uint32_t)num_chars);
-				memcpy(p + sizeof(uint32_t), data, size_chars);
-				m_offset = end_offset;
-				if (m_offset > m_size)
+				if (m_offset > m_size) {
+					memset(m_data + m_size, 0, m_offset - m_size);
 					m_size = m_offset;
-#if !CHECK_STREAM_STATE
+				}
 				m_state = state_t::ok;
-#endif
-				return *this;
+				return { m_data + m_offset, length };
 			}
 
-			///
-			/// Writes string to the stream length-prefixed
-			///
-			/// This method is intended for chaining: e.g. stream.write_str(a).write_str(b).write_str(c)...
-			/// Since it would make it impossible to detect if any of the write_str(a) or write_str(b) failed should
-			/// write_str(c) succeed, the method skips writing if stream state is not ok.
-			///
-			/// As memory write rarely fails, a #define CHECK_STREAM_STATE 0 turns this checking off when
-			/// performance is paramount.
-			///
-			/// \param[in] data  String to write
-			///
-			/// \return This stream
-			///
-			template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
-			memory_file& write_str(_In_ const std::basic_string<T, TR, AX>& data)
+			virtual void release_write(_In_ size_t length)
 			{
-#if SET_FILE_OP_TIMES
-				m_atime = m_mtime = time_point::now();
-#endif
-				if (CHECK_STREAM_STATE && !ok()) _Unlikely_
-					return *this;
-				size_t num_chars = data.size();
-				if (num_chars > UINT32_MAX)
-					throw std::invalid_argument("string too long");
-				size_t size_chars = num_chars * sizeof(T);
-				size_t size = sizeof(uint32_t) + size_chars;
-				size_t end_offset = m_offset + size;
-				if (end_offset > m_reserved) {
-					reserve(end_offset);
-					if (!ok()) _Unlikely_
-						return *this;
-				}
-				auto p = &m_data[m_offset];
-				*reinterpret_cast<uint32_t*>(p) = HE2LE((uint32_t)num_chars);
-				memcpy(p + sizeof(uint32_t), data.data(), size_chars);
-				m_offset = end_offset;
+				stdex_assert(length <= m_mapped - m_offset);
+				m_offset += length;
 				if (m_offset > m_size)
 					m_size = m_offset;
-#if !CHECK_STREAM_STATE
-				m_state = state_t::ok;
-#endif
-				return *this;
+			}
+
+			virtual _Success_(return != 0 || length == 0) size_t read_at(
+				_In_ fpos_t offset, _Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+			{
+				stdex_assert(data || !length);
+				size_t size = m_size;
+				if (offset >= size)
+					return 0;
+				size_t num_read = std::min(length, size - static_cast<size_t>(offset));
+				memcpy(data, m_data + static_cast<size_t>(offset), num_read);
+				return num_read;
 			}
 
 			///
-			/// Writes content of another stream
+			/// Writes block of data at given file position
 			///
-			/// \return Number of bytes written
+			/// Stream state is not updated. Writes within file size allow concurrent calls from multiple threads. Writes
+			/// extending the file must not run concurrently with any other operation.
 			///
-			size_t write_stream(_Inout_ basic & stream, _In_ size_t amount = SIZE_MAX)
+			/// \param[in] offset  Absolute file position to write to
+			/// \param[in] data    Buffer to write data from
+			/// \param[in] length  Number of bytes to write
+			///
+			/// \return Number of bytes successfully written. On error, fewer bytes than \p length are returned.
+			///
+			virtual _Success_(return != 0) size_t write_at(
+				_In_ fpos_t offset, _In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
 			{
-#if SET_FILE_OP_TIMES
-				m_atime = m_mtime = time_point::now();
-#endif
-				size_t num_read, dst_offset = m_offset, dst_size = m_offset;
-				size_t num_copied = 0, to_write = amount;
-				m_state = state_t::ok;
-				if (amount != SIZE_MAX) {
-					dst_size = stdex::add(dst_size, amount);
-					reserve(dst_size);
-					if (!ok()) _Unlikely_
+				stdex_assert(data || !length);
+				if (!m_writable || offset > SIZE_MAX - length) _Unlikely_
+					return 0;
+				size_t end_offset = static_cast<size_t>(offset) + length;
+				if (end_offset > m_mapped) {
+					state_t state = m_state;
+					reserve(end_offset);
+					bool succeeded = ok();
+					m_state = state;
+					if (!succeeded) _Unlikely_
 						return 0;
-					while (to_write) {
-						num_read = stream.read(&m_data[dst_offset], to_write);
-						/*dst_size =*/ dst_offset += num_read;
-						num_copied += num_read;
-						to_write -= num_read;
-						if (!stream.ok()) {
-							if (stream.state() != state_t::eof)
-								m_state = state_t::fail;
-							break;
-						}
-					};
 				}
-				else {
-					size_t block_size;
-					while (to_write) {
-						block_size = std::min(to_write, default_block_size);
-						dst_size = stdex::add(dst_size, block_size);
-						reserve(dst_size);
-						if (!ok()) _Unlikely_
-							break;
-						num_read = stream.read(&m_data[dst_offset], block_size);
-						dst_size = dst_offset += num_read;
-						num_copied += num_read;
-						to_write -= num_read;
-						if (!stream.ok()) {
-							if (stream.state() != state_t::eof)
-								m_state = state_t::fail;
-							break;
-						}
-					};
+				if (static_cast<size_t>(offset) > m_size) {
+					// Writing past the end of file. Fill the gap with zeros as the file would.
+					memset(m_data + m_size, 0, static_cast<size_t>(offset) - m_size);
 				}
-				m_offset = dst_offset;
-				if (m_offset > m_size)
-					m_size = m_offset;
-				return num_copied;
+				memcpy(m_data + static_cast<size_t>(offset), data, length);
+				if (end_offset > m_size)
+					m_size = end_offset;
+				return length;
 			}
 
 			virtual void close()
 			{
-				if (m_manage && m_data)
-					free(m_data);
-				m_data = nullptr;
-				m_manage = true;
-				m_offset = 0;
-				m_size = m_reserved = 0;
-#if SET_FILE_OP_TIMES
-				m_ctime = m_atime = m_mtime = time_point::min();
+				if (m_file)
+					close_file();
+				else
+					m_state = state_t::ok;
+			}
+
+			virtual void flush()
+			{
+				if (m_data && m_writable) {
+#ifdef _WIN32
+					if (!FlushViewOfFile(m_data, m_mapped)) _Unlikely_ {
+#else
+					if (msync(m_data, m_mapped, MS_SYNC) < 0) _Unlikely_ {
 #endif
-				m_state = state_t::ok;
+						m_state = state_t::fail;
+						return;
+					}
+				}
+				m_file.flush();
+				m_state = m_file.state();
 			}
 
 			virtual fpos_t seek(_In_ foff_t offset, _In_ seek_t how = seek_t::beg)
@@ -3915,217 +8144,230 @@ namespace stdex
 
 			virtual fpos_t tell() const
 			{
-				return m_offset;
+				return m_file ? m_offset : fpos_max;
+			}
+
+			virtual void lock(_In_ fpos_t offset, _In_ fsize_t length)
+			{
+				m_file.lock(offset, length);
+				m_state = m_file.state();
+			}
+
+			virtual void unlock(_In_ fpos_t offset, _In_ fsize_t length)
+			{
+				m_file.unlock(offset, length);
+				m_state = m_file.state();
+			}
+
+			virtual void hint(_In_ fpos_t offset, _In_ fsize_t length, _In_ access_t access)
+			{
+				hint_memory(m_data, m_size, offset, length, access, true);
 			}
 
 			virtual fsize_t size() const
 			{
-				return m_size;
+				return m_file ? m_size : fsize_max;
 			}
 
 			virtual void truncate()
 			{
-#if SET_FILE_OP_TIMES
-				m_atime = m_mtime = time_point::now();
-#endif
+				if (!m_writable) _Unlikely_ {
+					m_state = state_t::fail;
+					return;
+				}
+				if (m_offset > m_mapped) {
+					reserve(m_offset);
+					if (!ok()) _Unlikely_
+						return;
+				}
+				if (m_offset > m_size)
+					memset(m_data + m_size, 0, m_offset - m_size);
 				m_size = m_offset;
-				reserve(m_offset);
+				m_state = state_t::ok;
 			}
 
-#if SET_FILE_OP_TIMES
 			virtual time_point ctime() const
 			{
-				return m_ctime;
+				return m_file.ctime();
 			}
 
 			virtual time_point atime() const
 			{
-				return m_atime;
+				return m_file.atime();
 			}
 
 			virtual time_point mtime() const
 			{
-				return m_mtime;
+				return m_file.mtime();
 			}
 
 			virtual void set_ctime(time_point date)
 			{
-				m_ctime = date;
+				m_file.set_ctime(date);
 			}
 
 			virtual void set_atime(time_point date)
 			{
-				m_atime = date;
+				m_file.set_atime(date);
 			}
 
 			virtual void set_mtime(time_point date)
 			{
-				m_mtime = date;
+				m_file.set_mtime(date);
 			}
-#endif
 
 		protected:
-			///
-			/// Writes data to specified file location
-			/// This does not move file pointer nor update file size. It checks for reserved space stdex_assert-only (in Debug builds). Use with caution!
-			///
-			/// \param[in] offset  Offset in file where to write data
-			/// \param[in] data    Data to write
-			///
-			template <class T>
-			void set(_In_ fpos_t offset, _In_ const T data)
+			/// \cond internal
+			void reserve(_In_ size_t required)
 			{
-#if SET_FILE_OP_TIMES
-				m_atime = m_mtime = time_point::now();
-#endif
-				stdex_assert(offset + sizeof(T) < m_size);
-				(*reinterpret_cast<T*>(&m_data[offset])) = HE2LE(data);
+				size_t mapped = m_mapped;
+				map(((required + required / 4 + (default_block_size - 1)) / default_block_size) * default_block_size);
+				if (!ok()) _Unlikely_ {
+					// Restore the previous view.
+					map(mapped);
+					m_state = state_t::fail;
+				}
 			}
 
-		public:
-			void set(_In_ fpos_t offset, _In_ const int8_t data) { set<int8_t>(offset, data); }
-			void set(_In_ fpos_t offset, _In_ const int16_t data) { set<int16_t>(offset, data); }
-			void set(_In_ fpos_t offset, _In_ const int32_t data) { set<int32_t>(offset, data); }
-			void set(_In_ fpos_t offset, _In_ const int64_t data) { set<int64_t>(offset, data); }
-			void set(_In_ fpos_t offset, _In_ const uint8_t data) { set<uint8_t>(offset, data); }
-			void set(_In_ fpos_t offset, _In_ const uint16_t data) { set<uint16_t>(offset, data); }
-			void set(_In_ fpos_t offset, _In_ const uint32_t data) { set<uint32_t>(offset, data); }
-			void set(_In_ fpos_t offset, _In_ const uint64_t data) { set<uint64_t>(offset, data); }
-			void set(_In_ fpos_t offset, _In_ const float data) { set<float>(offset, data); }
-			void set(_In_ fpos_t offset, _In_ const double data) { set<double>(offset, data); }
-			void set(_In_ fpos_t offset, _In_ const char data) { set<char>(offset, data); }
-#ifdef _NATIVE_WCHAR_T_DEFINED
-			void set(_In_ fpos_t offset, _In_ const wchar_t data) { set<wchar_t>(offset, data); }
+			void map(_In_ size_t length)
+			{
+				unmap();
+				if (!length) {
+					m_state = state_t::ok;
+					return;
+				}
+#ifdef _WIN32
+				// Mapping a writable view larger than the file extends the file.
+				ULARGE_INTEGER li;
+				li.QuadPart = length;
+				m_mapping = CreateFileMapping(m_file.get(), NULL, m_writable ? PAGE_READWRITE : PAGE_READONLY, li.HighPart, li.LowPart, NULL);
+				if (m_mapping) {
+					m_data = reinterpret_cast<uint8_t*>(MapViewOfFile(m_mapping, m_writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, length));
+					if (m_data) {
+						m_mapped = length;
+						m_state = state_t::ok;
+						return;
+					}
+					CloseHandle(m_mapping);
+					m_mapping = NULL;
+				}
+#else
+				if (!m_writable || ftruncate64(m_file.get(), static_cast<off64_t>(length)) >= 0) {
+					void* data = mmap(nullptr, length, m_writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_file.get(), 0);
+					if (data != MAP_FAILED) {
+						m_data = reinterpret_cast<uint8_t*>(data);
+						m_mapped = length;
+						m_state = state_t::ok;
+						return;
+					}
+				}
 #endif
+				m_state = state_t::fail;
+			}
 
-			///
-			/// Reads data from specified file location
-			/// This does not move file pointer. It checks for data size stdex_assert-only (in Debug builds). Use with caution!
-			///
-			/// \param[in] offset  Offset in file where to write data
-			/// \param[in] data    Data to write
-			///
-		protected:
-			template <class T>
-			void get(_In_ fpos_t offset, _Out_ T & data)
+			void unmap()
 			{
-				stdex_assert(offset + sizeof(T) < m_size);
-				data = LE2HE(*(T*)(&m_data[offset]));
-#if SET_FILE_OP_TIMES
-				m_atime = time_point::now();
+				if (m_data) {
+#ifdef _WIN32
+					UnmapViewOfFile(m_data);
+#else
+					munmap(m_data, m_mapped);
+#endif
+					m_data = nullptr;
+				}
+#ifdef _WIN32
+				if (m_mapping) {
+					CloseHandle(m_mapping);
+					m_mapping = NULL;
+				}
 #endif
+				m_mapped = 0;
 			}
 
-		public:
-			void get(_In_ fpos_t offset, _Out_ int8_t & data) { get<int8_t>(offset, data); }
-			void get(_In_ fpos_t offset, _Out_ int16_t & data) { get<int16_t>(offset, data); }
-			void get(_In_ fpos_t offset, _Out_ int32_t & data) { get<int32_t>(offset, data); }
-			void get(_In_ fpos_t offset, _Out_ int64_t & data) { get<int64_t>(offset, data); }
-			void get(_In_ fpos_t offset, _Out_ uint8_t & data) { get<uint8_t>(offset, data); }
-			void get(_In_ fpos_t offset, _Out_ uint16_t & data) { get<uint16_t>(offset, data); }
-			void get(_In_ fpos_t offset, _Out_ uint32_t & data) { get<uint32_t>(offset, data); }
-			void get(_In_ fpos_t offset, _Out_ uint64_t & data) { get<uint64_t>(offset, data); }
-			void get(_In_ fpos_t offset, _Out_ float& data) { get<float>(offset, data); }
-			void get(_In_ fpos_t offset, _Out_ double& data) { get<double>(offset, data); }
-			void get(_In_ fpos_t offset, _Out_ char& data) { get<char>(offset, data); }
-#ifdef _NATIVE_WCHAR_T_DEFINED
-			void get(_In_ fpos_t offset, _Out_ wchar_t& data) { get<wchar_t>(offset, data); }
+			void close_file()
+			{
+				unmap();
+				m_state = state_t::ok;
+				if (m_writable) {
+					// Trim the space reserved for growth.
+#ifdef _WIN32
+					LARGE_INTEGER li;
+					li.QuadPart = m_size;
+					if (!SetFilePointerEx(m_file.get(), li, NULL, FILE_BEGIN) || !SetEndOfFile(m_file.get())) _Unlikely_
+#else
+					if (ftruncate64(m_file.get(), static_cast<off64_t>(m_size)) < 0) _Unlikely_
 #endif
+						m_state = state_t::fail;
+				}
+				m_file.close();
+				if (ok())
+					m_state = m_file.state();
+				m_offset = m_size = 0;
+				m_writable = m_append = false;
+			}
 
-			memory_file& operator <<(_In_ const int8_t data) { return write_data(data); }
-			memory_file& operator >>(_Out_ int8_t & data) { return read_data(data); }
-			memory_file& operator <<(_In_ const int16_t data) { return write_data(data); }
-			memory_file& operator >>(_Out_ int16_t & data) { return read_data(data); }
-			memory_file& operator <<(_In_ const int32_t data) { return write_data(data); }
-			memory_file& operator >>(_Out_ int32_t & data) { return read_data(data); }
-			memory_file& operator <<(_In_ const int64_t data) { return write_data(data); }
-			memory_file& operator >>(_Out_ int64_t & data) { return read_data(data); }
-			memory_file& operator <<(_In_ const uint8_t data) { return write_data(data); }
-			memory_file& operator >>(_Out_ uint8_t & data) { return read_data(data); }
-			memory_file& operator <<(_In_ const uint16_t data) { return write_data(data); }
-			memory_file& operator >>(_Out_ uint16_t & data) { return read_data(data); }
-			memory_file& operator <<(_In_ const uint32_t data) { return write_data(data); }
-			memory_file& operator >>(_Out_ uint32_t & data) { return read_data(data); }
-			memory_file& operator <<(_In_ const uint64_t data) { return write_data(data); }
-			memory_file& operator >>(_Out_ uint64_t & data) { return read_data(data); }
-			memory_file& operator <<(_In_ const float data) { return write_data(data); }
-			memory_file& operator >>(_Out_ float& data) { return read_data(data); }
-			memory_file& operator <<(_In_ const double data) { return write_data(data); }
-			memory_file& operator >>(_Out_ double& data) { return read_data(data); }
-			memory_file& operator <<(_In_ const char data) { return write_data(data); }
-			memory_file& operator >>(_Out_ char& data) { return read_data(data); }
-#ifdef _NATIVE_WCHAR_T_DEFINED
-			memory_file& operator <<(_In_ const wchar_t data) { return write_data(data); }
-			memory_file& operator >>(_Out_ wchar_t& data) { return read_data(data); }
+			file m_file;
+			uint8_t* m_data; ///< mapped view
+#ifdef _WIN32
+			HANDLE m_mapping; ///< file mapping object
 #endif
-			template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
-			memory_file& operator >>(_Out_ std::basic_string<T, TR, AX>&data) { return read_str(data); }
-			template <class T>
-			memory_file& operator <<(_In_ const T * data) { return write_str(data); }
-			template<class T, class TR = std::char_traits<T>, class AX = std::allocator<T>>
-			memory_file& operator <<(_In_ const std::basic_string<T, TR, AX>& data) { return write_str(data); }
-
-		protected:
-			uint8_t* m_data; ///< file data
-			bool m_manage; ///< may reallocate m_data?
 			size_t m_offset; ///< file pointer
-			size_t m_size; ///< file size
-			size_t m_reserved; ///< reserved file size
-#if SET_FILE_OP_TIMES
-			time_point
-				m_ctime,
-				m_atime,
-				m_mtime;
-#endif
+			size_t m_size; ///< logical file size
+			size_t m_mapped; ///< mapped view size
+			bool m_writable; ///< is mapping writable?
+			bool m_append; ///< do all writes go to the end of file?
+			/// \endcond
 		};
 
+		constexpr size_t default_fifo_chunk_size = 0x1000; ///< Default fifo data chunk size
+
 		///
 		/// In-memory FIFO queue
 		///
+		/// Data is stored in fixed-size chunks. Chunks consumed are kept for reuse until the queue is closed.
+		///
 		class fifo : public basic {
 		public:
-			fifo() :
-				m_offset(0),
+			///
+			/// Constructs an empty queue
+			///
+			/// \param[in] chunk_size  Size of data chunk
+			///
+			fifo(_In_ size_t chunk_size = default_fifo_chunk_size) :
+				m_chunk_size(chunk_size),
 				m_size(0),
 				m_head(nullptr),
-				m_tail(nullptr)
-			{}
+				m_tail(nullptr),
+				m_free(nullptr)
+			{
+				if (!chunk_size) _Unlikely_
+					throw std::invalid_argument("zero chunk size");
+			}
 
 			virtual ~fifo()
 			{
-				while (m_head) {
-					auto p = m_head;
-					m_head = p->next;
-					delete p;
-				}
+				free_chunks(m_head);
+				free_chunks(m_free);
 			}
 
-#pragma warning(suppress: 6101) // See [2] below
 			virtual _Success_(return != 0 || length == 0) size_t read(
 				_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
 			{
 				stdex_assert(data || !length);
 				for (size_t to_read = length;;) {
-					if (!m_head) _Unlikely_ {
+					if (!m_size) _Unlikely_ {
 						m_state = to_read < length || !length ? state_t::ok : state_t::eof;
-						return length - to_read; // [2] Code analysis misses `length - to_read` bytes were written to data in previous loop iterations.
+						return length - to_read;
 					}
-					size_t remaining = m_head->size - m_offset;
-					if (remaining > to_read) {
-						memcpy(data, m_head->data + m_offset, to_read);
-						m_offset += to_read;
-						m_size -= to_read;
+					size_t num_read = std::min(to_read, m_head->size - m_head->start);
+					memcpy(data, m_head->data + m_head->start, num_read);
+					consume(num_read);
+					to_read -= num_read;
+					if (!to_read) {
 						m_state = state_t::ok;
 						return length;
 					}
-					memcpy(data, m_head->data + m_offset, remaining);
-					m_offset = 0;
-					m_size -= remaining;
-					reinterpret_cast<uint8_t*&>(data) += remaining;
-					to_read -= remaining;
-					auto p = m_head;
-					m_head = p->next;
-					delete p;
+					reinterpret_cast<uint8_t*&>(data) += num_read;
 				}
 			}
 
@@ -4133,33 +8375,68 @@ namespace stdex
 				_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
 			{
 				stdex_assert(data || !length);
-				try {
-					std::unique_ptr<node_t> n(reinterpret_cast<node_t*>(new uint8_t[sizeof(node_t) + length]));
-					n->next = nullptr;
-					n->size = length;
-					memcpy(n->data, data, length);
-					m_size += length;
-					if (m_head)
-						m_tail = m_tail->next = n.release();
-					else
-						m_head = m_tail = n.release();
-					m_state = state_t::ok;
-					return length;
+				for (size_t to_write = length;;) {
+					if (!to_write) {
+						m_state = state_t::ok;
+						return length;
+					}
+					if (!reserve()) _Unlikely_ {
+						m_state = state_t::fail;
+						return length - to_write;
+					}
+					size_t num_written = std::min(to_write, m_tail->capacity - m_tail->size);
+					memcpy(m_tail->data + m_tail->size, data, num_written);
+					m_tail->size += num_written;
+					m_size += num_written;
+					to_write -= num_written;
+					reinterpret_cast<const uint8_t*&>(data) += num_written;
 				}
-				catch (const std::bad_alloc&) {
+			}
+
+			virtual std::tuple<const uint8_t*, size_t> acquire_read(_In_ size_t length)
+			{
+				if (!m_size) _Unlikely_ {
+					m_state = length ? state_t::eof : state_t::ok;
+					return { nullptr, 0 };
+				}
+				m_state = state_t::ok;
+				return { m_head->data + m_head->start, std::min(length, m_head->size - m_head->start) };
+			}
+
+			virtual void release_read(_In_ size_t length)
+			{
+				stdex_assert(length <= m_size);
+				consume(length);
+			}
+
+			virtual bool can_borrow_ahead() const
+			{
+				return true;
+			}
+
+			virtual std::tuple<uint8_t*, size_t> acquire_write(_In_ size_t length)
+			{
+				if (!reserve()) _Unlikely_ {
 					m_state = state_t::fail;
-					return 0;
+					return { nullptr, 0 };
 				}
+				m_state = state_t::ok;
+				return { m_tail->data + m_tail->size, std::min(length, m_tail->capacity - m_tail->size) };
+			}
+
+			virtual void release_write(_In_ size_t length)
+			{
+				stdex_assert(m_tail && length <= m_tail->capacity - m_tail->size);
+				m_tail->size += length;
+				m_size += length;
 			}
 
 			virtual void close()
 			{
-				m_size = m_offset = 0;
-				while (m_head) {
-					auto p = m_head;
-					m_head = p->next;
-					delete p;
-				}
+				free_chunks(m_head);
+				free_chunks(m_free);
+				m_head = m_tail = m_free = nullptr;
+				m_size = 0;
 				m_state = state_t::ok;
 			}
 
@@ -4168,14 +8445,156 @@ namespace stdex
 			///
 			size_t size() const { return m_size; };
 
+			///
+			/// Moves all pending data of another queue to the end of this queue
+			///
+			/// Data chunks are moved without copying.
+			///
+			/// \param[in,out] other  Queue to move data from. The queue is empty on return.
+			///
+			void splice(_Inout_ fifo& other)
+			{
+				if (this == std::addressof(other) || !other.m_size) _Unlikely_
+					return;
+				if (!m_size) {
+					while (m_head) {
+						node_t* n = m_head;
+						m_head = n->next;
+						recycle(n);
+					}
+					m_tail = nullptr;
+				}
+				if (m_tail)
+					m_tail->next = other.m_head;
+				else
+					m_head = other.m_head;
+				m_tail = other.m_tail;
+				m_size += other.m_size;
+				other.m_head = other.m_tail = nullptr;
+				other.m_size = 0;
+				m_state = state_t::ok;
+			}
+
+			///
+			/// Writes all pending data to a stream
+			///
+			/// Data chunks are passed to the stream's writev() directly without copying.
+			///
+			/// \param[in,out] stream  Stream to write data to
+			///
+			/// \return Number of bytes written. Data not written remains in the queue.
+			///
+			size_t write_to(_Inout_ basic& stream)
+			{
+				size_t num_written_total = 0;
+				while (m_size) {
+					segment_t segments[max_segments];
+					size_t count = 0;
+					for (node_t* n = m_head; n && count < _countof(segments); n = n->next)
+						if (n->start < n->size)
+							segments[count++] = { n->data + n->start, n->size - n->start };
+					size_t num_written = stream.writev(segments, count);
+					consume(num_written);
+					num_written_total += num_written;
+					if (!stream.ok()) _Unlikely_ {
+						m_state = stream.state();
+						return num_written_total;
+					}
+				}
+				m_state = state_t::ok;
+				return num_written_total;
+			}
+
 		protected:
-			size_t m_offset, m_size;
+			/// \cond internal
 			struct node_t {
 				node_t* next;
-				size_t size;
+				size_t start;    ///< Offset of data not read yet
+				size_t size;     ///< Offset of free space
+				size_t capacity; ///< Data size
 #pragma warning(suppress:4200)
 				uint8_t data[0];
-			} *m_head, * m_tail;
+			};
+
+			///
+			/// Makes sure there is some free space in the tail chunk
+			///
+			/// \return true on success; false if out of memory
+			///
+			bool reserve()
+			{
+				if (m_tail && m_tail->size < m_tail->capacity)
+					return true;
+				node_t* n;
+				if (m_free) {
+					n = m_free;
+					m_free = n->next;
+				}
+				else {
+					try { n = reinterpret_cast<node_t*>(new uint8_t[sizeof(node_t) + m_chunk_size]); }
+					catch (const std::bad_alloc&) { return false; }
+					n->capacity = m_chunk_size;
+				}
+				n->next = nullptr;
+				n->start = n->size = 0;
+				if (m_tail)
+					m_tail = m_tail->next = n;
+				else
+					m_head = m_tail = n;
+				return true;
+			}
+
+			///
+			/// Discards data from the queue head
+			///
+			void consume(_In_ size_t length)
+			{
+				if (!m_head) _Unlikely_
+					return;
+				m_size -= length;
+				for (;;) {
+					size_t remaining = m_head->size - m_head->start;
+					if (length < remaining) {
+						m_head->start += length;
+						return;
+					}
+					length -= remaining;
+					if (m_head == m_tail) {
+						// Keep the last chunk for following writes.
+						m_head->start = m_head->size = 0;
+						return;
+					}
+					node_t* n = m_head;
+					m_head = n->next;
+					recycle(n);
+				}
+			}
+
+			void recycle(_In_ node_t* n)
+			{
+				if (n->capacity == m_chunk_size) {
+					n->next = m_free;
+					m_free = n;
+				}
+				else
+					delete[] reinterpret_cast<uint8_t*>(n);
+			}
+
+			static void free_chunks(_In_opt_ node_t* n)
+			{
+				while (n) {
+					node_t* next = n->next;
+					delete[] reinterpret_cast<uint8_t*>(n);
+					n = next;
+				}
+			}
+			/// \endcond
+
+		protected:
+			size_t m_chunk_size;
+			size_t m_size;
+			node_t* m_head, * m_tail;
+			node_t* m_free; ///< List of chunks available for reuse
 		};
 
 		///
@@ -4316,6 +8735,12 @@ namespace stdex
 				}
 			}
 
+			virtual void hint(_In_ fpos_t offset, _In_ fsize_t length, _In_ access_t access)
+			{
+				for (auto f : m_files)
+					f->hint(offset, length, access);
+			}
+
 			virtual fsize_t size() const
 			{
 				if (m_files.empty())
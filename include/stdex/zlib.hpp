@@ -7,6 +7,8 @@
 
 #include "assert.hpp"
 #include "compat.hpp"
+#include "math.hpp"
+#include "pool.hpp"
 #include "stream.hpp"
 #if _MSC_VER
 #include <CodeAnalysis/Warnings.h>
@@ -17,8 +19,14 @@
 #if _MSC_VER
 #pragma warning(pop)
 #endif
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #if defined(__GNUC__)
 #pragma GCC diagnostic push
@@ -27,6 +35,11 @@
 
 namespace stdex
 {
+	///
+	/// Maximum number of idle zlib contexts of each kind kept for reuse per NUMA node
+	///
+	constexpr size_t zlib_pool_capacity = 8;
+
 	/// \cond internal
 	inline void throw_on_zlib_error(int result)
 	{
@@ -42,22 +55,248 @@ namespace stdex
 		default: throw std::runtime_error("zlib unknown error");
 		}
 	}
+
+	struct zlib_deflate_context
+	{
+		z_stream zlib;
+		int level;
+		uInt block_size;
+		std::unique_ptr<Byte[]> block;
+
+		zlib_deflate_context(_In_ int _level, _In_ uInt _block_size) :
+			level(_level),
+			block_size(_block_size),
+			block(_block_size ? new Byte[_block_size] : nullptr)
+		{
+			memset(&zlib, 0, sizeof(zlib));
+			throw_on_zlib_error(deflateInit(&zlib, level));
+		}
+
+		~zlib_deflate_context()
+		{
+			deflateEnd(&zlib);
+		}
+	};
+
+	struct zlib_inflate_context
+	{
+		z_stream zlib;
+		uInt block_size;
+		std::unique_ptr<Byte[]> block;
+
+		zlib_inflate_context(_In_ uInt _block_size) :
+			block_size(_block_size),
+			block(_block_size ? new Byte[_block_size] : nullptr)
+		{
+			memset(&zlib, 0, sizeof(zlib));
+			throw_on_zlib_error(inflateInit(&zlib));
+		}
+
+		~zlib_inflate_context()
+		{
+			inflateEnd(&zlib);
+		}
+	};
+
+	inline pool<std::unique_ptr<zlib_deflate_context>>& zlib_deflate_pool()
+	{
+		// Never destroyed: streams may return their contexts during static destruction.
+		static auto p = new pool<std::unique_ptr<zlib_deflate_context>>(zlib_pool_capacity);
+		return *p;
+	}
+
+	inline pool<std::unique_ptr<zlib_inflate_context>>& zlib_inflate_pool()
+	{
+		static auto p = new pool<std::unique_ptr<zlib_inflate_context>>(zlib_pool_capacity);
+		return *p;
+	}
+
+	inline std::unique_ptr<zlib_deflate_context> acquire_deflate_context(_In_ int level, _In_ uInt block_size)
+	{
+		auto ctx = zlib_deflate_pool().pop();
+		if (!ctx)
+			return std::unique_ptr<zlib_deflate_context>(new zlib_deflate_context(level, block_size));
+		if (ctx->level != level) {
+			// deflateParams() after deflateReset() fails in zlib 1.2.11 and older. Reinitialize the stream instead.
+			deflateEnd(&ctx->zlib);
+			memset(&ctx->zlib, 0, sizeof(ctx->zlib));
+			ctx->level = level;
+			throw_on_zlib_error(deflateInit(&ctx->zlib, level));
+		}
+		if (ctx->block_size < block_size) {
+			ctx->block.reset(new Byte[block_size]);
+			ctx->block_size = block_size;
+		}
+		return ctx;
+	}
+
+	inline void release_deflate_context(_Inout_ std::unique_ptr<zlib_deflate_context>&& ctx)
+	{
+		ctx->zlib.next_in = ctx->zlib.next_out = NULL;
+		ctx->zlib.avail_in = ctx->zlib.avail_out = 0;
+		if (deflateReset(&ctx->zlib) != Z_OK || !zlib_deflate_pool().push(std::move(ctx)))
+			ctx.reset();
+	}
+
+	inline std::unique_ptr<zlib_inflate_context> acquire_inflate_context(_In_ uInt block_size)
+	{
+		auto ctx = zlib_inflate_pool().pop();
+		if (!ctx)
+			return std::unique_ptr<zlib_inflate_context>(new zlib_inflate_context(block_size));
+		if (ctx->block_size < block_size) {
+			ctx->block.reset(new Byte[block_size]);
+			ctx->block_size = block_size;
+		}
+		return ctx;
+	}
+
+	inline void release_inflate_context(_Inout_ std::unique_ptr<zlib_inflate_context>&& ctx)
+	{
+		ctx->zlib.next_in = ctx->zlib.next_out = NULL;
+		ctx->zlib.avail_in = ctx->zlib.avail_out = 0;
+		if (inflateReset(&ctx->zlib) != Z_OK || !zlib_inflate_pool().push(std::move(ctx)))
+			ctx.reset();
+	}
 	/// \endcond
 
+	///
+	/// Frees zlib contexts kept in pools for reuse
+	///
+	inline void zlib_clear_pools()
+	{
+		zlib_deflate_pool().clear();
+		zlib_inflate_pool().clear();
+	}
+
+	///
+	/// Compresses data
+	///
+	/// The zlib context is taken from and returned to a pool, making compression of many small buffers cheap.
+	///
+	/// \param[in,out] output             Buffer to append compressed data to
+	/// \param[in]     data               Data to compress
+	/// \param[in]     size               Size of data in bytes
+	/// \param[in]     compression_level  Compression level
+	///
+	inline void zlib_compress(_Inout_ std::vector<uint8_t>& output, _In_reads_bytes_opt_(size) const void* data, _In_ size_t size, _In_ int compression_level = Z_BEST_COMPRESSION)
+	{
+		stdex_assert(data || !size);
+		auto ctx = acquire_deflate_context(compression_level, 0);
+		z_stream& zlib = ctx->zlib;
+		zlib.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(data));
+		size_t offset = output.size();
+		output.resize(offset + (size <= UINT_MAX ? deflateBound(&zlib, static_cast<uLong>(size)) : 0x10000));
+		for (;;) {
+			uInt num_inflated = static_cast<uInt>(std::min<size_t>(size, UINT_MAX));
+			zlib.avail_in = num_inflated;
+			size -= num_inflated;
+			int result;
+			do {
+				if (offset == output.size())
+					output.resize(offset * 2);
+				zlib.next_out = output.data() + offset;
+				zlib.avail_out = static_cast<uInt>(std::min<size_t>(output.size() - offset, UINT_MAX));
+				uInt avail_out = zlib.avail_out;
+				result = deflate(&zlib, size ? Z_NO_FLUSH : Z_FINISH);
+				throw_on_zlib_error(result);
+				offset += avail_out - zlib.avail_out;
+			} while (size ? zlib.avail_in != 0 : result != Z_STREAM_END);
+			if (!size)
+				break;
+		}
+		output.resize(offset);
+		release_deflate_context(std::move(ctx));
+	}
+
+	///
+	/// Compresses data
+	///
+	/// The zlib context is taken from and returned to a pool, making compression of many small buffers cheap.
+	///
+	/// \param[in] data               Data to compress
+	/// \param[in] size               Size of data in bytes
+	/// \param[in] compression_level  Compression level
+	///
+	/// \return Compressed data
+	///
+	inline std::vector<uint8_t> zlib_compress(_In_reads_bytes_opt_(size) const void* data, _In_ size_t size, _In_ int compression_level = Z_BEST_COMPRESSION)
+	{
+		std::vector<uint8_t> output;
+		zlib_compress(output, data, size, compression_level);
+		return output;
+	}
+
+	///
+	/// Decompresses data
+	///
+	/// The zlib context is taken from and returned to a pool, making decompression of many small buffers cheap.
+	///
+	/// \param[in,out] output  Buffer to append decompressed data to
+	/// \param[in]     data    Compressed data
+	/// \param[in]     size    Size of compressed data in bytes
+	///
+	inline void zlib_decompress(_Inout_ std::vector<uint8_t>& output, _In_reads_bytes_opt_(size) const void* data, _In_ size_t size)
+	{
+		stdex_assert(data || !size);
+		auto ctx = acquire_inflate_context(0);
+		z_stream& zlib = ctx->zlib;
+		zlib.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(data));
+		size_t offset = output.size();
+		output.resize(offset + std::max<size_t>(std::min<size_t>(size, SIZE_MAX / 4) * 4, 0x100));
+		for (;;) {
+			if (!zlib.avail_in) {
+				if (!size) _Unlikely_
+					throw std::runtime_error("zlib data error"); // Truncated data
+				zlib.avail_in = static_cast<uInt>(std::min<size_t>(size, UINT_MAX));
+				size -= zlib.avail_in;
+			}
+			if (offset == output.size())
+				output.resize(offset * 2);
+			zlib.next_out = output.data() + offset;
+			zlib.avail_out = static_cast<uInt>(std::min<size_t>(output.size() - offset, UINT_MAX));
+			uInt avail_out = zlib.avail_out;
+			int result = inflate(&zlib, Z_NO_FLUSH);
+			throw_on_zlib_error(result);
+			offset += avail_out - zlib.avail_out;
+			if (result == Z_STREAM_END)
+				break;
+		}
+		output.resize(offset);
+		release_inflate_context(std::move(ctx));
+	}
+
+	///
+	/// Decompresses data
+	///
+	/// The zlib context is taken from and returned to a pool, making decompression of many small buffers cheap.
+	///
+	/// \param[in] data  Compressed data
+	/// \param[in] size  Size of compressed data in bytes
+	///
+	/// \return Decompressed data
+	///
+	inline std::vector<uint8_t> zlib_decompress(_In_reads_bytes_opt_(size) const void* data, _In_ size_t size)
+	{
+		std::vector<uint8_t> output;
+		zlib_decompress(output, data, size);
+		return output;
+	}
+
 	///
 	/// Compresses data when writing to a stream
 	///
+	/// The zlib context and buffer are taken from and returned to a pool.
+	///
 	class zlib_writer : public stdex::stream::converter
 	{
 	public:
 		zlib_writer(_Inout_ stdex::stream::basic& source, _In_ int compression_level = Z_BEST_COMPRESSION, _In_ uInt block_size = 0x10000) :
 			stdex::stream::converter(source),
+			m_context(acquire_deflate_context(compression_level, block_size)),
+			m_zlib(m_context->zlib),
 			m_block_size(block_size),
-			m_block(new Byte[block_size])
-		{
-			memset(&m_zlib, 0, sizeof(m_zlib));
-			throw_on_zlib_error(deflateInit(&m_zlib, compression_level));
-		}
+			m_block(m_context->block.get())
+		{}
 
 		virtual ~zlib_writer()
 		{
@@ -65,16 +304,13 @@ namespace stdex
 			m_zlib.next_in = NULL;
 			do {
 				m_zlib.avail_out = m_block_size;
-				m_zlib.next_out = m_block.get();
+				m_zlib.next_out = m_block;
 				throw_on_zlib_error(deflate(&m_zlib, Z_FINISH));
-				m_source->write(m_block.get(), m_block_size - m_zlib.avail_out);
+				m_source->write(m_block, m_block_size - m_zlib.avail_out);
 				if (!m_source->ok()) _Unlikely_
 					throw std::system_error(sys_error(), std::system_category(), "failed to flush compressed stream"); // Data loss occured
 			} while (m_zlib.avail_out == 0);
-			// m_zlib.avail_out = m_block_size;
-			// m_zlib.next_out = m_block.get();
-			// deflateReset(&m_zlib);
-			deflateEnd(&m_zlib);
+			release_deflate_context(std::move(m_context));
 		}
 
 		virtual _Success_(return != 0) size_t write(
@@ -88,11 +324,11 @@ namespace stdex
 				m_zlib.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(data));
 				do {
 					m_zlib.avail_out = m_block_size;
-					m_zlib.next_out = m_block.get();
+					m_zlib.next_out = m_block;
 					throw_on_zlib_error(deflate(&m_zlib, Z_NO_FLUSH));
 					size_t num_deflated = m_block_size - m_zlib.avail_out;
 					if (num_deflated) {
-						m_source->write(m_block.get(), num_deflated);
+						m_source->write(m_block, num_deflated);
 						if (!m_source->ok()) {
 							m_state = m_source->state();
 							return num_written;
@@ -107,30 +343,71 @@ namespace stdex
 			return num_written;
 		}
 
+		///
+		/// Writes all data written so far to the destination stream and flushes it
+		///
+		virtual void flush()
+		{
+			flush(Z_SYNC_FLUSH);
+		}
+
+		///
+		/// Writes all data written so far to the destination stream and flushes it
+		///
+		/// \param[in] flush_mode  Z_SYNC_FLUSH to make data available to the reader, or Z_FULL_FLUSH to also reset the
+		///                        compression state so decompression may restart at this point
+		///
+		void flush(_In_ int flush_mode)
+		{
+			m_zlib.avail_in = 0;
+			m_zlib.next_in = NULL;
+			do {
+				m_zlib.avail_out = m_block_size;
+				m_zlib.next_out = m_block;
+				int result = deflate(&m_zlib, flush_mode);
+				if (result != Z_BUF_ERROR) // Nothing to flush
+					throw_on_zlib_error(result);
+				size_t num_deflated = m_block_size - m_zlib.avail_out;
+				if (num_deflated) {
+					m_source->write(m_block, num_deflated);
+					if (!m_source->ok()) _Unlikely_ {
+						m_state = m_source->state();
+						return;
+					}
+				}
+			} while (m_zlib.avail_out == 0);
+			m_source->flush();
+			m_state = m_source->state();
+		}
+
 	protected:
-		z_stream m_zlib;
+		std::unique_ptr<zlib_deflate_context> m_context;
+		z_stream& m_zlib;
 		uInt m_block_size;
-		std::unique_ptr<Byte[]> m_block;
+		Byte* m_block;
 	};
 
 	///
 	/// Decompresses data when reading from a stream
 	///
+	/// The zlib context and buffer are taken from and returned to a pool. Reads return data decompressed from the input
+	/// available so far rather than wait for more input. This allows reading data flushed by zlib_writer::flush() as
+	/// soon as it arrives.
+	///
 	class zlib_reader : public stdex::stream::converter
 	{
 	public:
 		zlib_reader(_Inout_ stdex::stream::basic& source, _In_ uInt block_size = 0x10000) :
 			stdex::stream::converter(source),
+			m_context(acquire_inflate_context(block_size)),
+			m_zlib(m_context->zlib),
 			m_block_size(block_size),
-			m_block(new Byte[block_size])
-		{
-			memset(&m_zlib, 0, sizeof(m_zlib));
-			throw_on_zlib_error(inflateInit(&m_zlib));
-		}
+			m_block(m_context->block.get())
+		{}
 
 		virtual ~zlib_reader()
 		{
-			inflateEnd(&m_zlib);
+			release_inflate_context(std::move(m_context));
 		}
 
 #pragma warning(suppress: 6101) // See [1] below
@@ -145,19 +422,26 @@ namespace stdex
 				m_zlib.next_out = reinterpret_cast<Bytef*>(data);
 				do {
 					if (m_zlib.avail_in == 0) {
-						m_zlib.next_in = m_block.get();
-						m_zlib.avail_in = static_cast<uInt>(m_source->read(m_block.get(), m_block_size));
+						size_t num_inflated = num_read + num_deflated - m_zlib.avail_out;
+						if (num_inflated) {
+							// Return what we have rather than block waiting for more input.
+							m_state = stdex::stream::state_t::ok;
+							return num_inflated; // [1] Code analysis misses `num_deflated - m_zlib.avail_out` bytes were written to data in previous loop iterations.
+						}
+						m_zlib.next_in = m_block;
+						m_zlib.avail_in = static_cast<uInt>(m_source->read(m_block, m_block_size));
 						if (!m_zlib.avail_in) {
-							num_read += num_deflated - m_zlib.avail_out; // [1] Code analysis misses `num_deflated - m_zlib.avail_out` bytes were written to data in previous loop iterations.
-							if (num_read) {
-								m_state = stdex::stream::state_t::ok;
-								return num_read;
-							}
 							m_state = m_source->state();
 							return 0;
 						}
 					}
-					throw_on_zlib_error(inflate(&m_zlib, Z_NO_FLUSH));
+					int result = inflate(&m_zlib, Z_NO_FLUSH);
+					throw_on_zlib_error(result);
+					if (result == Z_STREAM_END) {
+						num_read += num_deflated - m_zlib.avail_out;
+						m_state = num_read ? stdex::stream::state_t::ok : stdex::stream::state_t::eof;
+						return num_read;
+					}
 				} while (m_zlib.avail_out);
 				num_read += num_deflated;
 				reinterpret_cast<Bytef*&>(data) += num_deflated;
@@ -167,10 +451,636 @@ namespace stdex
 			return num_read;
 		}
 
+	protected:
+		std::unique_ptr<zlib_inflate_context> m_context;
+		z_stream& m_zlib;
+		uInt m_block_size;
+		Byte* m_block;
+	};
+
+	///
+	/// Compresses data on multiple threads when writing to a stream
+	///
+	/// Data is split into blocks compressed concurrently. Each block is primed with the last 32 kB of data preceding it
+	/// as a dictionary, keeping the compression ratio close to zlib_writer. Blocks are written in order as a single
+	/// zlib or gzip stream with checksum combined across blocks. zlib streams are readable by zlib_reader.
+	///
+	class zlib_parallel_writer : public stdex::stream::converter
+	{
+	public:
+		///
+		/// Starts compressing
+		///
+		/// \param[in] source             Destination stream
+		/// \param[in] compression_level  Compression level
+		/// \param[in] gzip               Write gzip format instead of zlib format
+		/// \param[in] thread_count       Number of compressing threads. Use 0 for one thread per CPU.
+		/// \param[in] block_size         Amount of uncompressed data compressed by a thread at once
+		///
+		zlib_parallel_writer(_Inout_ stdex::stream::basic& source, _In_ int compression_level = Z_BEST_COMPRESSION, _In_ bool gzip = false, _In_ size_t thread_count = 0, _In_ uInt block_size = 0x20000) :
+			stdex::stream::converter(source),
+			m_level(compression_level == Z_DEFAULT_COMPRESSION ? 6 : compression_level),
+			m_gzip(gzip),
+			m_block_size(block_size),
+			m_checksum(gzip ? crc32(0, Z_NULL, 0) : adler32(0, Z_NULL, 0)),
+			m_size(0),
+			m_quit(false)
+		{
+			if (!block_size) _Unlikely_
+				throw std::invalid_argument("zero block size");
+			if (m_level < 0 || m_level > 9) _Unlikely_
+				throw std::invalid_argument("invalid compression level");
+			if (!thread_count)
+				thread_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+			m_queue_limit = thread_count * 2;
+			m_current = alloc_block();
+			write_header();
+			for (size_t i = 0; i < thread_count; ++i)
+				m_workers.push_back(std::thread([](_Inout_ zlib_parallel_writer& w) { w.process(); }, std::ref(*this)));
+		}
+
+		virtual ~zlib_parallel_writer() noexcept(false)
+		{
+			try {
+				submit(true);
+				while (!m_pending.empty())
+					write_block();
+				write_trailer();
+			}
+			catch (...) {
+				stop();
+				throw;
+			}
+			stop();
+			if (!m_source->ok()) _Unlikely_
+				throw std::system_error(sys_error(), std::system_category(), "failed to flush compressed stream"); // Data loss occured
+		}
+
+		virtual _Success_(return != 0) size_t write(
+			_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+		{
+			stdex_assert(data || !length);
+			for (size_t to_write = length;;) {
+				if (!to_write) {
+					m_state = stdex::stream::state_t::ok;
+					return length;
+				}
+				size_t num_copied = std::min<size_t>(to_write, m_block_size - m_current->data.size());
+				m_current->data.insert(m_current->data.end(), reinterpret_cast<const Byte*>(data), reinterpret_cast<const Byte*>(data) + num_copied);
+				if (m_current->data.size() == m_block_size) {
+					submit(false);
+					if (!m_source->ok()) _Unlikely_ {
+						m_state = m_source->state();
+						return length - to_write + num_copied;
+					}
+				}
+				reinterpret_cast<const Byte*&>(data) += num_copied;
+				to_write -= num_copied;
+			}
+		}
+
+		///
+		/// Writes all data written so far to the destination stream and flushes it
+		///
+		/// Blocks end at byte boundary. Compressing data in smaller blocks lowers the compression ratio.
+		///
+		virtual void flush()
+		{
+			if (!m_current->data.empty())
+				submit(false);
+			while (!m_pending.empty())
+				write_block();
+			if (m_source->ok())
+				m_source->flush();
+			m_state = m_source->state();
+		}
+
+	protected:
+		/// \cond internal
+		static constexpr size_t window_size = 0x8000;
+
+		struct block_t {
+			std::vector<Byte> data; ///< Uncompressed data
+			std::vector<Byte> dictionary; ///< Uncompressed data preceding the block
+			std::vector<Byte> deflated; ///< Compressed data
+			uLong checksum; ///< Adler-32 or CRC-32 of uncompressed data
+			int result; ///< zlib result code
+			bool last; ///< Is this the final block?
+			bool done; ///< Was the block compressed?
+		};
+
+		std::unique_ptr<block_t> alloc_block()
+		{
+			std::unique_ptr<block_t> b;
+			if (!m_free.empty()) {
+				b = std::move(m_free.back());
+				m_free.pop_back();
+				b->data.clear();
+				b->dictionary.clear();
+			}
+			else {
+				b.reset(new block_t);
+				b->data.reserve(m_block_size);
+			}
+			b->result = Z_OK;
+			b->last = false;
+			b->done = false;
+			return b;
+		}
+
+		void submit(_In_ bool last)
+		{
+			std::unique_ptr<block_t> next = alloc_block();
+			const std::vector<Byte>& data = m_current->data, & dictionary = m_current->dictionary;
+			if (data.size() >= window_size)
+				next->dictionary.assign(data.end() - window_size, data.end());
+			else {
+				size_t keep = std::min(dictionary.size(), window_size - data.size());
+				next->dictionary.assign(dictionary.end() - keep, dictionary.end());
+				next->dictionary.insert(next->dictionary.end(), data.begin(), data.end());
+			}
+			m_current->last = last;
+			{
+				const std::lock_guard<std::mutex> lk(m_mutex);
+				m_todo.push_back(m_current.get());
+				m_pending.push_back(std::move(m_current));
+			}
+			m_cv.notify_all();
+			m_current = std::move(next);
+			while (m_pending.size() > m_queue_limit)
+				write_block();
+		}
+
+		void write_block()
+		{
+			std::unique_ptr<block_t> b;
+			{
+				std::unique_lock<std::mutex> lk(m_mutex);
+				m_cv.wait(lk, [&] { return m_pending.front()->done; });
+				b = std::move(m_pending.front());
+				m_pending.pop_front();
+			}
+			throw_on_zlib_error(b->result);
+			if (m_source->ok())
+				m_source->write(b->deflated.data(), b->deflated.size());
+			m_checksum = m_gzip ?
+				crc32_combine(m_checksum, b->checksum, static_cast<z_off_t>(b->data.size())) :
+				adler32_combine(m_checksum, b->checksum, static_cast<z_off_t>(b->data.size()));
+			m_size += b->data.size();
+			m_free.push_back(std::move(b));
+		}
+
+		void write_header()
+		{
+			if (m_gzip) {
+				static const Byte os_code =
+#ifdef _WIN32
+					10;
+#else
+					3;
+#endif
+				Byte header[10] = { 0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, static_cast<Byte>(m_level == 9 ? 2 : m_level == 1 ? 4 : 0), os_code };
+				m_source->write(header, sizeof(header));
+			}
+			else {
+				unsigned int header = (Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8;
+				header |= (m_level < 2 ? 0 : m_level < 6 ? 1 : m_level == 6 ? 2 : 3) << 6;
+				header += 31 - (header % 31);
+				Byte data[2] = { static_cast<Byte>(header >> 8), static_cast<Byte>(header) };
+				m_source->write(data, sizeof(data));
+			}
+		}
+
+		void write_trailer()
+		{
+			if (m_gzip) {
+				Byte trailer[8] = {
+					static_cast<Byte>(m_checksum), static_cast<Byte>(m_checksum >> 8), static_cast<Byte>(m_checksum >> 16), static_cast<Byte>(m_checksum >> 24),
+					static_cast<Byte>(m_size), static_cast<Byte>(m_size >> 8), static_cast<Byte>(m_size >> 16), static_cast<Byte>(m_size >> 24) };
+				m_source->write(trailer, sizeof(trailer));
+			}
+			else {
+				Byte trailer[4] = { static_cast<Byte>(m_checksum >> 24), static_cast<Byte>(m_checksum >> 16), static_cast<Byte>(m_checksum >> 8), static_cast<Byte>(m_checksum) };
+				m_source->write(trailer, sizeof(trailer));
+			}
+		}
+
+		void process()
+		{
+			z_stream zlib;
+			memset(&zlib, 0, sizeof(zlib));
+			int init_result = deflateInit2(&zlib, m_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+			for (;;) {
+				block_t* b;
+				{
+					std::unique_lock<std::mutex> lk(m_mutex);
+					m_cv.wait(lk, [&] { return m_quit || !m_todo.empty(); });
+					if (m_todo.empty())
+						break;
+					b = m_todo.front();
+					m_todo.pop_front();
+				}
+				try { b->result = init_result == Z_OK ? compress(zlib, *b) : init_result; }
+				catch (const std::bad_alloc&) { b->result = Z_MEM_ERROR; }
+				{
+					const std::lock_guard<std::mutex> lk(m_mutex);
+					b->done = true;
+				}
+				m_cv.notify_all();
+			}
+			if (init_result == Z_OK)
+				deflateEnd(&zlib);
+		}
+
+		int compress(_Inout_ z_stream& zlib, _Inout_ block_t& b)
+		{
+			uInt size = static_cast<uInt>(b.data.size());
+			b.checksum = m_gzip ?
+				crc32(crc32(0, Z_NULL, 0), b.data.data(), size) :
+				adler32(adler32(0, Z_NULL, 0), b.data.data(), size);
+			int result = deflateReset(&zlib);
+			if (result == Z_OK && !b.dictionary.empty())
+				result = deflateSetDictionary(&zlib, b.dictionary.data(), static_cast<uInt>(b.dictionary.size()));
+			if (result != Z_OK) _Unlikely_
+				return result;
+			b.deflated.resize(deflateBound(&zlib, size) + 0x10);
+			zlib.next_in = b.data.data();
+			zlib.avail_in = size;
+			size_t num_deflated = 0;
+			for (;;) {
+				if (num_deflated == b.deflated.size())
+					b.deflated.resize(num_deflated * 2);
+				zlib.next_out = b.deflated.data() + num_deflated;
+				zlib.avail_out = static_cast<uInt>(b.deflated.size() - num_deflated);
+				result = deflate(&zlib, b.last ? Z_FINISH : Z_SYNC_FLUSH);
+				if (result < 0 && result != Z_BUF_ERROR) _Unlikely_
+					return result;
+				num_deflated = b.deflated.size() - zlib.avail_out;
+				if (b.last ? result == Z_STREAM_END : zlib.avail_out != 0)
+					break;
+			}
+			b.deflated.resize(num_deflated);
+			return Z_OK;
+		}
+
+		void stop()
+		{
+			{
+				const std::lock_guard<std::mutex> lk(m_mutex);
+				m_quit = true;
+			}
+			m_cv.notify_all();
+			for (auto& w : m_workers)
+				w.join();
+		}
+		/// \endcond
+
+	protected:
+		int m_level;
+		bool m_gzip;
+		uInt m_block_size;
+		uLong m_checksum; ///< Checksum of data written so far
+		uint64_t m_size; ///< Amount of data written so far
+		size_t m_queue_limit; ///< Maximum number of blocks pending
+		std::unique_ptr<block_t> m_current; ///< Block being filled
+		std::deque<std::unique_ptr<block_t>> m_pending; ///< Blocks submitted, in order
+		std::deque<block_t*> m_todo; ///< Blocks waiting for a thread
+		std::vector<std::unique_ptr<block_t>> m_free; ///< Blocks for reuse
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		bool m_quit;
+		std::vector<std::thread> m_workers;
+	};
+
+	constexpr uint32_t zlib_block_magic = 0x5849425a; ///< Compressed block file trailer signature ("ZBIX")
+
+	///
+	/// Compresses data to independently deflated blocks when writing to a stream
+	///
+	/// Each block of uncompressed data is a complete zlib stream. The block index and trailer are appended when the
+	/// writer is destroyed:
+	/// - uint64_t offset of each block followed by the offset of the index, relative to the first block
+	/// - uint64_t uncompressed size
+	/// - uint32_t uncompressed block size
+	/// - uint32_t zlib_block_magic
+	///
+	/// Use zlib_block_reader to read the data with random access.
+	///
+	class zlib_block_writer : public stdex::stream::converter
+	{
+	public:
+		zlib_block_writer(_Inout_ stdex::stream::basic& source, _In_ int compression_level = Z_BEST_COMPRESSION, _In_ uInt block_size = 0x10000) :
+			stdex::stream::converter(source),
+			m_block_size(block_size),
+			m_block(new Byte[block_size]),
+			m_block_used(0),
+			m_offset(0),
+			m_size(0)
+		{
+			if (!block_size) _Unlikely_
+				throw std::invalid_argument("zero block size");
+			memset(&m_zlib, 0, sizeof(m_zlib));
+			throw_on_zlib_error(deflateInit(&m_zlib, compression_level));
+			m_deflated_size = deflateBound(&m_zlib, block_size);
+			m_deflated.reset(new Byte[m_deflated_size]);
+		}
+
+		virtual ~zlib_block_writer()
+		{
+			if (m_block_used)
+				write_block();
+			m_index.push_back(m_offset);
+			for (auto offset : m_index)
+				*m_source << offset;
+			*m_source << m_size << static_cast<uint32_t>(m_block_size) << zlib_block_magic;
+			deflateEnd(&m_zlib);
+			if (!m_source->ok()) _Unlikely_
+				throw std::system_error(sys_error(), std::system_category(), "failed to flush compressed stream"); // Data loss occured
+		}
+
+		virtual _Success_(return != 0) size_t write(
+			_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+		{
+			stdex_assert(data || !length);
+			for (size_t to_write = length;;) {
+				if (!to_write) {
+					m_state = stdex::stream::state_t::ok;
+					return length;
+				}
+				size_t num_copied = std::min<size_t>(to_write, m_block_size - m_block_used);
+				memcpy(m_block.get() + m_block_used, data, num_copied);
+				m_block_used += static_cast<uInt>(num_copied);
+				m_size += num_copied;
+				if (m_block_used == m_block_size) {
+					write_block();
+					if (!m_source->ok()) _Unlikely_ {
+						m_state = m_source->state();
+						return length - to_write + num_copied;
+					}
+				}
+				reinterpret_cast<const Byte*&>(data) += num_copied;
+				to_write -= num_copied;
+			}
+		}
+
+	protected:
+		/// \cond internal
+		void write_block()
+		{
+			throw_on_zlib_error(deflateReset(&m_zlib));
+			m_zlib.next_in = m_block.get();
+			m_zlib.avail_in = m_block_used;
+			m_zlib.next_out = m_deflated.get();
+			m_zlib.avail_out = m_deflated_size;
+			int result = deflate(&m_zlib, Z_FINISH);
+			throw_on_zlib_error(result);
+			if (result != Z_STREAM_END) _Unlikely_
+				throw std::runtime_error("zlib buffer error");
+			size_t num_deflated = m_deflated_size - m_zlib.avail_out;
+			m_index.push_back(m_offset);
+			m_source->write(m_deflated.get(), num_deflated);
+			m_offset += num_deflated;
+			m_block_used = 0;
+		}
+		/// \endcond
+
 	protected:
 		z_stream m_zlib;
 		uInt m_block_size;
 		std::unique_ptr<Byte[]> m_block;
+		uInt m_block_used; ///< Amount of data in m_block
+		uLong m_deflated_size;
+		std::unique_ptr<Byte[]> m_deflated;
+		std::vector<uint64_t> m_index; ///< Offsets of blocks written
+		uint64_t m_offset; ///< Amount of compressed data written
+		uint64_t m_size; ///< Amount of uncompressed data written
+	};
+
+	///
+	/// Random access to data written by zlib_block_writer
+	///
+	/// Seeking is done on uncompressed data. Only the blocks containing the data read are decompressed. The most
+	/// recently used decompressed blocks are kept in a cache.
+	///
+	class zlib_block_reader : public stdex::stream::basic_file
+	{
+	public:
+		///
+		/// Opens compressed data
+		///
+		/// \param[in] source       Source file. Its end must be the end of compressed data.
+		/// \param[in] cache_count  Number of decompressed blocks to cache
+		///
+		zlib_block_reader(_Inout_ stdex::stream::basic_file& source, _In_ size_t cache_count = 4) :
+			stdex::stream::basic(stdex::stream::state_t::ok),
+			m_source(source),
+			m_offset(0),
+			m_cache(cache_count),
+			m_cache_tick(0)
+		{
+			if (!cache_count) _Unlikely_
+				throw std::invalid_argument("no cache blocks");
+			constexpr size_t trailer_size = sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t);
+			stdex::stream::fsize_t end = source.size();
+			if (end == stdex::stream::fsize_max || end < trailer_size) _Unlikely_
+				throw std::runtime_error("invalid block index");
+			uint32_t block_size, magic;
+			source.seekbeg(end - trailer_size);
+			source >> m_size >> block_size >> magic;
+			if (!source.ok() || magic != zlib_block_magic || !block_size) _Unlikely_
+				throw std::runtime_error("invalid block index");
+			m_block_size = block_size;
+			uint64_t block_count = (m_size + (block_size - 1)) / block_size;
+			if (block_count >= (end - trailer_size) / sizeof(uint64_t)) _Unlikely_
+				throw std::runtime_error("invalid block index");
+			stdex::stream::fpos_t index_offset = end - trailer_size - (block_count + 1) * sizeof(uint64_t);
+			source.seekbeg(index_offset);
+			m_index.resize(static_cast<size_t>(block_count + 1));
+			for (auto& offset : m_index)
+				source >> offset;
+			if (!source.ok() || m_index.back() > index_offset) _Unlikely_
+				throw std::runtime_error("invalid block index");
+			m_base = index_offset - m_index.back();
+			for (size_t i = 1; i < m_index.size(); ++i)
+				if (m_index[i] < m_index[i - 1]) _Unlikely_
+					throw std::runtime_error("invalid block index");
+
+			m_cache_data.reset(new Byte[stdex::mul(m_block_size, cache_count)]);
+			for (size_t i = 0; i < cache_count; ++i) {
+				m_cache[i].data = m_cache_data.get() + i * m_block_size;
+				m_cache[i].block = SIZE_MAX;
+				m_cache[i].used = 0;
+			}
+			memset(&m_zlib, 0, sizeof(m_zlib));
+			throw_on_zlib_error(inflateInit(&m_zlib));
+		}
+
+		virtual ~zlib_block_reader()
+		{
+			inflateEnd(&m_zlib);
+		}
+
+		virtual _Success_(return != 0 || length == 0) size_t read(
+			_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+		{
+			stdex_assert(data || !length);
+			for (size_t to_read = length;;) {
+				if (!to_read) {
+					m_state = stdex::stream::state_t::ok;
+					return length;
+				}
+				const Byte* ptr; size_t num_read;
+				std::tie(ptr, num_read) = acquire_block();
+				if (!ptr) {
+					if (to_read < length)
+						m_state = stdex::stream::state_t::ok;
+					return length - to_read;
+				}
+				num_read = std::min(num_read, to_read);
+				memcpy(data, ptr, num_read);
+				m_offset += num_read;
+				reinterpret_cast<Byte*&>(data) += num_read;
+				to_read -= num_read;
+			}
+		}
+
+		virtual std::tuple<const uint8_t*, size_t> acquire_read(_In_ size_t length)
+		{
+			const Byte* ptr; size_t num_read;
+			std::tie(ptr, num_read) = acquire_block();
+			if (!ptr) {
+				if (!length)
+					m_state = stdex::stream::state_t::ok;
+				return { nullptr, 0 };
+			}
+			m_state = stdex::stream::state_t::ok;
+			return { ptr, std::min(num_read, length) };
+		}
+
+		virtual void release_read(_In_ size_t length)
+		{
+			m_offset += length;
+		}
+
+		virtual bool can_borrow_ahead() const
+		{
+			return true;
+		}
+
+		virtual stdex::stream::fpos_t seek(_In_ stdex::stream::foff_t offset, _In_ stdex::stream::seek_t how = stdex::stream::seek_t::beg)
+		{
+			stdex::stream::fpos_t base;
+			switch (how) {
+			case stdex::stream::seek_t::beg: base = 0; break;
+			case stdex::stream::seek_t::cur: base = m_offset; break;
+			case stdex::stream::seek_t::end: base = m_size; break;
+			default: throw std::invalid_argument("unknown seek origin");
+			}
+			if (offset < 0 && static_cast<stdex::stream::fpos_t>(-offset) > base) _Unlikely_ {
+				m_state = stdex::stream::state_t::fail;
+				return stdex::stream::fpos_max;
+			}
+			m_state = stdex::stream::state_t::ok;
+			return m_offset = base + offset;
+		}
+
+		virtual stdex::stream::fpos_t tell() const
+		{
+			return m_offset;
+		}
+
+		virtual stdex::stream::fsize_t size() const
+		{
+			return m_size;
+		}
+
+		virtual void truncate()
+		{
+			m_state = stdex::stream::state_t::fail;
+		}
+
+		virtual stdex::stream::time_point ctime() const
+		{
+			return m_source.ctime();
+		}
+
+		virtual stdex::stream::time_point atime() const
+		{
+			return m_source.atime();
+		}
+
+		virtual stdex::stream::time_point mtime() const
+		{
+			return m_source.mtime();
+		}
+
+	protected:
+		/// \cond internal
+		struct cache_t {
+			Byte* data;
+			size_t block; ///< index of decompressed block or SIZE_MAX if none
+			uint64_t used; ///< time of last access for LRU replacement
+		};
+
+		std::tuple<const Byte*, size_t> acquire_block()
+		{
+			if (m_offset >= m_size) {
+				m_state = stdex::stream::state_t::eof;
+				return { nullptr, 0 };
+			}
+			size_t block = static_cast<size_t>(m_offset / m_block_size);
+			size_t block_offset = static_cast<size_t>(m_offset % m_block_size);
+			size_t block_size = static_cast<size_t>(std::min<uint64_t>(m_block_size, m_size - block * m_block_size));
+			cache_t* c = nullptr;
+			for (auto& b : m_cache) {
+				if (b.block == block) {
+					c = &b;
+					break;
+				}
+				if (!c || b.used < c->used)
+					c = &b;
+			}
+			if (c->block != block && !load_block(*c, block, block_size)) _Unlikely_ {
+				m_state = stdex::stream::state_t::fail;
+				return { nullptr, 0 };
+			}
+			c->used = ++m_cache_tick;
+			return { c->data + block_offset, block_size - block_offset };
+		}
+
+		bool load_block(_Inout_ cache_t& c, _In_ size_t block, _In_ size_t block_size)
+		{
+			c.block = SIZE_MAX;
+			size_t deflated_size = static_cast<size_t>(m_index[block + 1] - m_index[block]);
+			m_deflated.resize(deflated_size);
+			if (m_source.read_at(m_base + m_index[block], m_deflated.data(), deflated_size) != deflated_size) _Unlikely_
+				return false;
+			throw_on_zlib_error(inflateReset(&m_zlib));
+			m_zlib.next_in = m_deflated.data();
+			m_zlib.avail_in = static_cast<uInt>(deflated_size);
+			m_zlib.next_out = c.data;
+			m_zlib.avail_out = static_cast<uInt>(block_size);
+			int result = inflate(&m_zlib, Z_FINISH);
+			throw_on_zlib_error(result);
+			if (result != Z_STREAM_END || m_zlib.avail_out) _Unlikely_
+				throw std::runtime_error("zlib data error");
+			c.block = block;
+			return true;
+		}
+		/// \endcond
+
+	protected:
+		stdex::stream::basic_file& m_source;
+		stdex::stream::fpos_t m_base; ///< Source offset of the first block
+		size_t m_block_size; ///< Uncompressed block size
+		std::vector<uint64_t> m_index; ///< Block offsets relative to m_base
+		uint64_t m_size; ///< Uncompressed size
+		stdex::stream::fpos_t m_offset; ///< Uncompressed file position
+		z_stream m_zlib;
+		std::vector<Byte> m_deflated; ///< Compressed data of block being loaded
+		std::unique_ptr<Byte[]> m_cache_data; ///< Storage of all cache blocks
+		std::vector<cache_t> m_cache; ///< Decompressed blocks
+		uint64_t m_cache_tick; ///< Access counter for LRU replacement
 	};
 }
 
@@ -0,0 +1,236 @@
+﻿/*
+	SPDX-License-Identifier: MIT
+	Copyright © 2024 Amebis
+*/
+
+#pragma once
+
+#include "assert.hpp"
+#include "compat.hpp"
+#include "stream.hpp"
+#if _MSC_VER
+#include <CodeAnalysis/Warnings.h>
+#pragma warning(push)
+#pragma warning(disable: ALL_CODE_ANALYSIS_WARNINGS)
+#endif
+#include <zstd.h>
+#include <zstd_errors.h>
+#if _MSC_VER
+#pragma warning(pop)
+#endif
+#include <memory>
+#include <stdexcept>
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunknown-pragmas"
+#endif
+
+namespace stdex
+{
+	/// \cond internal
+	inline size_t throw_on_zstd_error(size_t result)
+	{
+		if (!ZSTD_isError(result))
+			return result;
+		if (ZSTD_getErrorCode(result) == ZSTD_error_memory_allocation)
+			throw std::bad_alloc();
+		throw std::runtime_error(ZSTD_getErrorName(result));
+	}
+	/// \endcond
+
+	///
+	/// Deleter for unique_ptr using ZSTD_freeCCtx
+	///
+	struct ZSTD_freeCCtx_delete
+	{
+		///
+		/// Delete a pointer
+		///
+		void operator()(_In_ ZSTD_CCtx* ptr) const
+		{
+			ZSTD_freeCCtx(ptr);
+		}
+	};
+
+	///
+	/// Deleter for unique_ptr using ZSTD_freeDCtx
+	///
+	struct ZSTD_freeDCtx_delete
+	{
+		///
+		/// Delete a pointer
+		///
+		void operator()(_In_ ZSTD_DCtx* ptr) const
+		{
+			ZSTD_freeDCtx(ptr);
+		}
+	};
+
+	///
+	/// Compresses data using Zstandard when writing to a stream
+	///
+	class zstd_writer : public stdex::stream::converter
+	{
+	public:
+		///
+		/// Starts compressing
+		///
+		/// \param[in] source             Destination stream
+		/// \param[in] compression_level  Compression level
+		/// \param[in] thread_count       Number of worker threads compressing in the background. Use 0 to compress on the calling thread.
+		/// \param[in] dictionary         Dictionary to compress with. The reader must use the same dictionary.
+		/// \param[in] dictionary_size    Size of dictionary in bytes
+		///
+		zstd_writer(
+			_Inout_ stdex::stream::basic& source,
+			_In_ int compression_level = ZSTD_CLEVEL_DEFAULT,
+			_In_ int thread_count = 0,
+			_In_reads_bytes_opt_(dictionary_size) const void* dictionary = nullptr, _In_ size_t dictionary_size = 0) :
+			stdex::stream::converter(source),
+			m_zstd(ZSTD_createCCtx()),
+			m_block_size(ZSTD_CStreamOutSize()),
+			m_block(new uint8_t[m_block_size])
+		{
+			if (!m_zstd) _Unlikely_
+				throw std::bad_alloc();
+			throw_on_zstd_error(ZSTD_CCtx_setParameter(m_zstd.get(), ZSTD_c_compressionLevel, compression_level));
+			throw_on_zstd_error(ZSTD_CCtx_setParameter(m_zstd.get(), ZSTD_c_checksumFlag, 1));
+			if (thread_count)
+				throw_on_zstd_error(ZSTD_CCtx_setParameter(m_zstd.get(), ZSTD_c_nbWorkers, thread_count));
+			if (dictionary_size)
+				throw_on_zstd_error(ZSTD_CCtx_loadDictionary(m_zstd.get(), dictionary, dictionary_size));
+		}
+
+		virtual ~zstd_writer()
+		{
+			ZSTD_inBuffer in = { nullptr, 0, 0 };
+			if (!compress(in, ZSTD_e_end)) _Unlikely_
+				throw std::system_error(sys_error(), std::system_category(), "failed to flush compressed stream"); // Data loss occured
+		}
+
+		virtual _Success_(return != 0) size_t write(
+			_In_reads_bytes_opt_(length) const void* data, _In_ size_t length)
+		{
+			stdex_assert(data || !length);
+			ZSTD_inBuffer in = { data, length, 0 };
+			if (!compress(in, ZSTD_e_continue)) _Unlikely_ {
+				m_state = m_source->state();
+				return in.pos;
+			}
+			m_state = stdex::stream::state_t::ok;
+			return length;
+		}
+
+		///
+		/// Writes all data written so far to the destination stream and flushes it
+		///
+		virtual void flush()
+		{
+			ZSTD_inBuffer in = { nullptr, 0, 0 };
+			if (compress(in, ZSTD_e_flush))
+				m_source->flush();
+			m_state = m_source->state();
+		}
+
+	protected:
+		/// \cond internal
+		bool compress(_Inout_ ZSTD_inBuffer& in, _In_ ZSTD_EndDirective mode)
+		{
+			for (;;) {
+				ZSTD_outBuffer out = { m_block.get(), m_block_size, 0 };
+				size_t remaining = throw_on_zstd_error(ZSTD_compressStream2(m_zstd.get(), &out, &in, mode));
+				if (out.pos) {
+					m_source->write(m_block.get(), out.pos);
+					if (!m_source->ok()) _Unlikely_
+						return false;
+				}
+				if (mode == ZSTD_e_continue ? in.pos == in.size : !remaining)
+					return true;
+			}
+		}
+		/// \endcond
+
+	protected:
+		std::unique_ptr<ZSTD_CCtx, ZSTD_freeCCtx_delete> m_zstd;
+		size_t m_block_size;
+		std::unique_ptr<uint8_t[]> m_block;
+	};
+
+	///
+	/// Decompresses Zstandard data when reading from a stream
+	///
+	/// Reads return data decompressed from the input available so far rather than wait for more input. This allows
+	/// reading data flushed by zstd_writer::flush() as soon as it arrives. Concatenated frames are read as one stream.
+	///
+	class zstd_reader : public stdex::stream::converter
+	{
+	public:
+		///
+		/// Starts decompressing
+		///
+		/// \param[in] source           Source stream
+		/// \param[in] dictionary       Dictionary the data was compressed with
+		/// \param[in] dictionary_size  Size of dictionary in bytes
+		///
+		zstd_reader(
+			_Inout_ stdex::stream::basic& source,
+			_In_reads_bytes_opt_(dictionary_size) const void* dictionary = nullptr, _In_ size_t dictionary_size = 0) :
+			stdex::stream::converter(source),
+			m_zstd(ZSTD_createDCtx()),
+			m_block_size(ZSTD_DStreamInSize()),
+			m_block(new uint8_t[m_block_size]),
+			m_in{ m_block.get(), 0, 0 },
+			m_pending(false)
+		{
+			if (!m_zstd) _Unlikely_
+				throw std::bad_alloc();
+			if (dictionary_size)
+				throw_on_zstd_error(ZSTD_DCtx_loadDictionary(m_zstd.get(), dictionary, dictionary_size));
+		}
+
+		virtual _Success_(return != 0 || length == 0) size_t read(
+			_Out_writes_bytes_to_opt_(length, return) void* data, _In_ size_t length)
+		{
+			stdex_assert(data || !length);
+			if (!length) {
+				m_state = stdex::stream::state_t::ok;
+				return 0;
+			}
+			ZSTD_outBuffer out = { data, length, 0 };
+			for (;;) {
+				if (m_in.pos == m_in.size && !m_pending) {
+					if (out.pos) {
+						// Return what we have rather than block waiting for more input.
+						m_state = stdex::stream::state_t::ok;
+						return out.pos;
+					}
+					m_in.size = m_source->read(m_block.get(), m_block_size);
+					m_in.pos = 0;
+					if (!m_in.size) {
+						m_state = m_source->state();
+						return 0;
+					}
+				}
+				throw_on_zstd_error(ZSTD_decompressStream(m_zstd.get(), &out, &m_in));
+				// Full output buffer might leave more data buffered in the decompressor.
+				m_pending = out.pos == out.size;
+				if (m_pending) {
+					m_state = stdex::stream::state_t::ok;
+					return out.pos;
+				}
+			}
+		}
+
+	protected:
+		std::unique_ptr<ZSTD_DCtx, ZSTD_freeDCtx_delete> m_zstd;
+		size_t m_block_size;
+		std::unique_ptr<uint8_t[]> m_block;
+		ZSTD_inBuffer m_in; ///< Input data not decompressed yet
+		bool m_pending; ///< Might decompressor hold more output?
+	};
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif